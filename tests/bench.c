@@ -0,0 +1,609 @@
+/* -*- mode:C; c-file-style: "bsd" -*- */
+/*
+ * Copyright (c) 2026 Yubico AB
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Benchmarks, run with "make bench".  Every workload is fixed so that
+ * numbers from different builds can be compared: each is run a few
+ * times to warm up, then timed over a number of repetitions of a batch
+ * of operations, and the median, 99th percentile, minimum and mean time
+ * per operation are reported, as a table or as JSON with -j.
+ *
+ * The challenge-response path runs against a trace replayed in place of
+ * a key, see yk_trace_replay().
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdbool.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#include <yubikey.h>
+#include <ykpers.h>
+#include <ykstatus.h>
+#include <ykdef.h>
+#include <ykpbkdf2.h>
+
+#include "ykpers-args.h"
+#include "sha.h"
+#include "yktrace.h"
+#include "ykcrc.h"
+
+static const char *trace_path = "bench_chalresp.trace";
+
+static int opt_reps = 51;
+static int opt_warmup = 5;
+static const char *opt_filter = NULL;
+static bool opt_json = false;
+static int num_results = 0;
+
+static unsigned char data[1024];
+static YK_STATUS *st;
+static YKP_CONFIG *cfg;
+static char exported[2048];
+static YK_KEY *yk;
+
+static double now_ns(void)
+{
+#ifdef _WIN32
+	LARGE_INTEGER freq, now;
+	QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&now);
+	return (double) now.QuadPart * 1e9 / (double) freq.QuadPart;
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+#endif
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+	double x = *(const double *) a, y = *(const double *) b;
+	return x < y ? -1 : x > y;
+}
+
+/* Time fn, which performs n operations, reporting per operation */
+static void run(const char *name, int (*fn)(unsigned int n), unsigned int n)
+{
+	double *samples, sum = 0;
+	int i, p99;
+
+	if (opt_filter && !strstr(name, opt_filter))
+		return;
+	if (!(samples = calloc(opt_reps, sizeof(double))))
+		exit(1);
+
+	for (i = 0; i < opt_warmup; i++) {
+		if (!fn(n)) {
+			fprintf(stderr, "%s: failed, skipped\n", name);
+			free(samples);
+			return;
+		}
+	}
+	for (i = 0; i < opt_reps; i++) {
+		double start = now_ns();
+		if (!fn(n)) {
+			fprintf(stderr, "%s: failed, skipped\n", name);
+			free(samples);
+			return;
+		}
+		samples[i] = (now_ns() - start) / n;
+		sum += samples[i];
+	}
+	qsort(samples, opt_reps, sizeof(double), cmp_double);
+	p99 = (opt_reps * 99 + 99) / 100 - 1;
+
+	if (opt_json) {
+		printf("%s\n    {\"name\":\"%s\",\"ops\":%u,\"reps\":%d,"
+		       "\"median_ns\":%.1f,\"p99_ns\":%.1f,\"min_ns\":%.1f,"
+		       "\"mean_ns\":%.1f}", num_results ? "," : "", name, n,
+		       opt_reps, samples[opt_reps / 2], samples[p99],
+		       samples[0], sum / opt_reps);
+	} else {
+		printf("%-28s %14.1f %14.1f %14.1f %14.1f\n", name,
+		       samples[opt_reps / 2], samples[p99], samples[0],
+		       sum / opt_reps);
+	}
+	num_results++;
+	free(samples);
+}
+
+/*************************************************************************
+ *
+ * Crypto
+ *
+ ****/
+
+static int bench_pbkdf2(unsigned int n)
+{
+	YK_PRF_METHOD prf = { 20, yk_hmac_sha1 };
+	unsigned char dk[16];
+	unsigned int i;
+
+	for (i = 0; i < n; i++) {
+		if (!yk_pbkdf2("passphrase", data, 8, 1000, dk, sizeof(dk),
+			       &prf))
+			return 0;
+	}
+	return 1;
+}
+
+static int bench_hmac_sha1(unsigned int n)
+{
+	uint8_t digest[USHAMaxHashSize];
+	unsigned int i;
+
+	for (i = 0; i < n; i++) {
+		if (hmac(SHA1, data, 64, data + 64, 20, digest) != shaSuccess)
+			return 0;
+	}
+	return 1;
+}
+
+static int bench_sha256(unsigned int n)
+{
+	uint8_t digest[USHAMaxHashSize];
+	USHAContext ctx;
+	unsigned int i;
+
+	for (i = 0; i < n; i++) {
+		if (USHAReset(&ctx, SHA256) != shaSuccess ||
+		    USHAInput(&ctx, data, sizeof(data)) != shaSuccess ||
+		    USHAResult(&ctx, digest) != shaSuccess)
+			return 0;
+	}
+	return 1;
+}
+
+/* The checksum of every frame written to a key */
+static int bench_crc16(unsigned int n)
+{
+	unsigned int i, crc = 0;
+
+	for (i = 0; i < n; i++)
+		crc ^= _yk_crc16(data + (i & 7), SLOT_DATA_SIZE);
+	return crc != 0x10000;
+}
+
+static int bench_crc16_libyubikey(unsigned int n)
+{
+	unsigned int i, crc = 0;
+
+	for (i = 0; i < n; i++)
+		crc ^= yubikey_crc16(data + (i & 7), SLOT_DATA_SIZE);
+	return crc != 0x10000;
+}
+
+/*
+ * Yubico OTPs from OTP_KEYS keys, each with its own public id, so that
+ * the batch decrypts with a different key in every lane
+ */
+#define OTP_KEYS 64
+
+static YKP_CONFIG *otp_cfgs[OTP_KEYS];
+static char otp_buf[OTP_KEYS][2 * (FIXED_SIZE + 16) + 1];
+static const char *otps[OTP_KEYS];
+static YKP_OTP_VALIDATOR *otp_validator;
+
+static int setup_otp(void)
+{
+	unsigned char ticket[16];
+	unsigned short crc;
+	int i;
+
+	for (i = 0; i < OTP_KEYS; i++) {
+		struct config_st *ycfg;
+
+		if (!(otp_cfgs[i] = ykp_alloc()))
+			return 0;
+		ykp_configure_for(otp_cfgs[i], 1, st);
+		ykp_AES_key_from_raw(otp_cfgs[i], (const char *) data + i);
+		ycfg = (struct config_st *) ykp_core_config(otp_cfgs[i]);
+		ycfg->fixedSize = 6;
+		memset(ycfg->fixed, 0, ycfg->fixedSize);
+		ycfg->fixed[0] = i;
+		memcpy(ycfg->uid, data + 2 * i, UID_SIZE);
+
+		memcpy(ticket, ycfg->uid, UID_SIZE);
+		memcpy(ticket + UID_SIZE, data + i, 8);
+		crc = ~_yk_crc16(ticket, 14);
+		ticket[14] = crc & 0xff;
+		ticket[15] = crc >> 8;
+		yubikey_aes_encrypt(ticket, ycfg->key);
+		yubikey_modhex_encode(otp_buf[i], (const char *) ycfg->fixed,
+				      ycfg->fixedSize);
+		yubikey_modhex_encode(otp_buf[i] + 2 * ycfg->fixedSize,
+				      (const char *) ticket, sizeof(ticket));
+		otps[i] = otp_buf[i];
+	}
+	otp_validator = ykp_otp_validator_alloc(otp_cfgs, OTP_KEYS);
+	return otp_validator != NULL;
+}
+
+static void teardown_otp(void)
+{
+	int i;
+
+	ykp_otp_validator_free(otp_validator);
+	for (i = 0; i < OTP_KEYS; i++)
+		ykp_free_config(otp_cfgs[i]);
+}
+
+static int bench_otp_decrypt(unsigned int n)
+{
+	struct ticket_st ticket;
+	unsigned int i;
+
+	for (i = 0; i < n; i++) {
+		if (!ykp_otp_decrypt(otp_cfgs[i % OTP_KEYS],
+				     otps[i % OTP_KEYS], &ticket))
+			return 0;
+	}
+	return 1;
+}
+
+static int bench_otp_validate_batch(unsigned int n)
+{
+	struct ticket_st tickets[OTP_KEYS];
+	int errors[OTP_KEYS];
+	unsigned int i;
+
+	for (i = 0; i < n; i += OTP_KEYS) {
+		if (ykp_otp_validate_batch(otp_validator, otps, OTP_KEYS,
+					   tickets, errors) != OTP_KEYS)
+			return 0;
+	}
+	return 1;
+}
+
+/* Yubico mode challenge responses, as precomputed for a table */
+static int bench_chalresp_yubico(unsigned int n)
+{
+	static unsigned char responses[OTP_KEYS][16];
+	struct ticket_st state;
+	unsigned int i;
+
+	memset(&state, 0, sizeof(state));
+	for (i = 0; i < n; i += OTP_KEYS) {
+		state.useCtr = i;
+		if (ykp_chalresp_yubico(cfg, data, OTP_KEYS, &state,
+					responses[0]) != OTP_KEYS)
+			return 0;
+	}
+	return 1;
+}
+
+/*************************************************************************
+ *
+ * Configuration codecs
+ *
+ ****/
+
+static int bench_export_legacy(unsigned int n)
+{
+	char buf[2048];
+	unsigned int i;
+
+	for (i = 0; i < n; i++) {
+		if (!ykp_export_config(cfg, buf, sizeof(buf),
+				       YKP_FORMAT_LEGACY))
+			return 0;
+	}
+	return 1;
+}
+
+static int bench_export_json(unsigned int n)
+{
+	char buf[2048];
+	unsigned int i;
+
+	for (i = 0; i < n; i++) {
+		if (!ykp_export_config(cfg, buf, sizeof(buf), YKP_FORMAT_YCFG))
+			return 0;
+	}
+	return 1;
+}
+
+static int bench_import_json(unsigned int n)
+{
+	YKP_CONFIG *imported = ykp_alloc();
+	unsigned int i;
+	int ret = 1;
+
+	ykp_configure_version(imported, st);
+	for (i = 0; i < n && ret; i++)
+		ret = ykp_import_config(imported, exported, strlen(exported),
+					YKP_FORMAT_YCFG);
+	ykp_free_config(imported);
+	return ret;
+}
+
+static int bench_args_to_config(unsigned int n)
+{
+	char *argv[] = {
+		"ykpersonalize", "-1", "-ooath-hotp", "-ooath-hotp8",
+		"-oappend-cr", "-a3132333435363738393031323334353637383930",
+		"-c313233343536", NULL
+	};
+	int argc = sizeof(argv) / sizeof(argv[0]) - 1;
+	unsigned int i;
+
+	for (i = 0; i < n; i++) {
+		YKP_CONFIG *c = ykp_alloc();
+		char oathid[128] = {0}, ndef[128], ndef_type = 0;
+		const char *infname = NULL, *outfname = NULL;
+		int data_format = YKP_FORMAT_LEGACY, exit_code = 0;
+		int num_modes_seen = 0;
+		bool autocommit = false, verbose = false, dry_run = false;
+		bool zap = false;
+		char *access_code = NULL, *new_access_code = NULL;
+		unsigned char usb_mode = 0, scan_map[sizeof(SCAN_MAP)];
+		unsigned char cr_timeout = 0, device_info[128];
+		unsigned short autoeject_timeout = 0;
+		size_t device_info_len = 0;
+		int rc;
+
+#if defined __FreeBSD__ || defined __OpenBSD__ || defined __NetBSD__ || defined __APPLE__
+		optind = optreset = 1;
+#else
+		optind = 0;
+#endif
+		ykp_configure_for(c, 1, st);
+		rc = args_to_config(argc, argv, c, oathid, sizeof(oathid),
+				    &infname, &outfname, &data_format,
+				    &autocommit, st, &verbose, &dry_run,
+				    &access_code, &new_access_code,
+				    &ndef_type, ndef, sizeof(ndef), &usb_mode,
+				    &zap, scan_map, &cr_timeout,
+				    &autoeject_timeout, &num_modes_seen,
+				    device_info, &device_info_len, &exit_code);
+		free(access_code);
+		free(new_access_code);
+		ykp_free_config(c);
+		if (!rc)
+			return 0;
+	}
+	return 1;
+}
+
+/*************************************************************************
+ *
+ * Challenge-response over a replayed key.  The trace holds what a key
+ * answers to an HMAC-SHA1 challenge of 64 bytes, repeated once for
+ * every call the benchmark makes.
+ *
+ ****/
+
+static void trace_add(FILE *f, unsigned char op, const unsigned char *report)
+{
+	struct yk_trace_rec r;
+	unsigned char buf[YK_TRACE_RECORD_SIZE];
+
+	memset(&r, 0, sizeof(r));
+	r.op = op;
+	r.ok = 1;
+	if (report)
+		memcpy(r.data, report, YK_TRACE_DATA_SIZE);
+	yk_trace_pack(buf, &r);
+	fwrite(buf, sizeof(buf), 1, f);
+}
+
+static void trace_status(FILE *f, unsigned char flags)
+{
+	unsigned char report[YK_TRACE_DATA_SIZE] = { 0, 4, 3, 7, 1, 3, 0, 0 };
+
+	report[YK_TRACE_DATA_SIZE - 1] = flags;
+	trace_add(f, YK_TRACE_READ, report);
+}
+
+static void trace_challenge(FILE *f, const unsigned char *challenge)
+{
+	struct frame_st frame;
+	unsigned char *p = (unsigned char *) &frame;
+	unsigned char response[28];
+	unsigned char report[YK_TRACE_DATA_SIZE];
+	unsigned short crc;
+	int seq, i;
+
+	/* the frame as yk_write_to_key() sends it, with no zero parts */
+	memset(&frame, 0, sizeof(frame));
+	memcpy(frame.payload, challenge, SLOT_DATA_SIZE);
+	frame.slot = SLOT_CHAL_HMAC2;
+	frame.crc = yk_endian_swap_16(yubikey_crc16(frame.payload,
+						    SLOT_DATA_SIZE));
+	for (seq = 0; seq * 7 < (int) sizeof(frame); seq++) {
+		trace_status(f, 0);
+		memcpy(report, p + seq * 7, 7);
+		report[7] = seq | SLOT_WRITE_FLAG;
+		trace_add(f, YK_TRACE_WRITE, report);
+	}
+
+	/* 20 bytes of response and their checksum, in parts of 7 */
+	memset(response, 0, sizeof(response));
+	for (i = 0; i < 20; i++)
+		response[i] = challenge[i] ^ 0x5c;
+	crc = ~yubikey_crc16(response, 20);
+	response[20] = crc & 0xff;
+	response[21] = crc >> 8;
+	for (seq = 0; seq <= 4; seq++) {
+		memset(report, 0, sizeof(report));
+		if (seq < 4)
+			memcpy(report, response + seq * 7, 7);
+		report[7] = RESP_PENDING_FLAG | (seq < 4 ? seq : 0);
+		trace_add(f, YK_TRACE_READ, report);
+	}
+
+	/* yk_force_key_update() */
+	memset(report, 0, sizeof(report));
+	report[7] = DUMMY_REPORT_WRITE;
+	trace_add(f, YK_TRACE_WRITE, report);
+}
+
+static int setup_chalresp(unsigned int calls)
+{
+	const unsigned char ids[YK_TRACE_DATA_SIZE] = { 0x50, 0x10, 0x10, 0x00 };
+	FILE *f = fopen(trace_path, "wb");
+	unsigned int i;
+
+	if (!f)
+		return 0;
+	fwrite(YK_TRACE_MAGIC, YK_TRACE_MAGIC_LEN, 1, f);
+	trace_add(f, YK_TRACE_OPEN, ids);
+	trace_status(f, 0);
+	for (i = 0; i < calls; i++)
+		trace_challenge(f, data);
+	trace_add(f, YK_TRACE_CLOSE, NULL);
+	fclose(f);
+
+	if (!yk_trace_replay(trace_path, 0) || !(yk = yk_open_key(0))) {
+		yk_trace_replay(NULL, 0);
+		return 0;
+	}
+	return 1;
+}
+
+static void teardown_chalresp(void)
+{
+	if (yk)
+		yk_close_key(yk);
+	yk_trace_replay(NULL, 0);
+	remove(trace_path);
+}
+
+static int bench_chalresp(unsigned int n)
+{
+	unsigned char response[SHA1_MAX_BLOCK_SIZE];
+	unsigned int i;
+
+	for (i = 0; i < n; i++) {
+		if (!yk_challenge_response(yk, SLOT_CHAL_HMAC2, 0,
+					   SLOT_DATA_SIZE, data,
+					   sizeof(response), response))
+			return 0;
+	}
+	return 1;
+}
+
+int main(int argc, char **argv)
+{
+	struct status_st *t;
+	size_t i;
+	int c;
+
+	while ((c = getopt(argc, argv, "jr:w:f:h")) != -1) {
+		switch (c) {
+		case 'j':
+			opt_json = true;
+			break;
+		case 'r':
+			opt_reps = atoi(optarg);
+			break;
+		case 'w':
+			opt_warmup = atoi(optarg);
+			break;
+		case 'f':
+			opt_filter = optarg;
+			break;
+		default:
+			fprintf(stderr, "Usage: %s [-j] [-r reps] [-w warmup] "
+				"[-f filter]\n", argv[0]);
+			return c == 'h' ? 0 : 1;
+		}
+	}
+	if (opt_reps < 1 || opt_warmup < 0) {
+		fprintf(stderr, "%s: bad repetitions\n", argv[0]);
+		return 1;
+	}
+
+	/* nonzero, so that no part of the challenge frame is skipped */
+	for (i = 0; i < sizeof(data); i++)
+		data[i] = i * 7 + 1;
+
+	st = ykds_alloc();
+	t = (struct status_st *) st;
+	t->versionMajor = 3;
+	t->versionMinor = 4;
+	cfg = ykp_alloc();
+	ykp_configure_for(cfg, 1, st);
+	ykp_AES_key_from_hex(cfg, "000102030405060708090a0b0c0d0e0f");
+	ykp_set_tktflag_APPEND_CR(cfg, true);
+	if (!ykp_export_config(cfg, exported, sizeof(exported),
+			       YKP_FORMAT_YCFG))
+		exported[0] = 0;
+
+	if (opt_json)
+		printf("{\n  \"benchmarks\": [");
+	else
+		printf("%-28s %14s %14s %14s %14s\n", "ns/op", "median", "p99",
+		       "min", "mean");
+
+	run("pbkdf2_hmac_sha1_1000", bench_pbkdf2, 1);
+	run("hmac_sha1_64", bench_hmac_sha1, 1000);
+	run("sha256_1024", bench_sha256, 1000);
+	run("crc16_64", bench_crc16, 1000);
+	run("crc16_64_libyubikey", bench_crc16_libyubikey, 1000);
+	if (setup_otp()) {
+		run("otp_decrypt", bench_otp_decrypt, 1024);
+		run("otp_validate_batch", bench_otp_validate_batch, 1024);
+	} else {
+		fprintf(stderr, "otp: no validator, skipped\n");
+	}
+	teardown_otp();
+	run("chalresp_yubico_batch", bench_chalresp_yubico, 1024);
+	run("export_legacy", bench_export_legacy, 1000);
+	if (exported[0]) {
+		run("export_json", bench_export_json, 1000);
+		run("import_json", bench_import_json, 1000);
+	} else if (!opt_filter || strstr("export_json import_json",
+					  opt_filter)) {
+		fprintf(stderr, "json: not built, skipped\n");
+	}
+	run("args_to_config_oath", bench_args_to_config, 100);
+	if (!opt_filter || strstr("chalresp_hmac_replay", opt_filter)) {
+		if (setup_chalresp(opt_warmup + opt_reps))
+			run("chalresp_hmac_replay", bench_chalresp, 1);
+		else
+			fprintf(stderr, "chalresp_hmac_replay: no trace, skipped\n");
+		teardown_chalresp();
+	}
+
+	if (opt_json)
+		printf("\n  ]\n}\n");
+
+	ykp_free_config(cfg);
+	ykds_free(st);
+	return 0;
+}
@@ -0,0 +1,374 @@
+/* -*- mode:C; c-file-style: "bsd" -*- */
+/*
+ * Copyright (c) 2026 Yubico AB
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * A YubiKey emulated as a USB device on Linux, with raw-gadget on a
+ * USB device controller, so that the unmodified USB backends and tools
+ * can be run and timed end to end, kernel included, without a key.
+ * The device has the OTP interface of a YubiKey 4, a boot keyboard
+ * with the feature report carrying the configuration protocol, which
+ * is answered by the emulated key of ykcore/ykemukey.c.
+ *
+ * With no controller hardware, the dummy_hcd module connects the
+ * gadget to a virtual host controller on the same machine:
+ *
+ *   modprobe dummy_hcd raw_gadget
+ *   ./ykgadget &
+ *   ykinfo -a; ykchalresp -2 -x 00; ykbench -u
+ *
+ * The device node of the gadget must be accessible to the user, see
+ * the udev rules shipped with ykpers.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+
+#ifdef HAVE_LINUX_USB_RAW_GADGET_H
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <linux/types.h>
+#include <linux/usb/ch9.h>
+#include <linux/usb/raw_gadget.h>
+
+#include <ykdef.h>
+
+#include "ykcore_backend.h"
+#include "ykemukey.h"
+
+#define HID_GET_REPORT		0x01
+#define HID_SET_IDLE		0x0a
+#define HID_SET_PROTOCOL	0x0b
+#define HID_SET_REPORT		0x09
+#define HID_DT_HID		0x21
+#define HID_DT_REPORT		0x22
+#define EP0_MAX_DATA		256
+
+struct ep0_io {
+	struct usb_raw_ep_io io;
+	unsigned char data[EP0_MAX_DATA];
+};
+
+struct control_event {
+	struct usb_raw_event event;
+	struct usb_ctrlrequest ctrl;
+};
+
+static const unsigned char report_descriptor[] = {
+	0x05, 0x01, 0x09, 0x06, 0xa1, 0x01,	/* generic desktop keyboard */
+	0x05, 0x07, 0x19, 0xe0, 0x29, 0xe7,	/* modifiers */
+	0x15, 0x00, 0x25, 0x01, 0x75, 0x01, 0x95, 0x08, 0x81, 0x02,
+	0x95, 0x01, 0x75, 0x08, 0x81, 0x01,	/* reserved */
+	0x95, 0x05, 0x75, 0x01, 0x05, 0x08,	/* leds */
+	0x19, 0x01, 0x29, 0x05, 0x91, 0x02,
+	0x95, 0x01, 0x75, 0x03, 0x91, 0x01,
+	0x95, 0x06, 0x75, 0x08, 0x15, 0x00,	/* keys */
+	0x25, 0x65, 0x05, 0x07, 0x19, 0x00, 0x29, 0x65, 0x81, 0x00,
+	0x09, 0x03, 0x75, 0x08, 0x95, 0x08,	/* 8 byte feature report */
+	0xb1, 0x02,
+	0xc0
+};
+
+static const struct usb_device_descriptor device_descriptor = {
+	.bLength = USB_DT_DEVICE_SIZE,
+	.bDescriptorType = USB_DT_DEVICE,
+	.bcdUSB = __constant_cpu_to_le16(0x0200),
+	.bMaxPacketSize0 = 64,
+	.idVendor = __constant_cpu_to_le16(YUBICO_VID),
+	.idProduct = __constant_cpu_to_le16(YK4_OTP_PID),
+	.bcdDevice = __constant_cpu_to_le16(0x0437),
+	.iManufacturer = 1,
+	.iProduct = 2,
+	.bNumConfigurations = 1,
+};
+
+/* configuration, interface, HID and endpoint descriptors */
+static const unsigned char config_descriptor[] = {
+	USB_DT_CONFIG_SIZE, USB_DT_CONFIG, 34, 0, 1, 1, 0, 0x80, 15,
+	USB_DT_INTERFACE_SIZE, USB_DT_INTERFACE, 0, 0, 1,
+	USB_CLASS_HID, 1, 1, 0,
+	9, HID_DT_HID, 0x11, 0x01, 0, 1, HID_DT_REPORT,
+	sizeof(report_descriptor), 0,
+	USB_DT_ENDPOINT_SIZE, USB_DT_ENDPOINT, USB_DIR_IN | 1,
+	USB_ENDPOINT_XFER_INT, 8, 0, 10
+};
+
+static const struct usb_endpoint_descriptor int_endpoint = {
+	.bLength = USB_DT_ENDPOINT_SIZE,
+	.bDescriptorType = USB_DT_ENDPOINT,
+	.bEndpointAddress = USB_DIR_IN | 1,
+	.bmAttributes = USB_ENDPOINT_XFER_INT,
+	.wMaxPacketSize = __constant_cpu_to_le16(8),
+	.bInterval = 10,
+};
+
+static const char *strings[] = { NULL, "Yubico", "YubiKey OTP (emulated)" };
+
+static struct yk_emu_key key;
+static int verbose = 0;
+static unsigned long reports = 0;
+
+/* A string descriptor in UTF-16LE, index 0 lists the languages */
+static int string_descriptor(int index, unsigned char *buf)
+{
+	size_t i, len;
+
+	if (index == 0) {
+		buf[0] = 4;
+		buf[1] = USB_DT_STRING;
+		buf[2] = 0x09;
+		buf[3] = 0x04;
+		return 4;
+	}
+	if (index >= (int) (sizeof(strings) / sizeof(strings[0])))
+		return -1;
+	len = strlen(strings[index]);
+	buf[0] = 2 + 2 * len;
+	buf[1] = USB_DT_STRING;
+	for (i = 0; i < len; i++) {
+		buf[2 + 2 * i] = strings[index][i];
+		buf[3 + 2 * i] = 0;
+	}
+	return buf[0];
+}
+
+/* The reply to a standard request, its length or -1 to stall */
+static int standard_request(int fd, const struct usb_ctrlrequest *ctrl,
+			    unsigned char *buf)
+{
+	int value = __le16_to_cpu(ctrl->wValue);
+
+	switch (ctrl->bRequest) {
+	case USB_REQ_GET_DESCRIPTOR:
+		switch (value >> 8) {
+		case USB_DT_DEVICE:
+			memcpy(buf, &device_descriptor,
+			       sizeof(device_descriptor));
+			return sizeof(device_descriptor);
+		case USB_DT_CONFIG:
+			memcpy(buf, config_descriptor,
+			       sizeof(config_descriptor));
+			return sizeof(config_descriptor);
+		case USB_DT_STRING:
+			return string_descriptor(value & 0xff, buf);
+		case HID_DT_HID:
+			memcpy(buf, config_descriptor + USB_DT_CONFIG_SIZE +
+			       USB_DT_INTERFACE_SIZE, 9);
+			return 9;
+		case HID_DT_REPORT:
+			memcpy(buf, report_descriptor,
+			       sizeof(report_descriptor));
+			return sizeof(report_descriptor);
+		}
+		return -1;
+	case USB_REQ_SET_CONFIGURATION:
+		if (ioctl(fd, USB_RAW_IOCTL_EP_ENABLE, &int_endpoint) < 0 ||
+		    ioctl(fd, USB_RAW_IOCTL_VBUS_DRAW, 15) < 0 ||
+		    ioctl(fd, USB_RAW_IOCTL_CONFIGURE, 0) < 0) {
+			perror("configure");
+			return -1;
+		}
+		return 0;
+	case USB_REQ_SET_INTERFACE:
+		return 0;
+	case USB_REQ_GET_CONFIGURATION:
+		buf[0] = 1;
+		return 1;
+	case USB_REQ_GET_STATUS:
+		buf[0] = 0;
+		buf[1] = 0;
+		return 2;
+	case USB_REQ_GET_INTERFACE:
+		buf[0] = 0;
+		return 1;
+	}
+	return -1;
+}
+
+/* The reply to a HID class request, as standard_request() */
+static int class_request(int fd, const struct usb_ctrlrequest *ctrl,
+			 unsigned char *buf)
+{
+	int value = __le16_to_cpu(ctrl->wValue);
+	int length = __le16_to_cpu(ctrl->wLength);
+
+	switch (ctrl->bRequest) {
+	case HID_SET_IDLE:
+	case HID_SET_PROTOCOL:
+		return 0;
+	case HID_GET_REPORT:
+		if ((value >> 8) != REPORT_TYPE_FEATURE ||
+		    length < FEATURE_RPT_SIZE)
+			return -1;
+		_yk_emu_key_read(&key, buf);
+		reports++;
+		return FEATURE_RPT_SIZE;
+	case HID_SET_REPORT:
+		/* the data follows on ep0, see control() */
+		return 0;
+	}
+	return -1;
+}
+
+static int control(int fd, const struct usb_ctrlrequest *ctrl)
+{
+	struct ep0_io ep0;
+	int length = __le16_to_cpu(ctrl->wLength);
+	int ret;
+
+	memset(&ep0, 0, sizeof(ep0));
+	if (verbose)
+		fprintf(stderr, "ykgadget: control %02x %02x %04x %04x %d\n",
+			ctrl->bRequestType, ctrl->bRequest,
+			__le16_to_cpu(ctrl->wValue),
+			__le16_to_cpu(ctrl->wIndex), length);
+
+	switch (ctrl->bRequestType & USB_TYPE_MASK) {
+	case USB_TYPE_STANDARD:
+		ret = standard_request(fd, ctrl, ep0.data);
+		break;
+	case USB_TYPE_CLASS:
+		ret = class_request(fd, ctrl, ep0.data);
+		break;
+	default:
+		ret = -1;
+	}
+	if (ret < 0 || length > EP0_MAX_DATA)
+		return ioctl(fd, USB_RAW_IOCTL_EP0_STALL, 0);
+
+	if (ctrl->bRequestType & USB_DIR_IN) {
+		ep0.io.length = ret < length ? ret : length;
+		return ioctl(fd, USB_RAW_IOCTL_EP0_WRITE, &ep0);
+	}
+
+	/* OUT: read the data stage, or acknowledge the status stage */
+	ep0.io.length = length;
+	if ((ret = ioctl(fd, USB_RAW_IOCTL_EP0_READ, &ep0)) < 0)
+		return ret;
+	if ((ctrl->bRequestType & USB_TYPE_MASK) == USB_TYPE_CLASS &&
+	    ctrl->bRequest == HID_SET_REPORT &&
+	    (__le16_to_cpu(ctrl->wValue) >> 8) == REPORT_TYPE_FEATURE &&
+	    ret == FEATURE_RPT_SIZE) {
+		_yk_emu_key_write(&key, ep0.data);
+		reports++;
+	}
+	return 0;
+}
+
+static volatile sig_atomic_t done = 0;
+
+static void stop(int sig)
+{
+	done = 1;
+}
+
+int main(int argc, char **argv)
+{
+	const char *driver = "dummy_udc";
+	const char *device = "dummy_udc.0";
+	unsigned int serial = 1000000;
+	struct usb_raw_init init;
+	struct control_event ev;
+	int fd, c;
+
+	while ((c = getopt(argc, argv, "d:D:s:vh")) != -1) {
+		switch (c) {
+		case 'd':
+			driver = optarg;
+			break;
+		case 'D':
+			device = optarg;
+			break;
+		case 's':
+			serial = strtoul(optarg, NULL, 10);
+			break;
+		case 'v':
+			verbose = 1;
+			break;
+		default:
+			fprintf(stderr, "Usage: %s [-v] [-s serial] "
+				"[-d udc driver] [-D udc device]\n", argv[0]);
+			return c == 'h' ? 0 : 1;
+		}
+	}
+	_yk_emu_key_init(&key, serial);
+
+	if ((fd = open("/dev/raw-gadget", O_RDWR)) < 0) {
+		perror("/dev/raw-gadget");
+		return 1;
+	}
+	memset(&init, 0, sizeof(init));
+	strncpy((char *) init.driver_name, driver, UDC_NAME_LENGTH_MAX - 1);
+	strncpy((char *) init.device_name, device, UDC_NAME_LENGTH_MAX - 1);
+	init.speed = USB_SPEED_HIGH;
+	if (ioctl(fd, USB_RAW_IOCTL_INIT, &init) < 0 ||
+	    ioctl(fd, USB_RAW_IOCTL_RUN, 0) < 0) {
+		perror("raw-gadget");
+		close(fd);
+		return 1;
+	}
+
+	signal(SIGINT, stop);
+	signal(SIGTERM, stop);
+	while (!done) {
+		memset(&ev, 0, sizeof(ev));
+		ev.event.length = sizeof(ev.ctrl);
+		if (ioctl(fd, USB_RAW_IOCTL_EVENT_FETCH, &ev) < 0) {
+			if (errno == EINTR)
+				continue;
+			perror("event");
+			break;
+		}
+		if (ev.event.type == USB_RAW_EVENT_CONNECT) {
+			if (verbose)
+				fprintf(stderr, "ykgadget: connected\n");
+		} else if (ev.event.type == USB_RAW_EVENT_CONTROL) {
+			if (control(fd, &ev.ctrl) < 0 && errno != EINTR)
+				perror("ep0");
+		}
+	}
+
+	fprintf(stderr, "ykgadget: %lu feature reports\n", reports);
+	close(fd);
+	return 0;
+}
+
+#else
+
+int main(int argc, char **argv)
+{
+	fprintf(stderr, "%s: needs Linux with raw-gadget\n", argv[0]);
+	return 1;
+}
+
+#endif
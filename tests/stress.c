@@ -0,0 +1,327 @@
+/* -*- mode:C; c-file-style: "bsd" -*- */
+/*
+ * Copyright (c) 2026 Yubico AB
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Stress test, run with "make stress".  Threads drive emulated keys
+ * (see yk_emulate()) all at once, thread i using key i modulo the
+ * number of keys, and mix status reads, HMAC challenges, configuration
+ * writes and error code churn that must stay per thread.  Threads that
+ * share a key take turns on it, as applications must, or with -s
+ * queue their calls on the key shared with yk_shared_alloc().  The run
+ * is repeated for 1, 2, 4, ... threads up to -t, reporting throughput
+ * for each, and fails when any operation did.
+ *
+ * For data races, build with ThreadSanitizer:
+ *
+ *   make stress CFLAGS="-g -O1 -fsanitize=thread" \
+ *	LDFLAGS=-fsanitize=thread
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdbool.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#include <ykpers.h>
+#include <ykstatus.h>
+#include <ykdef.h>
+
+#include "ykthread.h"
+
+#define MAX_THREADS	256
+#define MAX_KEYS	64
+
+struct key_slot {
+	YK_MUTEX_TYPE lock;
+	YK_KEY *yk;
+	YK_SHARED *sh;
+	unsigned char expected[20];
+};
+
+struct worker {
+	YK_THREAD_TYPE tid;
+	int id;
+	struct key_slot *key;
+	unsigned int ops;
+	unsigned int failed;
+};
+
+static int opt_threads = 0;
+static int opt_keys = 4;
+static unsigned int opt_ops = 100;
+static bool opt_shared = false;
+
+static struct key_slot keys[MAX_KEYS];
+static struct worker workers[MAX_THREADS];
+static unsigned char challenge[SLOT_DATA_SIZE];
+
+static double now_s(void)
+{
+#ifdef _WIN32
+	LARGE_INTEGER freq, now;
+	QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&now);
+	return (double) now.QuadPart / (double) freq.QuadPart;
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+#endif
+}
+
+static bool op_status(struct worker *w, YK_STATUS *st)
+{
+	bool ok;
+
+	if (opt_shared)
+		return yk_shared_get_status(w->key->sh, st) &&
+			ykds_version_major(st) == 4;
+	YK_MUTEX_LOCK(w->key->lock);
+	ok = yk_get_status(w->key->yk, st) && ykds_version_major(st) == 4;
+	YK_MUTEX_UNLOCK(w->key->lock);
+	return ok;
+}
+
+static bool op_challenge(struct worker *w)
+{
+	unsigned char response[64];
+	bool ok;
+
+	if (opt_shared) {
+		ok = yk_shared_challenge_response(w->key->sh, SLOT_CHAL_HMAC1,
+						  0, sizeof(challenge),
+						  challenge, sizeof(response),
+						  response);
+	} else {
+		YK_MUTEX_LOCK(w->key->lock);
+		ok = yk_challenge_response(w->key->yk, SLOT_CHAL_HMAC1, 0,
+					   sizeof(challenge), challenge,
+					   sizeof(response), response);
+		YK_MUTEX_UNLOCK(w->key->lock);
+	}
+	return ok && memcmp(response, w->key->expected, 20) == 0;
+}
+
+static bool op_write(struct worker *w, YKP_CONFIG *cfg)
+{
+	unsigned char key[16];
+	bool ok;
+
+	if (!ykp_random_bytes(key, sizeof(key)))
+		return false;
+	ykp_AES_key_from_raw(cfg, (char *) key);
+	if (opt_shared)
+		return yk_shared_write_command(w->key->sh,
+					       ykp_core_config(cfg),
+					       ykp_command(cfg), NULL);
+	YK_MUTEX_LOCK(w->key->lock);
+	ok = yk_write_command(w->key->yk, ykp_core_config(cfg),
+			      ykp_command(cfg), NULL);
+	YK_MUTEX_UNLOCK(w->key->lock);
+	return ok;
+}
+
+/* Failing calls must set the error codes of this thread only */
+static bool op_errno(struct worker *w, YKP_CONFIG *cfg)
+{
+	int mark = 0x100 + w->id;
+
+	ykp_errno = mark;
+	yk_errno = mark;
+	if (ykp_errno != mark || yk_errno != mark)
+		return false;
+	if (ykp_configure_command(cfg, 0xff) || ykp_errno != YKP_EINVCONFNUM)
+		return false;
+	if (yk_write_config(w->key->yk, ykp_core_config(cfg), 3, NULL) ||
+	    yk_errno != YK_EINVALIDCMD)
+		return false;
+	return ykp_errno == YKP_EINVCONFNUM;
+}
+
+static YK_THREAD_FUNC(worker_run, arg)
+{
+	struct worker *w = arg;
+	YK_STATUS *st = ykds_alloc();
+	YKP_CONFIG *cfg = ykp_alloc();
+	unsigned int i;
+
+	if (!st || !cfg || !op_status(w, st) ||
+	    !ykp_configure_for(cfg, 1, st)) {
+		w->failed = opt_ops;
+		goto out;
+	}
+	for (i = 0; i < opt_ops; i++) {
+		bool ok;
+
+		switch ((i + w->id) % 4) {
+		case 0:
+			ok = op_status(w, st);
+			break;
+		case 1:
+			ok = op_challenge(w);
+			break;
+		case 2:
+			ok = op_write(w, cfg);
+			break;
+		default:
+			ok = op_errno(w, cfg);
+			break;
+		}
+		w->ops++;
+		if (!ok)
+			w->failed++;
+	}
+out:
+	ykp_free_config(cfg);
+	ykds_free(st);
+	return 0;
+}
+
+/* Runs threads workers, returning the number of failed operations */
+static unsigned int run(int threads)
+{
+	unsigned int ops = 0, failed = 0;
+	double start, elapsed;
+	int i, started;
+
+	memset(workers, 0, sizeof(workers));
+	start = now_s();
+	for (started = 0; started < threads; started++) {
+		workers[started].id = started;
+		workers[started].key = &keys[started % opt_keys];
+		if (YK_THREAD_CREATE(workers[started].tid, worker_run,
+				     &workers[started]) != 0) {
+			fprintf(stderr, "failed to start thread %d\n", started);
+			failed++;
+			break;
+		}
+	}
+	for (i = 0; i < started; i++)
+		YK_THREAD_JOIN(workers[i].tid);
+	elapsed = now_s() - start;
+
+	for (i = 0; i < started; i++) {
+		ops += workers[i].ops;
+		failed += workers[i].failed;
+	}
+	printf("%8d %6d %10u %10.3f %12.1f %8u\n", threads, opt_keys, ops,
+	       elapsed, elapsed > 0 ? ops / elapsed : 0.0, failed);
+	return failed;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int failed = 0;
+	int c, i, threads;
+
+	while ((c = getopt(argc, argv, "t:k:n:sh")) != -1) {
+		switch (c) {
+		case 't':
+			opt_threads = atoi(optarg);
+			break;
+		case 'k':
+			opt_keys = atoi(optarg);
+			break;
+		case 'n':
+			opt_ops = atoi(optarg);
+			break;
+		case 's':
+			opt_shared = true;
+			break;
+		default:
+			fprintf(stderr, "Usage: %s [-s] [-t max threads] "
+				"[-k keys] [-n operations per thread]\n",
+				argv[0]);
+			return c == 'h' ? 0 : 1;
+		}
+	}
+	if (opt_threads <= 0)
+		opt_threads = 2 * YK_CPU_COUNT();
+	if (opt_threads <= 0)
+		opt_threads = 2;
+	if (opt_threads > MAX_THREADS || opt_keys < 1 || opt_keys > MAX_KEYS) {
+		fprintf(stderr, "%s: at most %d threads and %d keys\n",
+			argv[0], MAX_THREADS, MAX_KEYS);
+		return 1;
+	}
+
+	for (i = 0; i < (int) sizeof(challenge); i++)
+		challenge[i] = i * 7 + 1;
+
+	if (!yk_emulate(opt_keys) || !yk_init()) {
+		fprintf(stderr, "%s: failed to emulate keys\n", argv[0]);
+		return 1;
+	}
+	/* the responses every thread must get */
+	for (i = 0; i < opt_keys; i++) {
+		unsigned char response[64];
+
+		if (YK_MUTEX_INIT(keys[i].lock) != 0 ||
+		    !(keys[i].yk = yk_open_key(i)) ||
+		    !yk_challenge_response(keys[i].yk, SLOT_CHAL_HMAC1, 0,
+					   sizeof(challenge), challenge,
+					   sizeof(response), response)) {
+			fprintf(stderr, "%s: key %d failed\n", argv[0], i);
+			return 1;
+		}
+		memcpy(keys[i].expected, response, 20);
+		if (opt_shared && !(keys[i].sh = yk_shared_alloc(keys[i].yk))) {
+			fprintf(stderr, "%s: key %d failed\n", argv[0], i);
+			return 1;
+		}
+	}
+
+	printf("%8s %6s %10s %10s %12s %8s\n", "threads", "keys", "ops",
+	       "seconds", "ops/s", "failed");
+	for (threads = 1; ; threads *= 2) {
+		if (threads > opt_threads)
+			threads = opt_threads;
+		failed += run(threads);
+		if (threads == opt_threads)
+			break;
+	}
+
+	for (i = 0; i < opt_keys; i++) {
+		if (keys[i].sh)
+			yk_shared_free(keys[i].sh);
+		else
+			yk_close_key(keys[i].yk);
+		YK_MUTEX_DESTROY(keys[i].lock);
+	}
+	yk_release();
+	yk_emulate(0);
+	return failed ? 1 : 0;
+}
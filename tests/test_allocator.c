@@ -0,0 +1,140 @@
+/* -*- mode:C; c-file-style: "bsd" -*- */
+/*
+ * Copyright (c) 2026 Yubico AB
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include <ykpers.h>
+#include <ykstatus.h>
+#include <ykdef.h>
+
+struct counter {
+	int allocs;
+	int frees;
+};
+
+static void *_test_alloc(size_t size, void *ctx)
+{
+	((struct counter *) ctx)->allocs++;
+	return malloc(size);
+}
+
+static void _test_free(void *ptr, void *ctx)
+{
+	((struct counter *) ctx)->frees++;
+	free(ptr);
+}
+
+static void _test_hooks(void)
+{
+	struct counter c = { 0, 0 };
+	YKP_CONFIG *cfg;
+	YK_STATUS *st;
+	YK_NDEF *ndef;
+	YK_DEVICE_CONFIG *dev;
+
+	assert(yk_set_allocator(_test_alloc, NULL, &c) == 0);
+	assert(yk_errno == YK_EINVAL);
+	assert(yk_set_allocator(_test_alloc, _test_free, &c) == 1);
+
+	cfg = ykp_alloc();
+	st = ykds_alloc();
+	ndef = ykp_alloc_ndef();
+	dev = ykp_alloc_device_config();
+	assert(cfg && st && ndef && dev);
+	assert(c.allocs == 4);
+
+	ykp_free_config(cfg);
+	ykds_free(st);
+	ykp_free_ndef(ndef);
+	ykp_free_device_config(dev);
+	assert(c.frees == 4);
+
+	assert(yk_set_allocator(NULL, NULL, NULL) == 1);
+	cfg = ykp_alloc();
+	ykp_free_config(cfg);
+	assert(c.allocs == 4 && c.frees == 4);
+}
+
+static void _test_in_place(void)
+{
+	union {
+		unsigned char buf[1024];
+		double align;
+	} mem;
+	YKP_CONFIG *cfg;
+	YKP_CONFIG *ref;
+	YK_STATUS *st;
+	YK_NDEF *ndef;
+	YK_DEVICE_CONFIG *dev;
+
+	assert(ykp_config_size() <= sizeof(mem.buf));
+	assert(ykds_size() <= sizeof(mem.buf));
+	assert(ykp_ndef_size() <= sizeof(mem.buf));
+	assert(ykp_device_config_size() <= sizeof(mem.buf));
+
+	memset(mem.buf, 0xff, sizeof(mem.buf));
+	cfg = ykp_config_init_in_place(mem.buf, sizeof(mem.buf));
+	assert(cfg == (YKP_CONFIG *) mem.buf);
+	ref = ykp_alloc();
+	assert(memcmp(cfg, ref, ykp_config_size()) == 0);
+	ykp_free_config(ref);
+	assert(ykp_config_init_in_place(mem.buf, ykp_config_size() - 1) == NULL);
+	assert(ykp_errno == YKP_EINVAL);
+	assert(ykp_config_init_in_place(mem.buf + 1, ykp_config_size()) == NULL);
+	assert(ykp_errno == YKP_EINVAL);
+
+	st = ykds_init_in_place(mem.buf, sizeof(mem.buf));
+	assert(st != NULL && ykds_version_major(st) == 0);
+	assert(ykds_init_in_place(mem.buf, ykds_size() - 1) == NULL);
+	assert(yk_errno == YK_EINVAL);
+
+	ndef = ykp_ndef_init_in_place(mem.buf, sizeof(mem.buf));
+	assert(ndef != NULL);
+	assert(ykp_construct_ndef_uri(ndef, "https://example.com") == 1);
+	assert(ykp_ndef_init_in_place(NULL, sizeof(mem.buf)) == NULL);
+
+	dev = ykp_device_config_init_in_place(mem.buf, sizeof(mem.buf));
+	assert(dev != NULL);
+	assert(ykp_set_device_mode(dev, 0x81) == 1);
+	assert(ykp_device_config_init_in_place(mem.buf, 1) == NULL);
+	assert(ykp_errno == YKP_EINVAL);
+}
+
+int main(void)
+{
+	_test_hooks();
+	_test_in_place();
+
+	return 0;
+}
@@ -0,0 +1,136 @@
+/* -*- mode:C; c-file-style: "bsd" -*- */
+/*
+ * Copyright (c) 2026 Yubico AB
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <assert.h>
+
+#include <ykpers.h>
+#include <ykstatus.h>
+#include <ykdef.h>
+
+static YKP_CONFIG *_test_config(int major, int minor, int build)
+{
+	YK_STATUS *st = ykds_alloc();
+	struct status_st *t = (struct status_st *) st;
+	YKP_CONFIG *cfg = ykp_alloc();
+
+	t->versionMajor = major;
+	t->versionMinor = minor;
+	t->versionBuild = build;
+	ykp_configure_version(cfg, st);
+	ykds_free(st);
+	return cfg;
+}
+
+static void _test_command(int major, int minor, int build, uint8_t command,
+			  int expected_errno)
+{
+	YKP_CONFIG *cfg = _test_config(major, minor, build);
+
+	ykp_errno = 0;
+	assert(ykp_configure_command(cfg, command) == (expected_errno == 0));
+	assert(ykp_errno == expected_errno);
+	ykp_free_config(cfg);
+}
+
+static void _test_flag(int major, int minor, int build,
+		       int (*setter)(YKP_CONFIG *, bool), bool expected)
+{
+	YKP_CONFIG *cfg = _test_config(major, minor, build);
+
+	ykp_errno = 0;
+	assert(setter(cfg, true) == expected);
+	assert(ykp_errno == (expected ? 0 : YKP_EYUBIKEYVER));
+	ykp_free_config(cfg);
+}
+
+static void _test_commands(void)
+{
+	_test_command(1, 3, 0, SLOT_CONFIG2, YKP_EOLDYUBIKEY);
+	_test_command(2, 0, 0, SLOT_CONFIG2, 0);
+	/* the NEO beta is versioned from 2.1.4 and has no second slot */
+	_test_command(2, 1, 3, SLOT_CONFIG2, 0);
+	_test_command(2, 1, 4, SLOT_CONFIG2, YKP_EYUBIKEYVER);
+	_test_command(2, 1, 4, SLOT_NDEF, 0);
+	_test_command(2, 2, 0, SLOT_UPDATE1, YKP_EOLDYUBIKEY);
+	_test_command(2, 3, 0, SLOT_SWAP, 0);
+	_test_command(3, 0, 0, SLOT_NDEF2, 0);
+	_test_command(4, 3, 7, SLOT_NDEF, YKP_EYUBIKEYVER);
+	_test_command(4, 3, 7, SLOT_DEVICE_CONFIG, 0);
+	_test_command(4, 3, 7, SLOT_YK4_SET_DEVICE_INFO, YKP_EYUBIKEYVER);
+	_test_command(5, 2, 4, SLOT_NDEF2, 0);
+	_test_command(5, 2, 4, SLOT_YK4_SET_DEVICE_INFO, 0);
+	_test_command(6, 0, 0, SLOT_NDEF2, YKP_EYUBIKEYVER);
+	_test_command(6, 0, 0, SLOT_DEVICE_CONFIG, YKP_EYUBIKEYVER);
+	_test_command(6, 0, 0, SLOT_SCAN_MAP, 0);
+	_test_command(5, 0, 0, 0x77, YKP_EINVCONFNUM);
+}
+
+static void _test_flags(void)
+{
+	_test_flag(0, 9, 9, ykp_set_tktflag_APPEND_CR, true);
+	_test_flag(1, 3, 0, ykp_set_cfgflag_ALLOW_HIDTRIG, true);
+	_test_flag(2, 0, 0, ykp_set_cfgflag_ALLOW_HIDTRIG, false);
+	_test_flag(2, 0, 0, ykp_set_tktflag_OATH_HOTP, false);
+	_test_flag(2, 1, 0, ykp_set_tktflag_OATH_HOTP, true);
+	_test_flag(2, 1, 4, ykp_set_cfgflag_STATIC_TICKET, false);
+	_test_flag(2, 1, 5, ykp_set_cfgflag_STATIC_TICKET, true);
+	_test_flag(2, 1, 6, ykp_set_extflag_SERIAL_API_VISIBLE, true);
+	_test_flag(2, 1, 6, ykp_set_extflag_SERIAL_USB_VISIBLE, false);
+	_test_flag(2, 2, 0, ykp_set_tktflag_CHAL_RESP, true);
+	_test_flag(2, 2, 0, ykp_set_extflag_ALLOW_UPDATE, false);
+	_test_flag(2, 3, 0, ykp_set_extflag_DORMANT, true);
+	_test_flag(2, 3, 0, ykp_set_extflag_LED_INV, false);
+	_test_flag(2, 4, 0, ykp_set_extflag_LED_INV, true);
+	_test_flag(3, 0, 1, ykp_set_extflag_LED_INV, false);
+	_test_flag(3, 1, 0, ykp_set_extflag_LED_INV, true);
+	_test_flag(5, 1, 0, ykp_set_extflag_LED_INV, true);
+}
+
+static void _test_oath_imf(void)
+{
+	YKP_CONFIG *cfg = _test_config(2, 1, 6);
+
+	assert(ykp_set_oath_imf(cfg, 16) == 0);
+	ykp_free_config(cfg);
+	cfg = _test_config(2, 1, 7);
+	assert(ykp_set_oath_imf(cfg, 16) == 1);
+	assert(ykp_get_oath_imf(cfg) == 16);
+	ykp_free_config(cfg);
+}
+
+int main(void)
+{
+	_test_commands();
+	_test_flags();
+	_test_oath_imf();
+
+	return 0;
+}
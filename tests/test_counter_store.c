@@ -0,0 +1,334 @@
+/* -*- mode:C; c-file-style: "bsd" -*- */
+/*
+ * Copyright (c) 2026 Yubico AB
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <assert.h>
+#ifndef _WIN32
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#include <ykpers.h>
+#include <ykstatus.h>
+#include <ykdef.h>
+
+#include "ykthread.h"
+
+#define NTHREADS 8
+#define NCOUNTS 2000
+#define NIDS 100
+
+static const char *store_path = "test_counter_store.ykc";
+
+static YKP_COUNTER_STORE *store;
+static const unsigned char shared_id[] = { 1, 2, 3, 4, 5, 6 };
+static int accepted[NCOUNTS + 1];
+
+static void _test_basic(void)
+{
+	const unsigned char id[] = { 0xa0, 0xa1, 0xa2, 0xa3, 0xa4, 0xa5 };
+	struct ticket_st ticket;
+	uint64_t counter;
+
+	remove(store_path);
+	store = ykp_open_counter_store(store_path, 16);
+	assert(store != NULL);
+
+	assert(ykp_counter_get(store, id, sizeof(id), &counter) == 0);
+	assert(ykp_errno == YKP_ENOCFG);
+
+	/* the first counter from a key creates its entry */
+	assert(ykp_counter_update(store, id, sizeof(id), 5, &counter) == 1);
+	assert(counter == 0);
+	assert(ykp_counter_update(store, id, sizeof(id), 5, &counter) == 0);
+	assert(ykp_errno == YKP_EREPLAY);
+	assert(counter == 5);
+	assert(ykp_counter_update(store, id, sizeof(id), 4, NULL) == 0);
+	assert(ykp_errno == YKP_EREPLAY);
+	assert(ykp_counter_update(store, id, sizeof(id), 6, NULL) == 1);
+	assert(ykp_counter_get(store, id, sizeof(id), &counter) == 1);
+	assert(counter == 6);
+
+	/* seeding leaves the counter of a known id alone */
+	assert(ykp_counter_seed(store, id, sizeof(id), 100) == 1);
+	assert(ykp_counter_get(store, id, sizeof(id), &counter) == 1);
+	assert(counter == 6);
+	/* a prefix is another id */
+	assert(ykp_counter_get(store, id, 4, NULL) == 0);
+	assert(ykp_errno == YKP_ENOCFG);
+
+	assert(ykp_counter_update(store, id, 0, 1, NULL) == 0);
+	assert(ykp_errno == YKP_EINVAL);
+	assert(ykp_counter_update(store, id, FIXED_SIZE + 1, 1, NULL) == 0);
+	assert(ykp_errno == YKP_EINVAL);
+
+	/* the session counter counts below the power-up counter */
+	memset(&ticket, 0, sizeof(ticket));
+	ticket.useCtr = 2 | TICKET_ACT_HIDRPT;
+	ticket.sessionCtr = 255;
+	counter = ykp_otp_counter(&ticket);
+	ticket.useCtr = 3;
+	ticket.sessionCtr = 0;
+	assert(ykp_otp_counter(&ticket) > counter);
+	assert(ykp_otp_counter(&ticket) == 3 << 8);
+}
+
+static void _test_seed_config(void)
+{
+	YK_STATUS *st = ykds_alloc();
+	struct status_st *t = (struct status_st *) st;
+	YKP_CONFIG *cfg = ykp_alloc();
+	struct config_st *ycfg;
+	uint64_t counter;
+
+	t->versionMajor = 2;
+	t->versionMinor = 2;
+	assert(ykp_configure_for(cfg, 1, st) == 1);
+	ykp_set_tktflag_OATH_HOTP(cfg, true);
+	assert(ykp_set_oath_imf(cfg, 32) == 1);
+	ycfg = (struct config_st *) ykp_core_config(cfg);
+	ycfg->fixedSize = 4;
+	memcpy(ycfg->fixed, "\x10\x20\x30\x40", 4);
+
+	assert(ykp_counter_seed_config(store, cfg) == 1);
+	assert(ykp_counter_get(store, ycfg->fixed, 4, &counter) == 1);
+	assert(counter == 32);
+	/* a validated code at offset 2 from the stored moving factor */
+	assert(ykp_counter_update(store, ycfg->fixed, 4, counter + 2 + 1,
+				  NULL) == 1);
+	assert(ykp_counter_update(store, ycfg->fixed, 4, counter + 1,
+				  NULL) == 0);
+
+	ykp_free_config(cfg);
+	ykds_free(st);
+}
+
+static YK_THREAD_FUNC(worker, arg)
+{
+	int n = *(int *) arg;
+	unsigned char id[2];
+	int i;
+
+	/* every thread offers the same counters in order, each must be
+	   accepted exactly once */
+	for (i = 1; i <= NCOUNTS; i++) {
+		if (ykp_counter_update(store, shared_id, sizeof(shared_id), i,
+				       NULL))
+			__atomic_add_fetch(&accepted[i], 1, __ATOMIC_SEQ_CST);
+		else
+			assert(ykp_errno == YKP_EREPLAY);
+	}
+	/* and adds ids of its own, racing for buckets */
+	for (i = 0; i < NIDS; i++) {
+		id[0] = n;
+		id[1] = i;
+		assert(ykp_counter_seed(store, id, sizeof(id), n * 1000 + i) == 1);
+	}
+	return 0;
+}
+
+static void _test_threads(void)
+{
+	YK_THREAD_TYPE tids[NTHREADS];
+	int args[NTHREADS];
+	unsigned char id[2];
+	uint64_t counter;
+	int i, j, total = 0;
+
+	assert(ykp_close_counter_store(store) == 1);
+	remove(store_path);
+	store = ykp_open_counter_store(store_path, NTHREADS * NIDS + 1);
+	assert(store != NULL);
+
+	for (i = 0; i < NTHREADS; i++) {
+		args[i] = i;
+		assert(YK_THREAD_CREATE(tids[i], worker, &args[i]) == 0);
+	}
+	for (i = 0; i < NTHREADS; i++)
+		YK_THREAD_JOIN(tids[i]);
+
+	for (i = 1; i <= NCOUNTS; i++) {
+		assert(accepted[i] <= 1);
+		total += accepted[i];
+	}
+	assert(total >= 1);
+	assert(accepted[NCOUNTS] == 1);
+	assert(ykp_counter_store_sync(store) == 1);
+
+	/* all of it is in the file */
+	assert(ykp_close_counter_store(store) == 1);
+	store = ykp_open_counter_store(store_path, 0);
+	assert(store != NULL);
+	assert(ykp_counter_get(store, shared_id, sizeof(shared_id),
+			       &counter) == 1);
+	assert(counter == NCOUNTS);
+	for (i = 0; i < NTHREADS; i++) {
+		for (j = 0; j < NIDS; j++) {
+			id[0] = i;
+			id[1] = j;
+			assert(ykp_counter_get(store, id, sizeof(id),
+					       &counter) == 1);
+			assert(counter == (uint64_t) (i * 1000 + j));
+		}
+	}
+	assert(ykp_close_counter_store(store) == 1);
+}
+
+/* A claim that was never published, as left by a crashed process */
+static void _test_recovery(void)
+{
+	const unsigned char id[] = { 0x42 };
+	unsigned char bucket[32];
+	uint32_t state;
+	uint64_t counter;
+	FILE *f;
+	int i, claimed = -1;
+
+	remove(store_path);
+	store = ykp_open_counter_store(store_path, 1);
+	assert(store != NULL);
+	assert(ykp_counter_update(store, id, sizeof(id), 7, NULL) == 1);
+	assert(ykp_close_counter_store(store) == 1);
+
+	/* two buckets after the 32 byte header, claim the free one */
+	f = fopen(store_path, "r+b");
+	assert(f != NULL);
+	for (i = 0; i < 2; i++) {
+		assert(fseek(f, 32 + 32 * i, SEEK_SET) == 0);
+		assert(fread(bucket, sizeof(bucket), 1, f) == 1);
+		memcpy(&state, bucket, sizeof(state));
+		if (state == 0)
+			claimed = i;
+	}
+	assert(claimed >= 0);
+	state = 1;
+	assert(fseek(f, 32 + 32 * claimed, SEEK_SET) == 0);
+	assert(fwrite(&state, sizeof(state), 1, f) == 1);
+	fclose(f);
+
+	store = ykp_open_counter_store(store_path, 0);
+	assert(store != NULL);
+	assert(ykp_counter_get(store, id, sizeof(id), &counter) == 1);
+	assert(counter == 7);
+	/* the retired bucket is not handed out again */
+	assert(ykp_counter_seed(store, (const unsigned char *) "x", 1, 0) == 0);
+	assert(ykp_errno == YKP_EIO);
+	assert(ykp_close_counter_store(store) == 1);
+
+	f = fopen(store_path, "r+b");
+	assert(f != NULL);
+	assert(fseek(f, 32 + 32 * claimed, SEEK_SET) == 0);
+	assert(fread(&state, sizeof(state), 1, f) == 1);
+	assert(state == 3);
+
+	/* and a damaged header is refused */
+	assert(fseek(f, 0, SEEK_SET) == 0);
+	fputc('X', f);
+	fclose(f);
+	assert(ykp_open_counter_store(store_path, 0) == NULL);
+	assert(ykp_errno == YKP_EIO);
+}
+
+#ifndef _WIN32
+/* A claim left by a process that died while others keep the store open */
+static void _test_stale_claim(void)
+{
+	const unsigned char id[] = { 0x42 };
+	unsigned char bucket[32];
+	uint32_t state;
+	uint64_t counter;
+	pid_t pid;
+	FILE *f;
+	int i, claimed = -1;
+
+	/* a pid that is gone */
+	pid = fork();
+	assert(pid >= 0);
+	if (pid == 0)
+		_exit(0);
+	assert(waitpid(pid, NULL, 0) == pid);
+
+	remove(store_path);
+	store = ykp_open_counter_store(store_path, 1);
+	assert(store != NULL);
+	assert(ykp_counter_update(store, id, sizeof(id), 7, NULL) == 1);
+
+	f = fopen(store_path, "r+b");
+	assert(f != NULL);
+	for (i = 0; i < 2; i++) {
+		assert(fseek(f, 32 + 32 * i, SEEK_SET) == 0);
+		assert(fread(bucket, sizeof(bucket), 1, f) == 1);
+		memcpy(&state, bucket, sizeof(state));
+		if (state == 0)
+			claimed = i;
+	}
+	assert(claimed >= 0);
+	state = (uint32_t) pid << 2 | 1;
+	assert(fseek(f, 32 + 32 * claimed, SEEK_SET) == 0);
+	assert(fwrite(&state, sizeof(state), 1, f) == 1);
+	fclose(f);
+
+	/* lookups probe past it instead of waiting for it */
+	assert(ykp_counter_get(store, (const unsigned char *) "x", 1,
+			       &counter) == 0);
+	assert(ykp_errno == YKP_ENOCFG);
+	assert(ykp_counter_get(store, id, sizeof(id), &counter) == 1);
+	assert(counter == 7);
+	assert(ykp_counter_update(store, id, sizeof(id), 8, NULL) == 1);
+	/* and it is retired, not handed out again */
+	assert(ykp_counter_seed(store, (const unsigned char *) "x", 1, 0) == 0);
+	assert(ykp_errno == YKP_EIO);
+	assert(ykp_close_counter_store(store) == 1);
+
+	f = fopen(store_path, "rb");
+	assert(f != NULL);
+	assert(fseek(f, 32 + 32 * claimed, SEEK_SET) == 0);
+	assert(fread(&state, sizeof(state), 1, f) == 1);
+	assert(state == 3);
+	fclose(f);
+}
+#endif
+
+int main(void)
+{
+	_test_basic();
+	_test_seed_config();
+	_test_threads();
+	_test_recovery();
+#ifndef _WIN32
+	_test_stale_claim();
+#endif
+	remove(store_path);
+
+	return 0;
+}
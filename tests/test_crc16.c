@@ -0,0 +1,89 @@
+/* -*- mode:C; c-file-style: "bsd" -*- */
+/*
+ * Copyright (c) 2026 Yubico AB
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include <yubikey.h>
+#include <ykcore.h>
+
+#include "ykcrc.h"
+
+static void _test_check_value(void)
+{
+	/* CRC-16/IBM-SDLC of "123456789", before the final complement */
+	assert(_yk_crc16((const unsigned char *) "123456789", 9) ==
+	       (0x906e ^ 0xffff));
+	assert(_yk_crc16(NULL, 0) == 0xffff);
+}
+
+/* Every length and alignment up to a few slices, against libyubikey */
+static void _test_against_libyubikey(void)
+{
+	unsigned char buf[128];
+	size_t off, len;
+
+	srand(4711);
+	for (off = 0; off < sizeof(buf); off++)
+		buf[off] = rand() & 0xff;
+
+	for (off = 0; off < 8; off++) {
+		for (len = 0; off + len <= 100; len++)
+			assert(_yk_crc16(buf + off, len) ==
+			       yubikey_crc16(buf + off, len));
+	}
+}
+
+static void _test_residual(void)
+{
+	unsigned char buf[66];
+	unsigned short crc;
+	size_t i;
+
+	for (i = 0; i < 64; i++)
+		buf[i] = i * 3;
+	crc = ~_yk_crc16(buf, 64);
+	buf[64] = crc & 0xff;
+	buf[65] = crc >> 8;
+	assert(_yk_crc16(buf, 66) == YK_CRC_OK_RESIDUAL);
+	buf[10] ^= 0x20;
+	assert(_yk_crc16(buf, 66) != YK_CRC_OK_RESIDUAL);
+}
+
+int main(void)
+{
+	_test_check_value();
+	_test_against_libyubikey();
+	_test_residual();
+
+	return 0;
+}
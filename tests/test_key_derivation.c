@@ -0,0 +1,178 @@
+/* -*- mode:C; c-file-style: "bsd" -*- */
+/*
+ * Copyright (c) 2026 Yubico AB
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+#include <ykpers.h>
+#include <ykstatus.h>
+#include <ykdef.h>
+
+#define NKEYS 1000
+
+static unsigned char master[32];
+
+static YKP_CONFIG *_test_config(int slot, bool hmac)
+{
+	YK_STATUS *st = ykds_alloc();
+	struct status_st *t = (struct status_st *) st;
+	YKP_CONFIG *cfg = ykp_alloc();
+
+	t->versionMajor = 2;
+	t->versionMinor = 2;
+	assert(ykp_configure_for(cfg, slot, st) == 1);
+	if (hmac) {
+		ykp_set_tktflag_CHAL_RESP(cfg, true);
+		ykp_set_cfgflag_CHAL_HMAC(cfg, true);
+	}
+	ykds_free(st);
+	return cfg;
+}
+
+/* Expected values computed with an independent HKDF-SHA256 */
+static void _test_known_answer(void)
+{
+	YKP_CONFIG *cfg = _test_config(1, false);
+	struct config_st *ycfg = (struct config_st *) ykp_core_config(cfg);
+	const unsigned char key[] = {
+		0x43, 0x05, 0xec, 0xfb, 0xde, 0xd8, 0x25, 0xf4,
+		0xac, 0x67, 0xfe, 0x0f, 0x42, 0xa2, 0x3f, 0xf4 };
+	const unsigned char uid[] = { 0x95, 0x00, 0x37, 0xec, 0x1f, 0x91 };
+	const unsigned char fixed[] = { 0x81, 0x6d, 0xf6, 0x61, 0xc8, 0x92 };
+	const unsigned char hmac_key[] = {
+		0x0f, 0x19, 0x6a, 0xfd, 0xf3, 0x32, 0xc3, 0xf1,
+		0xf9, 0x70, 0xde, 0xd0, 0x60, 0xeb, 0x2b, 0x73,
+		0x17, 0x7c, 0xb5, 0x80 };
+
+	assert(ykp_derive_config(cfg, master, sizeof(master), 1234567,
+				 YKP_DERIVE_KEY | YKP_DERIVE_UID |
+				 YKP_DERIVE_FIXED) == 1);
+	assert(memcmp(ycfg->key, key, sizeof(key)) == 0);
+	assert(memcmp(ycfg->uid, uid, sizeof(uid)) == 0);
+	assert(ycfg->fixedSize == 6);
+	assert(memcmp(ycfg->fixed, fixed, sizeof(fixed)) == 0);
+	ykp_free_config(cfg);
+
+	cfg = _test_config(2, true);
+	ycfg = (struct config_st *) ykp_core_config(cfg);
+	assert(ykp_derive_config(cfg, master, sizeof(master), 1234567,
+				 YKP_DERIVE_KEY) == 1);
+	assert(memcmp(ycfg->key, hmac_key, 16) == 0);
+	assert(memcmp(ycfg->uid, hmac_key + 16, 4) == 0);
+	assert(ycfg->fixedSize == 0);
+
+	/* the uid holds key material with 20 byte keys */
+	assert(ykp_derive_config(cfg, master, sizeof(master), 1234567,
+				 YKP_DERIVE_UID) == 0);
+	assert(ykp_errno == YKP_EINVAL);
+	ykp_free_config(cfg);
+
+	/* a bad fixed size fails before any field is derived */
+	cfg = _test_config(1, false);
+	ycfg = (struct config_st *) ykp_core_config(cfg);
+	ycfg->fixedSize = FIXED_SIZE + 1;
+	assert(ykp_derive_config(cfg, master, sizeof(master), 1234567,
+				 YKP_DERIVE_KEY | YKP_DERIVE_FIXED) == 0);
+	assert(ykp_errno == YKP_EINVAL);
+	assert(memcmp(ycfg->key, "\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0",
+		      KEY_SIZE) == 0);
+	ykp_free_config(cfg);
+}
+
+static void *_test_no_alloc(size_t size, void *ctx)
+{
+	return NULL;
+}
+
+static void _test_no_free(void *ptr, void *ctx)
+{
+}
+
+static void _test_batch(void)
+{
+	static YKP_CONFIG *cfgs[NKEYS];
+	static unsigned int serials[NKEYS];
+	YKP_CONFIG *single = _test_config(1, false);
+	YKP_CONFIG *saved;
+	int i;
+
+	for (i = 0; i < NKEYS; i++) {
+		serials[i] = 5000000 + i;
+		cfgs[i] = _test_config(1, false);
+	}
+	assert(ykp_derive_configs(cfgs, serials, NKEYS, master,
+				  sizeof(master), YKP_DERIVE_KEY |
+				  YKP_DERIVE_UID, 4) == 1);
+
+	for (i = 0; i < NKEYS; i++) {
+		assert(ykp_derive_config(single, master, sizeof(master),
+					 serials[i], YKP_DERIVE_KEY |
+					 YKP_DERIVE_UID) == 1);
+		assert(memcmp(ykp_core_config(single), ykp_core_config(cfgs[i]),
+			      sizeof(struct config_st)) == 0);
+		if (i > 0)
+			assert(memcmp(((struct config_st *) ykp_core_config(cfgs[i]))->key,
+				      ((struct config_st *) ykp_core_config(cfgs[i - 1]))->key,
+				      KEY_SIZE) != 0);
+	}
+
+	/* a missing configuration fails the whole batch */
+	saved = cfgs[NKEYS / 2];
+	cfgs[NKEYS / 2] = NULL;
+	assert(ykp_derive_configs(cfgs, serials, NKEYS, master,
+				  sizeof(master), YKP_DERIVE_KEY, 0) == 0);
+	assert(ykp_errno == YKP_ENOCFG);
+	cfgs[NKEYS / 2] = saved;
+
+	/* as does running out of memory, reported as such */
+	assert(yk_set_allocator(_test_no_alloc, _test_no_free, NULL) == 1);
+	assert(ykp_derive_configs(cfgs, serials, NKEYS, master,
+				  sizeof(master), YKP_DERIVE_KEY, 4) == 0);
+	assert(ykp_errno == YKP_ENOMEM);
+	assert(yk_set_allocator(NULL, NULL, NULL) == 1);
+
+	for (i = 0; i < NKEYS; i++)
+		ykp_free_config(cfgs[i]);
+	ykp_free_config(single);
+}
+
+int main(void)
+{
+	size_t i;
+
+	for (i = 0; i < sizeof(master); i++)
+		master[i] = i;
+
+	_test_known_answer();
+	_test_batch();
+
+	return 0;
+}
@@ -31,6 +31,10 @@
 #include <stdio.h>
 #include <string.h>
 #include <assert.h>
+#ifndef _WIN32
+#include <unistd.h>
+#include <sys/wait.h>
+#endif
 
 #include <ykpers.h>
 #include <ykdef.h>
@@ -67,6 +71,67 @@ static void _test_160_bits_key(YKP_CONFIG *ykp, struct config_st *cfg)
 	assert(memcmp(cfg->uid, empty, sizeof(cfg->uid)) != 0);
 }
 
+static void _test_random_salt(YKP_CONFIG *ykp, struct config_st *cfg)
+{
+	unsigned char first[16];
+
+	memset (cfg, 0, sizeof(struct config_st));
+	cfg->tktFlags = TKTFLAG_APPEND_CR;
+
+	/* without a salt the result must differ between calls */
+	assert(ykp_AES_key_from_passphrase(ykp, "test", NULL) == 1);
+	memcpy(first, cfg->key, sizeof(first));
+	assert(ykp_AES_key_from_passphrase(ykp, "test", NULL) == 1);
+	assert(memcmp(first, cfg->key, sizeof(first)) != 0);
+}
+
+static void _test_random_bytes(void)
+{
+	unsigned char empty[8192];
+	unsigned char a[8192];
+	unsigned char b[37];
+	int i;
+
+	memset (empty, 0, sizeof(empty));
+
+	/* small requests are served from the buffer, large ones directly */
+	for (i = 0; i < 1000; i++) {
+		memset (a, 0, sizeof(b));
+		memset (b, 0, sizeof(b));
+		assert(ykp_random_bytes(a, sizeof(b)) == 1);
+		assert(ykp_random_bytes(b, sizeof(b)) == 1);
+		assert(memcmp(a, b, sizeof(b)) != 0);
+	}
+	assert(ykp_random_bytes(a, sizeof(a)) == 1);
+	assert(memcmp(a, empty, sizeof(a)) != 0);
+	assert(ykp_random_bytes(a, 0) == 1);
+}
+
+#ifndef _WIN32
+/* A forked child must not hand out what the parent's buffer holds */
+static void _test_random_fork(void)
+{
+	unsigned char parent[16], child[16];
+	int fds[2], status;
+	pid_t pid;
+
+	assert(ykp_random_bytes(parent, 1) == 1);
+	assert(pipe(fds) == 0);
+	pid = fork();
+	assert(pid >= 0);
+	if (pid == 0) {
+		ykp_random_bytes(child, sizeof(child));
+		_exit(write(fds[1], child, sizeof(child)) != sizeof(child));
+	}
+	close(fds[1]);
+	assert(ykp_random_bytes(parent, sizeof(parent)) == 1);
+	assert(read(fds[0], child, sizeof(child)) == sizeof(child));
+	assert(waitpid(pid, &status, 0) == pid && status == 0);
+	close(fds[0]);
+	assert(memcmp(parent, child, sizeof(child)) != 0);
+}
+#endif
+
 int main (void)
 {
 	YKP_CONFIG *ykp;
@@ -84,6 +149,11 @@ int main (void)
 
 	_test_128_bits_key(ykp, ycfg);
 	_test_160_bits_key(ykp, ycfg);
+	_test_random_salt(ykp, ycfg);
+	_test_random_bytes();
+#ifndef _WIN32
+	_test_random_fork();
+#endif
 
 	rc = ykp_free_config(ykp);
 	if (!rc)
@@ -0,0 +1,164 @@
+/* -*- mode:C; c-file-style: "bsd" -*- */
+/*
+ * Copyright (c) 2026 Yubico AB
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include <ykpers.h>
+#include <ykstatus.h>
+#include <ykdef.h>
+
+#define NKEYS 100
+
+static const char *manifest_path = "test_manifest.ykm";
+
+static YK_STATUS *_test_init_st(void)
+{
+	YK_STATUS *st = ykds_alloc();
+	struct status_st *t = (struct status_st *) st;
+
+	t->versionMajor = 2;
+	t->versionMinor = 4;
+	t->versionBuild = 0;
+	return st;
+}
+
+static YKP_CONFIG *_test_config(YK_STATUS *st, unsigned int serial,
+				int slot)
+{
+	YKP_CONFIG *cfg = ykp_alloc();
+	struct config_st *ycfg;
+
+	assert(ykp_configure_for(cfg, slot, st) == 1);
+	ycfg = (struct config_st *) ykp_core_config(cfg);
+	memset(ycfg->key, serial & 0xff, sizeof(ycfg->key));
+	ycfg->uid[0] = slot;
+	ycfg->fixedSize = serial % 16;
+	return cfg;
+}
+
+static void _test_write_and_lookup(void)
+{
+	YK_STATUS *st = _test_init_st();
+	YKP_CONFIG *cfgs[NKEYS];
+	unsigned int serials[NKEYS];
+	YKP_MANIFEST *m;
+	int i;
+
+	for (i = 0; i < NKEYS; i++) {
+		serials[i] = 1000000 + i / 2;
+		cfgs[i] = _test_config(st, serials[i], i % 2 + 1);
+	}
+	assert(ykp_write_manifest(manifest_path, serials, cfgs, NKEYS) == 1);
+
+	m = ykp_open_manifest(manifest_path);
+	assert(m != NULL);
+	assert(ykp_manifest_count(m) == NKEYS);
+
+	for (i = 0; i < NKEYS; i++) {
+		YKP_CONFIG *cfg = ykp_config_from_manifest(m, serials[i],
+							   i % 2 + 1);
+		assert(cfg != NULL);
+		assert(ykp_config_num(cfg) == i % 2 + 1);
+		assert(memcmp(ykp_core_config(cfg), ykp_core_config(cfgs[i]),
+			      sizeof(struct config_st)) == 0);
+		/* lookups hand out views into the manifest */
+		assert(cfg == ykp_config_from_manifest(m, serials[i],
+						       i % 2 + 1));
+	}
+
+	assert(ykp_config_from_manifest(m, 42, 1) == NULL);
+	assert(ykp_errno == YKP_ENOCFG);
+	assert(ykp_config_from_manifest(m, serials[0], 3) == NULL);
+	assert(ykp_errno == YKP_EINVAL);
+
+	ykp_close_manifest(m);
+	for (i = 0; i < NKEYS; i++)
+		ykp_free_config(cfgs[i]);
+	ykds_free(st);
+}
+
+static void _test_duplicate(void)
+{
+	YK_STATUS *st = _test_init_st();
+	unsigned int serials[2] = { 4711, 4711 };
+	YKP_CONFIG *cfgs[2];
+
+	cfgs[0] = _test_config(st, serials[0], 1);
+	cfgs[1] = _test_config(st, serials[1], 1);
+	assert(ykp_write_manifest(manifest_path, serials, cfgs, 2) == 0);
+	assert(ykp_errno == YKP_EINVAL);
+	ykp_free_config(cfgs[0]);
+	ykp_free_config(cfgs[1]);
+	ykds_free(st);
+}
+
+static void _test_corrupt(void)
+{
+	YK_STATUS *st = _test_init_st();
+	unsigned int serial = 4711;
+	YKP_CONFIG *cfg = _test_config(st, serial, 2);
+	FILE *f;
+	int c;
+
+	assert(ykp_write_manifest(manifest_path, &serial, &cfg, 1) == 1);
+
+	/* flip a byte in the first record */
+	f = fopen(manifest_path, "r+b");
+	assert(f != NULL);
+	assert(fseek(f, 40, SEEK_SET) == 0);
+	c = fgetc(f);
+	assert(fseek(f, 40, SEEK_SET) == 0);
+	fputc(c ^ 0x01, f);
+	fclose(f);
+
+	assert(ykp_open_manifest(manifest_path) == NULL);
+	assert(ykp_errno == YKP_EMANIFEST);
+	assert(ykp_open_manifest("nonexistent.ykm") == NULL);
+	assert(ykp_errno == YKP_EIO);
+	assert(ykp_write_manifest("nonexistent/test.ykm", &serial, &cfg,
+				  1) == 0);
+	assert(ykp_errno == YKP_EIO);
+
+	ykp_free_config(cfg);
+	ykds_free(st);
+}
+
+int main(void)
+{
+	_test_write_and_lookup();
+	_test_duplicate();
+	_test_corrupt();
+	remove(manifest_path);
+
+	return 0;
+}
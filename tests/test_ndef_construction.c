@@ -135,6 +135,97 @@ static void _test_uri_without_identifier(void)
 	ykp_free_ndef(ndef);
 }
 
+#define NUM_IDENTIFIERS 35
+
+/* The identifier picked for a URI must be the first one in table order
+   that it starts with, as a scan of the table finds. */
+static void _test_identifier_match(void)
+{
+	char identifiers[NUM_IDENTIFIERS][64];
+	const char *tails[] = { "", "x", "epc:id:", "ftp.", "www.", "/" };
+	YK_NDEF *ndef = ykp_alloc_ndef();
+	int num = NUM_IDENTIFIERS;
+	int i, j, k;
+
+	/* read the table back through ykp_ndef_as_text() */
+	for (i = 0; i < num; i++) {
+		memset(ndef, 0, sizeof(*ndef));
+		ndef->type = 'U';
+		ndef->data[0] = i + 1;
+		ndef->len = 1;
+		memset(identifiers[i], 0, sizeof(identifiers[i]));
+		assert(ykp_ndef_as_text(ndef, identifiers[i], 64) == 1);
+	}
+
+	for (i = 0; i < num; i++) {
+		for (j = 0; j < (int) (sizeof(tails) / sizeof(tails[0])); j++) {
+			char uri[128];
+			int expect = 0;
+			size_t expect_len = 0;
+
+			snprintf(uri, sizeof(uri), "%s%s", identifiers[i], tails[j]);
+			for (k = 0; k < num; k++) {
+				size_t len = strlen(identifiers[k]);
+				if (strncmp(uri, identifiers[k], len) == 0) {
+					expect = k + 1;
+					expect_len = len;
+					break;
+				}
+			}
+			assert(expect != 0);
+			assert(ykp_construct_ndef_uri(ndef, uri) == 1);
+			assert(ndef->data[0] == expect);
+			assert(ndef->len == strlen(uri) - expect_len + 1);
+
+			/* every shorter string */
+			uri[strlen(identifiers[i]) - 1] = '\0';
+			expect = 0;
+			for (k = 0; k < num; k++) {
+				if (strncmp(uri, identifiers[k], strlen(identifiers[k])) == 0) {
+					expect = k + 1;
+					break;
+				}
+			}
+			assert(ykp_construct_ndef_uri(ndef, uri) == 1);
+			assert(ndef->data[0] == expect);
+		}
+	}
+	ykp_free_ndef(ndef);
+}
+
+static void _test_template(void)
+{
+	YKP_CONFIG *cfg = ykp_alloc();
+	struct config_st *ycfg = (struct config_st *) ykp_core_config(cfg);
+	char out[64];
+
+	assert(ykp_expand_ndef_template(out, sizeof(out),
+					"https://example.com/{serial}/{serial_hex}",
+					1077254, NULL) == 1);
+	assert(strcmp(out, "https://example.com/1077254/00107006") == 0);
+	assert(ykp_expand_ndef_template(out, sizeof(out), "{serial_modhex}",
+					1077254, NULL) == 1);
+	assert(strcmp(out, "ccbcicch") == 0);
+
+	assert(ykp_expand_ndef_template(out, sizeof(out), "id={prefix}",
+					1, NULL) == 0);
+	assert(ykp_errno == YKP_EINVAL);
+	ycfg->fixedSize = 2;
+	ycfg->fixed[0] = 0x01;
+	ycfg->fixed[1] = 0xff;
+	assert(ykp_expand_ndef_template(out, sizeof(out), "id={prefix}",
+					1, cfg) == 1);
+	assert(strcmp(out, "id=cbvv") == 0);
+
+	assert(ykp_expand_ndef_template(out, sizeof(out), "{bogus}",
+					1, cfg) == 0);
+	assert(ykp_expand_ndef_template(out, 8, "{serial}", 123456789,
+					cfg) == 0);
+	assert(ykp_expand_ndef_template(out, 10, "{serial}", 123456789,
+					cfg) == 1);
+	ykp_free_config(cfg);
+}
+
 int main (void)
 {
 	_test_https_uri();
@@ -143,6 +234,8 @@ int main (void)
 	_test_exact_text();
 	_test_other_lang_text();
 	_test_uri_without_identifier();
+	_test_identifier_match();
+	_test_template();
 
 	return 0;
 }
@@ -0,0 +1,163 @@
+/* -*- mode:C; c-file-style: "bsd" -*- */
+/*
+ * Copyright (c) 2026 Yubico AB
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <assert.h>
+
+#include <ykpers.h>
+#include <ykstatus.h>
+#include <ykdef.h>
+
+static YKP_CONFIG *_test_config(void)
+{
+	YK_STATUS *st = ykds_alloc();
+	struct status_st *t = (struct status_st *) st;
+	YKP_CONFIG *cfg = ykp_alloc();
+
+	t->versionMajor = 2;
+	t->versionMinor = 2;
+	assert(ykp_configure_for(cfg, 1, st) == 1);
+	ykp_set_tktflag_OATH_HOTP(cfg, true);
+	ykp_HMAC_key_from_raw(cfg, "12345678901234567890");
+	ykds_free(st);
+	return cfg;
+}
+
+/* RFC 4226 appendix D */
+static void _test_hotp(void)
+{
+	const char *codes[] = {
+		"755224", "287082", "359152", "969429", "338314",
+		"254676", "287922", "162583", "399871", "520489"
+	};
+	YKP_CONFIG *cfg = _test_config();
+	unsigned int offset;
+	unsigned int i;
+
+	for (i = 0; i < 10; i++) {
+		offset = 42;
+		assert(ykp_oath_hotp_validate(cfg, i, 0, codes[i], &offset) == 1);
+		assert(offset == 0);
+		assert(ykp_oath_hotp_validate(cfg, 0, 9, codes[i], &offset) == 1);
+		assert(offset == i);
+	}
+	assert(ykp_oath_hotp_validate(cfg, 1, 8, codes[0], &offset) == 0);
+	assert(ykp_errno == YKP_ENOMATCH);
+	assert(ykp_oath_hotp_validate(cfg, 0, 9, "12345", &offset) == 0);
+	assert(ykp_errno == YKP_EINVAL);
+	assert(ykp_oath_hotp_validate(cfg, 0, 9, "75522a", &offset) == 0);
+	assert(ykp_errno == YKP_EINVAL);
+
+	/* the window is bounded */
+	assert(ykp_oath_hotp_validate(cfg, 0, 1000, codes[9], &offset) == 1);
+	assert(offset == 9);
+	assert(ykp_oath_hotp_validate(cfg, 0, 1001, codes[9], &offset) == 0);
+	assert(ykp_errno == YKP_EINVAL);
+	assert(ykp_oath_hotp_validate(cfg, 0, UINT_MAX, codes[9], &offset) == 0);
+	assert(ykp_errno == YKP_EINVAL);
+
+	/* a 16 byte key can not be used */
+	ykp_set_tktflag_OATH_HOTP(cfg, false);
+	assert(ykp_oath_hotp_validate(cfg, 0, 9, codes[0], &offset) == 0);
+	assert(ykp_errno == YKP_EINVAL);
+
+	ykp_free_config(cfg);
+}
+
+/* RFC 6238 appendix B, SHA-1 */
+static void _test_totp(void)
+{
+	struct {
+		uint64_t time;
+		const char *code;
+	} vectors[] = {
+		{ 59ULL, "94287082" },
+		{ 1111111109ULL, "07081804" },
+		{ 1111111111ULL, "14050471" },
+		{ 1234567890ULL, "89005924" },
+		{ 2000000000ULL, "69279037" },
+		{ 20000000000ULL, "65353130" },
+	};
+	YKP_CONFIG *cfg = _test_config();
+	int offset;
+	size_t i;
+
+	for (i = 0; i < sizeof(vectors) / sizeof(vectors[0]); i++) {
+		assert(ykp_oath_totp_validate(cfg, vectors[i].time, 30, 0,
+					      vectors[i].code, &offset) == 1);
+		assert(offset == 0);
+		assert(ykp_oath_totp_validate(cfg, vectors[i].time + 60, 30, 2,
+					      vectors[i].code, &offset) == 1);
+		assert(offset == -2);
+		assert(ykp_oath_totp_validate(cfg, vectors[i].time - 30, 30, 1,
+					      vectors[i].code, &offset) == 1);
+		assert(offset == 1);
+	}
+	assert(ykp_oath_totp_validate(cfg, 59 + 90, 30, 2, "94287082",
+				      &offset) == 0);
+	assert(ykp_errno == YKP_ENOMATCH);
+	assert(ykp_oath_totp_validate(cfg, 59, 0, 2, "94287082", &offset) == 0);
+	assert(ykp_errno == YKP_EINVAL);
+	assert(ykp_oath_totp_validate(cfg, 59, 30, 1000, "94287082",
+				      &offset) == 1);
+	assert(offset == 0);
+	assert(ykp_oath_totp_validate(cfg, 59, 30, 1001, "94287082",
+				      &offset) == 0);
+	assert(ykp_errno == YKP_EINVAL);
+	assert(ykp_oath_totp_validate(cfg, 59, 30, UINT_MAX / 2 + 1,
+				      "94287082", &offset) == 0);
+	assert(ykp_errno == YKP_EINVAL);
+
+	ykp_free_config(cfg);
+}
+
+static void _test_truncate(void)
+{
+	/* RFC 4226 section 5.4 */
+	const unsigned char hmac[] = {
+		0x1f, 0x86, 0x98, 0x69, 0x0e, 0x02, 0xca, 0x16, 0x61, 0x85,
+		0x50, 0xef, 0x7f, 0x19, 0xda, 0x8e, 0x94, 0x5b, 0x55, 0x5a
+	};
+
+	assert(ykp_oath_truncate(hmac, 6) == 872921);
+	assert(ykp_oath_truncate(hmac, 8) == 57872921);
+}
+
+int main(void)
+{
+	_test_hotp();
+	_test_totp();
+	_test_truncate();
+
+	return 0;
+}
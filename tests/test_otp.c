@@ -0,0 +1,281 @@
+/* -*- mode:C; c-file-style: "bsd" -*- */
+/*
+ * Copyright (c) 2026 Yubico AB
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+#include <yubikey.h>
+#include <ykpers.h>
+#include <ykstatus.h>
+#include <ykdef.h>
+
+#include "ykcrc.h"
+
+#define NKEYS 20
+
+static YKP_CONFIG *_test_config(int n)
+{
+	YK_STATUS *st = ykds_alloc();
+	struct status_st *t = (struct status_st *) st;
+	YKP_CONFIG *cfg = ykp_alloc();
+	struct config_st *ycfg;
+	unsigned char key[KEY_SIZE];
+	size_t i;
+
+	t->versionMajor = 2;
+	t->versionMinor = 2;
+	assert(ykp_configure_for(cfg, 1, st) == 1);
+	for (i = 0; i < sizeof(key); i++)
+		key[i] = n * 16 + i;
+	ykp_AES_key_from_raw(cfg, (const char *) key);
+	ycfg = (struct config_st *) ykp_core_config(cfg);
+	ycfg->fixedSize = 6;
+	for (i = 0; i < ycfg->fixedSize; i++)
+		ycfg->fixed[i] = 0x20 + n;
+	for (i = 0; i < UID_SIZE; i++)
+		ycfg->uid[i] = n + i;
+	ykds_free(st);
+	return cfg;
+}
+
+/* The OTP a key programmed with cfg would emit */
+static void _test_otp(YKP_CONFIG *cfg, unsigned short use_ctr,
+		      unsigned char session_ctr, char *otp)
+{
+	struct config_st *ycfg = (struct config_st *) ykp_core_config(cfg);
+	unsigned char ticket[16];
+	unsigned short crc;
+
+	memcpy(ticket, ycfg->uid, UID_SIZE);
+	ticket[6] = use_ctr & 0xff;
+	ticket[7] = use_ctr >> 8;
+	ticket[8] = 0x34;
+	ticket[9] = 0x12;
+	ticket[10] = 0x56;
+	ticket[11] = session_ctr;
+	ticket[12] = 0xcd;
+	ticket[13] = 0xab;
+	crc = ~_yk_crc16(ticket, 14);
+	ticket[14] = crc & 0xff;
+	ticket[15] = crc >> 8;
+	yubikey_aes_encrypt(ticket, ycfg->key);
+
+	yubikey_modhex_encode(otp, (const char *) ycfg->fixed,
+			      ycfg->fixedSize);
+	yubikey_modhex_encode(otp + 2 * ycfg->fixedSize,
+			      (const char *) ticket, sizeof(ticket));
+}
+
+static void _test_decrypt(void)
+{
+	YKP_CONFIG *cfg = _test_config(1);
+	YKP_CONFIG *other = _test_config(2);
+	struct config_st *ycfg = (struct config_st *) ykp_core_config(cfg);
+	struct ticket_st ticket;
+	char otp[2 * (FIXED_SIZE + 16) + 1];
+
+	_test_otp(cfg, 0x1234, 7, otp);
+	assert(strlen(otp) == 44);
+	assert(ykp_otp_decrypt(cfg, otp, &ticket) == 1);
+	assert(memcmp(ticket.uid, ycfg->uid, UID_SIZE) == 0);
+	assert(ticket.useCtr == 0x1234);
+	assert(ticket.sessionCtr == 7);
+	assert(ticket.tstpl == 0x1234);
+	assert(ticket.tstph == 0x56);
+	assert(ticket.rnd == 0xabcd);
+
+	/* the public id is not the one of other */
+	assert(ykp_otp_decrypt(other, otp, &ticket) == 0);
+	assert(ykp_errno == YKP_ENOMATCH);
+
+	/* a flipped ticket bit breaks the CRC */
+	otp[30] = otp[30] == 'c' ? 'b' : 'c';
+	assert(ykp_otp_decrypt(cfg, otp, &ticket) == 0);
+	assert(ykp_errno == YKP_ENOMATCH);
+
+	assert(ykp_otp_decrypt(cfg, "cccccccc", &ticket) == 0);
+	assert(ykp_errno == YKP_EINVAL);
+	otp[20] = 'x';
+	assert(ykp_otp_decrypt(cfg, otp, &ticket) == 0);
+	assert(ykp_errno == YKP_EINVAL);
+
+	ykp_free_config(cfg);
+	ykp_free_config(other);
+}
+
+static void _test_validator(void)
+{
+	YKP_CONFIG *cfgs[NKEYS];
+	YKP_OTP_VALIDATOR *v;
+	struct ticket_st tickets[3 * NKEYS];
+	int errors[3 * NKEYS];
+	char buf[3 * NKEYS][2 * (FIXED_SIZE + 16) + 1];
+	const char *otps[3 * NKEYS];
+	struct config_st *ycfg;
+	int i;
+
+	for (i = 0; i < NKEYS; i++)
+		cfgs[i] = _test_config(i);
+	v = ykp_otp_validator_alloc(cfgs, NKEYS);
+	assert(v != NULL);
+
+	/* more than a batch, keys interleaved */
+	for (i = 0; i < 3 * NKEYS; i++) {
+		_test_otp(cfgs[(i * 7) % NKEYS], i, i % 256, buf[i]);
+		otps[i] = buf[i];
+	}
+	assert(ykp_otp_validate_batch(v, otps, 3 * NKEYS, tickets,
+				      errors) == 3 * NKEYS);
+	for (i = 0; i < 3 * NKEYS; i++) {
+		ycfg = (struct config_st *) ykp_core_config(cfgs[(i * 7) % NKEYS]);
+		assert(errors[i] == 0);
+		assert(tickets[i].useCtr == i);
+		assert(tickets[i].sessionCtr == i % 256);
+		assert(memcmp(tickets[i].uid, ycfg->uid, UID_SIZE) == 0);
+	}
+
+	/* failures in the middle of a batch leave the others valid */
+	buf[3][40] = buf[3][40] == 'c' ? 'b' : 'c';
+	buf[9][0] = 'v';
+	buf[9][1] = 'v';
+	buf[12][5] = '!';
+	otps[15] = "";
+	assert(ykp_otp_validate_batch(v, otps, 3 * NKEYS, NULL,
+				      errors) == 3 * NKEYS - 4);
+	for (i = 0; i < 3 * NKEYS; i++) {
+		switch (i) {
+		case 3:
+			assert(errors[i] == YKP_ENOMATCH);
+			break;
+		case 9:
+			assert(errors[i] == YKP_ENOCFG);
+			break;
+		case 12:
+		case 15:
+			assert(errors[i] == YKP_EINVAL);
+			break;
+		default:
+			assert(errors[i] == 0);
+		}
+	}
+
+	assert(ykp_otp_validate(v, buf[0], &tickets[0]) == 1);
+	assert(tickets[0].useCtr == 0);
+	assert(ykp_otp_validate(v, buf[9], NULL) == 0);
+	assert(ykp_errno == YKP_ENOCFG);
+
+	/* a key with the uid of another does not validate */
+	ycfg = (struct config_st *) ykp_core_config(cfgs[0]);
+	ycfg->uid[0] ^= 0xff;
+	_test_otp(cfgs[0], 1, 1, buf[0]);
+	assert(ykp_otp_validate(v, buf[0], NULL) == 0);
+	assert(ykp_errno == YKP_ENOMATCH);
+	ykp_otp_validator_free(v);
+
+	/* public ids are unique */
+	ykp_free_config(cfgs[1]);
+	cfgs[1] = cfgs[0];
+	assert(ykp_otp_validator_alloc(cfgs, 2) == NULL);
+	assert(ykp_errno == YKP_EINVAL);
+	cfgs[1] = NULL;
+	assert(ykp_otp_validator_alloc(cfgs, 2) == NULL);
+	assert(ykp_errno == YKP_ENOCFG);
+
+	ykp_free_config(cfgs[0]);
+	for (i = 2; i < NKEYS; i++)
+		ykp_free_config(cfgs[i]);
+}
+
+/* Responses checked against libyubikey, over more than a batch */
+static void _test_chalresp(void)
+{
+	YKP_CONFIG *cfg = _test_config(3);
+	struct config_st *ycfg = (struct config_st *) ykp_core_config(cfg);
+	unsigned char challenges[NKEYS][UID_SIZE];
+	unsigned char responses[NKEYS][16];
+	unsigned char block[16];
+	struct ticket_st state, tickets[NKEYS];
+	int errors[NKEYS];
+	int i, j;
+
+	memset(&state, 0, sizeof(state));
+	state.useCtr = 0x0102;
+	state.tstpl = 0x0304;
+	state.tstph = 0x05;
+	state.sessionCtr = 0x06;
+	state.rnd = 0x0708;
+	for (i = 0; i < NKEYS; i++) {
+		for (j = 0; j < UID_SIZE; j++)
+			challenges[i][j] = i * 13 + j;
+	}
+	assert(ykp_chalresp_yubico(cfg, challenges[0], NKEYS, &state,
+				   responses[0]) == NKEYS);
+
+	for (i = 0; i < NKEYS; i++) {
+		memcpy(block, responses[i], sizeof(block));
+		yubikey_aes_decrypt(block, ycfg->key);
+		assert(memcmp(block, challenges[i], UID_SIZE) == 0);
+		assert(block[6] == 0x02 && block[7] == 0x01);
+		assert(block[11] == 0x06);
+		assert(_yk_crc16(block, sizeof(block)) == 0xf0b8);
+	}
+
+	assert(ykp_chalresp_yubico_verify(cfg, challenges[0], responses[0],
+					  NKEYS, tickets, errors) == NKEYS);
+	for (i = 0; i < NKEYS; i++) {
+		assert(errors[i] == 0);
+		assert(tickets[i].useCtr == state.useCtr);
+		assert(tickets[i].tstpl == state.tstpl);
+		assert(tickets[i].rnd == state.rnd);
+	}
+
+	/* a response to another challenge, and a damaged one */
+	challenges[2][0] ^= 1;
+	responses[11][3] ^= 1;
+	assert(ykp_chalresp_yubico_verify(cfg, challenges[0], responses[0],
+					  NKEYS, NULL, errors) == NKEYS - 2);
+	assert(errors[2] == YKP_ENOMATCH);
+	assert(errors[11] == YKP_ENOMATCH);
+
+	assert(ykp_chalresp_yubico(NULL, challenges[0], 1, &state,
+				   responses[0]) == 0);
+	assert(ykp_errno == YKP_ENOCFG);
+	ykp_free_config(cfg);
+}
+
+int main(void)
+{
+	_test_decrypt();
+	_test_validator();
+	_test_chalresp();
+
+	return 0;
+}
@@ -0,0 +1,189 @@
+/* -*- mode:C; c-file-style: "bsd" -*- */
+/*
+ * Copyright (c) 2026 Yubico AB
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+#include <ykpers.h>
+#include <ykcore.h>
+#include <ykstatus.h>
+#include <ykdef.h>
+
+static void _test_build(void)
+{
+	YK_PLAN *plan = yk_plan_alloc();
+	YKP_CONFIG *cfg = ykp_alloc();
+	YK_NDEF *ndef = ykp_alloc_ndef();
+	YK_DEVICE_CONFIG *device_config = ykp_alloc_device_config();
+	unsigned char scan_map[sizeof(SCAN_MAP)] = SCAN_MAP;
+	unsigned char acc_code[ACC_CODE_SIZE] = { 1, 2, 3, 4, 5, 6 };
+	int i;
+
+	assert(plan != NULL);
+	assert(yk_plan_count(plan) == 0);
+
+	assert(yk_plan_add_command(plan, ykp_core_config(cfg), SLOT_CONFIG,
+				   NULL) == 1);
+	assert(yk_plan_add_command(plan, ykp_core_config(cfg), SLOT_CONFIG2,
+				   acc_code) == 1);
+	assert(ykp_construct_ndef_uri(ndef, "https://example.com/") == 1);
+	assert(yk_plan_add_ndef(plan, ndef, 1) == 1);
+	assert(yk_plan_add_device_config(plan, device_config) == 1);
+	assert(yk_plan_add_scan_map(plan, scan_map) == 1);
+	assert(yk_plan_count(plan) == 5);
+
+	/* bad arguments leave the plan as it was */
+	assert(yk_plan_add_ndef(plan, ndef, 3) == 0);
+	assert(yk_errno == YK_EINVALIDCMD);
+	assert(yk_plan_add_device_info(plan, scan_map, SLOT_DATA_SIZE + 1) == 0);
+	assert(yk_errno == YK_EINVAL);
+	assert(yk_plan_count(plan) == 5);
+
+	for (i = 5; i < YK_PLAN_MAX_STEPS; i++)
+		assert(yk_plan_add_ndef(plan, ndef, 2) == 1);
+	assert(yk_plan_add_ndef(plan, ndef, 2) == 0);
+	assert(yk_errno == YK_EWRONGSIZ);
+	assert(yk_plan_count(plan) == YK_PLAN_MAX_STEPS);
+
+	yk_plan_free(plan);
+	ykp_free_device_config(device_config);
+	ykp_free_ndef(ndef);
+	ykp_free_config(cfg);
+}
+
+static void _test_commit_args(void)
+{
+	size_t done = 42;
+
+	assert(yk_plan_commit(NULL, NULL, NULL, &done) == 0);
+	assert(yk_errno == YK_EINVAL);
+	assert(done == 0);
+	assert(yk_plan_count(NULL) == 0);
+	yk_plan_free(NULL);
+}
+
+static void _test_frame_count(void)
+{
+	unsigned char buf[SLOT_DATA_SIZE];
+
+	/* first and last part are always sent */
+	memset(buf, 0, sizeof(buf));
+	assert(yk_frame_count(SLOT_CONFIG, buf, sizeof(buf)) == 2);
+	buf[20] = 1;
+	assert(yk_frame_count(SLOT_CONFIG, buf, sizeof(buf)) == 3);
+	memset(buf, 0xff, sizeof(buf));
+	assert(yk_frame_count(SLOT_CONFIG, buf, sizeof(buf)) == 10);
+	assert(yk_frame_count(SLOT_CONFIG, buf, sizeof(buf) + 1) == 0);
+	assert(yk_errno == YK_EWRONGSIZ);
+}
+
+static void _test_update_planner(void)
+{
+	YK_STATUS *st = ykds_alloc();
+	struct status_st *t = (struct status_st *) st;
+	YKP_CONFIG *cfg = ykp_alloc();
+	struct config_st *ycfg;
+	int full_frames, frames;
+
+	t->versionMajor = 2;
+	t->versionMinor = 4;
+	t->touchLevel = CONFIG1_VALID;
+
+	/* a flag rotation becomes an update */
+	assert(ykp_configure_for(cfg, 1, st) == 1);
+	ycfg = (struct config_st *) ykp_core_config(cfg);
+	ykp_set_tktflag_APPEND_TAB1(cfg, true);
+	ykp_set_extflag_ALLOW_UPDATE(cfg, true);
+	assert(ykp_plan_config_write(cfg, st, NULL, &frames) == 1);
+	assert(ykp_command(cfg) == SLOT_UPDATE1);
+
+	/* a key needs a full write, which costs more frames */
+	memset(ycfg->key, 0x47, sizeof(ycfg->key));
+	assert(ykp_configure_command(cfg, SLOT_CONFIG) == 1);
+	assert(ykp_plan_config_write(cfg, st, NULL, &full_frames) == 1);
+	assert(ykp_command(cfg) == SLOT_CONFIG);
+	assert(full_frames > frames);
+	memset(ycfg->key, 0, sizeof(ycfg->key));
+
+	/* as do flags outside the update masks */
+	ykp_set_tktflag_OATH_HOTP(cfg, true);
+	assert(ykp_plan_config_write(cfg, st, NULL, &frames) == 1);
+	assert(ykp_command(cfg) == SLOT_CONFIG);
+	ykp_set_tktflag_OATH_HOTP(cfg, false);
+
+	/* an empty slot can't be updated */
+	assert(ykp_configure_for(cfg, 2, st) == 1);
+	ycfg = (struct config_st *) ykp_core_config(cfg);
+	ycfg->cfgFlags = 0;
+	ykp_set_extflag_ALLOW_UPDATE(cfg, true);
+	assert(ykp_plan_config_write(cfg, st, NULL, &frames) == 1);
+	assert(ykp_command(cfg) == SLOT_CONFIG2);
+	t->touchLevel = CONFIG1_VALID | CONFIG2_VALID;
+	assert(ykp_plan_config_write(cfg, st, NULL, &frames) == 1);
+	assert(ykp_command(cfg) == SLOT_UPDATE2);
+
+	/* nor can a key from before update */
+	t->versionMinor = 2;
+	assert(ykp_configure_command(cfg, SLOT_CONFIG2) == 1);
+	assert(ykp_plan_config_write(cfg, st, NULL, &frames) == 1);
+	assert(ykp_command(cfg) == SLOT_CONFIG2);
+
+	/* an update that can't be sent as one fails rather than becoming
+	   a full write */
+	t->versionMinor = 4;
+	ykp_configure_version(cfg, st);
+	assert(ykp_configure_command(cfg, SLOT_UPDATE2) == 1);
+	t->touchLevel = CONFIG1_VALID;
+	assert(ykp_plan_config_write(cfg, st, NULL, &frames) == 0);
+	assert(ykp_errno == YKP_EINVAL);
+	assert(ykp_command(cfg) == SLOT_UPDATE2);
+	t->touchLevel = CONFIG1_VALID | CONFIG2_VALID;
+	ykp_set_tktflag_OATH_HOTP(cfg, true);
+	assert(ykp_plan_config_write(cfg, st, NULL, &frames) == 0);
+	assert(ykp_errno == YKP_EINVAL);
+	assert(ykp_command(cfg) == SLOT_UPDATE2);
+	ykp_set_tktflag_OATH_HOTP(cfg, false);
+	assert(ykp_plan_config_write(cfg, st, NULL, &frames) == 1);
+	assert(ykp_command(cfg) == SLOT_UPDATE2);
+
+	ykp_free_config(cfg);
+	ykds_free(st);
+}
+
+int main(void)
+{
+	_test_build();
+	_test_commit_args();
+	_test_frame_count();
+	_test_update_planner();
+
+	return 0;
+}
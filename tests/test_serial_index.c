@@ -0,0 +1,145 @@
+/* -*- mode:C; c-file-style: "bsd" -*- */
+/*
+ * Copyright (c) 2026 Yubico AB
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+
+#include <ykcore.h>
+
+static const char *index_path = "test_serial_index.idx";
+static const char *victim_path = "test_serial_index.victim";
+
+static void _write_index(const char *contents)
+{
+	FILE *f = fopen(index_path, "w");
+
+	assert(f != NULL);
+	fputs(contents, f);
+	fclose(f);
+}
+
+static char *_read_index(void)
+{
+	static char buf[1024];
+	FILE *f = fopen(index_path, "r");
+	size_t n;
+
+	assert(f != NULL);
+	n = fread(buf, 1, sizeof(buf) - 1, f);
+	buf[n] = 0;
+	fclose(f);
+	return buf;
+}
+
+static void _test_open(unsigned int serial)
+{
+	YK_KEY *yk = yk_open_key_by_serial(serial);
+	unsigned int s;
+
+	assert(yk != NULL);
+	assert(yk_get_serial(yk, 1, 0, &s) == 1);
+	assert(s == serial);
+	assert(yk_close_key(yk) == 1);
+}
+
+/* A link waiting at a predictable temporary name is left alone */
+static void _test_tmp_link(void)
+{
+	char link_path[256], line[64];
+	FILE *f;
+
+	snprintf(link_path, sizeof(link_path), "%s.%ld", index_path,
+		 (long) getpid());
+	remove(link_path);
+	f = fopen(victim_path, "w");
+	assert(f != NULL);
+	fputs("victim\n", f);
+	fclose(f);
+	assert(symlink(victim_path, link_path) == 0);
+
+	_write_index("ykpers-serial-index 1\n1000003 0\n");
+	_test_open(1000003);
+	assert(strstr(_read_index(), "1000003 3\n") != NULL);
+
+	f = fopen(victim_path, "r");
+	assert(f != NULL);
+	assert(fgets(line, sizeof(line), f) != NULL);
+	fclose(f);
+	assert(strcmp(line, "victim\n") == 0);
+	remove(link_path);
+	remove(victim_path);
+}
+
+int main(void)
+{
+	/* emulated keys have serials 1000000 and up */
+	assert(yk_emulate(5) == 1);
+	assert(yk_init() == 1);
+	setenv("YK_SERIAL_INDEX", index_path, 1);
+	remove(index_path);
+
+	/* no index yet, all keys are scanned and indexed */
+	_test_open(1000003);
+	assert(strcmp(_read_index(), "ykpers-serial-index 1\n"
+		      "1000000 0\n1000001 1\n1000002 2\n1000003 3\n"
+		      "1000004 4\n") == 0);
+
+	/* a correct entry is used as is, the index is not rewritten */
+	_write_index("ykpers-serial-index 1\n42 7\n1000002 2\n");
+	_test_open(1000002);
+	assert(strstr(_read_index(), "42 7\n") != NULL);
+
+	/* a key that moved is found by a new scan */
+	_write_index("ykpers-serial-index 1\n42 7\n1000001 4\n");
+	_test_open(1000001);
+	assert(strstr(_read_index(), "42 7\n") == NULL);
+	assert(strstr(_read_index(), "1000001 1\n") != NULL);
+
+	_test_tmp_link();
+
+	/* garbage is ignored */
+	_write_index("not an index\n1000004 0\n");
+	_test_open(1000004);
+
+	assert(yk_open_key_by_serial(4711) == NULL);
+	assert(yk_errno == YK_ENOKEY);
+
+	/* without a file every lookup scans */
+	setenv("YK_SERIAL_INDEX", "", 1);
+	_test_open(1000000);
+
+	remove(index_path);
+	assert(yk_release() == 1);
+	assert(yk_emulate(0) == 1);
+	return 0;
+}
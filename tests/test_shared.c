@@ -0,0 +1,151 @@
+/* -*- mode:C; c-file-style: "bsd" -*- */
+/*
+ * Copyright (c) 2026 Yubico AB
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+#include <ykpers.h>
+#include <ykstatus.h>
+#include <ykdef.h>
+
+#include "ykthread.h"
+
+#define NTHREADS 8
+#define NCALLS 25
+
+static YK_SHARED *sh;
+static unsigned char challenge[SLOT_DATA_SIZE];
+static unsigned char expected[20];
+
+static YK_THREAD_FUNC(worker, arg)
+{
+	YK_STATUS *st = ykds_alloc();
+	unsigned char response[64];
+	unsigned int serial;
+	int i;
+
+	for (i = 0; i < NCALLS; i++) {
+		assert(yk_shared_challenge_response(sh, SLOT_CHAL_HMAC1, 0,
+						    sizeof(challenge),
+						    challenge,
+						    sizeof(response),
+						    response) == 1);
+		assert(memcmp(response, expected, sizeof(expected)) == 0);
+		assert(yk_shared_get_status(sh, st) == 1);
+		assert(ykds_version_major(st) == 4);
+		assert(yk_shared_get_serial(sh, 0, 0, &serial) == 1);
+		assert(serial == 1000000);
+	}
+	ykds_free(st);
+	return 0;
+}
+
+/* Calls from many threads on one key, which interleave if not queued */
+static void _test_threads(void)
+{
+	YK_THREAD_TYPE tids[NTHREADS];
+	unsigned char response[64];
+	int i;
+
+	for (i = 0; i < (int) sizeof(challenge); i++)
+		challenge[i] = i * 7 + 1;
+	assert(yk_shared_challenge_response(sh, SLOT_CHAL_HMAC1, 0,
+					    sizeof(challenge), challenge,
+					    sizeof(response), response) == 1);
+	memcpy(expected, response, sizeof(expected));
+
+	for (i = 0; i < NTHREADS; i++)
+		assert(YK_THREAD_CREATE(tids[i], worker, NULL) == 0);
+	for (i = 0; i < NTHREADS; i++)
+		YK_THREAD_JOIN(tids[i]);
+}
+
+static int append(YK_KEY *yk, void *arg)
+{
+	int *seen = arg;
+
+	seen[0]++;
+	seen[seen[0]] = seen[0];
+	return 1;
+}
+
+static int fail(YK_KEY *yk, void *arg)
+{
+	yk_errno = YK_EWRONGSIZ;
+	return 0;
+}
+
+static void _test_calls(void)
+{
+	volatile int cancel = 1;
+	int seen[4] = { 0 };
+	int i;
+
+	for (i = 0; i < 3; i++)
+		assert(yk_shared_call(sh, append, seen) == 1);
+	assert(seen[0] == 3 && seen[1] == 1 && seen[2] == 2 && seen[3] == 3);
+
+	/* the error is that of the owner thread */
+	yk_errno = 0;
+	assert(yk_shared_call(sh, fail, NULL) == 0);
+	assert(yk_errno == YK_EWRONGSIZ);
+
+	/* calls past their deadline or cancelled do not run */
+	assert(yk_shared_call_deadline(sh, append, seen, 1, NULL) == 0);
+	assert(yk_errno == YK_ETIMEOUT);
+	assert(yk_shared_call_deadline(sh, append, seen, 0, &cancel) == 0);
+	assert(yk_errno == YK_ECANCELED);
+	assert(seen[0] == 3);
+
+	assert(yk_shared_call(sh, NULL, NULL) == 0);
+	assert(yk_errno == YK_EINVAL);
+	assert(yk_shared_alloc(NULL) == NULL);
+	assert(yk_errno == YK_EINVAL);
+}
+
+int main(void)
+{
+	YK_KEY *yk;
+
+	assert(yk_emulate(1) == 1);
+	assert(yk_init() == 1);
+	assert((yk = yk_open_key(0)) != NULL);
+	assert((sh = yk_shared_alloc(yk)) != NULL);
+
+	_test_threads();
+	_test_calls();
+
+	assert(yk_shared_free(sh) == 1);
+	assert(yk_release() == 1);
+	assert(yk_emulate(0) == 1);
+
+	return 0;
+}
@@ -53,6 +53,8 @@ static void *start_thread(void *arg)
 {
 	YK_STATUS *st;
 	YK_KEY *yk = 0;
+	unsigned int serial = 0;
+	int index = (int) (size_t) arg;
 	yk_errno = 0;
 	ykp_errno = 0;
 	if(!yk_init()) {
@@ -61,11 +63,13 @@ static void *start_thread(void *arg)
 	}
 	st = ykds_alloc();
 
-	yk = yk_open_key(0);
-	if(yk != 0) {
-		yk_get_status(yk, st);
-		yk_close_key(yk);
-	}
+	yk = yk_open_key(index);
+	assert(yk != 0);
+	assert(yk_get_status(yk, st) == 1);
+	assert(ykds_version_major(st) == 4);
+	assert(yk_get_serial(yk, 0, 0, &serial) == 1);
+	assert(serial == 1000000 + (unsigned int) index);
+	yk_close_key(yk);
 
 	ykds_free(st);
 	yk_release();
@@ -78,10 +82,15 @@ static void _test_threaded_calls(void)
 	unsigned long i;
 	ALLOC_THREADS(times);
 
+	/* one emulated key per thread, all threads running at once */
+	assert(yk_emulate(times) == 1);
+	for(i = 0; i < times; i++) {
+		spawn_thread(threads[i], NULL, start_thread, (void *) (size_t) i);
+	}
 	for(i = 0; i < times; i++) {
-		spawn_thread(threads[i], NULL, start_thread, NULL);
 		join_thread(threads[i], NULL);
 	}
+	assert(yk_emulate(0) == 1);
 
 	FREE_THREADS;
 }
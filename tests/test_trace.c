@@ -0,0 +1,163 @@
+/* -*- mode:C; c-file-style: "bsd" -*- */
+/*
+ * Copyright (c) 2026 Yubico AB
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+#include <ykcore.h>
+#include <ykstatus.h>
+#include <ykdef.h>
+
+#include "yktrace.h"
+
+static const char *trace_path = "test_trace.trace";
+
+static void _add(FILE *f, uint32_t delta_us, unsigned char op, int ok,
+		 const unsigned char *data)
+{
+	struct yk_trace_rec r;
+	unsigned char buf[YK_TRACE_RECORD_SIZE];
+
+	memset(&r, 0, sizeof(r));
+	r.delta_us = delta_us;
+	r.op = op;
+	r.ok = ok;
+	if (data)
+		memcpy(r.data, data, YK_TRACE_DATA_SIZE);
+	yk_trace_pack(buf, &r);
+	assert(fwrite(buf, sizeof(buf), 1, f) == 1);
+}
+
+/* a key opened, its status read twice, the second time after gap_us */
+static void _write_trace(uint32_t gap_us, const unsigned char *write)
+{
+	const unsigned char ids[YK_TRACE_DATA_SIZE] = { 0x50, 0x10, 0x10, 0x00 };
+	const unsigned char status[YK_TRACE_DATA_SIZE] = {
+		0, 3, 4, 5, 7, 0x03, 0x00, 0 };
+	FILE *f = fopen(trace_path, "wb");
+
+	assert(f != NULL);
+	assert(fwrite(YK_TRACE_MAGIC, YK_TRACE_MAGIC_LEN, 1, f) == 1);
+	_add(f, 10, YK_TRACE_OPEN, 1, ids);
+	_add(f, 500, YK_TRACE_READ, 1, status);
+	if (write)
+		_add(f, 100, YK_TRACE_WRITE, 1, write);
+	_add(f, gap_us, YK_TRACE_READ, 1, status);
+	_add(f, 100, YK_TRACE_CLOSE, 1, NULL);
+	fclose(f);
+}
+
+static void _test_replay(void)
+{
+	YK_STATUS *st = ykds_alloc();
+	YK_KEY *yk;
+	uint64_t start;
+	int vid, pid;
+
+	_write_trace(50000, NULL);
+	assert(yk_trace_replay(trace_path, 1) == 1);
+
+	yk = yk_open_key(0);
+	assert(yk != NULL);
+	assert(yk_get_key_vid_pid(yk, &vid, &pid) == 1);
+	assert(vid == 0x1050 && pid == 0x0010);
+
+	/* the recorded 50 ms gap is kept */
+	start = yk_time_ms();
+	assert(yk_get_status(yk, st) == 1);
+	assert(yk_time_ms() - start >= 45);
+	assert(ykds_version_major(st) == 3);
+	assert(ykds_version_build(st) == 5);
+	assert(ykds_pgm_seq(st) == 7);
+	assert(ykds_touch_level(st) == 3);
+
+	/* the trace has run out */
+	assert(yk_get_status(yk, st) == 0);
+	assert(yk_errno == YK_ETRACE);
+	yk_close_key(yk);
+
+	assert(yk_trace_replay(NULL, 0) == 1);
+	ykds_free(st);
+}
+
+static void _test_mismatch(void)
+{
+	unsigned char update[YK_TRACE_DATA_SIZE] = { 0 };
+	YK_KEY *yk;
+
+	/* yk_force_key_update() writes a dummy report, record another one */
+	update[YK_TRACE_DATA_SIZE - 1] = DUMMY_REPORT_WRITE;
+	_write_trace(0, update);
+	assert(yk_trace_replay(trace_path, 0) == 1);
+	yk = yk_open_key(0);
+	assert(yk != NULL);
+	assert(yk_force_key_update(yk) == 1);
+	yk_close_key(yk);
+
+	update[0] = 1;
+	_write_trace(0, update);
+	assert(yk_trace_replay(trace_path, 0) == 1);
+	yk = yk_open_key(0);
+	assert(yk != NULL);
+	assert(yk_force_key_update(yk) == 0);
+	assert(yk_errno == YK_ETRACE);
+	yk_close_key(yk);
+
+	/* no key at another index */
+	assert(yk_trace_replay(trace_path, 0) == 1);
+	assert(yk_open_key(1) == NULL);
+	assert(yk_errno == YK_ETRACE);
+
+	assert(yk_trace_replay(NULL, 0) == 1);
+}
+
+static void _test_bad_file(void)
+{
+	FILE *f = fopen(trace_path, "wb");
+
+	assert(f != NULL);
+	assert(fwrite("NOTATRACE", 9, 1, f) == 1);
+	fclose(f);
+	assert(yk_trace_replay(trace_path, 0) == 0);
+	assert(yk_errno == YK_ETRACE);
+	assert(yk_trace_replay("nonexistent.trace", 0) == 0);
+	assert(yk_errno == YK_ETRACE);
+}
+
+int main(void)
+{
+	_test_replay();
+	_test_mismatch();
+	_test_bad_file();
+	remove(trace_path);
+
+	return 0;
+}
@@ -103,9 +103,30 @@ static void _test_yk_firmware(void)
 	}
 }
 
+/* An expired deadline or a set flag fails before the key is touched */
+static void _test_yk_deadline(void)
+{
+	uint64_t now = yk_time_ms();
+	unsigned int serial = 0;
+	volatile int cancel = 1;
+
+	assert(now > 0);
+	assert(yk_time_ms() >= now);
+
+	assert(yk_get_serial_deadline(NULL, 0, 0, &serial, 1, NULL) == 0);
+	assert(yk_errno == YK_ETIMEOUT);
+	assert(yk_get_serial_deadline(NULL, 0, 0, &serial, now + 60000,
+				      &cancel) == 0);
+	assert(yk_errno == YK_ECANCELED);
+	assert(yk_write_scan_map_deadline(NULL, NULL, 0, &cancel) == 0);
+	assert(yk_errno == YK_ECANCELED);
+	assert(yk_strerror(YK_ECANCELED) != NULL);
+}
+
 int main(void)
 {
 	_test_yk_firmware();
+	_test_yk_deadline();
 
 	return 0;
 }
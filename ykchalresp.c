@@ -33,21 +33,34 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <time.h>
+#ifdef _WIN32
+#include <windows.h>
+#endif
 
 #include <yubikey.h>
 #include <ykdef.h>
 #include <ykcore.h>
 #include <ykstatus.h>
+#include <ykpers.h>
 #include <ykpers-version.h>
 
+#include "ykthread.h"
+
+#define MAX_KEYS	64
+
 const char *usage =
 	"Usage: ykchalresp [options] [challenge]\n"
 	"\n"
 	"Options :\n"
 	"\n"
-	"\t-nkey     Send challenge to nth key found.\n"
+	"\t-nkey     Send challenge to nth key found, may be repeated.\n"
+	"\t-a        Send challenge to all keys found.\n"
+	"\t-f        With several keys, output only the first response\n"
+	"\t          and cancel the others.\n"
 	"\t-1        Send challenge to slot 1. This is the default.\n"
 	"\t-2        Send challenge to slot 2.\n"
 	"\t-H        Send a 64 byte HMAC challenge. This is the default.\n"
@@ -55,6 +68,9 @@ const char *usage =
 	"\t-N        Abort if Yubikey requires button press.\n"
 	"\t-x        Challenge is hex encoded.\n"
 	"\t-t        Time based challenge (for TOTP)\n"
+	"\t-pSECS    Time step of -t in seconds, 30 by default\n"
+	"\t-wSTEPS   With -t, output the codes from STEPS time steps before\n"
+	"\t          to STEPS time steps after the current one\n"
 	"\t-6        Output 6 digit HOTP/TOTP code\n"
 	"\t-8        Output 8 digit HOTP/TOTP code\n"
 	"\t-iFILE    Read challenge from a file instead, - for STDIN\n"
@@ -65,7 +81,7 @@ const char *usage =
 	"\n"
 	"\n"
 	;
-const char *optstring = "1268xvhHtYNVi:n:";
+const char *optstring = "1268xvhHtYNVi:n:afp:w:";
 
 static void report_yk_error(void)
 {
@@ -82,15 +98,27 @@ static void report_yk_error(void)
 
 extern int optind;
 
+static void totp_challenge(unsigned int t_counter, unsigned char *t_buf)
+{
+	memset(t_buf, 0, 8);
+	t_buf[7] = t_counter & 0x000000ff;
+	t_buf[6] = (t_counter & 0x0000ff00) >> 8;
+	t_buf[5] = (t_counter & 0x00ff0000) >>16;
+	t_buf[4] = (t_counter & 0xff000000) >>24;
+}
+
 static int parse_args(int argc, char **argv,
 	       int *slot, bool *verbose,
 	       unsigned char **challenge, unsigned int *challenge_len,
 	       bool *hmac, bool *may_block, bool *totp, int *digits,
-	       int *exit_code, int *key_index)
+	       int *exit_code, int *key_indexes, int *num_keys,
+	       bool *all_keys, bool *first_wins,
+	       unsigned int *t_counter, int *window)
 {
 	int c;
 	bool hex_encoded = false;
 	FILE *input = NULL;
+	int period = 30;
 
 	while((c = getopt(argc, argv, optstring)) != -1) {
 		switch (c) {
@@ -134,7 +162,35 @@ static int parse_args(int argc, char **argv,
 			}
 			break;
 		case 'n':
-			*key_index = atoi(optarg);
+			if (*num_keys == MAX_KEYS) {
+				fprintf(stderr, "At most %d keys can be given.\n",
+					MAX_KEYS);
+				*exit_code = 1;
+				return 0;
+			}
+			key_indexes[(*num_keys)++] = atoi(optarg);
+			break;
+		case 'a':
+			*all_keys = true;
+			break;
+		case 'f':
+			*first_wins = true;
+			break;
+		case 'p':
+			period = atoi(optarg);
+			if (period <= 0) {
+				fprintf(stderr, "Invalid time step '%s'.\n", optarg);
+				*exit_code = 1;
+				return 0;
+			}
+			break;
+		case 'w':
+			*window = atoi(optarg);
+			if (*window < 0 || *window > 1000) {
+				fprintf(stderr, "Invalid window '%s'.\n", optarg);
+				*exit_code = 1;
+				return 0;
+			}
 			break;
 		case 'V':
 			fputs(YKPERS_VERSION_STRING "\n", stderr);
@@ -153,16 +209,21 @@ static int parse_args(int argc, char **argv,
 		fputs(usage, stderr);
 		return 0;
 	}
+	if (*window && !(*totp && *hmac)) {
+		fprintf(stderr, "A window can only be used with -t.\n");
+		*exit_code = 1;
+		return 0;
+	}
+	if (*window && (*all_keys || *num_keys > 1)) {
+		fprintf(stderr, "A window can only be used with one key.\n");
+		*exit_code = 1;
+		return 0;
+	}
 	if (*totp && *hmac) {
-		unsigned int t_counter;
 		static unsigned char t_buf[8];
-		t_counter = (int) time(NULL);
-		t_counter = t_counter / 30;
-		memset(t_buf, 0, sizeof(t_buf));
-		t_buf[7] = t_counter & 0x000000ff;
-		t_buf[6] = (t_counter & 0x0000ff00) >> 8;
-		t_buf[5] = (t_counter & 0x00ff0000) >>16;
-		t_buf[4] = (t_counter & 0xff000000) >>24;
+		*t_counter = (unsigned int) time(NULL);
+		*t_counter = *t_counter / period;
+		totp_challenge(*t_counter, t_buf);
 		*challenge = (unsigned char *) &t_buf;
 		*challenge_len = 8;
 	}
@@ -243,14 +304,13 @@ static int check_firmware(YK_KEY *yk, bool verbose)
 
 static int challenge_response(YK_KEY *yk, int slot,
 		       unsigned char *challenge, unsigned int len,
-		       bool hmac, bool may_block, bool verbose, int digits )
+		       bool hmac, bool may_block, bool verbose, int digits,
+		       char *output, size_t output_len, volatile int *cancel)
 {
 	unsigned char response[SHA1_MAX_BLOCK_SIZE];
 	unsigned char output_buf[(SHA1_MAX_BLOCK_SIZE * 2) + 1];
 	int yk_cmd;
 	unsigned int expect_bytes = 0;
-	unsigned int offset;
-	unsigned int bin_code;
 	memset(response, 0, sizeof(response));
 	memset(output_buf, 0, sizeof(output_buf));
 
@@ -269,8 +329,9 @@ static int challenge_response(YK_KEY *yk, int slot,
 		return 0;
 	}
 
-	if(! yk_challenge_response(yk, yk_cmd, may_block, len,
-				challenge, sizeof(response), response)) {
+	if(! yk_challenge_response_deadline(yk, yk_cmd, may_block, len,
+					    challenge, sizeof(response),
+					    response, 0, cancel)) {
 		return 0;
 	}
 
@@ -278,18 +339,8 @@ static int challenge_response(YK_KEY *yk, int slot,
 	expect_bytes = (hmac == true) ? 20 : 16;
 
 	if(digits && hmac){
-		offset   =  response[19] & 0xf ;
-		bin_code = (response[offset]  & 0x7f) << 24
-			| (response[offset+1] & 0xff) << 16
-			| (response[offset+2] & 0xff) <<  8
-			| (response[offset+3] & 0xff) ;
-		if(digits == 8){
-			bin_code = bin_code % 100000000;
-			printf("%08u\n", bin_code);
-			return 1;
-		}
-		bin_code = bin_code % 1000000;
-		printf("%06i\n", bin_code);
+		snprintf(output, output_len, "%0*u", digits,
+			 ykp_oath_truncate(response, digits));
 		return 1;
 	}
 	if (hmac) {
@@ -297,11 +348,162 @@ static int challenge_response(YK_KEY *yk, int slot,
 	} else {
 		yubikey_modhex_encode((char *)output_buf, (char *)response, expect_bytes);
 	}
-	printf("%s\n", output_buf);
+	snprintf(output, output_len, "%s", output_buf);
 
 	return 1;
 }
 
+/* Several keys: the challenge is sent to every key from its own thread.
+   Either every response is output, one line per key with the time it
+   took, or only the first successful one, in which case the threads
+   still waiting are cancelled and reset their keys.  Only the worker
+   owning a key touches its handle, and the results are read by the
+   main thread after the join, or under the lock for the winner. */
+
+struct multi_state {
+	YK_MUTEX_TYPE lock;
+	YK_COND_TYPE cond;
+	int done;
+	struct multi_key *winner;
+	volatile int cancel;
+};
+
+struct multi_key {
+	int index;
+	YK_KEY *yk;
+	struct multi_state *state;
+	YK_THREAD_TYPE thread;
+	bool threaded;
+
+	/* request */
+	int slot;
+	unsigned char *challenge;
+	unsigned int challenge_len;
+	bool hmac, may_block, verbose;
+	int digits;
+
+	/* result */
+	int ok;
+	int err;
+	char output[(SHA1_MAX_BLOCK_SIZE * 2) + 1];
+	double latency_ms;
+};
+
+static double now_ms(void)
+{
+#ifdef _WIN32
+	LARGE_INTEGER freq, now;
+	QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&now);
+	return (double) now.QuadPart * 1000.0 / (double) freq.QuadPart;
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+#endif
+}
+
+static YK_THREAD_FUNC(multi_worker, arg)
+{
+	struct multi_key *key = arg;
+	struct multi_state *state = key->state;
+	double start = now_ms();
+
+	yk_errno = 0;
+	key->ok = check_firmware(key->yk, key->verbose) &&
+		challenge_response(key->yk, key->slot,
+				   key->challenge, key->challenge_len,
+				   key->hmac, key->may_block, key->verbose,
+				   key->digits, key->output,
+				   sizeof(key->output), &state->cancel);
+	key->latency_ms = now_ms() - start;
+	/* yk_errno is per thread, yk_usb_strerror() is not */
+	if (!key->ok)
+		key->err = yk_errno;
+
+	YK_MUTEX_LOCK(state->lock);
+	state->done++;
+	if (key->ok && !state->winner)
+		state->winner = key;
+	YK_COND_BROADCAST(state->cond);
+	YK_MUTEX_UNLOCK(state->lock);
+	return 0;
+}
+
+static void multi_report_error(const struct multi_key *key)
+{
+	if (key->err)
+		printf("%d: Yubikey core error: %s (%.1f ms)\n", key->index,
+		       yk_strerror(key->err), key->latency_ms);
+	else
+		printf("%d: failed (%.1f ms)\n", key->index, key->latency_ms);
+}
+
+static int multi_challenge_response(struct multi_key *keys, int num_keys,
+				    bool first_wins)
+{
+	struct multi_state state;
+	int exit_code = 0;
+	int i;
+
+	memset(&state, 0, sizeof(state));
+	if (YK_MUTEX_INIT(state.lock) != 0)
+		return 1;
+	if (YK_COND_INIT(state.cond) != 0) {
+		YK_MUTEX_DESTROY(state.lock);
+		return 1;
+	}
+
+	for (i = 0; i < num_keys; i++) {
+		YK_THREAD_TYPE t;
+
+		keys[i].state = &state;
+		if (YK_THREAD_CREATE(t, multi_worker, &keys[i]) == 0) {
+			keys[i].threaded = true;
+			keys[i].thread = t;
+		} else {
+			multi_worker(&keys[i]);
+		}
+	}
+
+	if (first_wins) {
+		YK_MUTEX_LOCK(state.lock);
+		while (!state.winner && state.done < num_keys)
+			YK_COND_WAIT(state.cond, state.lock);
+		if (state.winner) {
+			printf("%s\n", state.winner->output);
+			fflush(stdout);
+		} else {
+			exit_code = 1;
+		}
+		state.cancel = 1;
+		YK_MUTEX_UNLOCK(state.lock);
+	}
+
+	for (i = 0; i < num_keys; i++) {
+		if (keys[i].threaded)
+			YK_THREAD_JOIN(keys[i].thread);
+		if (first_wins) {
+			if (keys[i].verbose)
+				fprintf(stderr, "Key %d %s after %.1f ms\n",
+					keys[i].index,
+					&keys[i] == state.winner ? "answered first" :
+					keys[i].ok ? "answered" : "gave up",
+					keys[i].latency_ms);
+		} else if (keys[i].ok) {
+			printf("%d: %s (%.1f ms)\n", keys[i].index,
+			       keys[i].output, keys[i].latency_ms);
+		} else {
+			multi_report_error(&keys[i]);
+			exit_code = 1;
+		}
+	}
+
+	YK_COND_DESTROY(state.cond);
+	YK_MUTEX_DESTROY(state.lock);
+	return exit_code;
+}
+
 int main(int argc, char **argv)
 {
 	YK_KEY *yk = 0;
@@ -316,8 +518,14 @@ int main(int argc, char **argv)
 	int digits = 0;
 	unsigned char *challenge;
 	unsigned int challenge_len;
+	char output[(SHA1_MAX_BLOCK_SIZE * 2) + 1];
 	int slot = 1;
-	int key_index = 0;
+	int key_indexes[MAX_KEYS];
+	int num_keys = 0;
+	bool all_keys = false;
+	bool first_wins = false;
+	unsigned int t_counter = 0;
+	int window = 0;
 
 	yk_errno = 0;
 
@@ -325,7 +533,9 @@ int main(int argc, char **argv)
 			 &slot, &verbose,
 			 &challenge, &challenge_len,
 			 &hmac, &may_block, &totp, &digits,
-			 &exit_code, &key_index))
+			 &exit_code, key_indexes, &num_keys,
+			 &all_keys, &first_wins,
+			 &t_counter, &window))
 		exit(exit_code);
 
 	if (!yk_init()) {
@@ -333,23 +543,95 @@ int main(int argc, char **argv)
 		goto err;
 	}
 
-	if (!(yk = yk_open_key(key_index))) {
-		exit_code = 1;
+	if (all_keys || num_keys > 1) {
+		struct multi_key *keys = calloc(MAX_KEYS, sizeof(*keys));
+		int i, n = 0;
+
+		if (!keys) {
+			exit_code = 1;
+			goto err;
+		}
+		for (i = 0; all_keys ? i < MAX_KEYS : i < num_keys; i++) {
+			int index = all_keys ? i : key_indexes[i];
+			YK_KEY *k = yk_open_key(index);
+
+			if (!k) {
+				if (all_keys && yk_errno == YK_ENOKEY)
+					break;
+				fprintf(stderr, "Key %d: ", index);
+				report_yk_error();
+				continue;
+			}
+			keys[n].index = index;
+			keys[n].yk = k;
+			keys[n].slot = slot;
+			keys[n].challenge = challenge;
+			keys[n].challenge_len = challenge_len;
+			keys[n].hmac = hmac;
+			keys[n].may_block = may_block;
+			keys[n].verbose = verbose;
+			keys[n].digits = digits;
+			n++;
+		}
+		if (n == 0) {
+			yk_errno = YK_ENOKEY;
+			exit_code = 1;
+		} else {
+			exit_code = multi_challenge_response(keys, n, first_wins);
+			/* keys that could not be opened only matter when
+			   every response is wanted */
+			if (!all_keys && !first_wins && n < num_keys)
+				exit_code = 1;
+			yk_errno = 0;
+		}
+		for (i = 0; i < n; i++) {
+			if (!yk_close_key(keys[i].yk)) {
+				report_yk_error();
+				exit_code = 2;
+			}
+		}
+		free(keys);
+		error = exit_code != 0;
 		goto err;
 	}
 
-	if (! check_firmware(yk, verbose)) {
+	if (!(yk = yk_open_key(num_keys ? key_indexes[0] : 0))) {
 		exit_code = 1;
 		goto err;
 	}
 
-	if (! challenge_response(yk, slot,
-				 challenge, challenge_len,
-				 hmac, may_block, verbose, digits)) {
+	if (! check_firmware(yk, verbose)) {
 		exit_code = 1;
 		goto err;
 	}
 
+	if (window) {
+		/* One command at a time is all the key takes, what is
+		   saved is opening the key again for every step. */
+		int i;
+
+		for (i = -window; i <= window; i++) {
+			totp_challenge(t_counter + i, challenge);
+			if (! challenge_response(yk, slot,
+						 challenge, challenge_len,
+						 hmac, may_block, verbose, digits,
+						 output, sizeof(output), NULL)) {
+				exit_code = 1;
+				goto err;
+			}
+			printf("%+d %u %s\n", i, t_counter + i, output);
+		}
+	} else {
+		if (! challenge_response(yk, slot,
+					 challenge, challenge_len,
+					 hmac, may_block, verbose, digits,
+					 output, sizeof(output), NULL)) {
+			exit_code = 1;
+			goto err;
+		}
+		printf("%s\n", output);
+	}
+
 	exit_code = 0;
 	error = false;
 
@@ -0,0 +1,115 @@
+/* -*- mode:C; c-file-style: "bsd" -*- */
+/*
+ * Copyright (c) 2026 Yubico AB
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "ykcore_lcl.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static void *default_alloc(size_t size, void *ctx)
+{
+	return malloc(size);
+}
+
+static void default_free(void *ptr, void *ctx)
+{
+	free(ptr);
+}
+
+static void *(*alloc_fn)(size_t size, void *ctx) = default_alloc;
+static void (*free_fn)(void *ptr, void *ctx) = default_free;
+static void *alloc_ctx = NULL;
+
+int yk_set_allocator(void *(*alloc)(size_t size, void *ctx),
+		     void (*release)(void *ptr, void *ctx), void *ctx)
+{
+	if (!alloc != !release) {
+		yk_errno = YK_EINVAL;
+		return 0;
+	}
+	if (alloc) {
+		alloc_fn = alloc;
+		free_fn = release;
+		alloc_ctx = ctx;
+	} else {
+		alloc_fn = default_alloc;
+		free_fn = default_free;
+		alloc_ctx = NULL;
+	}
+	return 1;
+}
+
+void *_yk_malloc(size_t size)
+{
+	void *p = alloc_fn(size, alloc_ctx);
+	if (!p)
+		yk_errno = YK_ENOMEM;
+	return p;
+}
+
+void _yk_free(void *ptr)
+{
+	if (ptr)
+		free_fn(ptr, alloc_ctx);
+}
+
+/* Thread specific blocks are released by the thread destructor, possibly
+   after the allocator has been changed, so they remember who made them. */
+struct tsd_header {
+	union {
+		struct {
+			void (*free_fn)(void *ptr, void *ctx);
+			void *ctx;
+		} a;
+		long double align;
+	} u;
+};
+
+void *_yk_tsd_calloc(size_t size)
+{
+	struct tsd_header *h = alloc_fn(sizeof(*h) + size, alloc_ctx);
+
+	if (!h)
+		return NULL;
+	h->u.a.free_fn = free_fn;
+	h->u.a.ctx = alloc_ctx;
+	memset(h + 1, 0, size);
+	return h + 1;
+}
+
+void _yk_tsd_free(void *ptr)
+{
+	struct tsd_header *h;
+
+	if (!ptr)
+		return;
+	h = (struct tsd_header *) ptr - 1;
+	h->u.a.free_fn(h, h->u.a.ctx);
+}
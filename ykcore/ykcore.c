@@ -28,15 +28,22 @@
  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+/* for secure_getenv() */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
 #include "ykcore_lcl.h"
 #include "ykcore_backend.h"
 #include "yktsd.h"
 #include "ykbzero.h"
+#include "ykcrc.h"
 
-/* To get modhex and crc16 */
+/* To get modhex */
 #include <yubikey.h>
 
 #include <stdio.h>
+#include <stdlib.h>
 #ifndef _WIN32
 #include <unistd.h>
 #define Sleep(x) usleep((x)*1000)
@@ -65,14 +72,62 @@
  */
 #define WAIT_FOR_WRITE_FLAG	1150
 
+const struct yk_transport_st _yk_usb_transport = {
+	_ykusb_start,
+	_ykusb_stop,
+	_ykusb_open_device,
+	_ykusb_close_device,
+	_ykusb_read,
+	_ykusb_write,
+	_ykusb_get_vid_pid,
+	_ykusb_strerror,
+	_ykusb_list_devices,
+	_ykusb_open_device_id,
+	_ykusb_wait_for_change,
+};
+
+const struct yk_transport_st *_yk_transport = &_yk_usb_transport;
+
+/* A set-id program runs with the environment of its caller, so the
+   library only reads it when the program has the ids of its user. */
+const char *_yk_getenv(const char *name)
+{
+#if defined(HAVE_SECURE_GETENV)
+	return secure_getenv(name);
+#elif defined(_WIN32)
+	return getenv(name);
+#else
+	if (getuid() != geteuid() || getgid() != getegid())
+		return NULL;
+	return getenv(name);
+#endif
+}
+
 int yk_init(void)
 {
-	return _ykusb_start();
+#ifdef YK_TRANSPORT_ENV
+	const char *path;
+
+	/* Built with --enable-transport-env, unmodified programs can run on
+	   emulated keys and record and replay traces */
+	if ((path = _yk_getenv("YK_EMULATE")) != NULL) {
+		if (!yk_emulate(atoi(path)))
+			return 0;
+	} else if ((path = _yk_getenv("YK_TRACE_REPLAY")) != NULL) {
+		if (!yk_trace_replay(path,
+				     _yk_getenv("YK_TRACE_UNTIMED") == NULL))
+			return 0;
+	} else if ((path = _yk_getenv("YK_TRACE_RECORD")) != NULL) {
+		if (!yk_trace_record(path))
+			return 0;
+	}
+#endif
+	return _yk_transport->start();
 }
 
 int yk_release(void)
 {
-	return _ykusb_stop();
+	return _yk_transport->stop();
 }
 
 YK_KEY *yk_open_first_key(void)
@@ -80,9 +135,9 @@ YK_KEY *yk_open_first_key(void)
 	return yk_open_key(0);
 }
 
-YK_KEY *yk_open_key_vid_pid(int vid, const int* pids, size_t pids_len, int index)
+/* Keys are only handed out once they answer a status read */
+static YK_KEY *_yk_checked_open(YK_KEY *yk)
 {
-	YK_KEY *yk = _ykusb_open_device(vid, pids, pids_len, index);
 	int rc = yk_errno;
 
 	if (yk) {
@@ -98,6 +153,12 @@ YK_KEY *yk_open_key_vid_pid(int vid, const int* pids, size_t pids_len, int index
 	return yk;
 }
 
+YK_KEY *yk_open_key_vid_pid(int vid, const int* pids, size_t pids_len, int index)
+{
+	return _yk_checked_open(_yk_transport->open_device(vid, pids,
+							   pids_len, index));
+}
+
 static const int yubico_pids[] = {YUBIKEY_PID, NEO_OTP_PID, NEO_OTP_CCID_PID,
 	NEO_OTP_U2F_PID, NEO_OTP_U2F_CCID_PID, YK4_OTP_PID,
 	YK4_OTP_U2F_PID, YK4_OTP_CCID_PID, YK4_OTP_U2F_CCID_PID,
@@ -108,9 +169,44 @@ YK_KEY *yk_open_key(int index)
 	return yk_open_key_vid_pid(YUBICO_VID, yubico_pids, sizeof(yubico_pids) / sizeof(yubico_pids[0]), index);
 }
 
+int yk_list_keys(unsigned int *ids, size_t max, size_t *count)
+{
+	if ((!ids && max) || !count) {
+		yk_errno = YK_EINVAL;
+		return 0;
+	}
+	if (!_yk_transport->list_devices) {
+		yk_errno = YK_ENOTYETIMPL;
+		return 0;
+	}
+	return _yk_transport->list_devices(YUBICO_VID, yubico_pids,
+					   sizeof(yubico_pids) / sizeof(yubico_pids[0]),
+					   ids, max, count);
+}
+
+YK_KEY *yk_open_key_id(unsigned int id)
+{
+	if (!_yk_transport->open_device_id) {
+		yk_errno = YK_ENOTYETIMPL;
+		return NULL;
+	}
+	return _yk_checked_open(_yk_transport->open_device_id(YUBICO_VID, yubico_pids,
+							     sizeof(yubico_pids) / sizeof(yubico_pids[0]),
+							     id));
+}
+
+int yk_wait_for_change(unsigned int timeout_ms)
+{
+	if (!_yk_transport->wait_for_change) {
+		yk_errno = YK_ENOTYETIMPL;
+		return 0;
+	}
+	return _yk_transport->wait_for_change(timeout_ms);
+}
+
 int yk_close_key(YK_KEY *yk)
 {
-	return _ykusb_close_device(yk);
+	return _yk_transport->close_device(yk);
 }
 
 int yk_check_firmware_version(YK_KEY *k)
@@ -216,17 +312,16 @@ int yk_get_capabilities(YK_KEY *yk, uint8_t slot, unsigned int flags,
 	return 1;
 }
 
-static int _yk_write(YK_KEY *yk, uint8_t yk_cmd, unsigned char *buf, size_t len)
+/* Write a command and verify that it bumped the programming sequence.
+ * stat holds the status from before the write and is updated from the
+ * status report the key returns once it has processed the command, so a
+ * series of writes needs no separate status reads in between.
+ */
+static int _yk_write_step(YK_KEY *yk, uint8_t yk_cmd, unsigned char *buf,
+			  size_t len, YK_STATUS *stat)
 {
-	YK_STATUS stat;
-	int seq;
-
-	/* Get current sequence # from status block */
-
-	if (!yk_get_status(yk, &stat /*, 0*/))
-		return 0;
-
-	seq = stat.pgmSeq;
+	unsigned char data[FEATURE_RPT_SIZE];
+	int seq = stat->pgmSeq;
 
 	/* Write to Yubikey */
 	if (!yk_write_to_key(yk, yk_cmd, buf, len))
@@ -237,44 +332,50 @@ static int _yk_write(YK_KEY *yk, uint8_t yk_cmd, unsigned char *buf, size_t len)
 	 * want to get the bytes in the status message, but when writing configuration
 	 * we don't expect any data back.
 	 */
-	if(!yk_wait_for_key_status(yk, yk_cmd, 0, WAIT_FOR_WRITE_FLAG, false, SLOT_WRITE_FLAG, NULL))
+	if(!yk_wait_for_key_status(yk, yk_cmd, 0, WAIT_FOR_WRITE_FLAG, false, SLOT_WRITE_FLAG, data))
 		return 0;
 
-	/* Verify update */
+	/* Verify update, the status block follows the first byte of the
+	   report just as in yk_read_from_key() */
 
-	if (!yk_get_status(yk, &stat /*, 0*/))
-		return 0;
+	memcpy(stat, data + 1, sizeof(YK_STATUS));
+	stat->touchLevel = yk_endian_swap_16(stat->touchLevel);
 
 	yk_errno = YK_EWRITEERR;
 
 	/* when both configurations from a YubiKey is erased it will return
 	 * pgmSeq 0, if one is still configured after an erase pgmSeq is
 	 * counted up as usual. */
-	if((stat.touchLevel & (CONFIG1_VALID | CONFIG2_VALID)) == 0 && stat.pgmSeq == 0) {
+	if((stat->touchLevel & (CONFIG1_VALID | CONFIG2_VALID)) == 0 && stat->pgmSeq == 0) {
 		return 1;
 	}
-	return stat.pgmSeq != seq;
+	return stat->pgmSeq != seq;
 }
 
-int yk_write_device_info(YK_KEY *yk, unsigned char *buf, unsigned int len)
+static int _yk_write(YK_KEY *yk, uint8_t yk_cmd, unsigned char *buf, size_t len)
 {
-	return _yk_write(yk, SLOT_YK4_SET_DEVICE_INFO, buf, len);
+	YK_STATUS stat;
+
+	/* Get current sequence # from status block */
+
+	if (!yk_get_status(yk, &stat /*, 0*/))
+		return 0;
+
+	return _yk_write_step(yk, yk_cmd, buf, len, &stat);
 }
 
+/* The buffers for the write commands, also used when building a plan */
 
-int yk_write_command(YK_KEY *yk, YK_CONFIG *cfg, uint8_t command,
-		    unsigned char *acc_code)
+static size_t _yk_command_buf(unsigned char *buf, YK_CONFIG *cfg,
+			      unsigned char *acc_code)
 {
-	int ret;
-	unsigned char buf[sizeof(YK_CONFIG) + ACC_CODE_SIZE];
-
 	/* Update checksum and insert config block in buffer if present */
 
-	memset(buf, 0, sizeof(buf));
+	memset(buf, 0, sizeof(YK_CONFIG) + ACC_CODE_SIZE);
 
 	if (cfg) {
-		cfg->crc = ~yubikey_crc16 ((unsigned char *) cfg,
-					   sizeof(YK_CONFIG) - sizeof(cfg->crc));
+		cfg->crc = ~_yk_crc16((unsigned char *) cfg,
+				      sizeof(YK_CONFIG) - sizeof(cfg->crc));
 		cfg->crc = yk_endian_swap_16(cfg->crc);
 		memcpy(buf, cfg, sizeof(YK_CONFIG));
 	}
@@ -284,7 +385,56 @@ int yk_write_command(YK_KEY *yk, YK_CONFIG *cfg, uint8_t command,
 	if (acc_code)
 		memcpy(buf + sizeof(YK_CONFIG), acc_code, ACC_CODE_SIZE);
 
-	ret = _yk_write(yk, command, buf, sizeof(buf));
+	return sizeof(YK_CONFIG) + ACC_CODE_SIZE;
+}
+
+static int _yk_ndef_command(int confnum, uint8_t *command)
+{
+	switch(confnum) {
+		case 1:
+			*command = SLOT_NDEF;
+			break;
+		case 2:
+			*command = SLOT_NDEF2;
+			break;
+		default:
+			yk_errno = YK_EINVALIDCMD;
+			return 0;
+	}
+	return 1;
+}
+
+int yk_write_device_info(YK_KEY *yk, unsigned char *buf, unsigned int len)
+{
+	return _yk_write(yk, SLOT_YK4_SET_DEVICE_INFO, buf, len);
+}
+
+
+int yk_write_command(YK_KEY *yk, YK_CONFIG *cfg, uint8_t command,
+		    unsigned char *acc_code)
+{
+	int ret;
+	unsigned char buf[sizeof(YK_CONFIG) + ACC_CODE_SIZE];
+	size_t len = _yk_command_buf(buf, cfg, acc_code);
+
+	ret = _yk_write(yk, command, buf, len);
+	insecure_memzero(buf, sizeof(buf));
+	return ret;
+}
+
+int yk_command_frame_count(const YK_CONFIG *cfg, uint8_t command,
+			   unsigned char *acc_code)
+{
+	YK_CONFIG tmp;
+	unsigned char buf[sizeof(YK_CONFIG) + ACC_CODE_SIZE];
+	size_t len;
+	int ret;
+
+	if (cfg)
+		memcpy(&tmp, cfg, sizeof(tmp));
+	len = _yk_command_buf(buf, cfg ? &tmp : NULL, acc_code);
+	ret = yk_frame_count(command, buf, len);
+	insecure_memzero(&tmp, sizeof(tmp));
 	insecure_memzero(buf, sizeof(buf));
 	return ret;
 }
@@ -321,17 +471,8 @@ int yk_write_ndef2(YK_KEY *yk, YK_NDEF *ndef, int confnum)
 	unsigned char buf[sizeof(YK_NDEF)];
 	uint8_t command;
 
-	switch(confnum) {
-		case 1:
-			command = SLOT_NDEF;
-			break;
-		case 2:
-			command = SLOT_NDEF2;
-			break;
-		default:
-			yk_errno = YK_EINVALIDCMD;
-			return 0;
-	}
+	if (!_yk_ndef_command(confnum, &command))
+		return 0;
 
 	/* Insert config block in buffer */
 
@@ -356,6 +497,157 @@ int yk_write_scan_map(YK_KEY *yk, unsigned char *scan_map)
 	return _yk_write(yk, SLOT_SCAN_MAP, scan_map, strlen(SCAN_MAP));
 }
 
+/*
+ * A plan is an ordered list of writes to one key, prepared up front and
+ * then committed back to back on one handle.  The status is read once,
+ * each write is verified against the status report of the previous one.
+ */
+
+struct yk_plan_step {
+	uint8_t command;
+	unsigned char len;
+	unsigned char buf[SLOT_DATA_SIZE];
+};
+
+struct yk_plan_st {
+	size_t count;
+	struct yk_plan_step steps[YK_PLAN_MAX_STEPS];
+};
+
+YK_PLAN *yk_plan_alloc(void)
+{
+	YK_PLAN *plan = _yk_malloc(sizeof(YK_PLAN));
+
+	if (plan)
+		memset(plan, 0, sizeof(YK_PLAN));
+	return plan;
+}
+
+void yk_plan_free(YK_PLAN *plan)
+{
+	if (plan) {
+		insecure_memzero(plan, sizeof(YK_PLAN));
+		_yk_free(plan);
+	}
+}
+
+size_t yk_plan_count(const YK_PLAN *plan)
+{
+	return plan ? plan->count : 0;
+}
+
+static struct yk_plan_step *_yk_plan_step(YK_PLAN *plan, uint8_t command,
+					  size_t len)
+{
+	struct yk_plan_step *step;
+
+	if (!plan || len > SLOT_DATA_SIZE) {
+		yk_errno = YK_EINVAL;
+		return NULL;
+	}
+	if (plan->count == YK_PLAN_MAX_STEPS) {
+		yk_errno = YK_EWRONGSIZ;
+		return NULL;
+	}
+	step = &plan->steps[plan->count++];
+	memset(step, 0, sizeof(*step));
+	step->command = command;
+	step->len = len;
+	return step;
+}
+
+int yk_plan_add_command(YK_PLAN *plan, YK_CONFIG *cfg, uint8_t command,
+			unsigned char *acc_code)
+{
+	struct yk_plan_step *step;
+
+	if (!(step = _yk_plan_step(plan, command,
+				   sizeof(YK_CONFIG) + ACC_CODE_SIZE)))
+		return 0;
+	_yk_command_buf(step->buf, cfg, acc_code);
+	return 1;
+}
+
+int yk_plan_add_ndef(YK_PLAN *plan, YK_NDEF *ndef, int confnum)
+{
+	struct yk_plan_step *step;
+	uint8_t command;
+
+	if (!_yk_ndef_command(confnum, &command) ||
+	    !(step = _yk_plan_step(plan, command, sizeof(YK_NDEF))))
+		return 0;
+	memcpy(step->buf, ndef, sizeof(YK_NDEF));
+	return 1;
+}
+
+int yk_plan_add_device_config(YK_PLAN *plan, YK_DEVICE_CONFIG *device_config)
+{
+	struct yk_plan_step *step;
+
+	if (!(step = _yk_plan_step(plan, SLOT_DEVICE_CONFIG,
+				   sizeof(YK_DEVICE_CONFIG))))
+		return 0;
+	memcpy(step->buf, device_config, sizeof(YK_DEVICE_CONFIG));
+	return 1;
+}
+
+int yk_plan_add_scan_map(YK_PLAN *plan, unsigned char *scan_map)
+{
+	struct yk_plan_step *step;
+
+	if (!(step = _yk_plan_step(plan, SLOT_SCAN_MAP, strlen(SCAN_MAP))))
+		return 0;
+	memcpy(step->buf, scan_map, strlen(SCAN_MAP));
+	return 1;
+}
+
+int yk_plan_add_device_info(YK_PLAN *plan, unsigned char *buf,
+			    unsigned int len)
+{
+	struct yk_plan_step *step;
+
+	if (!(step = _yk_plan_step(plan, SLOT_YK4_SET_DEVICE_INFO, len)))
+		return 0;
+	memcpy(step->buf, buf, len);
+	return 1;
+}
+
+int yk_plan_commit(YK_KEY *yk, const YK_PLAN *plan, YK_STATUS *status,
+		   size_t *done)
+{
+	YK_STATUS stat;
+	size_t i;
+
+	if (done)
+		*done = 0;
+	if (!plan) {
+		yk_errno = YK_EINVAL;
+		return 0;
+	}
+
+	if (!yk_get_status(yk, &stat))
+		return 0;
+	if (status)
+		memcpy(status, &stat, sizeof(stat));
+
+	for (i = 0; i < plan->count; i++) {
+		const struct yk_plan_step *step = &plan->steps[i];
+		unsigned char buf[SLOT_DATA_SIZE];
+		int ret;
+
+		memcpy(buf, step->buf, step->len);
+		ret = _yk_write_step(yk, step->command, buf, step->len, &stat);
+		insecure_memzero(buf, sizeof(buf));
+		if (!ret)
+			return 0;
+		if (done)
+			*done = i + 1;
+		if (status)
+			memcpy(status, &stat, sizeof(stat));
+	}
+	return 1;
+}
+
 /*
  * This function is for doing HMAC-SHA1 or Yubico challenge-response with a key.
  */
@@ -398,33 +690,32 @@ int yk_challenge_response(YK_KEY *yk, uint8_t yk_cmd, int may_block,
 	return 1;
 }
 
+static int errno_tsd_init = -1;
+YK_DEFINE_TSD_METADATA(errno_key);
+YK_DEFINE_TSD_ONCE(errno_key);
+
+static void errno_key_create(void)
+{
+	errno_tsd_init = YK_TSD_INIT(errno_key, _yk_tsd_free) == 0 ? 1 : -1;
+}
+
 int * _yk_errno_location(void)
 {
-	static int tsd_init = 0;
 	static int nothread_errno = 0;
-	YK_DEFINE_TSD_METADATA(errno_key);
-	int rc = 0;
+	int *p;
 
-	if (tsd_init == 0) {
-		if ((rc = YK_TSD_INIT(errno_key, free)) == 0) {
-			tsd_init = 1;
-		} else {
-			tsd_init = -1;
-		}
-	}
+	YK_TSD_ONCE(errno_key, errno_key_create);
+	if (errno_tsd_init != 1)
+		return &nothread_errno;
 
-	if(YK_TSD_GET(int *, errno_key) == NULL) {
-		void *p = calloc(1, sizeof(int));
-		if (!p) {
-			tsd_init = -1;
-		} else {
-			YK_TSD_SET(errno_key, p);
+	if ((p = YK_TSD_GET(int *, errno_key)) == NULL) {
+		p = _yk_tsd_calloc(sizeof(int));
+		if (!p || YK_TSD_SET(errno_key, p) != 0) {
+			_yk_tsd_free(p);
+			return &nothread_errno;
 		}
 	}
-	if (tsd_init == 1) {
-		return YK_TSD_GET(int *, errno_key);
-	}
-	return &nothread_errno;
+	return p;
 }
 
 static const char *errtext[] = {
@@ -443,6 +734,9 @@ static const char *errtext[] = {
 	"invalid command for operation",
 	"expected only one YubiKey but several present",
 	"no data returned from device",
+	"invalid argument",
+	"operation cancelled",
+	"trace file error or mismatch",
 };
 const char *yk_strerror(int errnum)
 {
@@ -452,7 +746,7 @@ const char *yk_strerror(int errnum)
 }
 const char *yk_usb_strerror(void)
 {
-	return _ykusb_strerror();
+	return _yk_transport->strerror();
 }
 
 /* This function would've been better named 'yk_read_status_from_key'. Because
@@ -476,7 +770,7 @@ int yk_read_from_key(YK_KEY *yk, uint8_t slot,
 
 	memset(data, 0, sizeof(data));
 
-	if (!_ykusb_read(yk, REPORT_TYPE_FEATURE, 0, (char *)data, FEATURE_RPT_SIZE))
+	if (!_yk_transport->read(yk, REPORT_TYPE_FEATURE, 0, (char *)data, FEATURE_RPT_SIZE))
 		return 0;
 
 	/* This makes it apparent that there's some mysterious value in
@@ -512,8 +806,18 @@ int yk_wait_for_key_status(YK_KEY *yk, uint8_t slot, unsigned int flags,
 	slot = 0;
 
 	while (slept_time < max_time_ms) {
-		Sleep(sleepval);
-		slept_time += sleepval;
+		unsigned int nap = sleepval;
+		int err;
+
+		/* Give up, leaving the key ready for the next command, when
+		   a _deadline call runs out of time or is cancelled */
+		if ((err = _yk_deadline_check(&nap)) != 0) {
+			yk_force_key_update(yk);
+			yk_errno = err;
+			return 0;
+		}
+		Sleep(nap);
+		slept_time += nap;
 		/* exponential backoff, up to 500 ms */
 		sleepval *= 2;
 		if (sleepval > 500)
@@ -521,7 +825,7 @@ int yk_wait_for_key_status(YK_KEY *yk, uint8_t slot, unsigned int flags,
 
 		/* Read a status report from the key */
 		memset(data, 0, sizeof(data));
-		if (!_ykusb_read(yk, REPORT_TYPE_FEATURE, slot, (char *) &data, FEATURE_RPT_SIZE))
+		if (!_yk_transport->read(yk, REPORT_TYPE_FEATURE, slot, (char *) &data, FEATURE_RPT_SIZE))
 			return 0;
 #ifdef YK_DEBUG
 		_yk_hexdump(data, FEATURE_RPT_SIZE);
@@ -611,7 +915,7 @@ int yk_read_response_from_key(YK_KEY *yk, uint8_t slot, unsigned int flags,
 	while (*bytes_read + FEATURE_RPT_SIZE <= bufsize) {
 		memset(data, 0, sizeof(data));
 
-		if (!_ykusb_read(yk, REPORT_TYPE_FEATURE, 0, (char *)data, FEATURE_RPT_SIZE))
+		if (!_yk_transport->read(yk, REPORT_TYPE_FEATURE, 0, (char *)data, FEATURE_RPT_SIZE))
 			return 0;
 #ifdef YK_DEBUG
 		_yk_hexdump(data, FEATURE_RPT_SIZE);
@@ -624,7 +928,7 @@ int yk_read_response_from_key(YK_KEY *yk, uint8_t slot, unsigned int flags,
 				if (expect_bytes > 0) {
 					/* Size of response is known. Verify CRC. */
 					expect_bytes += 2;
-					int crc = yubikey_crc16(buf, expect_bytes);
+					int crc = _yk_crc16(buf, expect_bytes);
 					if (crc != YK_CRC_OK_RESIDUAL) {
 						yk_errno = YK_ECHECKSUM;
 						return 0;
@@ -669,29 +973,75 @@ int yk_read_response_from_key(YK_KEY *yk, uint8_t slot, unsigned int flags,
  * given in the 'slot' parameter (e.g. SLOT_CHAL_HMAC2 to send a HMAC-SHA1
  * challenge to slot 2).
  */
-int yk_write_to_key(YK_KEY *yk, uint8_t slot, const void *buf, int bufcount)
+static int _yk_build_frame(YK_FRAME *frame, uint8_t slot, const void *buf,
+			   int bufcount)
 {
-	YK_FRAME frame;
-	unsigned char repbuf[FEATURE_RPT_SIZE];
-	int i, seq;
-	int ret = 0;
-	unsigned char *ptr, *end;
+	int i;
 
-	if (bufcount > sizeof(frame.payload)) {
+	if (bufcount > sizeof(frame->payload)) {
 		yk_errno = YK_EWRONGSIZ;
 		return 0;
 	}
 
 	/* Insert data and set slot # */
 
-	memset(&frame, 0, sizeof(frame));
-	memcpy(frame.payload, buf, bufcount);
-	frame.slot = slot;
+	memset(frame, 0, sizeof(*frame));
+	memcpy(frame->payload, buf, bufcount);
+	frame->slot = slot;
 
 	/* Append slot checksum */
 
-	i = yubikey_crc16 (frame.payload, sizeof(frame.payload));
-	frame.crc = yk_endian_swap_16(i);
+	i = _yk_crc16(frame->payload, sizeof(frame->payload));
+	frame->crc = yk_endian_swap_16(i);
+	return 1;
+}
+
+/* Parts that are all zeroes except first and last are not sent, to
+   speed up the transfer */
+static int _yk_part_skipped(const unsigned char *part, int seq, int last)
+{
+	int i;
+
+	if (seq == 0 || last)
+		return 0;
+	for (i = 0; i < (FEATURE_RPT_SIZE - 1); i++) {
+		if (part[i])
+			return 0;
+	}
+	return 1;
+}
+
+/* The number of feature reports yk_write_to_key() sends for buf */
+int yk_frame_count(uint8_t slot, const void *buf, int bufcount)
+{
+	YK_FRAME frame;
+	unsigned char *ptr, *end;
+	int seq, count = 0;
+
+	if (!_yk_build_frame(&frame, slot, buf, bufcount))
+		return 0;
+
+	ptr = (unsigned char *) &frame;
+	end = (unsigned char *) &frame + sizeof(frame);
+	for (seq = 0; ptr < end; seq++, ptr += FEATURE_RPT_SIZE - 1) {
+		if (!_yk_part_skipped(ptr, seq,
+				      ptr + FEATURE_RPT_SIZE - 1 >= end))
+			count++;
+	}
+	insecure_memzero(&frame, sizeof(frame));
+	return count;
+}
+
+int yk_write_to_key(YK_KEY *yk, uint8_t slot, const void *buf, int bufcount)
+{
+	YK_FRAME frame;
+	unsigned char repbuf[FEATURE_RPT_SIZE];
+	int i, seq;
+	int ret = 0;
+	unsigned char *ptr, *end;
+
+	if (!_yk_build_frame(&frame, slot, buf, bufcount))
+		return 0;
 
 	/* Chop up the data into parts that fits into the payload of a
 	   feature report. Set the sequence number | 0x80 in the end
@@ -706,14 +1056,13 @@ int yk_write_to_key(YK_KEY *yk, uint8_t slot, const void *buf, int bufcount)
 	fprintf(stderr, "YK_DEBUG: Write %i bytes to YubiKey :\n", bufcount);
 #endif
 	for (seq = 0; ptr < end; seq++) {
-		int all_zeros = 1;
-		/* Ignore parts that are all zeroes except first and last
-		   to speed up the transfer */
+		int skip = _yk_part_skipped(ptr, seq,
+					    ptr + FEATURE_RPT_SIZE - 1 >= end);
 
 		for (i = 0; i < (FEATURE_RPT_SIZE - 1); i++) {
-			if ((repbuf[i] = *ptr++)) all_zeros = 0;
+			repbuf[i] = *ptr++;
 		}
-		if (all_zeros && (seq > 0) && (ptr < end))
+		if (skip)
 			continue;
 
 		/* sequence number goes into lower bits of last byte */
@@ -728,7 +1077,7 @@ int yk_write_to_key(YK_KEY *yk, uint8_t slot, const void *buf, int bufcount)
 #ifdef YK_DEBUG
 		_yk_hexdump(repbuf, FEATURE_RPT_SIZE);
 #endif
-		if (!_ykusb_write(yk, REPORT_TYPE_FEATURE, 0,
+		if (!_yk_transport->write(yk, REPORT_TYPE_FEATURE, 0,
 				  (char *)repbuf, FEATURE_RPT_SIZE))
 			goto end;
 	}
@@ -746,30 +1095,24 @@ int yk_force_key_update(YK_KEY *yk)
 
 	memset(buf, 0, sizeof(buf));
 	buf[FEATURE_RPT_SIZE - 1] = DUMMY_REPORT_WRITE; /* Invalid sequence = update only */
-	if (!_ykusb_write(yk, REPORT_TYPE_FEATURE, 0, (char *)buf, FEATURE_RPT_SIZE))
+	if (!_yk_transport->write(yk, REPORT_TYPE_FEATURE, 0, (char *)buf, FEATURE_RPT_SIZE))
 		return 0;
 
 	return 1;
 }
 
 int yk_get_key_vid_pid(YK_KEY *yk, int *vid, int *pid) {
-	return _ykusb_get_vid_pid(yk, vid, pid);
+	return _yk_transport->get_vid_pid(yk, vid, pid);
 }
 
 uint16_t yk_endian_swap_16(uint16_t x)
 {
-	static int testflag = -1;
-
-	if (testflag == -1) {
-		uint16_t testword = 0x0102;
-		unsigned char *testchars = (unsigned char *)&testword;
-		if (*testchars == '\1')
-			testflag = 1; /* Big endian arch, swap needed */
-		else
-			testflag = 0; /* Little endian arch, no swap needed */
-	}
+	/* Tested on every call rather than cached in a static, which
+	   threads would race on; compilers fold it to a constant */
+	uint16_t testword = 0x0102;
+	unsigned char *testchars = (unsigned char *)&testword;
 
-	if (testflag)
+	if (*testchars == '\1') /* Big endian arch, swap needed */
 		x = (x >> 8) | ((x & 0xff) << 8);
 
 	return x;
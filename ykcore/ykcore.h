@@ -64,6 +64,8 @@ typedef struct yk_nav_st YK_NAV;	/* Navigation structure.
 typedef struct yk_frame_st YK_FRAME;	/* Data frame for write operation */
 typedef struct ndef_st YK_NDEF;
 typedef struct yk_device_config_st YK_DEVICE_CONFIG;
+typedef struct yk_plan_st YK_PLAN;	/* Writes committed as a batch */
+typedef struct yk_shared_st YK_SHARED;	/* Key shared by threads */
 
 /*************************************************************************
  *
@@ -73,6 +75,31 @@ typedef struct yk_device_config_st YK_DEVICE_CONFIG;
 extern int yk_init(void);
 extern int yk_release(void);
 
+/* Allocator for the objects created by ykcore and ykpers, passing ctx
+   along.  NULL restores malloc() and free().  Set it before creating
+   objects, an object must be freed with the allocator that made it. */
+extern int yk_set_allocator(void *(*alloc)(size_t size, void *ctx),
+			    void (*release)(void *ptr, void *ctx),
+			    void *ctx);
+
+/* Record the reports exchanged with keys to a trace file, or replay a
+   trace in place of USB, delaying reports as recorded when timed is set.
+   Call with no keys open, NULL goes back to USB.  A recording is a new
+   file, yk_trace_record() fails if path exists.  In a library built
+   with --enable-transport-env, yk_init() starts one when
+   YK_TRACE_RECORD or YK_TRACE_REPLAY names a file, replay is untimed if
+   YK_TRACE_UNTIMED is set; set-id programs ignore them. */
+extern int yk_trace_record(const char *path);
+extern int yk_trace_replay(const char *path, int timed);
+
+/* Serve keys emulated in memory in place of USB, for tests without
+   hardware.  The keys follow the report protocol of a YubiKey 4 but
+   their challenge responses are not real HMAC-SHA1 or OTPs.  Call with
+   no keys open, 0 goes back to USB.  In a library built with
+   --enable-transport-env, yk_init() emulates the number of keys given
+   in YK_EMULATE, unless the program is set-id. */
+extern int yk_emulate(unsigned int keys);
+
 /*************************************************************************
  *
  * Functions to get and release the key itself.
@@ -83,6 +110,20 @@ extern YK_KEY *yk_open_first_key(void);
 extern YK_KEY *yk_open_key(int);	/* opens nth key available */
 extern YK_KEY *yk_open_key_vid_pid(int, const int*, size_t, int);
 extern int yk_close_key(YK_KEY *k);		/* closes a previously opened key */
+/* Opens the key with the serial number, or fails with YK_ENOKEY.  The
+   index each serial was found at is kept in $XDG_RUNTIME_DIR, or the
+   file in YK_SERIAL_INDEX, so that only that key is opened while it
+   stays in place.  Set-id programs ignore both variables. */
+extern YK_KEY *yk_open_key_by_serial(unsigned int serial);
+/* Keys present are told apart by an id, bus and address on USB, that
+   stays the same while the key is plugged in.  yk_list_keys() stores
+   the ids of up to max keys and their number in count, and
+   yk_open_key_id() opens one.  yk_wait_for_change() returns when a
+   device is plugged in or removed, or after timeout_ms.  All three fail
+   with YK_ENOTYETIMPL where the backend has no hotplug support. */
+extern int yk_list_keys(unsigned int *ids, size_t max, size_t *count);
+extern YK_KEY *yk_open_key_id(unsigned int id);
+extern int yk_wait_for_change(unsigned int timeout_ms);
 
 /*************************************************************************
  *
@@ -130,6 +171,12 @@ extern int yk_write_device_config(YK_KEY *yk, YK_DEVICE_CONFIG *device_config);
 extern int yk_write_scan_map(YK_KEY *yk, unsigned char *scan_map);
 /* Write something to the YubiKey (a command that is). */
 extern int yk_write_to_key(YK_KEY *yk, uint8_t slot, const void *buf, int bufcount);
+/* The number of feature reports yk_write_to_key() would send, parts
+   that are all zeroes are skipped. */
+extern int yk_frame_count(uint8_t slot, const void *buf, int bufcount);
+/* The same for yk_write_command() */
+extern int yk_command_frame_count(const YK_CONFIG *cfg, uint8_t command,
+				  unsigned char *acc_code);
 /* Do a challenge-response round with the key. */
 extern int yk_challenge_response(YK_KEY *yk, uint8_t yk_cmd, int may_block,
 				 unsigned int challenge_len, const unsigned char *challenge,
@@ -144,6 +191,126 @@ int yk_get_capabilities(YK_KEY *yk, uint8_t slot, unsigned int flags,
 /* Set the device info (TLV string) */
 int yk_write_device_info(YK_KEY *yk, unsigned char *buf, unsigned int len);
 
+/*************************************************************************
+ *
+ * Functions to write several commands to one key back to back.  The
+ * writes are stored in a plan, copied at the time they are added, and
+ * yk_plan_commit() performs them in order on one handle.  The status is
+ * read once, each write is verified from the status the key returns
+ * when it completes.  A commit stops at the first failed write, the
+ * number of completed writes is stored in done.
+ *
+ ****/
+#define YK_PLAN_MAX_STEPS	16
+
+extern YK_PLAN *yk_plan_alloc(void);
+extern void yk_plan_free(YK_PLAN *plan);
+extern size_t yk_plan_count(const YK_PLAN *plan);
+/* same arguments as the yk_write_* functions */
+extern int yk_plan_add_command(YK_PLAN *plan, YK_CONFIG *cfg, uint8_t command,
+			       unsigned char *acc_code);
+extern int yk_plan_add_ndef(YK_PLAN *plan, YK_NDEF *ndef, int confnum);
+extern int yk_plan_add_device_config(YK_PLAN *plan,
+				     YK_DEVICE_CONFIG *device_config);
+extern int yk_plan_add_scan_map(YK_PLAN *plan, unsigned char *scan_map);
+extern int yk_plan_add_device_info(YK_PLAN *plan, unsigned char *buf,
+				   unsigned int len);
+/* status, if not NULL, receives the status after the last completed write */
+extern int yk_plan_commit(YK_KEY *yk, const YK_PLAN *plan, YK_STATUS *status,
+			  size_t *done);
+
+/*************************************************************************
+ *
+ * Functions to share one key between threads.  yk_shared_alloc() takes
+ * over an open key and starts a thread that owns it.  Calls on the
+ * shared key are queued without locking and run by the owner one at a
+ * time, in the order they were queued, so that the reports of different
+ * calls never interleave.  Each call returns when it has run, with
+ * yk_errno set as the call left it.  yk_shared_free() runs the calls
+ * already queued, stops the owner and closes the key; no calls may be
+ * made during or after it.
+ *
+ ****/
+extern YK_SHARED *yk_shared_alloc(YK_KEY *yk);
+extern int yk_shared_free(YK_SHARED *sh);
+/* run fn(yk, arg) on the owner, returning what it returns */
+extern int yk_shared_call(YK_SHARED *sh, int (*fn)(YK_KEY *yk, void *arg),
+			  void *arg);
+extern int yk_shared_get_status(YK_SHARED *sh, YK_STATUS *status);
+extern int yk_shared_get_serial(YK_SHARED *sh, uint8_t slot,
+				unsigned int flags, unsigned int *serial);
+extern int yk_shared_challenge_response(YK_SHARED *sh, uint8_t yk_cmd,
+					int may_block,
+					unsigned int challenge_len,
+					const unsigned char *challenge,
+					unsigned int response_len,
+					unsigned char *response);
+extern int yk_shared_write_command(YK_SHARED *sh, YK_CONFIG *cfg,
+				   uint8_t command, unsigned char *acc_code);
+
+/*************************************************************************
+ *
+ * Variants of the calls that wait on the key, bounded by an absolute
+ * deadline in yk_time_ms() time and a cancellation flag that may be set
+ * from another thread.  0 and NULL disable either.  A call that runs
+ * out of time fails with YK_ETIMEOUT, a cancelled one with YK_ECANCELED,
+ * and the key is reset with yk_force_key_update().
+ *
+ ****/
+/* milliseconds from a monotonic clock */
+extern uint64_t yk_time_ms(void);
+extern int yk_get_serial_deadline(YK_KEY *yk, uint8_t slot, unsigned int flags,
+				  unsigned int *serial, uint64_t deadline_ms,
+				  volatile int *cancel);
+extern int yk_get_capabilities_deadline(YK_KEY *yk, uint8_t slot,
+					unsigned int flags,
+					unsigned char *capabilities,
+					unsigned int *len,
+					uint64_t deadline_ms,
+					volatile int *cancel);
+extern int yk_read_response_from_key_deadline(YK_KEY *yk, uint8_t slot,
+					      unsigned int flags, void *buf,
+					      unsigned int bufsize,
+					      unsigned int expect_bytes,
+					      unsigned int *bytes_read,
+					      uint64_t deadline_ms,
+					      volatile int *cancel);
+extern int yk_write_command_deadline(YK_KEY *yk, YK_CONFIG *cfg,
+				     uint8_t command, unsigned char *acc_code,
+				     uint64_t deadline_ms, volatile int *cancel);
+extern int yk_write_config_deadline(YK_KEY *yk, YK_CONFIG *cfg, int confnum,
+				    unsigned char *acc_code,
+				    uint64_t deadline_ms, volatile int *cancel);
+extern int yk_write_ndef2_deadline(YK_KEY *yk, YK_NDEF *ndef, int confnum,
+				   uint64_t deadline_ms, volatile int *cancel);
+extern int yk_write_device_config_deadline(YK_KEY *yk,
+					   YK_DEVICE_CONFIG *device_config,
+					   uint64_t deadline_ms,
+					   volatile int *cancel);
+extern int yk_write_scan_map_deadline(YK_KEY *yk, unsigned char *scan_map,
+				      uint64_t deadline_ms,
+				      volatile int *cancel);
+extern int yk_write_device_info_deadline(YK_KEY *yk, unsigned char *buf,
+					 unsigned int len,
+					 uint64_t deadline_ms,
+					 volatile int *cancel);
+extern int yk_plan_commit_deadline(YK_KEY *yk, const YK_PLAN *plan,
+				   YK_STATUS *status, size_t *done,
+				   uint64_t deadline_ms, volatile int *cancel);
+/* the deadline also covers the time spent queued */
+extern int yk_shared_call_deadline(YK_SHARED *sh,
+				   int (*fn)(YK_KEY *yk, void *arg),
+				   void *arg, uint64_t deadline_ms,
+				   volatile int *cancel);
+extern int yk_challenge_response_deadline(YK_KEY *yk, uint8_t yk_cmd,
+					  int may_block,
+					  unsigned int challenge_len,
+					  const unsigned char *challenge,
+					  unsigned int response_len,
+					  unsigned char *response,
+					  uint64_t deadline_ms,
+					  volatile int *cancel);
+
 
 /*************************************************************************
  *
@@ -176,6 +343,9 @@ extern uint16_t yk_endian_swap_16(uint16_t x);
 #define YK_EINVALIDCMD	0x0c	/* supplied command is invalid for this operation */
 #define YK_EMORETHANONE	0x0d    /* expected to find only one key but found more */
 #define YK_ENODATA	0x0e	/* no data was returned from a read */
+#define YK_EINVAL	0x0f	/* invalid argument */
+#define YK_ECANCELED	0x10	/* operation cancelled */
+#define YK_ETRACE	0x11	/* trace file error, or replay diverged */
 
 /* Flags for response reading. Use high numbers to not exclude the possibility
  * to combine these with for example SLOT commands from ykdef.h in the future.
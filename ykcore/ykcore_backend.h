@@ -51,4 +51,12 @@ int _ykusb_get_vid_pid(void *dev, int *vid, int *pid);
 
 const char *_ykusb_strerror(void);
 
+/* Listing by id and hotplug, YK_ENOTYETIMPL where not supported */
+int _ykusb_list_devices(int vendor_id, const int *product_ids,
+			size_t pids_len, unsigned int *ids, size_t max,
+			size_t *count);
+void *_ykusb_open_device_id(int vendor_id, const int *product_ids,
+			    size_t pids_len, unsigned int id);
+int _ykusb_wait_for_change(unsigned int timeout_ms);
+
 #endif	/* __YKCORE_BACKEND_H_INCLUDED__ */
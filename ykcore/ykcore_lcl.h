@@ -66,4 +66,63 @@ extern int yk_read_from_key(YK_KEY *k, uint8_t slot,
 			    void *buf, unsigned int bufsize,
 			    unsigned int *bufcount);
 
+/*************************************************************************
+ *
+ * Memory for objects handed out by ykcore and ykpers, taken from the
+ * allocator set with yk_set_allocator().
+ *
+ ****/
+extern void *_yk_malloc(size_t size);
+extern void _yk_free(void *ptr);
+/* zeroed, for thread specific data, released with _yk_tsd_free() */
+extern void *_yk_tsd_calloc(size_t size);
+extern void _yk_tsd_free(void *ptr);
+
+/*************************************************************************
+ *
+ * The transport the reports go through, the USB backend unless a trace
+ * is recorded or replayed.
+ *
+ ****/
+struct yk_transport_st {
+	int (*start)(void);
+	int (*stop)(void);
+	void *(*open_device)(int vendor_id, const int *product_ids,
+			     size_t pids_len, int index);
+	int (*close_device)(void *dev);
+	int (*read)(void *dev, int report_type, int report_number,
+		    char *buffer, int buffer_size);
+	int (*write)(void *dev, int report_type, int report_number,
+		     char *buffer, int buffer_size);
+	int (*get_vid_pid)(void *dev, int *vid, int *pid);
+	const char *(*strerror)(void);
+	/* NULL where keys cannot be listed by id or watched */
+	int (*list_devices)(int vendor_id, const int *product_ids,
+			    size_t pids_len, unsigned int *ids, size_t max,
+			    size_t *count);
+	void *(*open_device_id)(int vendor_id, const int *product_ids,
+				size_t pids_len, unsigned int id);
+	int (*wait_for_change)(unsigned int timeout_ms);
+};
+
+extern const struct yk_transport_st _yk_usb_transport;
+extern const struct yk_transport_st *_yk_transport;
+
+/*************************************************************************
+ *
+ * The deadline and cancellation flag of the _deadline call running on
+ * this thread.  Returns 0 when the wait may go on, YK_ETIMEOUT or
+ * YK_ECANCELED otherwise, and lowers sleep_ms to the time left.
+ *
+ ****/
+extern int _yk_deadline_check(unsigned int *sleep_ms);
+
+/* fn(yk, arg) bounded by a deadline and flag, as the _deadline calls */
+extern int _yk_deadline_run(int (*fn)(YK_KEY *yk, void *arg), YK_KEY *yk,
+			    void *arg, uint64_t deadline_ms,
+			    volatile int *cancel);
+
+/* getenv(), NULL in set-id programs */
+extern const char *_yk_getenv(const char *name);
+
 #endif	/* __YKCORE_LCL_H_INCLUDED__ */
@@ -32,6 +32,7 @@
 #include <libusb.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/time.h>
 
 #include "ykcore.h"
 #include "ykdef.h"
@@ -43,6 +44,8 @@
 static int ykl_errno;
 static int libusb_inited = 0;
 static libusb_context *usb_ctx = NULL;
+static int hotplug_registered = 0;
+static libusb_hotplug_callback_handle hotplug_handle;
 
 /*************************************************************************
  **  function _ykusb_write						**
@@ -152,45 +155,50 @@ int _ykusb_start(void)
 extern int _ykusb_stop(void)
 {
 	if (libusb_inited == 1) {
+		/* which also drops the hotplug callback */
 		libusb_exit(usb_ctx);
 		usb_ctx = NULL;
 		libusb_inited = 0;
+		hotplug_registered = 0;
 		return 1;
 	}
 	yk_errno = YK_EUSBERR;
 	return 0;
 }
 
-void *_ykusb_open_device(int vendor_id, const int *product_ids, size_t pids_len, int index)
+static int device_matches(libusb_device *dev, int vendor_id,
+			  const int *product_ids, size_t pids_len)
 {
-	libusb_device *dev = NULL;
-	libusb_device_handle *h = NULL;
 	struct libusb_device_descriptor desc;
-	libusb_device **list;
-	ssize_t cnt = libusb_get_device_list(usb_ctx, &list);
-	ssize_t i = 0;
-	int rc = YK_ENOKEY;
-	const int desired_cfg = 1;
-	int found = 0;
+	size_t j;
 
-	for (i = 0; i < cnt; i++) {
-		ykl_errno = libusb_get_device_descriptor(list[i], &desc);
-		if (ykl_errno != 0)
-			goto done;
-
-		if (desc.idVendor == vendor_id) {
-			size_t j;
-			for(j = 0; j < pids_len; j++) {
-				if (desc.idProduct == product_ids[j]) {
-					found++;
-					if (found-1 == index) {
-						dev = list[i];
-						break;
-					}
-				}
-			}
-		}
+	ykl_errno = libusb_get_device_descriptor(dev, &desc);
+	if (ykl_errno != 0)
+		return -1;
+	if (desc.idVendor != vendor_id)
+		return 0;
+	for (j = 0; j < pids_len; j++) {
+		if (desc.idProduct == product_ids[j])
+			return 1;
 	}
+	return 0;
+}
+
+/* Keys are told apart by bus and address, which stay the same while
+   they are plugged in */
+static unsigned int device_id(libusb_device *dev)
+{
+	return (libusb_get_bus_number(dev) << 8) |
+		libusb_get_device_address(dev);
+}
+
+/* Open dev, one of list, and free the list */
+static libusb_device_handle *open_listed(libusb_device **list,
+					 libusb_device *dev)
+{
+	libusb_device_handle *h = NULL;
+	int rc = YK_ENOKEY;
+	const int desired_cfg = 1;
 
 	if (dev) {
 		int current_cfg;
@@ -222,6 +230,114 @@ void *_ykusb_open_device(int vendor_id, const int *product_ids, size_t pids_len,
 	return h;
 }
 
+void *_ykusb_open_device(int vendor_id, const int *product_ids, size_t pids_len, int index)
+{
+	libusb_device *dev = NULL;
+	libusb_device **list;
+	ssize_t cnt = libusb_get_device_list(usb_ctx, &list);
+	ssize_t i = 0;
+	int found = 0;
+
+	for (i = 0; i < cnt; i++) {
+		int m = device_matches(list[i], vendor_id, product_ids,
+				       pids_len);
+		if (m < 0) {
+			libusb_free_device_list(list, 1);
+			yk_errno = YK_ENOKEY;
+			return NULL;
+		}
+		if (m && found++ == index) {
+			dev = list[i];
+			break;
+		}
+	}
+	return open_listed(list, dev);
+}
+
+/* The id may be stale or come from a caller, so the device is only
+   opened, with its driver detached, when it is one of ours */
+void *_ykusb_open_device_id(int vendor_id, const int *product_ids,
+			    size_t pids_len, unsigned int id)
+{
+	libusb_device *dev = NULL;
+	libusb_device **list;
+	ssize_t cnt = libusb_get_device_list(usb_ctx, &list);
+	ssize_t i;
+
+	for (i = 0; i < cnt; i++) {
+		if (device_id(list[i]) == id) {
+			if (device_matches(list[i], vendor_id, product_ids,
+					   pids_len) == 1)
+				dev = list[i];
+			break;
+		}
+	}
+	return open_listed(list, dev);
+}
+
+int _ykusb_list_devices(int vendor_id, const int *product_ids,
+			size_t pids_len, unsigned int *ids, size_t max,
+			size_t *count)
+{
+	libusb_device **list;
+	ssize_t cnt = libusb_get_device_list(usb_ctx, &list);
+	ssize_t i;
+	size_t n = 0;
+
+	if (cnt < 0) {
+		ykl_errno = cnt;
+		yk_errno = YK_EUSBERR;
+		return 0;
+	}
+	for (i = 0; i < cnt && n < max; i++) {
+		if (device_matches(list[i], vendor_id, product_ids,
+				   pids_len) == 1)
+			ids[n++] = device_id(list[i]);
+	}
+	libusb_free_device_list(list, 1);
+	*count = n;
+	return 1;
+}
+
+static int hotplug_callback(libusb_context *ctx, libusb_device *dev,
+			    libusb_hotplug_event event, void *user_data)
+{
+	return 0;	/* stay registered */
+}
+
+/* Registered on the first wait, the callback only makes the wait
+   return, the caller lists the devices again */
+int _ykusb_wait_for_change(unsigned int timeout_ms)
+{
+	struct timeval tv;
+
+	if (!libusb_has_capability(LIBUSB_CAP_HAS_HOTPLUG)) {
+		yk_errno = YK_ENOTYETIMPL;
+		return 0;
+	}
+	if (!hotplug_registered) {
+		ykl_errno = libusb_hotplug_register_callback(usb_ctx,
+			LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED |
+			LIBUSB_HOTPLUG_EVENT_DEVICE_LEFT, 0,
+			LIBUSB_HOTPLUG_MATCH_ANY, LIBUSB_HOTPLUG_MATCH_ANY,
+			LIBUSB_HOTPLUG_MATCH_ANY, hotplug_callback, NULL,
+			&hotplug_handle);
+		if (ykl_errno != 0) {
+			yk_errno = YK_EUSBERR;
+			return 0;
+		}
+		hotplug_registered = 1;
+	}
+	tv.tv_sec = timeout_ms / 1000;
+	tv.tv_usec = (timeout_ms % 1000) * 1000;
+	ykl_errno = libusb_handle_events_timeout_completed(usb_ctx, &tv, NULL);
+	if (ykl_errno != 0 && ykl_errno != LIBUSB_ERROR_INTERRUPTED) {
+		yk_errno = YK_EUSBERR;
+		return 0;
+	}
+	return 1;
+}
+
 int _ykusb_close_device(void *yk)
 {
 	libusb_attach_kernel_driver(yk, 0);
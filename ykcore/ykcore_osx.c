@@ -253,6 +253,27 @@ int _ykusb_get_vid_pid(void *yk, int *vid, int *pid) {
 	return 1;
 }
 
+int _ykusb_list_devices(int vendor_id, const int *product_ids,
+			size_t pids_len, unsigned int *ids, size_t max,
+			size_t *count)
+{
+	yk_errno = YK_ENOTYETIMPL;
+	return 0;
+}
+
+void *_ykusb_open_device_id(int vendor_id, const int *product_ids,
+			    size_t pids_len, unsigned int id)
+{
+	yk_errno = YK_ENOTYETIMPL;
+	return NULL;
+}
+
+int _ykusb_wait_for_change(unsigned int timeout_ms)
+{
+	yk_errno = YK_ENOTYETIMPL;
+	return 0;
+}
+
 const char *_ykusb_strerror()
 {
 	switch (_ykusb_IOReturn) {
@@ -0,0 +1,258 @@
+/* -*- mode:C; c-file-style: "bsd" -*- */
+/*
+ * Copyright (c) 2026 Yubico AB
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Deadlines and cancellation for the calls that wait on the key.
+ *
+ * The _deadline variants put an absolute deadline and a cancellation
+ * flag in thread specific data for the duration of the call, and
+ * yk_wait_for_key_status(), which every wait goes through, checks them
+ * on each poll.  A call that runs out of time or is cancelled resets
+ * the key with yk_force_key_update() so that it is ready for the next
+ * command.
+ */
+
+#include "ykcore_lcl.h"
+#include "yktsd.h"
+
+#include <string.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+/* Poll at least this often for a cancellation flag */
+#define CANCEL_POLL_MS	100
+
+struct deadline_st {
+	uint64_t deadline_ms;
+	volatile int *cancel;
+};
+
+static int deadline_tsd_init = -1;
+YK_DEFINE_TSD_METADATA(deadline_key);
+YK_DEFINE_TSD_ONCE(deadline_key);
+
+static void deadline_key_create(void)
+{
+	deadline_tsd_init =
+		YK_TSD_INIT(deadline_key, _yk_tsd_free) == 0 ? 1 : -1;
+}
+
+static struct deadline_st *deadline_get(int create)
+{
+	struct deadline_st *d;
+
+	YK_TSD_ONCE(deadline_key, deadline_key_create);
+	if (deadline_tsd_init != 1)
+		return NULL;
+
+	d = YK_TSD_GET(struct deadline_st *, deadline_key);
+	if (d == NULL && create) {
+		d = _yk_tsd_calloc(sizeof(struct deadline_st));
+		if (d && YK_TSD_SET(deadline_key, d) != 0) {
+			_yk_tsd_free(d);
+			d = NULL;
+		}
+	}
+	return d;
+}
+
+uint64_t yk_time_ms(void)
+{
+#ifdef _WIN32
+	return GetTickCount64();
+#else
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+#endif
+}
+
+int _yk_deadline_check(unsigned int *sleep_ms)
+{
+	struct deadline_st *d = deadline_get(0);
+	uint64_t now;
+
+	if (d == NULL)
+		return 0;
+	if (d->cancel) {
+		if (*d->cancel)
+			return YK_ECANCELED;
+		if (*sleep_ms > CANCEL_POLL_MS)
+			*sleep_ms = CANCEL_POLL_MS;
+	}
+	if (d->deadline_ms) {
+		now = yk_time_ms();
+		if (now >= d->deadline_ms)
+			return YK_ETIMEOUT;
+		if (*sleep_ms > d->deadline_ms - now)
+			*sleep_ms = d->deadline_ms - now;
+	}
+	return 0;
+}
+
+/* Nested calls keep the earlier deadline and the inner flag */
+static int deadline_push(struct deadline_st *saved, uint64_t deadline_ms,
+			 volatile int *cancel)
+{
+	struct deadline_st *d = deadline_get(1);
+	unsigned int nap = 0;
+	int err;
+
+	if (d == NULL) {
+		yk_errno = YK_ENOMEM;
+		return 0;
+	}
+	memcpy(saved, d, sizeof(*saved));
+	if (deadline_ms && (!d->deadline_ms || deadline_ms < d->deadline_ms))
+		d->deadline_ms = deadline_ms;
+	if (cancel)
+		d->cancel = cancel;
+
+	/* Nothing has been sent to the key yet, so no reset is needed */
+	if ((err = _yk_deadline_check(&nap)) != 0) {
+		memcpy(d, saved, sizeof(*d));
+		yk_errno = err;
+		return 0;
+	}
+	return 1;
+}
+
+static void deadline_pop(const struct deadline_st *saved)
+{
+	struct deadline_st *d = deadline_get(0);
+
+	if (d)
+		memcpy(d, saved, sizeof(*d));
+}
+
+#define DEADLINE_CALL(call)					\
+	struct deadline_st saved;				\
+	int ret;						\
+								\
+	if (!deadline_push(&saved, deadline_ms, cancel))	\
+		return 0;					\
+	ret = call;						\
+	deadline_pop(&saved);					\
+	return ret
+
+int _yk_deadline_run(int (*fn)(YK_KEY *yk, void *arg), YK_KEY *yk, void *arg,
+		     uint64_t deadline_ms, volatile int *cancel)
+{
+	DEADLINE_CALL(fn(yk, arg));
+}
+
+int yk_get_serial_deadline(YK_KEY *yk, uint8_t slot, unsigned int flags,
+			   unsigned int *serial, uint64_t deadline_ms,
+			   volatile int *cancel)
+{
+	DEADLINE_CALL(yk_get_serial(yk, slot, flags, serial));
+}
+
+int yk_get_capabilities_deadline(YK_KEY *yk, uint8_t slot, unsigned int flags,
+				 unsigned char *capabilities, unsigned int *len,
+				 uint64_t deadline_ms, volatile int *cancel)
+{
+	DEADLINE_CALL(yk_get_capabilities(yk, slot, flags, capabilities, len));
+}
+
+int yk_read_response_from_key_deadline(YK_KEY *yk, uint8_t slot,
+				       unsigned int flags, void *buf,
+				       unsigned int bufsize,
+				       unsigned int expect_bytes,
+				       unsigned int *bytes_read,
+				       uint64_t deadline_ms,
+				       volatile int *cancel)
+{
+	DEADLINE_CALL(yk_read_response_from_key(yk, slot, flags, buf, bufsize,
+						expect_bytes, bytes_read));
+}
+
+int yk_write_command_deadline(YK_KEY *yk, YK_CONFIG *cfg, uint8_t command,
+			      unsigned char *acc_code, uint64_t deadline_ms,
+			      volatile int *cancel)
+{
+	DEADLINE_CALL(yk_write_command(yk, cfg, command, acc_code));
+}
+
+int yk_write_config_deadline(YK_KEY *yk, YK_CONFIG *cfg, int confnum,
+			     unsigned char *acc_code, uint64_t deadline_ms,
+			     volatile int *cancel)
+{
+	DEADLINE_CALL(yk_write_config(yk, cfg, confnum, acc_code));
+}
+
+int yk_write_ndef2_deadline(YK_KEY *yk, YK_NDEF *ndef, int confnum,
+			    uint64_t deadline_ms, volatile int *cancel)
+{
+	DEADLINE_CALL(yk_write_ndef2(yk, ndef, confnum));
+}
+
+int yk_write_device_config_deadline(YK_KEY *yk,
+				    YK_DEVICE_CONFIG *device_config,
+				    uint64_t deadline_ms, volatile int *cancel)
+{
+	DEADLINE_CALL(yk_write_device_config(yk, device_config));
+}
+
+int yk_write_scan_map_deadline(YK_KEY *yk, unsigned char *scan_map,
+			       uint64_t deadline_ms, volatile int *cancel)
+{
+	DEADLINE_CALL(yk_write_scan_map(yk, scan_map));
+}
+
+int yk_write_device_info_deadline(YK_KEY *yk, unsigned char *buf,
+				  unsigned int len, uint64_t deadline_ms,
+				  volatile int *cancel)
+{
+	DEADLINE_CALL(yk_write_device_info(yk, buf, len));
+}
+
+int yk_plan_commit_deadline(YK_KEY *yk, const YK_PLAN *plan,
+			    YK_STATUS *status, size_t *done,
+			    uint64_t deadline_ms, volatile int *cancel)
+{
+	DEADLINE_CALL(yk_plan_commit(yk, plan, status, done));
+}
+
+int yk_challenge_response_deadline(YK_KEY *yk, uint8_t yk_cmd, int may_block,
+				   unsigned int challenge_len,
+				   const unsigned char *challenge,
+				   unsigned int response_len,
+				   unsigned char *response,
+				   uint64_t deadline_ms, volatile int *cancel)
+{
+	DEADLINE_CALL(yk_challenge_response(yk, yk_cmd, may_block,
+					    challenge_len, challenge,
+					    response_len, response));
+}
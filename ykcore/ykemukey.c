@@ -0,0 +1,202 @@
+/* -*- mode:C; c-file-style: "bsd" -*- */
+/*
+ * Copyright (c) 2026 Yubico AB
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * The emulated key behind yk_emulate() and the USB gadget in
+ * tests/gadget.c.  Written frames are assembled and acted on: writes to
+ * configuration slots bump the programming sequence, and serial number,
+ * capability and challenge requests queue a response that is read back
+ * one report at a time.  Challenge responses are a fixed function of
+ * the key, slot and challenge, not real HMAC-SHA1 or Yubico OTP.
+ */
+
+#include "ykcore_lcl.h"
+#include "ykcore_backend.h"
+#include "ykemukey.h"
+#include "ykcrc.h"
+
+#include <string.h>
+
+void _yk_emu_key_init(struct yk_emu_key *k, unsigned int serial)
+{
+	memset(k, 0, sizeof(*k));
+	k->serial = serial;
+	k->status.versionMajor = 4;
+	k->status.versionMinor = 3;
+	k->status.versionBuild = 7;
+	k->resp_parts = -1;
+}
+
+/* Queue a response of len bytes, followed by its checksum if crc is set */
+static void emu_respond(struct yk_emu_key *k, const unsigned char *data,
+			int len, int crc)
+{
+	memset(k->resp, 0, sizeof(k->resp));
+	memcpy(k->resp, data, len);
+	if (crc) {
+		int c = ~_yk_crc16(k->resp, len);
+
+		k->resp[len++] = c & 0xff;
+		k->resp[len++] = (c >> 8) & 0xff;
+	}
+	k->resp_parts = (len + FEATURE_RPT_SIZE - 2) / (FEATURE_RPT_SIZE - 1);
+	k->resp_seq = 0;
+}
+
+static void emu_challenge(struct yk_emu_key *k, unsigned char cmd,
+			  const unsigned char *challenge, int outlen)
+{
+	unsigned char out[20];
+	uint32_t h = 2166136261UL ^ k->serial ^ ((uint32_t) cmd << 24);
+	int i;
+
+	for (i = 0; i < SLOT_DATA_SIZE; i++)
+		h = (h ^ challenge[i]) * 16777619UL;
+	for (i = 0; i < outlen; i++) {
+		h = (h ^ i) * 16777619UL;
+		out[i] = h >> 24;
+	}
+	emu_respond(k, out, outlen, 1);
+}
+
+static void emu_set_slot(struct yk_emu_key *k, int slot,
+			 const unsigned char *payload)
+{
+	unsigned int valid = slot == 1 ? CONFIG1_VALID : CONFIG2_VALID;
+	int i;
+
+	for (i = 0; i < SLOT_DATA_SIZE && payload[i] == 0; i++)
+		;
+	if (i == SLOT_DATA_SIZE)
+		k->status.touchLevel &= ~valid;
+	else
+		k->status.touchLevel |= valid;
+}
+
+/* Act on a complete frame, which the key ignores if the checksum is bad */
+static void emu_frame(struct yk_emu_key *k)
+{
+	unsigned char *payload = k->frame;
+	unsigned char cmd = k->frame[SLOT_DATA_SIZE];
+	int crc = k->frame[SLOT_DATA_SIZE + 1] |
+		(k->frame[SLOT_DATA_SIZE + 2] << 8);
+	unsigned char serial[4];
+	unsigned char caps[1] = { 0 };
+
+	if (_yk_crc16(payload, SLOT_DATA_SIZE) != crc)
+		return;
+
+	switch (cmd) {
+	case SLOT_CONFIG:
+		emu_set_slot(k, 1, payload);
+		k->status.pgmSeq++;
+		break;
+	case SLOT_CONFIG2:
+		emu_set_slot(k, 2, payload);
+		k->status.pgmSeq++;
+		break;
+	case SLOT_SWAP:
+	case SLOT_UPDATE1:
+	case SLOT_UPDATE2:
+	case SLOT_NDEF:
+	case SLOT_NDEF2:
+	case SLOT_DEVICE_CONFIG:
+	case SLOT_SCAN_MAP:
+	case SLOT_YK4_SET_DEVICE_INFO:
+		k->status.pgmSeq++;
+		break;
+	case SLOT_DEVICE_SERIAL:
+		serial[0] = (k->serial >> 24) & 0xff;
+		serial[1] = (k->serial >> 16) & 0xff;
+		serial[2] = (k->serial >> 8) & 0xff;
+		serial[3] = k->serial & 0xff;
+		emu_respond(k, serial, sizeof(serial), 1);
+		return;
+	case SLOT_YK4_CAPABILITIES:
+		emu_respond(k, caps, sizeof(caps), 0);
+		return;
+	case SLOT_CHAL_HMAC1:
+	case SLOT_CHAL_HMAC2:
+		emu_challenge(k, cmd, payload, 20);
+		return;
+	case SLOT_CHAL_OTP1:
+	case SLOT_CHAL_OTP2:
+		emu_challenge(k, cmd, payload, 16);
+		return;
+	default:
+		return;
+	}
+
+	/* an erased key restarts its programming sequence */
+	if (!(k->status.touchLevel & (CONFIG1_VALID | CONFIG2_VALID)))
+		k->status.pgmSeq = 0;
+}
+
+void _yk_emu_key_read(struct yk_emu_key *k, unsigned char *report)
+{
+	memset(report, 0, FEATURE_RPT_SIZE);
+	if (k->resp_parts < 0) {
+		report[1] = k->status.versionMajor;
+		report[2] = k->status.versionMinor;
+		report[3] = k->status.versionBuild;
+		report[4] = k->status.pgmSeq;
+		report[5] = k->status.touchLevel & 0xff;
+		report[6] = (k->status.touchLevel >> 8) & 0xff;
+	} else if (k->resp_seq < k->resp_parts) {
+		/* the response, then a report with sequence zero */
+		memcpy(report, k->resp + k->resp_seq * (FEATURE_RPT_SIZE - 1),
+		       FEATURE_RPT_SIZE - 1);
+		report[FEATURE_RPT_SIZE - 1] = RESP_PENDING_FLAG | k->resp_seq;
+		k->resp_seq++;
+	} else {
+		report[FEATURE_RPT_SIZE - 1] = RESP_PENDING_FLAG;
+	}
+}
+
+void _yk_emu_key_write(struct yk_emu_key *k, const unsigned char *report)
+{
+	unsigned char flags = report[FEATURE_RPT_SIZE - 1];
+	int seq = flags & 0x1f;
+
+	if (flags == DUMMY_REPORT_WRITE) {
+		k->resp_parts = -1;
+	} else if ((flags & SLOT_WRITE_FLAG) &&
+		   seq * (FEATURE_RPT_SIZE - 1) < YK_EMU_FRAME_SIZE) {
+		/* parts that are all zeroes may be left out */
+		if (seq == 0) {
+			memset(k->frame, 0, sizeof(k->frame));
+			k->resp_parts = -1;
+		}
+		memcpy(k->frame + seq * (FEATURE_RPT_SIZE - 1), report,
+		       FEATURE_RPT_SIZE - 1);
+		if ((seq + 1) * (FEATURE_RPT_SIZE - 1) >= YK_EMU_FRAME_SIZE)
+			emu_frame(k);
+	}
+}
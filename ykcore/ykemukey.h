@@ -0,0 +1,60 @@
+/* -*- mode:C; c-file-style: "bsd" -*- */
+/*
+ * Copyright (c) 2026 Yubico AB
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef	__YKEMUKEY_H_INCLUDED__
+#define	__YKEMUKEY_H_INCLUDED__
+
+#include <stdint.h>
+
+#include "ykdef.h"
+
+/* The state of an emulated key, for yk_emulate() and tests/gadget.c.
+   It answers feature reports as a YubiKey 4 OTP interface does.  The
+   caller serializes access. */
+
+#define YK_EMU_FRAME_SIZE	70
+#define YK_EMU_RESP_SIZE	(SLOT_DATA_SIZE + 2 + 5)
+
+struct yk_emu_key {
+	unsigned int serial;
+	struct status_st status;
+	unsigned char frame[YK_EMU_FRAME_SIZE];
+	unsigned char resp[YK_EMU_RESP_SIZE];
+	int resp_parts;		/* -1 when no response is pending */
+	int resp_seq;
+};
+
+extern void _yk_emu_key_init(struct yk_emu_key *k, unsigned int serial);
+/* report is FEATURE_RPT_SIZE bytes */
+extern void _yk_emu_key_read(struct yk_emu_key *k, unsigned char *report);
+extern void _yk_emu_key_write(struct yk_emu_key *k,
+			      const unsigned char *report);
+
+#endif	/* __YKEMUKEY_H_INCLUDED__ */
@@ -0,0 +1,204 @@
+/* -*- mode:C; c-file-style: "bsd" -*- */
+/*
+ * Copyright (c) 2026 Yubico AB
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Keys emulated in memory, served in place of USB.  The keys themselves
+ * are in ykemukey.c; each has its own lock here, so that threads
+ * driving different keys run in parallel, which makes the emulator the
+ * transport for stress tests of ykcore and ykpers.
+ */
+
+#include "ykcore_lcl.h"
+#include "ykcore_backend.h"
+#include "ykthread.h"
+#include "ykemukey.h"
+
+#include <string.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+#define EMU_MAX_KEYS		64
+#define EMU_SERIAL_BASE		1000000
+
+struct emu_key {
+	YK_MUTEX_TYPE lock;
+	struct yk_emu_key key;
+};
+
+static struct emu_key emu_keys[EMU_MAX_KEYS];
+static unsigned int emu_count;
+static int emu_lock_init = 0;
+
+static int emu_start(void)
+{
+	return 1;
+}
+
+static int emu_stop(void)
+{
+	return 1;
+}
+
+static void *emu_open_device(int vendor_id, const int *product_ids,
+			     size_t pids_len, int index)
+{
+	if (index < 0 || (unsigned int) index >= emu_count) {
+		yk_errno = YK_ENOKEY;
+		return NULL;
+	}
+	return &emu_keys[index];
+}
+
+static int emu_close_device(void *dev)
+{
+	return 1;
+}
+
+static int emu_read(void *dev, int report_type, int report_number,
+		    char *buffer, int buffer_size)
+{
+	struct emu_key *k = dev;
+	unsigned char data[FEATURE_RPT_SIZE];
+
+	YK_MUTEX_LOCK(k->lock);
+	_yk_emu_key_read(&k->key, data);
+	YK_MUTEX_UNLOCK(k->lock);
+
+	memset(buffer, 0, buffer_size);
+	memcpy(buffer, data, buffer_size < FEATURE_RPT_SIZE ?
+	       buffer_size : FEATURE_RPT_SIZE);
+	return 1;
+}
+
+static int emu_write(void *dev, int report_type, int report_number,
+		     char *buffer, int buffer_size)
+{
+	struct emu_key *k = dev;
+
+	if (buffer_size != FEATURE_RPT_SIZE) {
+		yk_errno = YK_EWRONGSIZ;
+		return 0;
+	}
+	YK_MUTEX_LOCK(k->lock);
+	_yk_emu_key_write(&k->key, (unsigned char *) buffer);
+	YK_MUTEX_UNLOCK(k->lock);
+	return 1;
+}
+
+static int emu_get_vid_pid(void *dev, int *vid, int *pid)
+{
+	*vid = YUBICO_VID;
+	*pid = YK4_OTP_PID;
+	return 1;
+}
+
+static const char *emu_strerror(void)
+{
+	return "no USB with emulated keys";
+}
+
+/* Ids are the index plus one, and the keys stay plugged in */
+static int emu_list_devices(int vendor_id, const int *product_ids,
+			    size_t pids_len, unsigned int *ids, size_t max,
+			    size_t *count)
+{
+	size_t i;
+
+	for (i = 0; i < emu_count && i < max; i++)
+		ids[i] = i + 1;
+	*count = i;
+	return 1;
+}
+
+static void *emu_open_device_id(int vendor_id, const int *product_ids,
+				size_t pids_len, unsigned int id)
+{
+	return emu_open_device(vendor_id, product_ids, pids_len,
+			       (int) id - 1);
+}
+
+static int emu_wait_for_change(unsigned int timeout_ms)
+{
+#ifdef _WIN32
+	Sleep(timeout_ms);
+#else
+	usleep(timeout_ms * 1000);
+#endif
+	return 1;
+}
+
+static const struct yk_transport_st emulated_transport = {
+	emu_start,
+	emu_stop,
+	emu_open_device,
+	emu_close_device,
+	emu_read,
+	emu_write,
+	emu_get_vid_pid,
+	emu_strerror,
+	emu_list_devices,
+	emu_open_device_id,
+	emu_wait_for_change,
+};
+
+int yk_emulate(unsigned int keys)
+{
+	unsigned int i;
+
+	if (keys > EMU_MAX_KEYS) {
+		yk_errno = YK_EINVAL;
+		return 0;
+	}
+	/* leaves any trace behind */
+	if (!yk_trace_replay(NULL, 0))
+		return 0;
+	if (keys == 0)
+		return 1;
+
+	if (!emu_lock_init) {
+		for (i = 0; i < EMU_MAX_KEYS; i++) {
+			if (YK_MUTEX_INIT(emu_keys[i].lock) != 0) {
+				while (i-- > 0)
+					YK_MUTEX_DESTROY(emu_keys[i].lock);
+				yk_errno = YK_ENOMEM;
+				return 0;
+			}
+		}
+		emu_lock_init = 1;
+	}
+	for (i = 0; i < keys; i++)
+		_yk_emu_key_init(&emu_keys[i].key, EMU_SERIAL_BASE + i);
+	emu_count = keys;
+	_yk_transport = &emulated_transport;
+	return 1;
+}
@@ -0,0 +1,239 @@
+/* -*- mode:C; c-file-style: "bsd" -*- */
+/*
+ * Copyright (c) 2026 Yubico AB
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Opening a key by serial number.
+ *
+ * Finding a serial by opening every key in turn costs an open, a
+ * detach and a serial read per key.  The serials seen on the last scan
+ * are kept with the index the key was opened at, in a small file under
+ * the runtime directory:
+ *
+ *   ykpers-serial-index 1
+ *   <serial> <index>
+ *   ...
+ *
+ * A lookup opens the indexed key only and checks its serial.  When the
+ * serial is unknown or the key moved, all keys are scanned again and
+ * the file is rewritten, so a stale file costs one scan and never gives
+ * the wrong key.
+ */
+
+#include "ykcore_lcl.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <io.h>
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
+
+#define INDEX_MAGIC	"ykpers-serial-index 1"
+#define INDEX_MAX_KEYS	128
+
+struct index_entry {
+	unsigned int serial;
+	int index;
+};
+
+/* The file named by YK_SERIAL_INDEX, where an empty value turns the
+   file off, or one in $XDG_RUNTIME_DIR for keys on USB.  Set-id
+   programs use neither. */
+static const char *index_path(char *buf, size_t len)
+{
+	const char *path = _yk_getenv("YK_SERIAL_INDEX");
+	const char *dir;
+	int n;
+
+	if (path != NULL)
+		return *path ? path : NULL;
+	if (_yk_transport != &_yk_usb_transport)
+		return NULL;
+	dir = _yk_getenv("XDG_RUNTIME_DIR");
+	if (dir == NULL || *dir == '\0')
+		return NULL;
+	n = snprintf(buf, len, "%s/ykpers-serial-index", dir);
+	if (n < 0 || (size_t) n >= len)
+		return NULL;
+	return buf;
+}
+
+static int index_load(const char *path, struct index_entry *entries)
+{
+	char line[64];
+	FILE *f = fopen(path, "r");
+	int n = 0;
+
+	if (f == NULL)
+		return 0;
+	if (fgets(line, sizeof(line), f) == NULL ||
+	    strncmp(line, INDEX_MAGIC "\n", sizeof(INDEX_MAGIC)) != 0) {
+		fclose(f);
+		return 0;
+	}
+	while (n < INDEX_MAX_KEYS && fgets(line, sizeof(line), f) != NULL) {
+		if (sscanf(line, "%u %d", &entries[n].serial,
+			   &entries[n].index) == 2 && entries[n].index >= 0)
+			n++;
+	}
+	fclose(f);
+	return n;
+}
+
+/* A new file next to path, with a name nobody could have made ready */
+static FILE *index_tmp(const char *path, char *tmp, size_t len)
+{
+	FILE *f;
+	int fd, n;
+
+#ifdef _WIN32
+	n = snprintf(tmp, len, "%s.%ld", path, (long) getpid());
+	if (n < 0 || (size_t) n >= len)
+		return NULL;
+	fd = open(tmp, O_CREAT | O_EXCL | O_WRONLY, S_IREAD | S_IWRITE);
+#else
+	n = snprintf(tmp, len, "%s.XXXXXX", path);
+	if (n < 0 || (size_t) n >= len)
+		return NULL;
+	fd = mkstemp(tmp);
+#endif
+	if (fd < 0)
+		return NULL;
+	if ((f = fdopen(fd, "w")) == NULL) {
+		close(fd);
+		remove(tmp);
+	}
+	return f;
+}
+
+/* Written to a temporary file and renamed, so readers never see a
+   partial index */
+static void index_save(const char *path, const struct index_entry *entries,
+		       int n)
+{
+	char tmp[1024];
+	FILE *f;
+	int i, ok;
+
+	if ((f = index_tmp(path, tmp, sizeof(tmp))) == NULL)
+		return;
+	ok = fprintf(f, "%s\n", INDEX_MAGIC) > 0;
+	for (i = 0; ok && i < n; i++)
+		ok = fprintf(f, "%u %d\n", entries[i].serial,
+			     entries[i].index) > 0;
+	if (fclose(f) != 0)
+		ok = 0;
+#ifdef _WIN32
+	if (ok)
+		remove(path);
+#endif
+	if (!ok || rename(tmp, path) != 0)
+		remove(tmp);
+}
+
+/* The key at index, if it has the serial */
+static YK_KEY *index_try(int index, unsigned int serial)
+{
+	YK_KEY *yk = yk_open_key(index);
+	unsigned int s;
+
+	if (yk == NULL)
+		return NULL;
+	if (yk_get_serial(yk, 1, 0, &s) && s == serial)
+		return yk;
+	yk_close_key(yk);
+	return NULL;
+}
+
+/* Open every key and record its serial, leaving the one with the
+   serial open in *found */
+static int index_scan(unsigned int serial, struct index_entry *entries,
+		      YK_KEY **found)
+{
+	int i, n = 0;
+
+	for (i = 0; i < INDEX_MAX_KEYS; i++) {
+		YK_KEY *yk = yk_open_key(i);
+		unsigned int s;
+
+		if (yk == NULL) {
+			if (yk_errno == YK_ENOKEY)
+				break;
+			continue;
+		}
+		/* keys before 2.2 have no serial to index */
+		if (yk_get_serial(yk, 1, 0, &s)) {
+			entries[n].serial = s;
+			entries[n].index = i;
+			n++;
+			if (s == serial && *found == NULL) {
+				*found = yk;
+				continue;
+			}
+		}
+		yk_close_key(yk);
+	}
+	return n;
+}
+
+YK_KEY *yk_open_key_by_serial(unsigned int serial)
+{
+	struct index_entry entries[INDEX_MAX_KEYS];
+	char buf[1024];
+	const char *path = index_path(buf, sizeof(buf));
+	YK_KEY *yk = NULL;
+	int i, n;
+
+	if (path != NULL) {
+		n = index_load(path, entries);
+		for (i = 0; i < n; i++) {
+			if (entries[i].serial == serial) {
+				if ((yk = index_try(entries[i].index,
+						    serial)) != NULL)
+					return yk;
+				break;
+			}
+		}
+	}
+
+	n = index_scan(serial, entries, &yk);
+	if (path != NULL)
+		index_save(path, entries, n);
+	if (yk == NULL)
+		yk_errno = YK_ENOKEY;
+	return yk;
+}
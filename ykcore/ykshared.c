@@ -0,0 +1,361 @@
+/* -*- mode:C; c-file-style: "bsd" -*- */
+/*
+ * Copyright (c) 2026 Yubico AB
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Keys shared by threads.
+ *
+ * The reports of one command must not interleave with those of another
+ * on the same key, so a shared key is driven by a thread of its own.
+ * Callers push requests onto a lock-free multi-producer, single-consumer
+ * queue (after Dmitry Vyukov's intrusive queue) and sleep until the
+ * owner has run them.  Requests live on the stack of the caller, so
+ * submitting allocates nothing and takes no lock; the owner sleeps
+ * when the queue is empty and is woken only then.
+ */
+
+#include "ykcore_lcl.h"
+#include "ykthread.h"
+
+#include <string.h>
+
+struct shared_req {
+	struct shared_req *next;
+	int (*fn)(YK_KEY *yk, void *arg);	/* NULL stops the owner */
+	void *arg;
+	uint64_t deadline_ms;
+	volatile int *cancel;
+	int ret;
+	int err;
+	int done;
+};
+
+struct yk_shared_st {
+	YK_KEY *yk;
+	struct shared_req *head;	/* pushed to by callers */
+	struct shared_req *tail;	/* popped from by the owner */
+	struct shared_req stub;
+	int waiting;			/* the owner sleeps on wake */
+	YK_MUTEX_TYPE lock;
+	YK_COND_TYPE wake;
+	YK_COND_TYPE done;
+	YK_THREAD_TYPE owner;
+};
+
+static void shared_push(YK_SHARED *sh, struct shared_req *req)
+{
+	struct shared_req *prev;
+
+	YK_ATOMIC_STORE_PTR(&req->next, NULL);
+	prev = YK_ATOMIC_XCHG_PTR(&sh->head, req);
+	/* until this store the queue looks empty to the owner, see
+	   shared_empty() */
+	YK_ATOMIC_STORE_PTR(&prev->next, req);
+}
+
+/* The next request, or NULL if there is none or one is half pushed */
+static struct shared_req *shared_pop(YK_SHARED *sh)
+{
+	struct shared_req *tail = sh->tail;
+	struct shared_req *next = YK_ATOMIC_LOAD_PTR(&tail->next);
+
+	if (tail == &sh->stub) {
+		if (next == NULL)
+			return NULL;
+		sh->tail = tail = next;
+		next = YK_ATOMIC_LOAD_PTR(&tail->next);
+	}
+	if (next) {
+		sh->tail = next;
+		return tail;
+	}
+	if (tail != YK_ATOMIC_LOAD_PTR(&sh->head))
+		return NULL;
+
+	/* tail is the last request, put the stub behind it */
+	shared_push(sh, &sh->stub);
+	next = YK_ATOMIC_LOAD_PTR(&tail->next);
+	if (next) {
+		sh->tail = next;
+		return tail;
+	}
+	return NULL;
+}
+
+static int shared_empty(YK_SHARED *sh)
+{
+	return sh->tail == &sh->stub &&
+		YK_ATOMIC_LOAD_PTR(&sh->head) == &sh->stub;
+}
+
+static YK_THREAD_FUNC(shared_owner, arg)
+{
+	YK_SHARED *sh = arg;
+	struct shared_req *req;
+
+	for (;;) {
+		if ((req = shared_pop(sh)) == NULL) {
+			/* Callers wake the owner only when it says it is
+			   waiting, so say so before the last look */
+			YK_MUTEX_LOCK(sh->lock);
+			YK_ATOMIC_STORE_INT(&sh->waiting, 1);
+			if (shared_empty(sh))
+				YK_COND_WAIT(sh->wake, sh->lock);
+			YK_ATOMIC_STORE_INT(&sh->waiting, 0);
+			YK_MUTEX_UNLOCK(sh->lock);
+			continue;
+		}
+		if (req->fn == NULL)
+			break;
+
+		yk_errno = 0;
+		if (req->deadline_ms || req->cancel)
+			req->ret = _yk_deadline_run(req->fn, sh->yk, req->arg,
+						    req->deadline_ms,
+						    req->cancel);
+		else
+			req->ret = req->fn(sh->yk, req->arg);
+		req->err = yk_errno;
+
+		YK_MUTEX_LOCK(sh->lock);
+		req->done = 1;
+		YK_COND_BROADCAST(sh->done);
+		YK_MUTEX_UNLOCK(sh->lock);
+	}
+	return 0;
+}
+
+static void shared_submit(YK_SHARED *sh, struct shared_req *req)
+{
+	shared_push(sh, req);
+	if (YK_ATOMIC_LOAD_INT(&sh->waiting)) {
+		YK_MUTEX_LOCK(sh->lock);
+		YK_COND_BROADCAST(sh->wake);
+		YK_MUTEX_UNLOCK(sh->lock);
+	}
+}
+
+YK_SHARED *yk_shared_alloc(YK_KEY *yk)
+{
+	YK_SHARED *sh;
+
+	if (!yk) {
+		yk_errno = YK_EINVAL;
+		return NULL;
+	}
+	if (!(sh = _yk_malloc(sizeof(*sh))))
+		return NULL;
+	memset(sh, 0, sizeof(*sh));
+	sh->yk = yk;
+	sh->head = sh->tail = &sh->stub;
+
+	if (YK_MUTEX_INIT(sh->lock) != 0) {
+		_yk_free(sh);
+		yk_errno = YK_ENOMEM;
+		return NULL;
+	}
+	if (YK_COND_INIT(sh->wake) != 0) {
+		YK_MUTEX_DESTROY(sh->lock);
+		_yk_free(sh);
+		yk_errno = YK_ENOMEM;
+		return NULL;
+	}
+	if (YK_COND_INIT(sh->done) != 0) {
+		YK_COND_DESTROY(sh->wake);
+		YK_MUTEX_DESTROY(sh->lock);
+		_yk_free(sh);
+		yk_errno = YK_ENOMEM;
+		return NULL;
+	}
+	if (YK_THREAD_CREATE(sh->owner, shared_owner, sh) != 0) {
+		YK_COND_DESTROY(sh->done);
+		YK_COND_DESTROY(sh->wake);
+		YK_MUTEX_DESTROY(sh->lock);
+		_yk_free(sh);
+		yk_errno = YK_ENOMEM;
+		return NULL;
+	}
+	return sh;
+}
+
+int yk_shared_free(YK_SHARED *sh)
+{
+	struct shared_req stop;
+	int ret;
+
+	if (!sh)
+		return 1;
+
+	/* requests queued before this one still run */
+	memset(&stop, 0, sizeof(stop));
+	shared_submit(sh, &stop);
+	YK_THREAD_JOIN(sh->owner);
+
+	ret = yk_close_key(sh->yk);
+	YK_COND_DESTROY(sh->done);
+	YK_COND_DESTROY(sh->wake);
+	YK_MUTEX_DESTROY(sh->lock);
+	_yk_free(sh);
+	return ret;
+}
+
+int yk_shared_call_deadline(YK_SHARED *sh, int (*fn)(YK_KEY *yk, void *arg),
+			    void *arg, uint64_t deadline_ms,
+			    volatile int *cancel)
+{
+	struct shared_req req;
+
+	if (!sh || !fn) {
+		yk_errno = YK_EINVAL;
+		return 0;
+	}
+	memset(&req, 0, sizeof(req));
+	req.fn = fn;
+	req.arg = arg;
+	req.deadline_ms = deadline_ms;
+	req.cancel = cancel;
+	shared_submit(sh, &req);
+
+	YK_MUTEX_LOCK(sh->lock);
+	while (!req.done)
+		YK_COND_WAIT(sh->done, sh->lock);
+	YK_MUTEX_UNLOCK(sh->lock);
+
+	if (!req.ret)
+		yk_errno = req.err;
+	return req.ret;
+}
+
+int yk_shared_call(YK_SHARED *sh, int (*fn)(YK_KEY *yk, void *arg),
+		   void *arg)
+{
+	return yk_shared_call_deadline(sh, fn, arg, 0, NULL);
+}
+
+struct status_args {
+	YK_STATUS *status;
+};
+
+static int do_get_status(YK_KEY *yk, void *arg)
+{
+	struct status_args *a = arg;
+
+	return yk_get_status(yk, a->status);
+}
+
+int yk_shared_get_status(YK_SHARED *sh, YK_STATUS *status)
+{
+	struct status_args a;
+
+	a.status = status;
+	return yk_shared_call(sh, do_get_status, &a);
+}
+
+struct serial_args {
+	uint8_t slot;
+	unsigned int flags;
+	unsigned int *serial;
+};
+
+static int do_get_serial(YK_KEY *yk, void *arg)
+{
+	struct serial_args *a = arg;
+
+	return yk_get_serial(yk, a->slot, a->flags, a->serial);
+}
+
+int yk_shared_get_serial(YK_SHARED *sh, uint8_t slot, unsigned int flags,
+			 unsigned int *serial)
+{
+	struct serial_args a;
+
+	a.slot = slot;
+	a.flags = flags;
+	a.serial = serial;
+	return yk_shared_call(sh, do_get_serial, &a);
+}
+
+struct chalresp_args {
+	uint8_t yk_cmd;
+	int may_block;
+	unsigned int challenge_len;
+	const unsigned char *challenge;
+	unsigned int response_len;
+	unsigned char *response;
+};
+
+static int do_challenge_response(YK_KEY *yk, void *arg)
+{
+	struct chalresp_args *a = arg;
+
+	return yk_challenge_response(yk, a->yk_cmd, a->may_block,
+				     a->challenge_len, a->challenge,
+				     a->response_len, a->response);
+}
+
+int yk_shared_challenge_response(YK_SHARED *sh, uint8_t yk_cmd, int may_block,
+				 unsigned int challenge_len,
+				 const unsigned char *challenge,
+				 unsigned int response_len,
+				 unsigned char *response)
+{
+	struct chalresp_args a;
+
+	a.yk_cmd = yk_cmd;
+	a.may_block = may_block;
+	a.challenge_len = challenge_len;
+	a.challenge = challenge;
+	a.response_len = response_len;
+	a.response = response;
+	return yk_shared_call(sh, do_challenge_response, &a);
+}
+
+struct command_args {
+	YK_CONFIG *cfg;
+	uint8_t command;
+	unsigned char *acc_code;
+};
+
+static int do_write_command(YK_KEY *yk, void *arg)
+{
+	struct command_args *a = arg;
+
+	return yk_write_command(yk, a->cfg, a->command, a->acc_code);
+}
+
+int yk_shared_write_command(YK_SHARED *sh, YK_CONFIG *cfg, uint8_t command,
+			    unsigned char *acc_code)
+{
+	struct command_args a;
+
+	a.cfg = cfg;
+	a.command = command;
+	a.acc_code = acc_code;
+	return yk_shared_call(sh, do_write_command, &a);
+}
@@ -33,18 +33,31 @@
 #include "ykdef.h"
 #include "ykstatus.h"
 
+#include <string.h>
+
 YK_STATUS *ykds_alloc(void)
 {
-	YK_STATUS *st = malloc(sizeof(YK_STATUS));
-	if (!st) {
-		yk_errno = YK_ENOMEM;
-	}
-	return st;
+	return _yk_malloc(sizeof(YK_STATUS));
 }
 
 void ykds_free(YK_STATUS *st)
 {
-	free(st);
+	_yk_free(st);
+}
+
+size_t ykds_size(void)
+{
+	return sizeof(YK_STATUS);
+}
+
+YK_STATUS *ykds_init_in_place(void *mem, size_t len)
+{
+	if (!mem || len < sizeof(YK_STATUS)) {
+		yk_errno = YK_EINVAL;
+		return NULL;
+	}
+	memset(mem, 0, sizeof(YK_STATUS));
+	return mem;
 }
 
 YK_STATUS *ykds_static(void)
@@ -41,6 +41,10 @@ extern "C" {
 /* Allocate and free status structures */
 extern YK_STATUS *ykds_alloc(void);
 extern void ykds_free(YK_STATUS *st);
+/* Size of YK_STATUS, and initialisation of one in caller owned memory
+   which must not be passed to ykds_free() */
+extern size_t ykds_size(void);
+extern YK_STATUS *ykds_init_in_place(void *mem, size_t len);
 
 /* Return static status structure, to be used for quick checks.
    USE WITH CAUTION, as this is a SHARED OBJECT. */
@@ -0,0 +1,139 @@
+/* -*- mode:C; c-file-style: "bsd" -*- */
+/*
+ * Copyright (c) 2026 Yubico AB
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef	__YKTHREAD_H_INCLUDED__
+#define	__YKTHREAD_H_INCLUDED__
+
+/* Define thread and lock primitives, in the same spirit as yktsd.h.
+   Thread functions are declared as
+
+	static YK_THREAD_FUNC(name, arg)
+
+   and return 0. */
+#if defined _WIN32
+#include <windows.h>
+#include <errno.h>
+#define YK_THREAD_TYPE			HANDLE
+#define YK_THREAD_FUNC(name,arg)	DWORD WINAPI name(LPVOID arg)
+#define YK_THREAD_CREATE(t,fn,arg)	((t = CreateThread(NULL, 0, fn, arg, 0, NULL)) == NULL ? EAGAIN : 0)
+#define YK_THREAD_JOIN(t)		(WaitForSingleObject(t, INFINITE), CloseHandle(t))
+#define YK_MUTEX_TYPE			CRITICAL_SECTION
+#define YK_MUTEX_INIT(m)		(InitializeCriticalSection(&(m)), 0)
+#define YK_MUTEX_DESTROY(m)		DeleteCriticalSection(&(m))
+#define YK_MUTEX_LOCK(m)		EnterCriticalSection(&(m))
+#define YK_MUTEX_UNLOCK(m)		LeaveCriticalSection(&(m))
+#define YK_COND_TYPE			CONDITION_VARIABLE
+#define YK_COND_INIT(c)			(InitializeConditionVariable(&(c)), 0)
+#define YK_COND_DESTROY(c)		((void) 0)
+#define YK_COND_WAIT(c,m)		SleepConditionVariableCS(&(c), &(m), INFINITE)
+#define YK_COND_TIMEDWAIT(c,m,ms)	SleepConditionVariableCS(&(c), &(m), ms)
+#define YK_COND_BROADCAST(c)		WakeAllConditionVariable(&(c))
+#define YK_CPU_COUNT()			yk__cpu_count()
+static __inline int yk__cpu_count(void)
+{
+	SYSTEM_INFO si;
+	GetSystemInfo(&si);
+	return si.dwNumberOfProcessors;
+}
+#else
+#include <pthread.h>
+#include <unistd.h>
+#define YK_THREAD_TYPE			pthread_t
+#define YK_THREAD_FUNC(name,arg)	void *name(void *arg)
+#define YK_THREAD_CREATE(t,fn,arg)	pthread_create(&(t), NULL, fn, arg)
+#define YK_THREAD_JOIN(t)		pthread_join(t, NULL)
+#define YK_MUTEX_TYPE			pthread_mutex_t
+#define YK_MUTEX_INIT(m)		pthread_mutex_init(&(m), NULL)
+#define YK_MUTEX_DESTROY(m)		pthread_mutex_destroy(&(m))
+#define YK_MUTEX_LOCK(m)		pthread_mutex_lock(&(m))
+#define YK_MUTEX_UNLOCK(m)		pthread_mutex_unlock(&(m))
+#define YK_COND_TYPE			pthread_cond_t
+#define YK_COND_INIT(c)			pthread_cond_init(&(c), NULL)
+#define YK_COND_DESTROY(c)		pthread_cond_destroy(&(c))
+#define YK_COND_WAIT(c,m)		pthread_cond_wait(&(c), &(m))
+#define YK_COND_TIMEDWAIT(c,m,ms)	yk__cond_timedwait(&(c), &(m), ms)
+#define YK_COND_BROADCAST(c)		pthread_cond_broadcast(&(c))
+#define YK_CPU_COUNT()			((int) sysconf(_SC_NPROCESSORS_ONLN))
+#include <time.h>
+#include <sys/time.h>
+static __inline int yk__cond_timedwait(pthread_cond_t *c, pthread_mutex_t *m,
+				       unsigned int ms)
+{
+	struct timeval now;
+	struct timespec ts;
+
+	gettimeofday(&now, NULL);
+	ts.tv_sec = now.tv_sec + ms / 1000;
+	ts.tv_nsec = now.tv_usec * 1000L + (ms % 1000) * 1000000L;
+	if (ts.tv_nsec >= 1000000000L) {
+		ts.tv_sec++;
+		ts.tv_nsec -= 1000000000L;
+	}
+	return pthread_cond_timedwait(c, m, &ts);
+}
+#endif
+
+/* Sequentially consistent atomics on pointers and ints, enough for
+   lock-free queues, and compare-and-swap on 32 and 64 bit words, which
+   also works on memory shared between processes */
+#if defined _WIN32
+#define YK_ATOMIC_XCHG_PTR(p,v)		InterlockedExchangePointer((PVOID volatile *) (p), (v))
+#define YK_ATOMIC_LOAD_PTR(p)		InterlockedCompareExchangePointer((PVOID volatile *) (p), NULL, NULL)
+#define YK_ATOMIC_STORE_PTR(p,v)	((void) InterlockedExchangePointer((PVOID volatile *) (p), (v)))
+#define YK_ATOMIC_LOAD_INT(p)		InterlockedCompareExchange((LONG volatile *) (p), 0, 0)
+#define YK_ATOMIC_STORE_INT(p,v)	((void) InterlockedExchange((LONG volatile *) (p), (v)))
+#define YK_ATOMIC_CAS_INT(p,o,v)	(InterlockedCompareExchange((LONG volatile *) (p), (v), (o)) == (LONG) (o))
+#define YK_ATOMIC_LOAD_64(p)		InterlockedCompareExchange64((LONGLONG volatile *) (p), 0, 0)
+#define YK_ATOMIC_CAS_64(p,o,v)		(InterlockedCompareExchange64((LONGLONG volatile *) (p), (v), (o)) == (LONGLONG) (o))
+#else
+#define YK_ATOMIC_XCHG_PTR(p,v)		__atomic_exchange_n((p), (v), __ATOMIC_SEQ_CST)
+#define YK_ATOMIC_LOAD_PTR(p)		__atomic_load_n((p), __ATOMIC_SEQ_CST)
+#define YK_ATOMIC_STORE_PTR(p,v)	__atomic_store_n((p), (v), __ATOMIC_SEQ_CST)
+#define YK_ATOMIC_LOAD_INT(p)		__atomic_load_n((p), __ATOMIC_SEQ_CST)
+#define YK_ATOMIC_STORE_INT(p,v)	__atomic_store_n((p), (v), __ATOMIC_SEQ_CST)
+#define YK_ATOMIC_CAS_INT(p,o,v)	yk__atomic_cas_32((p), (o), (v))
+#define YK_ATOMIC_LOAD_64(p)		__atomic_load_n((p), __ATOMIC_SEQ_CST)
+#define YK_ATOMIC_CAS_64(p,o,v)		yk__atomic_cas_64((p), (o), (v))
+#include <stdint.h>
+static __inline int yk__atomic_cas_32(volatile uint32_t *p, uint32_t o,
+				      uint32_t v)
+{
+	return __atomic_compare_exchange_n(p, &o, v, 0, __ATOMIC_SEQ_CST,
+					   __ATOMIC_SEQ_CST);
+}
+static __inline int yk__atomic_cas_64(volatile uint64_t *p, uint64_t o,
+				      uint64_t v)
+{
+	return __atomic_compare_exchange_n(p, &o, v, 0, __ATOMIC_SEQ_CST,
+					   __ATOMIC_SEQ_CST);
+}
+#endif
+
+#endif	/* __YKTHREAD_H_INCLUDED__ */
@@ -0,0 +1,556 @@
+/* -*- mode:C; c-file-style: "bsd" -*- */
+/*
+ * Copyright (c) 2026 Yubico AB
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Recording and replay of the feature reports exchanged with keys.
+ *
+ * Recording wraps the USB backend and appends every open, close, read
+ * and write to a trace file.  Replay loads a trace and serves it in
+ * place of USB: reads return the recorded reports, writes must match
+ * the recorded ones, and with timing on every report is delayed so that
+ * the gap since the previous report of the same device is the recorded
+ * one.  This gives repeatable runs of the protocol code in ykcore.c on
+ * machines without keys.
+ */
+
+#include "ykcore_lcl.h"
+#include "ykcore_backend.h"
+#include "ykthread.h"
+#include "yktrace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <windows.h>
+#include <io.h>
+#else
+#include <time.h>
+#include <unistd.h>
+#endif
+
+#ifndef O_NOFOLLOW
+#define O_NOFOLLOW 0
+#endif
+
+static uint64_t trace_now_us(void)
+{
+#ifdef _WIN32
+	LARGE_INTEGER freq, now;
+
+	QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&now);
+	return (uint64_t) (now.QuadPart * 1000000.0 / freq.QuadPart);
+#else
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#endif
+}
+
+static void trace_sleep_us(uint64_t us)
+{
+#ifdef _WIN32
+	Sleep((DWORD) (us / 1000));
+#else
+	struct timespec ts;
+
+	ts.tv_sec = us / 1000000;
+	ts.tv_nsec = (us % 1000000) * 1000;
+	nanosleep(&ts, NULL);
+#endif
+}
+
+/*************************************************************************
+ *
+ * Recording
+ *
+ ****/
+
+struct rec_dev {
+	void *dev;
+	unsigned char id;
+};
+
+static FILE *rec_file = NULL;
+static YK_MUTEX_TYPE rec_lock;
+static uint64_t rec_last_us;
+static unsigned char rec_next_id;
+
+static void rec_append(unsigned char op, unsigned char dev, int arg, int ok,
+		       const void *data, int len)
+{
+	struct yk_trace_rec r;
+	unsigned char buf[YK_TRACE_RECORD_SIZE];
+	uint64_t now, delta;
+
+	memset(&r, 0, sizeof(r));
+	r.op = op;
+	r.dev = dev;
+	r.arg = arg & 0xff;
+	r.ok = ok ? 1 : 0;
+	if (!ok)
+		r.data[0] = yk_errno;
+	else if (data)
+		memcpy(r.data, data, len < YK_TRACE_DATA_SIZE ?
+		       len : YK_TRACE_DATA_SIZE);
+
+	YK_MUTEX_LOCK(rec_lock);
+	now = trace_now_us();
+	delta = now - rec_last_us;
+	r.delta_us = delta > 0xffffffffUL ? 0xffffffffUL : (uint32_t) delta;
+	rec_last_us = now;
+	yk_trace_pack(buf, &r);
+	fwrite(buf, sizeof(buf), 1, rec_file);
+	YK_MUTEX_UNLOCK(rec_lock);
+}
+
+static int rec_start(void)
+{
+	return _ykusb_start();
+}
+
+static int rec_stop(void)
+{
+	fflush(rec_file);
+	return _ykusb_stop();
+}
+
+static void *rec_open_device(int vendor_id, const int *product_ids,
+			     size_t pids_len, int index)
+{
+	struct rec_dev *d;
+	unsigned char ids[4];
+	int vid = 0, pid = 0;
+	void *dev = _ykusb_open_device(vendor_id, product_ids, pids_len,
+				       index);
+	int err = yk_errno;
+
+	if (!dev) {
+		rec_append(YK_TRACE_OPEN, 0, index, 0, NULL, 0);
+		yk_errno = err;
+		return NULL;
+	}
+	if (!(d = _yk_malloc(sizeof(*d)))) {
+		_ykusb_close_device(dev);
+		yk_errno = YK_ENOMEM;
+		return NULL;
+	}
+	d->dev = dev;
+	YK_MUTEX_LOCK(rec_lock);
+	d->id = rec_next_id++;
+	YK_MUTEX_UNLOCK(rec_lock);
+
+	_ykusb_get_vid_pid(dev, &vid, &pid);
+	ids[0] = vid & 0xff;
+	ids[1] = (vid >> 8) & 0xff;
+	ids[2] = pid & 0xff;
+	ids[3] = (pid >> 8) & 0xff;
+	rec_append(YK_TRACE_OPEN, d->id, index, 1, ids, sizeof(ids));
+	return d;
+}
+
+static int rec_close_device(void *p)
+{
+	struct rec_dev *d = p;
+	int ret = _ykusb_close_device(d->dev);
+
+	rec_append(YK_TRACE_CLOSE, d->id, 0, ret, NULL, 0);
+	_yk_free(d);
+	return ret;
+}
+
+static int rec_read(void *p, int report_type, int report_number,
+		    char *buffer, int buffer_size)
+{
+	struct rec_dev *d = p;
+	int ret = _ykusb_read(d->dev, report_type, report_number, buffer,
+			      buffer_size);
+	int err = yk_errno;
+
+	rec_append(YK_TRACE_READ, d->id, report_number, ret, buffer,
+		   buffer_size);
+	yk_errno = err;
+	return ret;
+}
+
+static int rec_write(void *p, int report_type, int report_number,
+		     char *buffer, int buffer_size)
+{
+	struct rec_dev *d = p;
+	int ret = _ykusb_write(d->dev, report_type, report_number, buffer,
+			       buffer_size);
+	int err = yk_errno;
+
+	rec_append(YK_TRACE_WRITE, d->id, report_number, ret, buffer,
+		   buffer_size);
+	yk_errno = err;
+	return ret;
+}
+
+static int rec_get_vid_pid(void *p, int *vid, int *pid)
+{
+	return _ykusb_get_vid_pid(((struct rec_dev *) p)->dev, vid, pid);
+}
+
+static const struct yk_transport_st record_transport = {
+	rec_start,
+	rec_stop,
+	rec_open_device,
+	rec_close_device,
+	rec_read,
+	rec_write,
+	rec_get_vid_pid,
+	_ykusb_strerror,
+	NULL,
+	NULL,
+	NULL,
+};
+
+/*************************************************************************
+ *
+ * Replay
+ *
+ ****/
+
+struct replay_rec {
+	uint64_t time_us;
+	struct yk_trace_rec r;
+};
+
+struct replay_dev {
+	unsigned char id;
+	size_t pos;
+	int vid, pid;
+	uint64_t last_time_us;	/* of the last record served */
+	uint64_t last_now_us;	/* when it was served */
+};
+
+static struct replay_rec *replay_recs = NULL;
+static size_t replay_count;
+static size_t replay_open_pos;
+static int replay_timed;
+static YK_MUTEX_TYPE replay_lock;
+
+static void replay_free(void)
+{
+	_yk_free(replay_recs);
+	replay_recs = NULL;
+	replay_count = 0;
+}
+
+static int replay_load(const char *path)
+{
+	unsigned char buf[YK_TRACE_RECORD_SIZE];
+	FILE *f = fopen(path, "rb");
+	uint64_t t = 0;
+	long size;
+	size_t i, n;
+
+	if (!f) {
+		yk_errno = YK_ETRACE;
+		return 0;
+	}
+	if (fread(buf, YK_TRACE_MAGIC_LEN, 1, f) != 1 ||
+	    memcmp(buf, YK_TRACE_MAGIC, YK_TRACE_MAGIC_LEN) != 0 ||
+	    fseek(f, 0, SEEK_END) != 0 || (size = ftell(f)) < 0 ||
+	    (size - YK_TRACE_MAGIC_LEN) % YK_TRACE_RECORD_SIZE != 0 ||
+	    fseek(f, YK_TRACE_MAGIC_LEN, SEEK_SET) != 0) {
+		fclose(f);
+		yk_errno = YK_ETRACE;
+		return 0;
+	}
+
+	n = (size - YK_TRACE_MAGIC_LEN) / YK_TRACE_RECORD_SIZE;
+	if (!(replay_recs = _yk_malloc(n * sizeof(*replay_recs) + 1))) {
+		fclose(f);
+		return 0;
+	}
+	for (i = 0; i < n; i++) {
+		if (fread(buf, sizeof(buf), 1, f) != 1) {
+			fclose(f);
+			replay_free();
+			yk_errno = YK_ETRACE;
+			return 0;
+		}
+		yk_trace_unpack(&replay_recs[i].r, buf);
+		t += replay_recs[i].r.delta_us;
+		replay_recs[i].time_us = t;
+	}
+	fclose(f);
+	replay_count = n;
+	replay_open_pos = 0;
+	return 1;
+}
+
+static int replay_start(void)
+{
+	return 1;
+}
+
+static int replay_stop(void)
+{
+	return 1;
+}
+
+/* Wait out the recorded gap to the previous report of the device */
+static void replay_pace(struct replay_dev *d, const struct replay_rec *rec)
+{
+	if (replay_timed) {
+		uint64_t gap = rec->time_us - d->last_time_us;
+		uint64_t spent = trace_now_us() - d->last_now_us;
+
+		if (gap > spent)
+			trace_sleep_us(gap - spent);
+	}
+	d->last_time_us = rec->time_us;
+	d->last_now_us = trace_now_us();
+}
+
+static void *replay_open_device(int vendor_id, const int *product_ids,
+				size_t pids_len, int index)
+{
+	struct replay_rec *rec = NULL;
+	struct replay_dev *d;
+	size_t i;
+
+	YK_MUTEX_LOCK(replay_lock);
+	for (i = replay_open_pos; i < replay_count; i++) {
+		if (replay_recs[i].r.op == YK_TRACE_OPEN) {
+			rec = &replay_recs[i];
+			replay_open_pos = i + 1;
+			break;
+		}
+	}
+	YK_MUTEX_UNLOCK(replay_lock);
+
+	if (!rec || rec->r.arg != (index & 0xff)) {
+		yk_errno = YK_ETRACE;
+		return NULL;
+	}
+	if (!rec->r.ok) {
+		yk_errno = rec->r.data[0];
+		return NULL;
+	}
+	if (!(d = _yk_malloc(sizeof(*d))))
+		return NULL;
+	d->id = rec->r.dev;
+	d->pos = rec - replay_recs + 1;
+	d->vid = rec->r.data[0] | (rec->r.data[1] << 8);
+	d->pid = rec->r.data[2] | (rec->r.data[3] << 8);
+	d->last_time_us = rec->time_us;
+	d->last_now_us = trace_now_us();
+	return d;
+}
+
+/* The next record of the device, which must be of the given kind */
+static struct replay_rec *replay_next(struct replay_dev *d, unsigned char op)
+{
+	size_t i;
+
+	for (i = d->pos; i < replay_count; i++) {
+		struct replay_rec *rec = &replay_recs[i];
+
+		if (rec->r.dev != d->id ||
+		    (rec->r.op == YK_TRACE_OPEN && !rec->r.ok))
+			continue;
+		if (rec->r.op != op)
+			break;
+		d->pos = i + 1;
+		replay_pace(d, rec);
+		return rec;
+	}
+	d->pos = replay_count;
+	yk_errno = YK_ETRACE;
+	return NULL;
+}
+
+static int replay_close_device(void *p)
+{
+	struct replay_dev *d = p;
+	struct replay_rec *rec = replay_next(d, YK_TRACE_CLOSE);
+
+	_yk_free(d);
+	return rec != NULL;
+}
+
+static int replay_read(void *p, int report_type, int report_number,
+		       char *buffer, int buffer_size)
+{
+	struct replay_rec *rec = replay_next(p, YK_TRACE_READ);
+
+	if (!rec)
+		return 0;
+	if (!rec->r.ok) {
+		yk_errno = rec->r.data[0];
+		return 0;
+	}
+	memset(buffer, 0, buffer_size);
+	memcpy(buffer, rec->r.data, buffer_size < YK_TRACE_DATA_SIZE ?
+	       buffer_size : YK_TRACE_DATA_SIZE);
+	return 1;
+}
+
+static int replay_write(void *p, int report_type, int report_number,
+			char *buffer, int buffer_size)
+{
+	struct replay_rec *rec = replay_next(p, YK_TRACE_WRITE);
+	int len = buffer_size < YK_TRACE_DATA_SIZE ?
+		buffer_size : YK_TRACE_DATA_SIZE;
+
+	if (!rec)
+		return 0;
+	if (memcmp(buffer, rec->r.data, len) != 0) {
+		yk_errno = YK_ETRACE;
+		return 0;
+	}
+	if (!rec->r.ok) {
+		yk_errno = rec->r.data[0];
+		return 0;
+	}
+	return 1;
+}
+
+static int replay_get_vid_pid(void *p, int *vid, int *pid)
+{
+	struct replay_dev *d = p;
+
+	*vid = d->vid;
+	*pid = d->pid;
+	return 1;
+}
+
+static const char *replay_strerror(void)
+{
+	return "no USB in trace replay";
+}
+
+static const struct yk_transport_st replay_transport = {
+	replay_start,
+	replay_stop,
+	replay_open_device,
+	replay_close_device,
+	replay_read,
+	replay_write,
+	replay_get_vid_pid,
+	replay_strerror,
+	NULL,
+	NULL,
+	NULL,
+};
+
+/*************************************************************************
+ *
+ * Switching transports, with no keys open
+ *
+ ****/
+
+static void trace_reset(void)
+{
+	if (rec_file) {
+		fclose(rec_file);
+		rec_file = NULL;
+		YK_MUTEX_DESTROY(rec_lock);
+	}
+	if (replay_recs) {
+		replay_free();
+		YK_MUTEX_DESTROY(replay_lock);
+	}
+	_yk_transport = &_yk_usb_transport;
+}
+
+/* Traces hold keys, access codes and responses, so the file is created
+   readable by its owner only, and never in place of an existing file or
+   through a symbolic link. */
+static FILE *trace_create(const char *path)
+{
+	FILE *f;
+	int fd;
+
+#ifdef _WIN32
+	fd = open(path, O_CREAT | O_EXCL | O_WRONLY | O_BINARY,
+		  S_IREAD | S_IWRITE);
+#else
+	fd = open(path, O_CREAT | O_EXCL | O_WRONLY | O_NOFOLLOW, 0600);
+#endif
+	if (fd < 0)
+		return NULL;
+	if (!(f = fdopen(fd, "wb")))
+		close(fd);
+	return f;
+}
+
+int yk_trace_record(const char *path)
+{
+	trace_reset();
+	if (!path)
+		return 1;
+
+	if (!(rec_file = trace_create(path)) ||
+	    fwrite(YK_TRACE_MAGIC, YK_TRACE_MAGIC_LEN, 1, rec_file) != 1) {
+		if (rec_file)
+			fclose(rec_file);
+		rec_file = NULL;
+		yk_errno = YK_ETRACE;
+		return 0;
+	}
+	if (YK_MUTEX_INIT(rec_lock) != 0) {
+		fclose(rec_file);
+		rec_file = NULL;
+		yk_errno = YK_ENOMEM;
+		return 0;
+	}
+	rec_last_us = trace_now_us();
+	rec_next_id = 0;
+	_yk_transport = &record_transport;
+	return 1;
+}
+
+int yk_trace_replay(const char *path, int timed)
+{
+	trace_reset();
+	if (!path)
+		return 1;
+
+	if (!replay_load(path))
+		return 0;
+	if (YK_MUTEX_INIT(replay_lock) != 0) {
+		replay_free();
+		yk_errno = YK_ENOMEM;
+		return 0;
+	}
+	replay_timed = timed;
+	_yk_transport = &replay_transport;
+	return 1;
+}
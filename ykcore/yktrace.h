@@ -0,0 +1,94 @@
+/* -*- mode:C; c-file-style: "bsd" -*- */
+/*
+ * Copyright (c) 2026 Yubico AB
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef	__YKTRACE_H_INCLUDED__
+#define	__YKTRACE_H_INCLUDED__
+
+#include <stdint.h>
+#include <string.h>
+
+/* Trace files hold the feature reports exchanged with keys, written by
+   yk_trace_record() and read by yk_trace_replay() and yktrace.  The
+   file is the magic followed by fixed size records:
+
+     0  delta_us	microseconds since the previous record, 32 bits LE
+     4  op		YK_TRACE_OPEN, _CLOSE, _READ or _WRITE
+     5  dev		id of the device, in the order it was opened
+     6  arg		report number, for an open the key index
+     7  ok		1 if the call succeeded, otherwise data[0] is yk_errno
+     8  data		the report, for an open vid and pid, 16 bits LE each
+*/
+
+#define YK_TRACE_MAGIC		"YKTRACE1"
+#define YK_TRACE_MAGIC_LEN	8
+#define YK_TRACE_RECORD_SIZE	16
+#define YK_TRACE_DATA_SIZE	8
+
+#define YK_TRACE_OPEN		'O'
+#define YK_TRACE_CLOSE		'C'
+#define YK_TRACE_READ		'R'
+#define YK_TRACE_WRITE		'W'
+
+struct yk_trace_rec {
+	uint32_t delta_us;
+	unsigned char op;
+	unsigned char dev;
+	unsigned char arg;
+	unsigned char ok;
+	unsigned char data[YK_TRACE_DATA_SIZE];
+};
+
+static __inline void yk_trace_pack(unsigned char *buf,
+				   const struct yk_trace_rec *r)
+{
+	buf[0] = r->delta_us & 0xff;
+	buf[1] = (r->delta_us >> 8) & 0xff;
+	buf[2] = (r->delta_us >> 16) & 0xff;
+	buf[3] = (r->delta_us >> 24) & 0xff;
+	buf[4] = r->op;
+	buf[5] = r->dev;
+	buf[6] = r->arg;
+	buf[7] = r->ok;
+	memcpy(buf + 8, r->data, YK_TRACE_DATA_SIZE);
+}
+
+static __inline void yk_trace_unpack(struct yk_trace_rec *r,
+				     const unsigned char *buf)
+{
+	r->delta_us = buf[0] | (buf[1] << 8) | (buf[2] << 16) |
+		((uint32_t) buf[3] << 24);
+	r->op = buf[4];
+	r->dev = buf[5];
+	r->arg = buf[6];
+	r->ok = buf[7];
+	memcpy(r->data, buf + 8, YK_TRACE_DATA_SIZE);
+}
+
+#endif	/* __YKTRACE_H_INCLUDED__ */
@@ -41,6 +41,14 @@
 #define yk__TSD_FREE(key)		(!TlsFree(key))
 #define yk__TSD_SET(key,value)		(!TlsSetValue(key,value))
 #define yk__TSD_GET(key)		TlsGetValue(key)
+#define yk__TSD_ONCE_TYPE		INIT_ONCE
+#define yk__TSD_ONCE_INIT		INIT_ONCE_STATIC_INIT
+#define yk__TSD_ONCE(once,fn)		InitOnceExecuteOnce(&once, yk__tsd_once, (PVOID) fn, NULL)
+static __inline BOOL CALLBACK yk__tsd_once(PINIT_ONCE once, PVOID fn, PVOID *ctx)
+{
+	((void (*)(void)) fn)();
+	return TRUE;
+}
 #else
 #include <pthread.h>
 #define yk__TSD_TYPE			pthread_key_t
@@ -48,6 +56,9 @@
 #define yk__TSD_FREE(key)		pthread_key_delete(key)
 #define yk__TSD_SET(key,value)		pthread_setspecific(key,(void *)value)
 #define yk__TSD_GET(key)		pthread_getspecific(key)
+#define yk__TSD_ONCE_TYPE		pthread_once_t
+#define yk__TSD_ONCE_INIT		PTHREAD_ONCE_INIT
+#define yk__TSD_ONCE(once,fn)		pthread_once(&once, fn)
 #endif
 
 /* Define the high-level macros that we use.  */
@@ -58,4 +69,9 @@
 #define YK_TSD_SET(x,value)		yk__TSD_SET(YK_TSD_METADATA(x),value)
 #define YK_TSD_GET(type,x)		(type)yk__TSD_GET(YK_TSD_METADATA(x))
 
+/* Keys are created by a function run once, however many threads get
+   there first */
+#define YK_DEFINE_TSD_ONCE(x)		static yk__TSD_ONCE_TYPE yk__tsd_once_##x = yk__TSD_ONCE_INIT
+#define YK_TSD_ONCE(x,fn)		yk__TSD_ONCE(yk__tsd_once_##x, fn)
+
 #endif
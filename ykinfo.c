@@ -31,8 +31,23 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <stdbool.h>
+#include <stdarg.h>
+#include <signal.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#endif
 
 #include <yubikey.h>
 #include <ykcore.h>
@@ -40,6 +55,8 @@
 #include <ykpers-version.h>
 #include <ykdef.h>
 
+#include "ykthread.h"
+
 const char *usage =
 	"Usage: ykinfo [options]\n"
 	"\n"
@@ -48,6 +65,7 @@ const char *usage =
 	"\t-s        Get serial in decimal from YubiKey\n"
 	"\t-m        Get serial in modhex from YubiKey\n"
 	"\t-nkey     Read from nth key found\n"
+	"\t-Sserial  Read from the key with this serial number\n"
 	"\t-H        Get serial in hex from YubiKey\n"
 	"\t-v        Get version from YubiKey\n"
 	"\t-t        Get touchlevel from YubiKey\n"
@@ -59,6 +77,12 @@ const char *usage =
 	"\t-a        Get all information above\n"
 	"\t-c        Get capabilities from YubiKey\n"
 	"\n"
+	"\t-A        Query all YubiKeys in parallel, output JSON lines with\n"
+	"\t          everything above unless options select fields\n"
+	"\t-Msecs    Keep all YubiKeys open and poll their status every secs\n"
+	"\t          seconds, exposing metrics in the Prometheus text format\n"
+	"\t-ofile    With -M, write the metrics to file\n"
+	"\t-lport    With -M, serve the metrics over HTTP on localhost:port\n"
 	"\t-q        Only output information from YubiKey\n"
 	"\n"
 	"\t-V        Get the tool version\n"
@@ -66,7 +90,7 @@ const char *usage =
 	"\n"
 	"\n"
 	;
-const char *optstring = "asmn:HvtpqhV12iIc";
+const char *optstring = "asmn:S:HvtpqhV12iIcAM:o:l:";
 
 static void report_yk_error(void)
 {
@@ -85,7 +109,9 @@ static int parse_args(int argc, char **argv,
 		bool *serial_dec, bool *serial_modhex, bool *serial_hex,
 		bool *version, bool *touch_level, bool *pgm_seq, bool *quiet,
 		bool *slot1, bool *slot2, bool *vid, bool *pid, bool *capa,
-		int *key_index, int *exit_code)
+		bool *all_keys, double *monitor_interval,
+		const char **monitor_textfile, int *monitor_port,
+		int *key_index, unsigned int *key_serial, int *exit_code)
 {
 	int c;
 
@@ -112,6 +138,14 @@ static int parse_args(int argc, char **argv,
 		case 'n':
 			*key_index = atoi(optarg);
 			break;
+		case 'S':
+			*key_serial = strtoul(optarg, NULL, 10);
+			if (*key_serial == 0) {
+				fputs("Invalid serial number.\n", stderr);
+				*exit_code = 1;
+				return 0;
+			}
+			break;
 		case 'H':
 			*serial_hex = true;
 			break;
@@ -142,6 +176,28 @@ static int parse_args(int argc, char **argv,
 		case 'c':
 			*capa = true;
 			break;
+		case 'A':
+			*all_keys = true;
+			break;
+		case 'M':
+			*monitor_interval = atof(optarg);
+			if (*monitor_interval <= 0) {
+				fputs("Invalid monitoring interval.\n", stderr);
+				*exit_code = 1;
+				return 0;
+			}
+			break;
+		case 'o':
+			*monitor_textfile = optarg;
+			break;
+		case 'l':
+			*monitor_port = atoi(optarg);
+			if (*monitor_port <= 0 || *monitor_port > 65535) {
+				fputs("Invalid port.\n", stderr);
+				*exit_code = 1;
+				return 0;
+			}
+			break;
 		case 'V':
 			fputs(YKPERS_VERSION_STRING "\n", stderr);
 			*exit_code = 0;
@@ -154,6 +210,22 @@ static int parse_args(int argc, char **argv,
 		}
 	}
 
+	if ((*monitor_textfile || *monitor_port) && *monitor_interval == 0) {
+		fputs("-o and -l need -M.\n", stderr);
+		*exit_code = 1;
+		return 0;
+	}
+	if (*monitor_interval > 0)
+		return 1;
+
+	if (!*serial_dec && !*serial_modhex && !*serial_hex &&
+			!*version && !*touch_level && !*pgm_seq && !*slot1 && !*slot2 &&
+			!*vid && !*pid && !*capa && *all_keys) {
+		*serial_dec = *serial_modhex = *serial_hex = true;
+		*version = *touch_level = *pgm_seq = true;
+		*slot1 = *slot2 = *vid = *pid = *capa = true;
+	}
+
 	if (!*serial_dec && !*serial_modhex && !*serial_hex &&
 			!*version && !*touch_level && !*pgm_seq && !*slot1 && !*slot2 &&
 			!*vid && !*pid && !*capa) {
@@ -166,6 +238,780 @@ static int parse_args(int argc, char **argv,
 	return 1;
 }
 
+/* With -A every key found is opened and queried from its own thread and
+   described by one JSON object, in the order the keys were found.  The
+   keys are enumerated once with yk_list_keys(); where the backend
+   cannot list them, indexes are probed by threads a wave at a time
+   until one finds no key. */
+
+#define FLEET_MAX_KEYS	256
+#define FLEET_WAVE	16
+
+struct fleet_fields {
+	bool serial_dec, serial_modhex, serial_hex;
+	bool version, touch_level, pgm_seq, slot1, slot2;
+	bool vid, pid, capa;
+};
+
+struct fleet_key {
+	int index;
+	bool by_id;
+	unsigned int id;
+	YK_KEY *yk;
+	const struct fleet_fields *fields;
+	bool threaded;
+
+	unsigned int serial;
+	YK_STATUS *st;
+	int vendor_id, product_id;
+	unsigned char capabilities[0xff];
+	unsigned int capabilities_len;
+	double latency_ms;
+	int err;
+};
+
+static double now_ms(void)
+{
+#ifdef _WIN32
+	LARGE_INTEGER freq, now;
+	QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&now);
+	return (double) now.QuadPart * 1000.0 / (double) freq.QuadPart;
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+#endif
+}
+
+/* Only yk_errno, which is per thread: yk_usb_strerror() reports the
+   last USB error of any thread. */
+static void fleet_set_error(struct fleet_key *key)
+{
+	key->err = yk_errno ? yk_errno : YK_EUSBERR;
+}
+
+static int fleet_query(struct fleet_key *key)
+{
+	const struct fleet_fields *f = key->fields;
+
+	if (f->serial_dec || f->serial_modhex || f->serial_hex) {
+		if (!yk_get_serial(key->yk, 1, 0, &key->serial))
+			return 0;
+	}
+	if (f->version || f->touch_level || f->pgm_seq || f->slot1 || f->slot2) {
+		if (!(key->st = ykds_alloc()) || !yk_get_status(key->yk, key->st))
+			return 0;
+	}
+	if (f->vid || f->pid) {
+		if (!yk_get_key_vid_pid(key->yk, &key->vendor_id,
+					&key->product_id))
+			return 0;
+	}
+	if (f->capa) {
+		key->capabilities_len = sizeof(key->capabilities);
+		if (!yk_get_capabilities(key->yk, 1, 0, key->capabilities,
+					 &key->capabilities_len))
+			return 0;
+	}
+	return 1;
+}
+
+static YK_THREAD_FUNC(fleet_worker, arg)
+{
+	struct fleet_key *key = arg;
+	double start;
+
+	yk_errno = 0;
+	key->yk = key->by_id ? yk_open_key_id(key->id) : yk_open_key(key->index);
+	if (!key->yk) {
+		fleet_set_error(key);
+		return 0;
+	}
+	start = now_ms();
+	if (!fleet_query(key))
+		fleet_set_error(key);
+	key->latency_ms = now_ms() - start;
+	return 0;
+}
+
+static void fleet_print(const struct fleet_key *key)
+{
+	const struct fleet_fields *f = key->fields;
+
+	printf("{\"index\":%d", key->index);
+	if (key->err) {
+		printf(",\"error\":\"%s\"", yk_strerror(key->err));
+		printf(",\"latency_ms\":%.3f}\n", key->latency_ms);
+		return;
+	}
+	if (f->serial_dec)
+		printf(",\"serial\":%u", key->serial);
+	if (f->serial_hex || f->serial_modhex) {
+		char buf[16];
+		char hex_serial[8];
+		char modhex_serial[16];
+		char *ptr = buf;
+
+		int chars = snprintf(buf + 1, sizeof(buf) - 1, "%x", key->serial);
+		if (chars % 2 == 1) {
+			buf[0] = '0';
+		} else {
+			ptr += 1;
+		}
+		if (f->serial_hex)
+			printf(",\"serial_hex\":\"%s\"", ptr);
+		if (f->serial_modhex) {
+			yubikey_hex_decode(hex_serial, ptr, strlen(ptr));
+			yubikey_modhex_encode(modhex_serial, hex_serial, strlen(ptr)/2);
+			printf(",\"serial_modhex\":\"%s\"", modhex_serial);
+		}
+	}
+	if (f->version)
+		printf(",\"version\":\"%d.%d.%d\"", ykds_version_major(key->st),
+		       ykds_version_minor(key->st), ykds_version_build(key->st));
+	if (f->touch_level)
+		printf(",\"touch_level\":%d", ykds_touch_level(key->st));
+	if (f->pgm_seq)
+		printf(",\"programming_sequence\":%d", ykds_pgm_seq(key->st));
+	if (f->slot1)
+		printf(",\"slot1_status\":%d",
+		       (ykds_touch_level(key->st) & CONFIG1_VALID) == CONFIG1_VALID);
+	if (f->slot2)
+		printf(",\"slot2_status\":%d",
+		       (ykds_touch_level(key->st) & CONFIG2_VALID) == CONFIG2_VALID);
+	if (f->vid)
+		printf(",\"vendor_id\":\"%x\"", key->vendor_id);
+	if (f->pid)
+		printf(",\"product_id\":\"%x\"", key->product_id);
+	if (f->capa) {
+		unsigned int i;
+		printf(",\"capabilities\":\"");
+		for (i = 0; i < key->capabilities_len; i++)
+			printf("%02x", key->capabilities[i]);
+		printf("\"");
+	}
+	printf(",\"latency_ms\":%.3f}\n", key->latency_ms);
+}
+
+/* Run the workers of keys[0..n), each in a thread if one can be had */
+static void fleet_query_all(struct fleet_key *keys, int n)
+{
+	YK_THREAD_TYPE tids[FLEET_WAVE];
+	bool threaded[FLEET_WAVE];
+	int i, j;
+
+	for (i = 0; i < n; i += FLEET_WAVE) {
+		int wave = n - i < FLEET_WAVE ? n - i : FLEET_WAVE;
+
+		for (j = 0; j < wave; j++) {
+			threaded[j] = YK_THREAD_CREATE(tids[j], fleet_worker,
+						       &keys[i + j]) == 0;
+			if (!threaded[j])
+				fleet_worker(&keys[i + j]);
+		}
+		for (j = 0; j < wave; j++) {
+			if (threaded[j])
+				YK_THREAD_JOIN(tids[j]);
+		}
+	}
+}
+
+/* Returns the exit code: 0 when every key answered, 1 otherwise. */
+static int fleet_run(const struct fleet_fields *fields)
+{
+	struct fleet_key *keys;
+	unsigned int ids[FLEET_MAX_KEYS];
+	size_t count;
+	int nkeys = 0;
+	int exit_code = 0;
+	int i;
+
+	if ((keys = calloc(FLEET_MAX_KEYS, sizeof(*keys))) == NULL) {
+		yk_errno = YK_ENOMEM;
+		report_yk_error();
+		return 1;
+	}
+	for (i = 0; i < FLEET_MAX_KEYS; i++) {
+		keys[i].index = i;
+		keys[i].fields = fields;
+	}
+
+	if (yk_list_keys(ids, FLEET_MAX_KEYS, &count)) {
+		nkeys = count;
+		for (i = 0; i < nkeys; i++) {
+			keys[i].by_id = true;
+			keys[i].id = ids[i];
+		}
+		fleet_query_all(keys, nkeys);
+	} else if (yk_errno == YK_ENOTYETIMPL) {
+		/* the first index with no key ends the list */
+		while (nkeys < FLEET_MAX_KEYS) {
+			int wave = FLEET_MAX_KEYS - nkeys < FLEET_WAVE ?
+				FLEET_MAX_KEYS - nkeys : FLEET_WAVE;
+			int end = nkeys + wave;
+
+			fleet_query_all(keys + nkeys, wave);
+			for (i = nkeys; i < end; i++) {
+				if (keys[i].err == YK_ENOKEY)
+					break;
+			}
+			nkeys = i;
+			if (i < end)
+				break;
+		}
+	} else {
+		report_yk_error();
+		free(keys);
+		return 1;
+	}
+	if (nkeys == 0) {
+		yk_errno = YK_ENOKEY;
+		report_yk_error();
+		exit_code = 1;
+	}
+
+	for (i = 0; i < nkeys; i++) {
+		fleet_print(&keys[i]);
+		if (keys[i].err)
+			exit_code = 1;
+	}
+	for (i = 0; i < FLEET_MAX_KEYS; i++) {
+		if (keys[i].yk)
+			yk_close_key(keys[i].yk);
+		if (keys[i].st)
+			ykds_free(keys[i].st);
+	}
+	free(keys);
+	return exit_code;
+}
+
+/* With -M the keys are kept open and polled with yk_get_status() at an
+   interval, and the results are exposed in the Prometheus text format,
+   as a textfile and/or over HTTP on a local port.  A key that stops
+   answering is closed and stays listed as down.  The keys are then
+   enumerated again, backing off each time that finds nothing new, and
+   otherwise every MONITOR_RESCAN_MAX to pick up new keys.  A rescan
+   keeps the keys that are open and only opens the others, by id where
+   the backend lists keys, else by index, dropping keys it already has
+   by serial number. */
+
+#define MONITOR_RESCAN_MAX	300.0	/* seconds between rescans at most */
+#define MONITOR_MAX_KEYS	256
+
+static const double latency_buckets[] = {
+	0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1.0
+};
+#define NUM_LATENCY_BUCKETS \
+	(sizeof(latency_buckets) / sizeof(latency_buckets[0]))
+
+struct monitor_key {
+	YK_KEY *yk;			/* NULL while the key is gone */
+	int index;
+	bool by_id;
+	unsigned int id;
+	unsigned int serial;		/* 0 if the key does not tell */
+	bool up;
+	YK_STATUS *st;
+	int vendor_id, product_id;
+	unsigned long polls;
+	unsigned long errors;
+	unsigned long buckets[NUM_LATENCY_BUCKETS];
+	double latency_sum;
+};
+
+struct monitor {
+	double interval;
+	const char *textfile;
+	int port;
+
+	struct monitor_key keys[MONITOR_MAX_KEYS];
+	int nkeys;
+	unsigned long unplugs;
+	unsigned long rescans;
+	double rescan_backoff;
+	double next_rescan;
+
+	char *text;			/* last rendered exposition */
+	size_t text_len;
+	size_t text_size;
+};
+
+static volatile sig_atomic_t monitor_stop = 0;
+
+static void monitor_signal(int sig)
+{
+	monitor_stop = 1;
+}
+
+static void monitor_printf(struct monitor *m, const char *fmt, ...)
+{
+	va_list ap;
+	int n;
+
+	for (;;) {
+		char *tmp;
+
+		va_start(ap, fmt);
+		n = vsnprintf(m->text + m->text_len, m->text_size - m->text_len,
+			      fmt, ap);
+		va_end(ap);
+		if (n < 0)
+			return;
+		if ((size_t) n < m->text_size - m->text_len) {
+			m->text_len += n;
+			return;
+		}
+		if (!(tmp = realloc(m->text, m->text_size * 2 + n + 1)))
+			return;
+		m->text = tmp;
+		m->text_size = m->text_size * 2 + n + 1;
+	}
+}
+
+static struct monitor_key *monitor_find(struct monitor *m, unsigned int serial,
+					int index)
+{
+	int i;
+
+	for (i = 0; i < m->nkeys; i++) {
+		if (serial ? m->keys[i].serial == serial :
+		    !m->keys[i].serial && m->keys[i].index == index)
+			return &m->keys[i];
+	}
+	if (m->nkeys == MONITOR_MAX_KEYS)
+		return NULL;
+	memset(&m->keys[m->nkeys], 0, sizeof(m->keys[0]));
+	return &m->keys[m->nkeys++];
+}
+
+/* Keys held open are not opened again */
+static bool monitor_holds_id(const struct monitor *m, unsigned int id)
+{
+	int i;
+
+	for (i = 0; i < m->nkeys; i++) {
+		if (m->keys[i].yk && m->keys[i].by_id && m->keys[i].id == id)
+			return true;
+	}
+	return false;
+}
+
+static bool monitor_holds_serial(const struct monitor *m, unsigned int serial)
+{
+	int i;
+
+	for (i = 0; i < m->nkeys; i++) {
+		if (m->keys[i].yk && serial && m->keys[i].serial == serial)
+			return true;
+	}
+	return false;
+}
+
+/* Take yk on, remembered by serial number so that counters carry over
+   when a key comes back.  Returns false if yk was not kept. */
+static bool monitor_add(struct monitor *m, YK_KEY *yk, int index,
+			bool by_id, unsigned int id)
+{
+	struct monitor_key *key;
+	unsigned int serial = 0;
+
+	if (!yk_get_serial(yk, 1, 0, &serial))
+		serial = 0;
+	if (monitor_holds_serial(m, serial) ||
+	    !(key = monitor_find(m, serial, index)) || key->yk) {
+		yk_close_key(yk);
+		return false;
+	}
+	key->yk = yk;
+	key->index = index;
+	key->by_id = by_id;
+	key->id = id;
+	key->serial = serial;
+	if (!key->st)
+		key->st = ykds_alloc();
+	if (!yk_get_key_vid_pid(yk, &key->vendor_id, &key->product_id))
+		key->vendor_id = key->product_id = 0;
+	return true;
+}
+
+/* Open the keys present that are not held yet, returning how many */
+static int monitor_rescan(struct monitor *m)
+{
+	unsigned int ids[MONITOR_MAX_KEYS];
+	size_t count, n;
+	int i, added = 0;
+
+	m->rescans++;
+	if (yk_list_keys(ids, MONITOR_MAX_KEYS, &count)) {
+		for (n = 0; n < count; n++) {
+			YK_KEY *yk;
+
+			if (monitor_holds_id(m, ids[n]))
+				continue;
+			if ((yk = yk_open_key_id(ids[n])) &&
+			    monitor_add(m, yk, n, true, ids[n]))
+				added++;
+		}
+		return added;
+	}
+
+	/* Without ids, held keys fail to open again or are recognised by
+	   their serial number */
+	for (i = 0; i < MONITOR_MAX_KEYS; i++) {
+		YK_KEY *yk = yk_open_key(i);
+
+		if (!yk) {
+			if (yk_errno == YK_ENOKEY)
+				break;
+			continue;
+		}
+		if (monitor_add(m, yk, i, false, 0))
+			added++;
+	}
+	return added;
+}
+
+/* Whether a key is gone, or none was found */
+static bool monitor_missing(const struct monitor *m)
+{
+	int i;
+
+	for (i = 0; i < m->nkeys; i++) {
+		if (!m->keys[i].yk)
+			return true;
+	}
+	return m->nkeys == 0;
+}
+
+static void monitor_observe(struct monitor_key *key, double seconds)
+{
+	size_t i;
+
+	for (i = 0; i < NUM_LATENCY_BUCKETS; i++) {
+		if (seconds <= latency_buckets[i])
+			key->buckets[i]++;
+	}
+	key->latency_sum += seconds;
+	key->polls++;
+}
+
+/* Returns false if a key was lost in this poll.  Keys that are gone
+   already are skipped, and one that fails but is still there is
+   polled again. */
+static bool monitor_poll(struct monitor *m)
+{
+	bool lost = false;
+	int i;
+
+	for (i = 0; i < m->nkeys; i++) {
+		struct monitor_key *key = &m->keys[i];
+		double start;
+
+		if (!key->yk) {
+			key->up = false;
+			continue;
+		}
+		start = now_ms();
+		key->up = key->st && yk_get_status(key->yk, key->st);
+		monitor_observe(key, (now_ms() - start) / 1000.0);
+		if (!key->up) {
+			key->errors++;
+			if (yk_errno == YK_EUSBERR) {
+				/* most likely unplugged */
+				yk_close_key(key->yk);
+				key->yk = NULL;
+				m->unplugs++;
+				lost = true;
+			}
+		}
+	}
+	return !lost;
+}
+
+static void monitor_render_key_labels(struct monitor *m,
+				      const struct monitor_key *key)
+{
+	if (key->serial)
+		monitor_printf(m, "serial=\"%u\"", key->serial);
+	else
+		monitor_printf(m, "index=\"%d\"", key->index);
+}
+
+#define MONITOR_GAUGE(m, name, help, expr)				\
+	do {								\
+		int i_;							\
+		monitor_printf(m, "# HELP ykinfo_" name " " help "\n"	\
+			       "# TYPE ykinfo_" name " gauge\n");	\
+		for (i_ = 0; i_ < (m)->nkeys; i_++) {			\
+			const struct monitor_key *key = &(m)->keys[i_];	\
+			if (!key->up)					\
+				continue;				\
+			monitor_printf(m, "ykinfo_" name "{");		\
+			monitor_render_key_labels(m, key);		\
+			monitor_printf(m, "} %d\n", (int) (expr));	\
+		}							\
+	} while (0)
+
+static void monitor_render(struct monitor *m)
+{
+	int i;
+	size_t b;
+
+	m->text_len = 0;
+	if (m->text)
+		m->text[0] = '\0';
+
+	monitor_printf(m, "# HELP ykinfo_keys Number of YubiKeys answering.\n"
+		       "# TYPE ykinfo_keys gauge\n");
+	for (i = 0, b = 0; i < m->nkeys; i++)
+		b += m->keys[i].up;
+	monitor_printf(m, "ykinfo_keys %lu\n", (unsigned long) b);
+	monitor_printf(m, "# HELP ykinfo_unplugs_total Keys that stopped answering.\n"
+		       "# TYPE ykinfo_unplugs_total counter\n"
+		       "ykinfo_unplugs_total %lu\n", m->unplugs);
+	monitor_printf(m, "# HELP ykinfo_rescans_total Enumerations of the keys.\n"
+		       "# TYPE ykinfo_rescans_total counter\n"
+		       "ykinfo_rescans_total %lu\n", m->rescans);
+
+	monitor_printf(m, "# HELP ykinfo_up Whether the key answered the last poll.\n"
+		       "# TYPE ykinfo_up gauge\n");
+	for (i = 0; i < m->nkeys; i++) {
+		monitor_printf(m, "ykinfo_up{");
+		monitor_render_key_labels(m, &m->keys[i]);
+		monitor_printf(m, "} %d\n", m->keys[i].up);
+	}
+
+	monitor_printf(m, "# HELP ykinfo_info Version and USB ids of the key.\n"
+		       "# TYPE ykinfo_info gauge\n");
+	for (i = 0; i < m->nkeys; i++) {
+		const struct monitor_key *key = &m->keys[i];
+		if (!key->up)
+			continue;
+		monitor_printf(m, "ykinfo_info{");
+		monitor_render_key_labels(m, key);
+		monitor_printf(m, ",version=\"%d.%d.%d\",vendor_id=\"%x\","
+			       "product_id=\"%x\"} 1\n",
+			       ykds_version_major(key->st),
+			       ykds_version_minor(key->st),
+			       ykds_version_build(key->st),
+			       key->vendor_id, key->product_id);
+	}
+
+	MONITOR_GAUGE(m, "touch_level", "Touch level of the key.",
+		      ykds_touch_level(key->st));
+	MONITOR_GAUGE(m, "programming_sequence", "Programming sequence of the key.",
+		      ykds_pgm_seq(key->st));
+	MONITOR_GAUGE(m, "slot1_valid", "Whether slot 1 is programmed.",
+		      (ykds_touch_level(key->st) & CONFIG1_VALID) == CONFIG1_VALID);
+	MONITOR_GAUGE(m, "slot2_valid", "Whether slot 2 is programmed.",
+		      (ykds_touch_level(key->st) & CONFIG2_VALID) == CONFIG2_VALID);
+
+	monitor_printf(m, "# HELP ykinfo_poll_errors_total Failed status polls.\n"
+		       "# TYPE ykinfo_poll_errors_total counter\n");
+	for (i = 0; i < m->nkeys; i++) {
+		monitor_printf(m, "ykinfo_poll_errors_total{");
+		monitor_render_key_labels(m, &m->keys[i]);
+		monitor_printf(m, "} %lu\n", m->keys[i].errors);
+	}
+
+	monitor_printf(m, "# HELP ykinfo_status_latency_seconds Time taken by status polls.\n"
+		       "# TYPE ykinfo_status_latency_seconds histogram\n");
+	for (i = 0; i < m->nkeys; i++) {
+		const struct monitor_key *key = &m->keys[i];
+
+		for (b = 0; b < NUM_LATENCY_BUCKETS; b++) {
+			monitor_printf(m, "ykinfo_status_latency_seconds_bucket{");
+			monitor_render_key_labels(m, key);
+			monitor_printf(m, ",le=\"%g\"} %lu\n", latency_buckets[b],
+				       key->buckets[b]);
+		}
+		monitor_printf(m, "ykinfo_status_latency_seconds_bucket{");
+		monitor_render_key_labels(m, key);
+		monitor_printf(m, ",le=\"+Inf\"} %lu\n", key->polls);
+		monitor_printf(m, "ykinfo_status_latency_seconds_sum{");
+		monitor_render_key_labels(m, key);
+		monitor_printf(m, "} %.6f\n", key->latency_sum);
+		monitor_printf(m, "ykinfo_status_latency_seconds_count{");
+		monitor_render_key_labels(m, key);
+		monitor_printf(m, "} %lu\n", key->polls);
+	}
+}
+
+/* Written next to the target and renamed, so readers never see a
+   partial file. */
+static void monitor_write_textfile(struct monitor *m)
+{
+	size_t len = strlen(m->textfile) + 5;
+	char *tmp = malloc(len);
+	FILE *f;
+
+	if (!tmp)
+		return;
+	snprintf(tmp, len, "%s.tmp", m->textfile);
+	if ((f = fopen(tmp, "w")) == NULL) {
+		perror(tmp);
+	} else if (fwrite(m->text, 1, m->text_len, f) != m->text_len) {
+		perror(tmp);
+		fclose(f);
+		remove(tmp);
+	} else if (fclose(f) != 0) {
+		perror(tmp);
+		remove(tmp);
+	} else {
+#ifdef _WIN32
+		remove(m->textfile);
+#endif
+		if (rename(tmp, m->textfile) != 0) {
+			perror(m->textfile);
+			remove(tmp);
+		}
+	}
+	free(tmp);
+}
+
+#ifndef _WIN32
+static int monitor_listen(int port)
+{
+	struct sockaddr_in sa;
+	int one = 1;
+	int fd = socket(AF_INET, SOCK_STREAM, 0);
+
+	if (fd < 0) {
+		perror("socket");
+		return -1;
+	}
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+	memset(&sa, 0, sizeof(sa));
+	sa.sin_family = AF_INET;
+	sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	sa.sin_port = htons(port);
+	if (bind(fd, (struct sockaddr *) &sa, sizeof(sa)) != 0 ||
+	    listen(fd, 16) != 0) {
+		perror("bind");
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+/* Answer one scrape with the last rendered exposition, whatever was
+   asked for.  The keys are never touched from here. */
+static void monitor_serve(struct monitor *m, int lfd)
+{
+	char hdr[128];
+	char req[1024];
+	struct timeval tv = { 1, 0 };
+	int fd = accept(lfd, NULL, NULL);
+	int n;
+
+	if (fd < 0)
+		return;
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+	setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+	if (recv(fd, req, sizeof(req), 0) > 0) {
+		n = snprintf(hdr, sizeof(hdr), "HTTP/1.0 200 OK\r\n"
+			     "Content-Type: text/plain; version=0.0.4\r\n"
+			     "Content-Length: %lu\r\n\r\n",
+			     (unsigned long) m->text_len);
+		if (send(fd, hdr, n, 0) == n && m->text_len)
+			send(fd, m->text, m->text_len, 0);
+	}
+	close(fd);
+}
+#endif
+
+/* Wait until the time given, answering scrapes meanwhile. */
+static void monitor_wait(struct monitor *m, int lfd, double until)
+{
+	double now;
+
+	while (!monitor_stop && (now = now_ms()) < until) {
+#ifdef _WIN32
+		Sleep((DWORD) (until - now));
+#else
+		struct timeval tv;
+		fd_set rfds;
+		double left = until - now;
+
+		tv.tv_sec = (long) (left / 1000);
+		tv.tv_usec = (long) ((left - tv.tv_sec * 1000.0) * 1000);
+		FD_ZERO(&rfds);
+		if (lfd >= 0)
+			FD_SET(lfd, &rfds);
+		if (select(lfd + 1, &rfds, NULL, NULL, &tv) > 0 &&
+		    FD_ISSET(lfd, &rfds))
+			monitor_serve(m, lfd);
+#endif
+	}
+}
+
+static int monitor_run(struct monitor *m)
+{
+	int lfd = -1;
+	int i;
+
+	if (m->port) {
+#ifdef _WIN32
+		fputs("Serving metrics over HTTP is not supported on this platform.\n",
+		      stderr);
+		return 1;
+#else
+		if ((lfd = monitor_listen(m->port)) < 0)
+			return 1;
+		signal(SIGPIPE, SIG_IGN);
+#endif
+	}
+	signal(SIGINT, monitor_signal);
+	signal(SIGTERM, monitor_signal);
+
+	m->rescan_backoff = m->interval;
+	m->next_rescan = 0;
+	while (!monitor_stop) {
+		double start = now_ms();
+
+		if (start >= m->next_rescan) {
+			/* While keys are missing, wait twice as long after
+			   each rescan that finds nothing. */
+			if (monitor_rescan(m) > 0)
+				m->rescan_backoff = m->interval;
+			else if ((m->rescan_backoff *= 2) > MONITOR_RESCAN_MAX)
+				m->rescan_backoff = MONITOR_RESCAN_MAX;
+			m->next_rescan = start + (monitor_missing(m) ?
+				m->rescan_backoff : MONITOR_RESCAN_MAX) * 1000;
+		}
+		if (!monitor_poll(m)) {
+			/* a key was just lost, look for it again soon */
+			double at = start + m->interval * 1000;
+
+			m->rescan_backoff = m->interval;
+			if (at < m->next_rescan)
+				m->next_rescan = at;
+		}
+
+		monitor_render(m);
+		if (m->textfile)
+			monitor_write_textfile(m);
+		if (!m->textfile && !m->port) {
+			fwrite(m->text, 1, m->text_len, stdout);
+			fflush(stdout);
+		}
+		monitor_wait(m, lfd, start + m->interval * 1000);
+	}
+
+#ifndef _WIN32
+	if (lfd >= 0)
+		close(lfd);
+#endif
+	for (i = 0; i < m->nkeys; i++) {
+		if (m->keys[i].yk)
+			yk_close_key(m->keys[i].yk);
+		if (m->keys[i].st)
+			ykds_free(m->keys[i].st);
+	}
+	free(m->text);
+	return 0;
+}
 
 int main(int argc, char **argv)
 {
@@ -187,7 +1033,12 @@ int main(int argc, char **argv)
 	bool capa = false;
 
 	bool quiet = false;
+	bool all_keys = false;
+	double monitor_interval = 0;
+	const char *monitor_textfile = NULL;
+	int monitor_port = 0;
 	int key_index = 0;
+	unsigned int key_serial = 0;
 
 	yk_errno = 0;
 
@@ -195,7 +1046,9 @@ int main(int argc, char **argv)
 				&serial_dec, &serial_modhex, &serial_hex,
 				&version, &touch_level, &pgm_seq, &quiet,
 				&slot1, &slot2, &vid, &pid, &capa,
-				&key_index, &exit_code))
+				&all_keys, &monitor_interval,
+				&monitor_textfile, &monitor_port,
+				&key_index, &key_serial, &exit_code))
 		exit(exit_code);
 
 	if (!yk_init()) {
@@ -203,7 +1056,37 @@ int main(int argc, char **argv)
 		goto err;
 	}
 
-	if (!(yk = yk_open_key(key_index))) {
+	if (all_keys || monitor_interval > 0) {
+		struct fleet_fields fields = {
+			serial_dec, serial_modhex, serial_hex,
+			version, touch_level, pgm_seq, slot1, slot2,
+			vid, pid, capa
+		};
+		struct monitor *m;
+
+		if (monitor_interval == 0) {
+			exit_code = fleet_run(&fields);
+		} else if ((m = calloc(1, sizeof(*m))) == NULL) {
+			exit_code = 1;
+		} else {
+			m->interval = monitor_interval;
+			m->textfile = monitor_textfile;
+			m->port = monitor_port;
+			exit_code = monitor_run(m);
+			free(m);
+		}
+		if (!yk_release()) {
+			report_yk_error();
+			exit_code = 2;
+		}
+		exit(exit_code);
+	}
+
+	if (key_serial)
+		yk = yk_open_key_by_serial(key_serial);
+	else
+		yk = yk_open_key(key_index);
+	if (!yk) {
 		exit_code = 1;
 		goto err;
 	}
@@ -48,6 +48,11 @@
 const char *usage =
 "Usage: ykpersonalize [options]\n"
 "-Nkey     use nth key found\n"
+"-A        with -n or -t, write the NDEF to all keys found, in parallel.\n"
+"          {serial}, {serial_hex}, {serial_modhex} and {prefix} in the\n"
+"          NDEF are replaced with the values of each key\n"
+"-MFILE    with -A, take the access code and the public id for {prefix}\n"
+"          of each key from the manifest FILE\n"
 "-u        update configuration without overwriting.  This is only available\n"
 "          in YubiKey 2.3 and later.  EXTFLAG_ALLOW_UPDATE will be set by\n"
 "          default\n"
@@ -160,7 +165,7 @@ const char *usage =
 "-V        tool version\n"
 "-h        help (this text)\n"
 ;
-const char *optstring = ":u12xza:c:n:t:hi:o:s:f:dvym:S:VN:D:";
+const char *optstring = ":u12xza:c:n:t:hi:o:s:f:dvym:S:VN:D:AM:";
 
 static int _set_fixed(char *opt, YKP_CONFIG *cfg);
 static int _format_decimal_as_hex(uint8_t *dst, size_t dst_len, uint8_t *src);
@@ -719,6 +724,8 @@ int args_to_config(int argc, char **argv, YKP_CONFIG *cfg, char *oathid,
 			break;
 		case 'V':
 		case 'N':
+		case 'A':
+		case 'M':
 			continue;
 		case ':':
 			switch(optopt) {
@@ -803,32 +810,7 @@ int args_to_config(int argc, char **argv, YKP_CONFIG *cfg, char *oathid,
 		}
 
 		if(keylocation == 0) {
-			const char *random_places[] = {
-				"/dev/srandom",
-				"/dev/urandom",
-				"/dev/random",
-				0
-			};
-			const char **random_place;
-			size_t read_bytes = 0;
-
-			for (random_place = random_places; *random_place; random_place++) {
-				FILE *random_file = fopen(*random_place, "r");
-				if (random_file) {
-					read_bytes = 0;
-
-					while (read_bytes < key_bytes) {
-						size_t n = fread(&keybuf[read_bytes], 1,
-								key_bytes - read_bytes, random_file);
-						read_bytes += n;
-					}
-
-					fclose(random_file);
-					break;
-				}
-			}
-			if(read_bytes < key_bytes) {
-				ykp_errno = YKP_ENORANDOM;
+			if(!ykp_random_bytes(keybuf, key_bytes)) {
 				*exit_code = 1;
 				return 0;
 			}
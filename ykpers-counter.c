@@ -0,0 +1,432 @@
+/* -*- mode:C; c-file-style: "bsd" -*- */
+/*
+ * Copyright (c) 2026 Yubico AB
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Replay counters of Yubico OTP and OATH-HOTP keys, keyed by public id,
+ * in a file that validators in any number of threads and processes map
+ * and update without a lock.
+ *
+ * The file is
+ *
+ *   struct store_header	header
+ *   struct store_bucket	buckets[header.buckets]
+ *
+ * in host byte order, the buckets forming an open addressed hash table
+ * with linear probing.  Entries are never removed, so a probe sequence
+ * never changes once a key is in it.  A bucket is claimed by switching
+ * its state from free to claimed with a compare-and-swap, filled in and
+ * then published as used; counters only move forward, with a
+ * compare-and-swap of the 64 bit word.
+ *
+ * Every write is a single aligned word in a shared mapping, so a
+ * process that dies leaves every counter at a value it accepted.  Only
+ * a claim can be left half done.  The claim carries the pid of its
+ * owner, so a process probing past it retires it once the owner is
+ * gone, and the first process to open the store after everybody else
+ * closed it, which is the one getting an exclusive lock, retires all of
+ * them.  Counters reach the disk when the kernel writes the pages back,
+ * or at ykp_counter_store_sync().
+ */
+
+#include "ykpers_lcl.h"
+#include "ykthread.h"
+
+#include <ykpers.h>
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifndef _WIN32
+#include <unistd.h>
+#include <sched.h>
+#include <signal.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#endif
+
+#define STORE_MAGIC		"YKPC"
+#define STORE_VERSION		1
+#define STORE_BYTE_ORDER	0x0102
+#define STORE_DEFAULT_CAPACITY	1024
+
+/* How long to wait for another thread to publish a bucket it claimed,
+   and how often to check that its owner is still alive meanwhile */
+#define STORE_CLAIM_SPINS	1000000
+#define STORE_OWNER_SPINS	1024
+
+/* The low two bits of a bucket state, a claim has the pid of the
+   process that made it above them */
+enum {
+	BUCKET_FREE = 0,
+	BUCKET_CLAIMED,
+	BUCKET_USED,
+	BUCKET_RETIRED		/* claim interrupted by a crash */
+};
+
+#define BUCKET_KIND(state)	((state) & 3)
+#define BUCKET_CLAIM(pid)	((uint32_t) (pid) << 2 | BUCKET_CLAIMED)
+#define BUCKET_OWNER(state)	((state) >> 2)
+
+struct store_header {
+	char magic[4];
+	uint16_t version;
+	uint16_t byte_order;
+	uint32_t bucket_size;
+	uint32_t buckets;
+	uint32_t reserved[4];
+};
+
+struct store_bucket {
+	uint32_t state;
+	uint8_t id_len;
+	uint8_t reserved[3];
+	uint8_t id[FIXED_SIZE];
+	uint64_t counter;
+};
+
+struct ykp_counter_store_t {
+	int fd;
+	unsigned char *data;
+	size_t size;
+	uint32_t mask;
+	struct store_bucket *buckets;
+};
+
+static uint32_t store_hash(const unsigned char *id, size_t id_len)
+{
+	uint32_t h = 2166136261u ^ (uint32_t) id_len;
+	size_t i;
+
+	for (i = 0; i < id_len; i++)
+		h = (h ^ id[i]) * 16777619u;
+	return h ^ (h >> 15);
+}
+
+static uint32_t store_buckets(size_t capacity)
+{
+	uint32_t buckets = 2;
+
+	while (buckets < capacity * 2)
+		buckets <<= 1;
+	return buckets;
+}
+
+#ifndef _WIN32
+static int store_create(int fd, size_t capacity)
+{
+	struct store_header hdr;
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, STORE_MAGIC, sizeof(hdr.magic));
+	hdr.version = STORE_VERSION;
+	hdr.byte_order = STORE_BYTE_ORDER;
+	hdr.bucket_size = sizeof(struct store_bucket);
+	hdr.buckets = store_buckets(capacity ? capacity :
+				    STORE_DEFAULT_CAPACITY);
+
+	/* the buckets are zero, that is free, before the header is valid */
+	return ftruncate(fd, sizeof(hdr) + (off_t) hdr.buckets *
+			 sizeof(struct store_bucket)) == 0 &&
+		pwrite(fd, &hdr, sizeof(hdr), 0) == sizeof(hdr) &&
+		fsync(fd) == 0;
+}
+
+static int store_validate(YKP_COUNTER_STORE *s)
+{
+	const struct store_header *hdr =
+		(const struct store_header *) s->data;
+
+	if (s->size < sizeof(*hdr) ||
+	    memcmp(hdr->magic, STORE_MAGIC, sizeof(hdr->magic)) != 0 ||
+	    hdr->version != STORE_VERSION ||
+	    hdr->byte_order != STORE_BYTE_ORDER ||
+	    hdr->bucket_size != sizeof(struct store_bucket) ||
+	    hdr->buckets == 0 || (hdr->buckets & (hdr->buckets - 1)) != 0 ||
+	    s->size != sizeof(*hdr) + (size_t) hdr->buckets *
+	    sizeof(struct store_bucket))
+		return 0;
+
+	s->mask = hdr->buckets - 1;
+	s->buckets = (struct store_bucket *) (s->data + sizeof(*hdr));
+	return 1;
+}
+
+/* Run with the exclusive lock held, nobody else has the store open */
+static void store_recover(YKP_COUNTER_STORE *s)
+{
+	uint32_t i;
+
+	for (i = 0; i <= s->mask; i++) {
+		if (BUCKET_KIND(s->buckets[i].state) == BUCKET_CLAIMED)
+			s->buckets[i].state = BUCKET_RETIRED;
+	}
+}
+#endif
+
+static uint32_t store_claim(void)
+{
+#ifdef _WIN32
+	return BUCKET_CLAIMED;
+#else
+	return BUCKET_CLAIM(getpid());
+#endif
+}
+
+/* Whether the process holding claim has died without publishing it */
+static int store_claim_stale(uint32_t claim)
+{
+#ifdef _WIN32
+	return 0;
+#else
+	pid_t owner = (pid_t) BUCKET_OWNER(claim);
+
+	return owner != 0 && owner != getpid() &&
+		kill(owner, 0) != 0 && errno == ESRCH;
+#endif
+}
+
+YKP_COUNTER_STORE *ykp_open_counter_store(const char *path, size_t capacity)
+{
+#ifdef _WIN32
+	ykp_errno = YKP_ENOTYETIMPL;
+	return NULL;
+#else
+	YKP_COUNTER_STORE *s;
+	struct stat sb;
+	int exclusive;
+
+	if (!path || capacity > UINT32_MAX / 2) {
+		ykp_errno = YKP_EINVAL;
+		return NULL;
+	}
+	s = _yk_malloc(sizeof(YKP_COUNTER_STORE));
+	if (!s)
+		return NULL;
+	memset(s, 0, sizeof(YKP_COUNTER_STORE));
+
+	if ((s->fd = open(path, O_RDWR | O_CREAT, 0600)) < 0)
+		goto err;
+	/* Every user holds a shared lock, the first one in takes it
+	   exclusively while creating or recovering the file. */
+	exclusive = flock(s->fd, LOCK_EX | LOCK_NB) == 0;
+	if (!exclusive && flock(s->fd, LOCK_SH) != 0)
+		goto err;
+	if (fstat(s->fd, &sb) != 0)
+		goto err;
+	if (sb.st_size == 0 && exclusive) {
+		if (!store_create(s->fd, capacity) || fstat(s->fd, &sb) != 0)
+			goto err;
+	}
+
+	s->size = sb.st_size;
+	if (s->size < sizeof(struct store_header))
+		goto err;
+	s->data = mmap(NULL, s->size, PROT_READ | PROT_WRITE, MAP_SHARED,
+		       s->fd, 0);
+	if (s->data == MAP_FAILED) {
+		s->data = NULL;
+		goto err;
+	}
+	if (!store_validate(s))
+		goto err;
+
+	if (exclusive) {
+		store_recover(s);
+		if (flock(s->fd, LOCK_SH) != 0)
+			goto err;
+	}
+	return s;
+
+err:
+	ykp_errno = YKP_EIO;
+	ykp_close_counter_store(s);
+	return NULL;
+#endif
+}
+
+int ykp_close_counter_store(YKP_COUNTER_STORE *s)
+{
+	if (!s)
+		return 1;
+#ifndef _WIN32
+	if (s->data)
+		munmap(s->data, s->size);
+	if (s->fd >= 0)
+		close(s->fd);
+#endif
+	_yk_free(s);
+	return 1;
+}
+
+int ykp_counter_store_sync(YKP_COUNTER_STORE *s)
+{
+	if (!s) {
+		ykp_errno = YKP_EINVAL;
+		return 0;
+	}
+#ifndef _WIN32
+	if (msync(s->data, s->size, MS_SYNC) != 0) {
+		ykp_errno = YKP_EIO;
+		return 0;
+	}
+#endif
+	return 1;
+}
+
+/* The bucket of id, claiming one for it with the counter seed when
+   create is set */
+static struct store_bucket *store_find(YKP_COUNTER_STORE *s,
+				       const unsigned char *id,
+				       size_t id_len, int create,
+				       uint64_t seed)
+{
+	uint32_t b, probes;
+
+	if (!s || !id || id_len == 0 || id_len > FIXED_SIZE) {
+		ykp_errno = YKP_EINVAL;
+		return NULL;
+	}
+
+	b = store_hash(id, id_len) & s->mask;
+	for (probes = 0; probes <= s->mask; probes++) {
+		struct store_bucket *bucket = &s->buckets[b];
+		uint32_t state = YK_ATOMIC_LOAD_INT(&bucket->state);
+		int spins = 0;
+
+		while (state == BUCKET_FREE && create) {
+			if (YK_ATOMIC_CAS_INT(&bucket->state, BUCKET_FREE,
+					      store_claim())) {
+				bucket->id_len = id_len;
+				memcpy(bucket->id, id, id_len);
+				bucket->counter = seed;
+				YK_ATOMIC_STORE_INT(&bucket->state, BUCKET_USED);
+				return bucket;
+			}
+			state = YK_ATOMIC_LOAD_INT(&bucket->state);
+		}
+		if (state == BUCKET_FREE) {
+			ykp_errno = YKP_ENOCFG;
+			return NULL;
+		}
+		while (BUCKET_KIND(state) == BUCKET_CLAIMED) {
+			if (spins % STORE_OWNER_SPINS == 0 &&
+			    store_claim_stale(state)) {
+				(void) YK_ATOMIC_CAS_INT(&bucket->state, state,
+						  BUCKET_RETIRED);
+			} else if (++spins > STORE_CLAIM_SPINS) {
+				ykp_errno = YKP_EIO;
+				return NULL;
+			} else {
+#ifndef _WIN32
+				sched_yield();
+#endif
+			}
+			state = YK_ATOMIC_LOAD_INT(&bucket->state);
+		}
+		if (state == BUCKET_USED && bucket->id_len == id_len &&
+		    memcmp(bucket->id, id, id_len) == 0)
+			return bucket;
+		b = (b + 1) & s->mask;
+	}
+
+	/* full */
+	ykp_errno = create ? YKP_EIO : YKP_ENOCFG;
+	return NULL;
+}
+
+int ykp_counter_get(YKP_COUNTER_STORE *s, const unsigned char *id,
+		    size_t id_len, uint64_t *counter)
+{
+	struct store_bucket *bucket = store_find(s, id, id_len, 0, 0);
+
+	if (!bucket)
+		return 0;
+	if (counter)
+		*counter = YK_ATOMIC_LOAD_64(&bucket->counter);
+	return 1;
+}
+
+int ykp_counter_seed(YKP_COUNTER_STORE *s, const unsigned char *id,
+		     size_t id_len, uint64_t counter)
+{
+	return store_find(s, id, id_len, 1, counter) != NULL;
+}
+
+int ykp_counter_seed_config(YKP_COUNTER_STORE *s, const YKP_CONFIG *cfg)
+{
+	const YK_CONFIG *ycfg;
+	uint64_t seed = 0;
+
+	if (!cfg) {
+		ykp_errno = YKP_ENOCFG;
+		return 0;
+	}
+	ycfg = &cfg->ykcore_config;
+	if ((ycfg->tktFlags & TKTFLAG_OATH_HOTP) == TKTFLAG_OATH_HOTP &&
+	    (ycfg->cfgFlags & CFGFLAG_CHAL_HMAC) != CFGFLAG_CHAL_HMAC &&
+	    (ycfg->cfgFlags & CFGFLAG_CHAL_YUBICO) != CFGFLAG_CHAL_YUBICO)
+		seed = ykp_get_oath_imf(cfg);
+	return ykp_counter_seed(s, ycfg->fixed, ycfg->fixedSize, seed);
+}
+
+int ykp_counter_update(YKP_COUNTER_STORE *s, const unsigned char *id,
+		       size_t id_len, uint64_t counter, uint64_t *previous)
+{
+	struct store_bucket *bucket = store_find(s, id, id_len, 1, 0);
+	uint64_t cur;
+
+	if (!bucket)
+		return 0;
+	cur = YK_ATOMIC_LOAD_64(&bucket->counter);
+	while (counter > cur) {
+		if (YK_ATOMIC_CAS_64(&bucket->counter, cur, counter)) {
+			if (previous)
+				*previous = cur;
+			return 1;
+		}
+		cur = YK_ATOMIC_LOAD_64(&bucket->counter);
+	}
+	if (previous)
+		*previous = cur;
+	ykp_errno = YKP_EREPLAY;
+	return 0;
+}
+
+uint64_t ykp_otp_counter(const struct ticket_st *ticket)
+{
+	if (!ticket)
+		return 0;
+	return ((uint64_t) (ticket->useCtr & TICKET_CTR_MASK) << 8) |
+		ticket->sessionCtr;
+}
@@ -0,0 +1,331 @@
+/* -*- mode:C; c-file-style: "bsd" -*- */
+/*
+ * Copyright (c) 2026 Yubico AB
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Deterministic derivation of per-key secrets from a master secret,
+ * using HKDF-SHA256 (RFC 5869).
+ *
+ * The master secret is extracted once with a fixed salt.  Every field
+ * is then expanded separately with the info string
+ *
+ *   "ykpers" || label || 0x00 || serial (32 bits, big endian) ||
+ *   slot || mode
+ *
+ * where label is "key", "uid" or "fixed", so that the fields are
+ * independent and enabling one does not change the others.
+ */
+
+#include "ykpers_lcl.h"
+#include "ykthread.h"
+#include "ykcore/ykbzero.h"
+#include "sha.h"
+
+#include <ykpers.h>
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+static const unsigned char kdf_salt[] = "ykpers-hkdf-v1";
+
+struct derive_job {
+	YKP_CONFIG **cfgs;
+	const unsigned int *serials;
+	size_t count;
+	size_t start;
+	size_t step;
+	const HMACContext *prk;
+	unsigned int fields;
+	int rc;
+	int err;
+};
+
+static int kdf_mode(const YK_CONFIG *ycfg)
+{
+	if ((ycfg->tktFlags & TKTFLAG_OATH_HOTP) == TKTFLAG_OATH_HOTP) {
+		if ((ycfg->cfgFlags & CFGFLAG_CHAL_HMAC) == CFGFLAG_CHAL_HMAC)
+			return MODE_CHAL_HMAC;
+		if ((ycfg->cfgFlags & CFGFLAG_CHAL_YUBICO) == CFGFLAG_CHAL_YUBICO)
+			return MODE_CHAL_YUBICO;
+		return MODE_OATH_HOTP;
+	}
+	if ((ycfg->cfgFlags & CFGFLAG_STATIC_TICKET) == CFGFLAG_STATIC_TICKET)
+		return MODE_STATIC_TICKET;
+	return MODE_OTP_YUBICO;
+}
+
+static int kdf_slot(const YKP_CONFIG *cfg)
+{
+	switch (cfg->command) {
+	case SLOT_CONFIG:
+	case SLOT_UPDATE1:
+		return 1;
+	case SLOT_CONFIG2:
+	case SLOT_UPDATE2:
+		return 2;
+	}
+	return 0;
+}
+
+/* HKDF-Extract, leaving the keyed context for HKDF-Expand in prk */
+static int kdf_extract(HMACContext *prk, const unsigned char *master,
+		       size_t master_len)
+{
+	HMACContext ctx;
+	uint8_t digest[USHAMaxHashSize];
+	int ret;
+
+	ret = hmacReset(&ctx, SHA256, kdf_salt, sizeof(kdf_salt) - 1) ||
+		hmacInput(&ctx, master, (int) master_len) ||
+		hmacResult(&ctx, digest) ||
+		hmacReset(prk, SHA256, digest, SHA256HashSize);
+
+	insecure_memzero(&ctx, sizeof(ctx));
+	insecure_memzero(digest, sizeof(digest));
+	return ret == shaSuccess;
+}
+
+/* HKDF-Expand of a single block, which covers every field */
+static int kdf_expand(const HMACContext *prk, const char *label,
+		      unsigned int serial, int slot, int mode,
+		      unsigned char *out, size_t len)
+{
+	HMACContext ctx;
+	uint8_t digest[USHAMaxHashSize];
+	unsigned char info[32];
+	size_t info_len = 0;
+	size_t label_len = strlen(label);
+	int ret;
+
+	memcpy(info, "ykpers", 6);
+	info_len += 6;
+	memcpy(info + info_len, label, label_len + 1);
+	info_len += label_len + 1;
+	info[info_len++] = (serial >> 24) & 0xff;
+	info[info_len++] = (serial >> 16) & 0xff;
+	info[info_len++] = (serial >> 8) & 0xff;
+	info[info_len++] = serial & 0xff;
+	info[info_len++] = slot;
+	info[info_len++] = mode;
+	info[info_len++] = 0x01;	/* block counter */
+
+	memcpy(&ctx, prk, sizeof(ctx));
+	ret = hmacInput(&ctx, info, (int) info_len) ||
+		hmacResult(&ctx, digest);
+	if (ret == shaSuccess)
+		memcpy(out, digest, len);
+
+	insecure_memzero(&ctx, sizeof(ctx));
+	insecure_memzero(digest, sizeof(digest));
+	return ret == shaSuccess;
+}
+
+static int kdf_derive(YKP_CONFIG *cfg, const HMACContext *prk,
+		      unsigned int serial, unsigned int fields)
+{
+	YK_CONFIG *ycfg;
+	unsigned char buf[FIXED_SIZE + UID_SIZE];
+	int slot, mode, key_bytes;
+	int ret = 1;
+
+	if (!cfg) {
+		ykp_errno = YKP_ENOCFG;
+		return 0;
+	}
+	if ((slot = kdf_slot(cfg)) == 0) {
+		ykp_errno = YKP_EINVCONFNUM;
+		return 0;
+	}
+
+	ycfg = &cfg->ykcore_config;
+	mode = kdf_mode(ycfg);
+	key_bytes = ykp_get_supported_key_length(cfg);
+
+	/* with 20 byte keys the uid holds key material */
+	if ((fields & YKP_DERIVE_UID) && key_bytes == 20) {
+		ykp_errno = YKP_EINVAL;
+		return 0;
+	}
+	/* checked before anything is derived, so a failure leaves cfg
+	   untouched */
+	if ((fields & YKP_DERIVE_FIXED) && ycfg->fixedSize > FIXED_SIZE) {
+		ykp_errno = YKP_EINVAL;
+		return 0;
+	}
+
+	if (fields & YKP_DERIVE_KEY) {
+		ret = kdf_expand(prk, "key", serial, slot, mode, buf, key_bytes);
+		if (ret) {
+			memcpy(ycfg->key, buf, KEY_SIZE);
+			if (key_bytes == 20)
+				memcpy(ycfg->uid, buf + KEY_SIZE, 4);
+		}
+	}
+	if (ret && (fields & YKP_DERIVE_UID)) {
+		ret = kdf_expand(prk, "uid", serial, slot, mode, buf, UID_SIZE);
+		if (ret)
+			memcpy(ycfg->uid, buf, UID_SIZE);
+	}
+	if (ret && (fields & YKP_DERIVE_FIXED)) {
+		if (ycfg->fixedSize == 0)
+			ycfg->fixedSize = 6;
+		ret = kdf_expand(prk, "fixed", serial, slot, mode, buf,
+				 ycfg->fixedSize);
+		if (ret)
+			memcpy(ycfg->fixed, buf, ycfg->fixedSize);
+	}
+
+	insecure_memzero(buf, sizeof(buf));
+	if (!ret)
+		ykp_errno = YKP_EINVAL;
+	return ret;
+}
+
+static int kdf_check_args(const unsigned char *master, size_t master_len,
+			  unsigned int fields)
+{
+	if (!master || master_len == 0 || master_len > INT32_MAX ||
+	    (fields & ~(YKP_DERIVE_KEY | YKP_DERIVE_UID | YKP_DERIVE_FIXED)) ||
+	    fields == 0) {
+		ykp_errno = YKP_EINVAL;
+		return 0;
+	}
+	return 1;
+}
+
+int ykp_derive_config(YKP_CONFIG *cfg, const unsigned char *master,
+		      size_t master_len, unsigned int serial,
+		      unsigned int fields)
+{
+	HMACContext prk;
+	int ret;
+
+	if (!kdf_check_args(master, master_len, fields))
+		return 0;
+	if (!kdf_extract(&prk, master, master_len)) {
+		ykp_errno = YKP_EINVAL;
+		return 0;
+	}
+	ret = kdf_derive(cfg, &prk, serial, fields);
+	insecure_memzero(&prk, sizeof(prk));
+	return ret;
+}
+
+static YK_THREAD_FUNC(derive_worker, arg)
+{
+	struct derive_job *job = arg;
+	size_t i;
+
+	job->rc = 1;
+	for (i = job->start; i < job->count; i += job->step) {
+		if (!kdf_derive(job->cfgs[i], job->prk, job->serials[i],
+				job->fields)) {
+			job->rc = 0;
+			job->err = ykp_errno;
+			break;
+		}
+	}
+	return 0;
+}
+
+int ykp_derive_configs(YKP_CONFIG **cfgs, const unsigned int *serials,
+		       size_t count, const unsigned char *master,
+		       size_t master_len, unsigned int fields, int threads)
+{
+	struct derive_job *jobs;
+	YK_THREAD_TYPE *tids;
+	HMACContext prk;
+	int i, started = 0;
+	int ret = 1;
+
+	if (!kdf_check_args(master, master_len, fields) ||
+	    (count && (!cfgs || !serials))) {
+		ykp_errno = YKP_EINVAL;
+		return 0;
+	}
+	if (threads <= 0)
+		threads = YK_CPU_COUNT();
+	if (threads <= 0)
+		threads = 1;
+	if ((size_t) threads > count)
+		threads = count ? (int) count : 1;
+
+	jobs = _yk_malloc(threads * sizeof(*jobs));
+	tids = _yk_malloc(threads * sizeof(*tids));
+	if (!jobs || !tids) {
+		_yk_free(jobs);
+		_yk_free(tids);
+		ykp_errno = YKP_ENOMEM;
+		return 0;
+	}
+	if (!kdf_extract(&prk, master, master_len)) {
+		_yk_free(jobs);
+		_yk_free(tids);
+		ykp_errno = YKP_EINVAL;
+		return 0;
+	}
+
+	memset(jobs, 0, threads * sizeof(*jobs));
+	for (i = 0; i < threads; i++) {
+		jobs[i].cfgs = cfgs;
+		jobs[i].serials = serials;
+		jobs[i].count = count;
+		jobs[i].start = i;
+		jobs[i].step = threads;
+		jobs[i].prk = &prk;
+		jobs[i].fields = fields;
+	}
+
+	/* Worker 0 runs on the calling thread, as does the share of any
+	   worker that could not be started. */
+	for (i = 1; i < threads; i++) {
+		if (YK_THREAD_CREATE(tids[i], derive_worker, &jobs[i]) != 0)
+			break;
+		started = i;
+	}
+	derive_worker(&jobs[0]);
+	for (i = started + 1; i < threads; i++)
+		derive_worker(&jobs[i]);
+	for (i = 1; i <= started; i++)
+		YK_THREAD_JOIN(tids[i]);
+
+	for (i = 0; i < threads; i++) {
+		if (!jobs[i].rc) {
+			ykp_errno = jobs[i].err;
+			ret = 0;
+			break;
+		}
+	}
+
+	insecure_memzero(&prk, sizeof(prk));
+	_yk_free(jobs);
+	_yk_free(tids);
+	return ret;
+}
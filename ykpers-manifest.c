@@ -0,0 +1,410 @@
+/* -*- mode:C; c-file-style: "bsd" -*- */
+/*
+ * Copyright (c) 2026 Yubico AB
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Binary manifest of pre-generated configurations.
+ *
+ * The file is laid out so that it can be mapped and used as is:
+ *
+ *   struct manifest_header	header
+ *   YKP_CONFIG			records[count]
+ *   struct manifest_bucket	index[buckets]
+ *
+ * The records are images of struct ykp_config_t in host byte order, so
+ * a lookup hands out a pointer straight into the mapping.  The index is
+ * an open addressed hash table keyed on serial number and slot, with
+ * linear probing and at least one free bucket.  The checksum covers
+ * everything following the header.
+ */
+
+#include "ykpers_lcl.h"
+#include "ykcore/ykbzero.h"
+#include "ykcore/ykcrc.h"
+
+#include <ykpers.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <io.h>
+#include <process.h>
+#else
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+#include <yubikey.h>
+
+#define MANIFEST_MAGIC		"YKPM"
+#define MANIFEST_VERSION	1
+#define MANIFEST_BYTE_ORDER	0x0102
+
+struct manifest_header {
+	char magic[4];
+	uint16_t version;
+	uint16_t byte_order;
+	uint32_t record_size;
+	uint32_t count;
+	uint32_t buckets;
+	uint16_t crc;
+	uint16_t reserved;
+	uint32_t reserved2[2];
+};
+
+struct manifest_bucket {
+	uint32_t serial;
+	uint16_t slot;
+	uint16_t reserved;
+	uint32_t record;	/* record index + 1, 0 marks a free bucket */
+};
+
+struct ykp_manifest_t {
+	unsigned char *data;
+	size_t size;
+	int mapped;
+	uint32_t count;
+	uint32_t mask;
+	YKP_CONFIG *records;
+	const struct manifest_bucket *index;
+};
+
+static int manifest_slot(const YKP_CONFIG *cfg)
+{
+	switch (cfg->command) {
+	case SLOT_CONFIG:
+	case SLOT_UPDATE1:
+		return 1;
+	case SLOT_CONFIG2:
+	case SLOT_UPDATE2:
+		return 2;
+	}
+	return 0;
+}
+
+static uint32_t manifest_hash(uint32_t serial, int slot)
+{
+	uint32_t h = serial * 2654435761u;
+	return h ^ (h >> 15) ^ ((uint32_t) slot << 28);
+}
+
+static uint32_t manifest_buckets(size_t count)
+{
+	uint32_t buckets = 2;
+
+	while (buckets < count * 2)
+		buckets <<= 1;
+	return buckets;
+}
+
+static int manifest_read_file(YKP_MANIFEST *m, int fd)
+{
+	size_t done = 0;
+
+	m->data = _yk_malloc(m->size);
+	if (!m->data)
+		return 0;
+	while (done < m->size) {
+		int n = read(fd, m->data + done, m->size - done);
+		if (n <= 0)
+			return 0;
+		done += n;
+	}
+	return 1;
+}
+
+static void manifest_release(YKP_MANIFEST *m)
+{
+	if (!m->data)
+		return;
+#ifndef _WIN32
+	if (m->mapped) {
+		munmap(m->data, m->size);
+		return;
+	}
+#endif
+	_yk_free(m->data);
+}
+
+static int manifest_validate(YKP_MANIFEST *m)
+{
+	const struct manifest_header *hdr =
+		(const struct manifest_header *) m->data;
+	size_t records_size, index_size;
+	uint32_t i, used = 0;
+
+	if (m->size < sizeof(*hdr) ||
+	    memcmp(hdr->magic, MANIFEST_MAGIC, sizeof(hdr->magic)) != 0 ||
+	    hdr->version != MANIFEST_VERSION ||
+	    hdr->byte_order != MANIFEST_BYTE_ORDER ||
+	    hdr->record_size != sizeof(YKP_CONFIG))
+		return 0;
+
+	if (hdr->buckets == 0 || (hdr->buckets & (hdr->buckets - 1)) != 0 ||
+	    hdr->buckets <= hdr->count)
+		return 0;
+
+	records_size = (size_t) hdr->count * sizeof(YKP_CONFIG);
+	index_size = (size_t) hdr->buckets * sizeof(struct manifest_bucket);
+	if (records_size / sizeof(YKP_CONFIG) != hdr->count ||
+	    m->size != sizeof(*hdr) + records_size + index_size)
+		return 0;
+
+	if (hdr->crc != _yk_crc16(m->data + sizeof(*hdr),
+				  m->size - sizeof(*hdr)))
+		return 0;
+
+	m->count = hdr->count;
+	m->mask = hdr->buckets - 1;
+	m->records = (YKP_CONFIG *) (m->data + sizeof(*hdr));
+	m->index = (const struct manifest_bucket *)
+		(m->data + sizeof(*hdr) + records_size);
+
+	for (i = 0; i < hdr->buckets; i++) {
+		if (m->index[i].record > m->count)
+			return 0;
+		if (m->index[i].record != 0)
+			used++;
+	}
+	return used == m->count;
+}
+
+YKP_MANIFEST *ykp_open_manifest(const char *path)
+{
+	YKP_MANIFEST *m;
+	struct stat sb;
+	int fd;
+
+	if (!path) {
+		ykp_errno = YKP_EINVAL;
+		return NULL;
+	}
+
+	m = _yk_malloc(sizeof(YKP_MANIFEST));
+	if (!m) {
+		ykp_errno = YKP_ENOMEM;
+		return NULL;
+	}
+	memset(m, 0, sizeof(YKP_MANIFEST));
+
+#ifdef _WIN32
+	fd = open(path, O_RDONLY | O_BINARY);
+#else
+	fd = open(path, O_RDONLY);
+#endif
+	if (fd < 0 || fstat(fd, &sb) != 0) {
+		ykp_errno = YKP_EIO;
+		goto err;
+	}
+	m->size = sb.st_size;
+	if (m->size < sizeof(struct manifest_header)) {
+		ykp_errno = YKP_EMANIFEST;
+		goto err;
+	}
+
+#ifndef _WIN32
+	/* Private writable mapping, so that callers may pass the handed
+	   out configurations to functions that update them in place
+	   (yk_write_command() fills in the crc) without touching the
+	   file. */
+	m->data = mmap(NULL, m->size, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+		       fd, 0);
+	if (m->data == MAP_FAILED)
+		m->data = NULL;
+	else
+		m->mapped = 1;
+#endif
+	if (!m->data && !manifest_read_file(m, fd)) {
+		ykp_errno = YKP_EIO;
+		goto err;
+	}
+	close(fd);
+	fd = -1;
+
+	if (!manifest_validate(m)) {
+		ykp_errno = YKP_EMANIFEST;
+		goto err;
+	}
+	return m;
+
+err:
+	if (fd >= 0)
+		close(fd);
+	manifest_release(m);
+	_yk_free(m);
+	return NULL;
+}
+
+int ykp_close_manifest(YKP_MANIFEST *manifest)
+{
+	if (manifest) {
+		if (manifest->data && !manifest->mapped)
+			insecure_memzero(manifest->records,
+					 manifest->count * sizeof(YKP_CONFIG));
+		manifest_release(manifest);
+		_yk_free(manifest);
+	}
+	return 1;
+}
+
+size_t ykp_manifest_count(const YKP_MANIFEST *manifest)
+{
+	return manifest ? manifest->count : 0;
+}
+
+YKP_CONFIG *ykp_config_from_manifest(YKP_MANIFEST *manifest,
+				     unsigned int serial, int slot)
+{
+	uint32_t i;
+
+	if (!manifest || (slot != 1 && slot != 2)) {
+		ykp_errno = YKP_EINVAL;
+		return NULL;
+	}
+
+	for (i = manifest_hash(serial, slot) & manifest->mask;
+	     manifest->index[i].record != 0;
+	     i = (i + 1) & manifest->mask) {
+		if (manifest->index[i].serial == serial &&
+		    manifest->index[i].slot == slot)
+			return &manifest->records[manifest->index[i].record - 1];
+	}
+	ykp_errno = YKP_ENOCFG;
+	return NULL;
+}
+
+int ykp_write_manifest(const char *path, const unsigned int *serials,
+		       YKP_CONFIG *const *cfgs, size_t count)
+{
+	struct manifest_header hdr;
+	struct manifest_bucket *index = NULL;
+	unsigned char *body = NULL;
+	size_t records_size, body_size;
+	char tmp[1024];
+	uint32_t buckets, i;
+	FILE *f = NULL;
+	int ret = 0;
+
+	if (!path || (count && (!serials || !cfgs)) ||
+	    count > (UINT32_MAX >> 2) / sizeof(YKP_CONFIG)) {
+		ykp_errno = YKP_EINVAL;
+		return 0;
+	}
+
+	buckets = manifest_buckets(count);
+	records_size = count * sizeof(YKP_CONFIG);
+	body_size = records_size + buckets * sizeof(struct manifest_bucket);
+	body = _yk_malloc(body_size);
+	if (!body) {
+		ykp_errno = YKP_ENOMEM;
+		return 0;
+	}
+	memset(body, 0, body_size);
+	index = (struct manifest_bucket *) (body + records_size);
+
+	for (i = 0; i < count; i++) {
+		int slot;
+		uint32_t b;
+
+		if (!cfgs[i] || (slot = manifest_slot(cfgs[i])) == 0) {
+			ykp_errno = YKP_EINVCONFNUM;
+			goto out;
+		}
+		for (b = manifest_hash(serials[i], slot) & (buckets - 1);
+		     index[b].record != 0; b = (b + 1) & (buckets - 1)) {
+			if (index[b].serial == serials[i] &&
+			    index[b].slot == slot) {
+				ykp_errno = YKP_EINVAL;
+				goto out;
+			}
+		}
+		index[b].serial = serials[i];
+		index[b].slot = slot;
+		index[b].record = i + 1;
+		memcpy(body + i * sizeof(YKP_CONFIG), cfgs[i],
+		       sizeof(YKP_CONFIG));
+	}
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, MANIFEST_MAGIC, sizeof(hdr.magic));
+	hdr.version = MANIFEST_VERSION;
+	hdr.byte_order = MANIFEST_BYTE_ORDER;
+	hdr.record_size = sizeof(YKP_CONFIG);
+	hdr.count = count;
+	hdr.buckets = buckets;
+	hdr.crc = _yk_crc16(body, body_size);
+
+	/* Written next to the manifest and renamed over it once on disk,
+	   so that readers never see a partial file */
+	if (snprintf(tmp, sizeof(tmp), "%s.%ld", path,
+		     (long) getpid()) >= (int) sizeof(tmp)) {
+		ykp_errno = YKP_EINVAL;
+		goto out;
+	}
+	if (!(f = fopen(tmp, "wb"))) {
+		ykp_errno = YKP_EIO;
+		goto out;
+	}
+	if (fwrite(&hdr, sizeof(hdr), 1, f) != 1 ||
+	    fwrite(body, body_size, 1, f) != 1 || fflush(f) != 0 ||
+#ifdef _WIN32
+	    _commit(_fileno(f)) != 0
+#else
+	    fsync(fileno(f)) != 0
+#endif
+	    ) {
+		ykp_errno = YKP_EIO;
+		goto out;
+	}
+	ret = 1;
+
+out:
+	if (f) {
+		if (fclose(f) != 0)
+			ret = 0;
+#ifdef _WIN32
+		if (ret)
+			remove(path);
+#endif
+		if (ret && rename(tmp, path) != 0)
+			ret = 0;
+		if (!ret) {
+			ykp_errno = YKP_EIO;
+			remove(tmp);
+		}
+	}
+	insecure_memzero(body, body_size);
+	_yk_free(body);
+	return ret;
+}
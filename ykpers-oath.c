@@ -0,0 +1,222 @@
+/* -*- mode:C; c-file-style: "bsd" -*- */
+/*
+ * Copyright (c) 2026 Yubico AB
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Validation of OATH-HOTP (RFC 4226) and TOTP (RFC 6238) codes against
+ * the 20 byte HMAC-SHA1 key of a configuration.
+ *
+ * The key is expanded into the SHA-1 states after the inner and outer
+ * pads once per call, so each candidate in the window costs two SHA-1
+ * compressions, without redoing the key schedule.
+ */
+
+#include "ykpers_lcl.h"
+#include "ykcore/ykbzero.h"
+#include "sha.h"
+
+#include <ykpers.h>
+
+#include <string.h>
+
+struct oath_key {
+	SHA1Context inner;
+	SHA1Context outer;
+};
+
+/* Largest window accepted, as for ykchalresp -w */
+#define OATH_MAX_WINDOW	1000
+
+static const unsigned int powers_of_ten[] = {
+	1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000,
+	1000000000
+};
+
+static int oath_key_setup(struct oath_key *k, const YKP_CONFIG *cfg)
+{
+	unsigned char pad[SHA1_Message_Block_Size];
+	size_t i;
+	int ret;
+
+	if (!cfg) {
+		ykp_errno = YKP_ENOCFG;
+		return 0;
+	}
+	if (ykp_get_supported_key_length(cfg) != 20) {
+		ykp_errno = YKP_EINVAL;
+		return 0;
+	}
+
+	/* 20 byte keys continue into the first four bytes of uid */
+	memset(pad, 0, sizeof(pad));
+	memcpy(pad, cfg->ykcore_config.key, KEY_SIZE);
+	memcpy(pad + KEY_SIZE, cfg->ykcore_config.uid, 20 - KEY_SIZE);
+
+	for (i = 0; i < sizeof(pad); i++)
+		pad[i] ^= 0x36;
+	ret = SHA1Reset(&k->inner) ||
+		SHA1Input(&k->inner, pad, sizeof(pad));
+	for (i = 0; i < sizeof(pad); i++)
+		pad[i] ^= 0x36 ^ 0x5c;
+	ret = ret || SHA1Reset(&k->outer) ||
+		SHA1Input(&k->outer, pad, sizeof(pad));
+
+	insecure_memzero(pad, sizeof(pad));
+	if (ret != shaSuccess) {
+		ykp_errno = YKP_EINVAL;
+		return 0;
+	}
+	return 1;
+}
+
+static unsigned int oath_code(const struct oath_key *k, uint64_t counter,
+			      unsigned int digits)
+{
+	SHA1Context ctx;
+	uint8_t msg[8];
+	uint8_t digest[SHA1HashSize];
+	unsigned int code;
+	int i;
+
+	for (i = 7; i >= 0; i--) {
+		msg[i] = counter & 0xff;
+		counter >>= 8;
+	}
+
+	memcpy(&ctx, &k->inner, sizeof(ctx));
+	SHA1Input(&ctx, msg, sizeof(msg));
+	SHA1Result(&ctx, digest);
+	memcpy(&ctx, &k->outer, sizeof(ctx));
+	SHA1Input(&ctx, digest, sizeof(digest));
+	SHA1Result(&ctx, digest);
+
+	code = ykp_oath_truncate(digest, digits);
+	insecure_memzero(&ctx, sizeof(ctx));
+	insecure_memzero(digest, sizeof(digest));
+	return code;
+}
+
+/* A code is six to nine decimal digits, returns the number of digits
+   or 0. */
+static unsigned int oath_parse_code(const char *code, unsigned int *value)
+{
+	unsigned int digits = 0;
+
+	if (!code)
+		return 0;
+	*value = 0;
+	for (; code[digits]; digits++) {
+		if (code[digits] < '0' || code[digits] > '9' || digits == 9)
+			return 0;
+		*value = *value * 10 + (code[digits] - '0');
+	}
+	return digits >= 6 ? digits : 0;
+}
+
+unsigned int ykp_oath_truncate(const unsigned char *hmac, unsigned int digits)
+{
+	unsigned int offset = hmac[19] & 0xf;
+	unsigned int bin_code = (hmac[offset] & 0x7f) << 24
+		| (hmac[offset + 1] & 0xff) << 16
+		| (hmac[offset + 2] & 0xff) << 8
+		| (hmac[offset + 3] & 0xff);
+
+	if (digits >= sizeof(powers_of_ten) / sizeof(powers_of_ten[0]))
+		return bin_code;
+	return bin_code % powers_of_ten[digits];
+}
+
+int ykp_oath_hotp_validate(const YKP_CONFIG *cfg, uint64_t counter,
+			   unsigned int window, const char *code,
+			   unsigned int *offset)
+{
+	struct oath_key k;
+	unsigned int value, digits, i;
+	int found = 0;
+
+	if (!(digits = oath_parse_code(code, &value)) ||
+	    window > OATH_MAX_WINDOW) {
+		ykp_errno = YKP_EINVAL;
+		return 0;
+	}
+	if (!oath_key_setup(&k, cfg))
+		return 0;
+
+	/* Every candidate is computed, a match does not end the search
+	   early. */
+	for (i = 0; i <= window; i++) {
+		if (oath_code(&k, counter + i, digits) == value && !found) {
+			found = 1;
+			if (offset)
+				*offset = i;
+		}
+	}
+
+	insecure_memzero(&k, sizeof(k));
+	if (!found)
+		ykp_errno = YKP_ENOMATCH;
+	return found;
+}
+
+int ykp_oath_totp_validate(const YKP_CONFIG *cfg, uint64_t now,
+			   unsigned int period, unsigned int window,
+			   const char *code, int *offset)
+{
+	struct oath_key k;
+	unsigned int value, digits, i;
+	uint64_t step;
+	int found = 0;
+
+	if (!(digits = oath_parse_code(code, &value)) || period == 0 ||
+	    window > OATH_MAX_WINDOW) {
+		ykp_errno = YKP_EINVAL;
+		return 0;
+	}
+	if (!oath_key_setup(&k, cfg))
+		return 0;
+
+	/* Closest time steps first: 0, -1, +1, -2, +2, ... */
+	step = now / period;
+	for (i = 0; i <= 2 * window; i++) {
+		int off = (i % 2) ? -(int) ((i + 1) / 2) : (int) (i / 2);
+
+		if ((off < 0 && step < (uint64_t) -off))
+			continue;
+		if (oath_code(&k, step + off, digits) == value && !found) {
+			found = 1;
+			if (offset)
+				*offset = off;
+		}
+	}
+
+	insecure_memzero(&k, sizeof(k));
+	if (!found)
+		ykp_errno = YKP_ENOMATCH;
+	return found;
+}
@@ -0,0 +1,592 @@
+/* -*- mode:C; c-file-style: "bsd" -*- */
+/*
+ * Copyright (c) 2026 Yubico AB
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Validation of Yubico OTPs against the configurations they were
+ * programmed with.
+ *
+ * An OTP is the public id, the fixed field of the configuration, and
+ * the 16 byte ticket encrypted with the AES key, all in modhex.  The
+ * ticket is valid if its CRC-16 leaves the residual and its uid is the
+ * one of the configuration.
+ *
+ * A validator indexes the configurations by public id and keeps the
+ * AES decryption key schedule of each, so that no key is expanded per
+ * OTP.  Where the CPU has AES-NI, a batch decrypts BATCH_WIDTH tickets
+ * at a time with their rounds interleaved, which keeps the AES units
+ * busy although every ticket has its own key.  Otherwise tickets are
+ * decrypted one at a time with libyubikey.
+ *
+ * Yubico mode challenge responses are the same tickets, with the
+ * challenge as uid, and are generated and verified in the same way.
+ */
+
+#include "ykpers_lcl.h"
+#include "ykcore/ykbzero.h"
+#include "ykcore/ykcrc.h"
+
+#include <ykpers.h>
+#include <yubikey.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#ifdef HAVE_AESNI
+#include <wmmintrin.h>
+#define AESNI_TARGET	__attribute__((target("aes,sse2")))
+#endif
+
+#define TICKET_SIZE	16
+#define AES_ROUNDS	10
+#define BATCH_WIDTH	8
+
+struct otp_entry {
+	unsigned char fixed[FIXED_SIZE];
+	unsigned char fixed_size;
+	unsigned char uid[UID_SIZE];
+	unsigned char key[KEY_SIZE];
+	/* decryption round keys, in the order they are used */
+	unsigned char dk[AES_ROUNDS + 1][TICKET_SIZE];
+};
+
+struct ykp_otp_validator_t {
+	struct otp_entry *entries;
+	size_t count;
+	size_t *buckets;	/* entry index + 1, 0 when empty */
+	size_t nbuckets;
+	int aesni;
+};
+
+/* A ticket waiting to be decrypted */
+struct otp_pending {
+	unsigned char block[TICKET_SIZE];
+	const struct otp_entry *entry;
+	size_t index;
+};
+
+static const char modhex_alphabet[] = "cbdefghijklnrtuv";
+
+static int modhex_decode(unsigned char *dst, const char *src, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		const char *hi = memchr(modhex_alphabet,
+					tolower((unsigned char) src[2 * i]), 16);
+		const char *lo = memchr(modhex_alphabet,
+					tolower((unsigned char) src[2 * i + 1]), 16);
+
+		if (!hi || !lo || !src[2 * i] || !src[2 * i + 1])
+			return 0;
+		dst[i] = ((hi - modhex_alphabet) << 4) | (lo - modhex_alphabet);
+	}
+	return 1;
+}
+
+static size_t fixed_hash(const unsigned char *fixed, size_t len)
+{
+	size_t h = 2166136261UL ^ len;
+	size_t i;
+
+	for (i = 0; i < len; i++)
+		h = (h ^ fixed[i]) * 16777619UL;
+	return h;
+}
+
+static const struct otp_entry *otp_lookup(const YKP_OTP_VALIDATOR *v,
+					  const unsigned char *fixed,
+					  size_t len)
+{
+	size_t b = fixed_hash(fixed, len) & (v->nbuckets - 1);
+
+	while (v->buckets[b]) {
+		const struct otp_entry *e = &v->entries[v->buckets[b] - 1];
+
+		if (e->fixed_size == len && memcmp(e->fixed, fixed, len) == 0)
+			return e;
+		b = (b + 1) & (v->nbuckets - 1);
+	}
+	return NULL;
+}
+
+#ifdef HAVE_AESNI
+static AESNI_TARGET __m128i aes_expand_step(__m128i k, __m128i t)
+{
+	t = _mm_shuffle_epi32(t, 0xff);
+	k = _mm_xor_si128(k, _mm_slli_si128(k, 4));
+	k = _mm_xor_si128(k, _mm_slli_si128(k, 4));
+	k = _mm_xor_si128(k, _mm_slli_si128(k, 4));
+	return _mm_xor_si128(k, t);
+}
+
+#define AES_EXPAND(i, rcon)						\
+	ek[i] = aes_expand_step(ek[i - 1],				\
+				_mm_aeskeygenassist_si128(ek[i - 1], rcon))
+
+/* The encryption round keys of key into ek if set, and for the
+   equivalent inverse cipher into dk: the encryption round keys in
+   reverse, passed through InvMixColumns except the outer two */
+static AESNI_TARGET void aesni_expand(const unsigned char *key,
+				      unsigned char (*enc)[TICKET_SIZE],
+				      unsigned char (*dk)[TICKET_SIZE])
+{
+	__m128i ek[AES_ROUNDS + 1];
+	int i;
+
+	ek[0] = _mm_loadu_si128((const __m128i *) key);
+	AES_EXPAND(1, 0x01);
+	AES_EXPAND(2, 0x02);
+	AES_EXPAND(3, 0x04);
+	AES_EXPAND(4, 0x08);
+	AES_EXPAND(5, 0x10);
+	AES_EXPAND(6, 0x20);
+	AES_EXPAND(7, 0x40);
+	AES_EXPAND(8, 0x80);
+	AES_EXPAND(9, 0x1b);
+	AES_EXPAND(10, 0x36);
+
+	if (enc) {
+		for (i = 0; i <= AES_ROUNDS; i++)
+			_mm_storeu_si128((__m128i *) enc[i], ek[i]);
+	}
+	if (dk) {
+		_mm_storeu_si128((__m128i *) dk[0], ek[AES_ROUNDS]);
+		for (i = 1; i < AES_ROUNDS; i++)
+			_mm_storeu_si128((__m128i *) dk[i],
+					 _mm_aesimc_si128(ek[AES_ROUNDS - i]));
+		_mm_storeu_si128((__m128i *) dk[AES_ROUNDS], ek[0]);
+	}
+	insecure_memzero(ek, sizeof(ek));
+}
+
+/* n <= BATCH_WIDTH blocks under one key, interleaved */
+static AESNI_TARGET void aesni_encrypt(const unsigned char (*ek)[TICKET_SIZE],
+				       unsigned char (*blocks)[TICKET_SIZE],
+				       size_t n)
+{
+	__m128i b[BATCH_WIDTH];
+	__m128i k;
+	size_t i;
+	int r;
+
+	k = _mm_loadu_si128((const __m128i *) ek[0]);
+	for (i = 0; i < n; i++)
+		b[i] = _mm_xor_si128(_mm_loadu_si128((__m128i *) blocks[i]), k);
+	for (r = 1; r < AES_ROUNDS; r++) {
+		k = _mm_loadu_si128((const __m128i *) ek[r]);
+		for (i = 0; i < n; i++)
+			b[i] = _mm_aesenc_si128(b[i], k);
+	}
+	k = _mm_loadu_si128((const __m128i *) ek[AES_ROUNDS]);
+	for (i = 0; i < n; i++)
+		_mm_storeu_si128((__m128i *) blocks[i],
+				 _mm_aesenclast_si128(b[i], k));
+}
+
+/* n <= BATCH_WIDTH tickets, the rounds of all of them interleaved */
+static AESNI_TARGET void aesni_decrypt(struct otp_pending *p, size_t n)
+{
+	__m128i b[BATCH_WIDTH];
+	size_t i;
+	int r;
+
+	for (i = 0; i < n; i++)
+		b[i] = _mm_xor_si128(_mm_loadu_si128((__m128i *) p[i].block),
+				     _mm_loadu_si128((const __m128i *) p[i].entry->dk[0]));
+	for (r = 1; r < AES_ROUNDS; r++) {
+		for (i = 0; i < n; i++)
+			b[i] = _mm_aesdec_si128(b[i],
+				_mm_loadu_si128((const __m128i *) p[i].entry->dk[r]));
+	}
+	for (i = 0; i < n; i++) {
+		b[i] = _mm_aesdeclast_si128(b[i],
+			_mm_loadu_si128((const __m128i *) p[i].entry->dk[AES_ROUNDS]));
+		_mm_storeu_si128((__m128i *) p[i].block, b[i]);
+	}
+}
+#endif
+
+static int otp_aesni(void)
+{
+#ifdef HAVE_AESNI
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("aes");
+#else
+	return 0;
+#endif
+}
+
+/* Fill in the key and, when AES-NI is used, the decryption schedule */
+static void otp_entry_key(struct otp_entry *e, const unsigned char *key,
+			  int aesni)
+{
+	memcpy(e->key, key, KEY_SIZE);
+#ifdef HAVE_AESNI
+	if (aesni)
+		aesni_expand(e->key, NULL, e->dk);
+#endif
+}
+
+static void otp_decrypt(int aesni, struct otp_pending *p, size_t n)
+{
+	size_t i;
+
+#ifdef HAVE_AESNI
+	if (aesni) {
+		aesni_decrypt(p, n);
+		return;
+	}
+#endif
+	for (i = 0; i < n; i++)
+		yubikey_aes_decrypt(p[i].block, p[i].entry->key);
+}
+
+/* Pack a ticket for uid with the fields of t and its checksum */
+static void otp_pack(const struct ticket_st *t, const unsigned char *uid,
+		     unsigned char *block)
+{
+	unsigned short crc;
+
+	memcpy(block, uid, UID_SIZE);
+	block[6] = t->useCtr & 0xff;
+	block[7] = t->useCtr >> 8;
+	block[8] = t->tstpl & 0xff;
+	block[9] = t->tstpl >> 8;
+	block[10] = t->tstph;
+	block[11] = t->sessionCtr;
+	block[12] = t->rnd & 0xff;
+	block[13] = t->rnd >> 8;
+	crc = ~_yk_crc16(block, TICKET_SIZE - 2);
+	block[14] = crc & 0xff;
+	block[15] = crc >> 8;
+}
+
+/* Check a decrypted ticket and unpack it, the fields are little endian */
+static int otp_ticket(const unsigned char *block, const unsigned char *uid,
+		      struct ticket_st *ticket)
+{
+	if (_yk_crc16(block, TICKET_SIZE) != YK_CRC_OK_RESIDUAL ||
+	    memcmp(block, uid, UID_SIZE) != 0)
+		return YKP_ENOMATCH;
+	if (ticket) {
+		memcpy(ticket->uid, block, UID_SIZE);
+		ticket->useCtr = block[6] | (block[7] << 8);
+		ticket->tstpl = block[8] | (block[9] << 8);
+		ticket->tstph = block[10];
+		ticket->sessionCtr = block[11];
+		ticket->rnd = block[12] | (block[13] << 8);
+		ticket->crc = block[14] | (block[15] << 8);
+	}
+	return 0;
+}
+
+/* Split an OTP into public id and ticket, 0 or a ykp error code */
+static int otp_parse(const char *otp, unsigned char *fixed,
+		     size_t *fixed_size, unsigned char *block)
+{
+	size_t len = otp ? strlen(otp) : 0;
+
+	if (len < 2 * TICKET_SIZE || len > 2 * (FIXED_SIZE + TICKET_SIZE) ||
+	    len % 2)
+		return YKP_EINVAL;
+	*fixed_size = len / 2 - TICKET_SIZE;
+	if (!modhex_decode(fixed, otp, *fixed_size) ||
+	    !modhex_decode(block, otp + 2 * *fixed_size, TICKET_SIZE))
+		return YKP_EINVAL;
+	return 0;
+}
+
+int ykp_otp_decrypt(const YKP_CONFIG *cfg, const char *otp,
+		    struct ticket_st *ticket)
+{
+	const YK_CONFIG *ycfg;
+	unsigned char fixed[FIXED_SIZE];
+	unsigned char block[TICKET_SIZE];
+	size_t fixed_size;
+	int err;
+
+	if (!cfg) {
+		ykp_errno = YKP_ENOCFG;
+		return 0;
+	}
+	if ((err = otp_parse(otp, fixed, &fixed_size, block)) != 0) {
+		ykp_errno = err;
+		return 0;
+	}
+	ycfg = &cfg->ykcore_config;
+	if (fixed_size != ycfg->fixedSize ||
+	    memcmp(fixed, ycfg->fixed, fixed_size) != 0) {
+		ykp_errno = YKP_ENOMATCH;
+		return 0;
+	}
+	yubikey_aes_decrypt(block, ycfg->key);
+	err = otp_ticket(block, ycfg->uid, ticket);
+	insecure_memzero(block, sizeof(block));
+	if (err) {
+		ykp_errno = err;
+		return 0;
+	}
+	return 1;
+}
+
+YKP_OTP_VALIDATOR *ykp_otp_validator_alloc(YKP_CONFIG *const *cfgs,
+					   size_t count)
+{
+	YKP_OTP_VALIDATOR *v;
+	size_t i;
+
+	if (!cfgs && count) {
+		ykp_errno = YKP_EINVAL;
+		return NULL;
+	}
+	if (!(v = _yk_malloc(sizeof(*v))))
+		return NULL;
+	memset(v, 0, sizeof(*v));
+	for (v->nbuckets = 16; v->nbuckets < 2 * count; v->nbuckets *= 2)
+		;
+	v->entries = _yk_malloc((count ? count : 1) * sizeof(*v->entries));
+	v->buckets = _yk_malloc(v->nbuckets * sizeof(*v->buckets));
+	if (!v->entries || !v->buckets) {
+		ykp_otp_validator_free(v);
+		return NULL;
+	}
+	memset(v->buckets, 0, v->nbuckets * sizeof(*v->buckets));
+	v->aesni = otp_aesni();
+
+	for (i = 0; i < count; i++) {
+		const YK_CONFIG *ycfg;
+		struct otp_entry *e = &v->entries[i];
+		size_t b;
+
+		if (!cfgs[i] || cfgs[i]->ykcore_config.fixedSize > FIXED_SIZE) {
+			v->count = i;
+			ykp_otp_validator_free(v);
+			ykp_errno = cfgs[i] ? YKP_EINVAL : YKP_ENOCFG;
+			return NULL;
+		}
+		ycfg = &cfgs[i]->ykcore_config;
+		/* one key per public id */
+		if (otp_lookup(v, ycfg->fixed, ycfg->fixedSize)) {
+			v->count = i;
+			ykp_otp_validator_free(v);
+			ykp_errno = YKP_EINVAL;
+			return NULL;
+		}
+
+		memset(e, 0, sizeof(*e));
+		memcpy(e->fixed, ycfg->fixed, ycfg->fixedSize);
+		e->fixed_size = ycfg->fixedSize;
+		memcpy(e->uid, ycfg->uid, UID_SIZE);
+		otp_entry_key(e, ycfg->key, v->aesni);
+		b = fixed_hash(e->fixed, e->fixed_size) & (v->nbuckets - 1);
+		while (v->buckets[b])
+			b = (b + 1) & (v->nbuckets - 1);
+		v->buckets[b] = i + 1;
+		v->count = i + 1;
+	}
+	return v;
+}
+
+void ykp_otp_validator_free(YKP_OTP_VALIDATOR *v)
+{
+	if (!v)
+		return;
+	if (v->entries) {
+		insecure_memzero(v->entries, v->count * sizeof(*v->entries));
+		_yk_free(v->entries);
+	}
+	_yk_free(v->buckets);
+	_yk_free(v);
+}
+
+size_t ykp_otp_validate_batch(const YKP_OTP_VALIDATOR *v,
+			      const char *const *otps, size_t count,
+			      struct ticket_st *tickets, int *errors)
+{
+	struct otp_pending pending[BATCH_WIDTH];
+	unsigned char fixed[FIXED_SIZE];
+	size_t i, j, n = 0, valid = 0;
+
+	if (!v || (count && (!otps || !errors))) {
+		ykp_errno = YKP_EINVAL;
+		return 0;
+	}
+
+	for (i = 0; i < count; i++) {
+		struct otp_pending *p = &pending[n];
+		size_t fixed_size;
+
+		errors[i] = otp_parse(otps[i], fixed, &fixed_size, p->block);
+		if (errors[i])
+			continue;
+		if (!(p->entry = otp_lookup(v, fixed, fixed_size))) {
+			errors[i] = YKP_ENOCFG;
+			continue;
+		}
+		p->index = i;
+
+		if (++n == BATCH_WIDTH || i + 1 == count) {
+			otp_decrypt(v->aesni, pending, n);
+			for (j = 0; j < n; j++) {
+				size_t k = pending[j].index;
+
+				errors[k] = otp_ticket(pending[j].block,
+						       pending[j].entry->uid,
+						       tickets ? &tickets[k] : NULL);
+				if (!errors[k])
+					valid++;
+			}
+			n = 0;
+		}
+	}
+	/* the last OTPs were rejected before the batch was full */
+	if (n) {
+		otp_decrypt(v->aesni, pending, n);
+		for (j = 0; j < n; j++) {
+			size_t k = pending[j].index;
+
+			errors[k] = otp_ticket(pending[j].block,
+					       pending[j].entry->uid,
+					       tickets ? &tickets[k] : NULL);
+			if (!errors[k])
+				valid++;
+		}
+	}
+	insecure_memzero(pending, sizeof(pending));
+	return valid;
+}
+
+int ykp_otp_validate(const YKP_OTP_VALIDATOR *v, const char *otp,
+		     struct ticket_st *ticket)
+{
+	int err;
+
+	if (ykp_otp_validate_batch(v, &otp, 1, ticket, &err) == 1)
+		return 1;
+	if (v)
+		ykp_errno = err;
+	return 0;
+}
+
+/*
+ * Yubico mode challenge-response: the key answers a 6 byte challenge
+ * with a ticket carrying the challenge in place of the uid, encrypted
+ * with the AES key of the slot.  The other fields are the counters,
+ * timestamp and random number of the key at that moment.
+ */
+
+size_t ykp_chalresp_yubico(const YKP_CONFIG *cfg,
+			   const unsigned char *challenges, size_t count,
+			   const struct ticket_st *ticket,
+			   unsigned char *responses)
+{
+	unsigned char (*blocks)[TICKET_SIZE] =
+		(unsigned char (*)[TICKET_SIZE]) responses;
+#ifdef HAVE_AESNI
+	unsigned char ek[AES_ROUNDS + 1][TICKET_SIZE];
+	int aesni = otp_aesni();
+#endif
+	size_t i, j;
+
+	if (!cfg) {
+		ykp_errno = YKP_ENOCFG;
+		return 0;
+	}
+	if (count && (!challenges || !ticket || !responses)) {
+		ykp_errno = YKP_EINVAL;
+		return 0;
+	}
+
+	for (i = 0; i < count; i++)
+		otp_pack(ticket, challenges + i * UID_SIZE, blocks[i]);
+#ifdef HAVE_AESNI
+	if (aesni) {
+		aesni_expand(cfg->ykcore_config.key, ek, NULL);
+		for (i = 0; i < count; i += BATCH_WIDTH) {
+			j = count - i < BATCH_WIDTH ? count - i : BATCH_WIDTH;
+			aesni_encrypt((const unsigned char (*)[TICKET_SIZE]) ek,
+				      blocks + i, j);
+		}
+		insecure_memzero(ek, sizeof(ek));
+		return count;
+	}
+#endif
+	for (j = 0; j < count; j++)
+		yubikey_aes_encrypt(blocks[j], cfg->ykcore_config.key);
+	return count;
+}
+
+size_t ykp_chalresp_yubico_verify(const YKP_CONFIG *cfg,
+				  const unsigned char *challenges,
+				  const unsigned char *responses,
+				  size_t count, struct ticket_st *tickets,
+				  int *errors)
+{
+	struct otp_pending pending[BATCH_WIDTH];
+	struct otp_entry *e;
+	size_t i, j, n, valid = 0;
+	int aesni = otp_aesni();
+
+	if (!cfg) {
+		ykp_errno = YKP_ENOCFG;
+		return 0;
+	}
+	if (count && (!challenges || !responses || !errors)) {
+		ykp_errno = YKP_EINVAL;
+		return 0;
+	}
+	if (!(e = _yk_malloc(sizeof(*e))))
+		return 0;
+	otp_entry_key(e, cfg->ykcore_config.key, aesni);
+
+	for (i = 0; i < count; i += n) {
+		n = count - i < BATCH_WIDTH ? count - i : BATCH_WIDTH;
+		for (j = 0; j < n; j++) {
+			memcpy(pending[j].block,
+			       responses + (i + j) * TICKET_SIZE, TICKET_SIZE);
+			pending[j].entry = e;
+			pending[j].index = i + j;
+		}
+		otp_decrypt(aesni, pending, n);
+		for (j = 0; j < n; j++) {
+			errors[i + j] = otp_ticket(pending[j].block,
+						   challenges + (i + j) * UID_SIZE,
+						   tickets ? &tickets[i + j] : NULL);
+			if (!errors[i + j])
+				valid++;
+		}
+	}
+
+	insecure_memzero(pending, sizeof(pending));
+	insecure_memzero(e, sizeof(*e));
+	_yk_free(e);
+	return valid;
+}
@@ -0,0 +1,212 @@
+/* -*- mode:C; c-file-style: "bsd" -*- */
+/*
+ * Copyright (c) 2026 Yubico AB
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Random material for keys, uids, access codes and salts.
+ *
+ * Each thread keeps a buffer that is refilled from the kernel with one
+ * call, so generating a batch of configurations costs a handful of
+ * system calls instead of an open/read/close per key.  Bytes are wiped
+ * from the buffer as they are handed out, and the buffer is discarded
+ * in a forked child so that parent and child never share output.  Forks
+ * are counted by a pthread_atfork() handler rather than by comparing
+ * getpid() on every call, which would cost a system call each time.
+ */
+
+#include "ykpers_lcl.h"
+#include "yktsd.h"
+#include "ykcore/ykbzero.h"
+
+#include <ykpers.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+#ifdef HAVE_GETRANDOM
+#include <sys/random.h>
+#endif
+
+#define RANDOM_POOL_SIZE	4096
+
+struct random_pool {
+	size_t avail;
+	unsigned int generation;	/* fork_generation when filled */
+	unsigned char buf[RANDOM_POOL_SIZE];
+};
+
+static int random_fill(unsigned char *buf, size_t len)
+{
+	const char *random_places[] = {
+		"/dev/srandom",
+		"/dev/urandom",
+		"/dev/random",
+		0
+	};
+	const char **random_place;
+	size_t read_bytes = 0;
+
+#ifdef HAVE_GETRANDOM
+	while (read_bytes < len) {
+		ssize_t n = getrandom(buf + read_bytes, len - read_bytes, 0);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+		read_bytes += n;
+	}
+	if (read_bytes == len)
+		return 1;
+	/* ENOSYS on old kernels, fall back to the device files */
+	read_bytes = 0;
+#endif
+
+	for (random_place = random_places; *random_place; random_place++) {
+		FILE *random_file = fopen(*random_place, "r");
+		if (random_file) {
+			setvbuf(random_file, NULL, _IONBF, 0);
+			while (read_bytes < len) {
+				size_t n = fread(buf + read_bytes, 1,
+						 len - read_bytes, random_file);
+				if (n == 0)
+					break;
+				read_bytes += n;
+			}
+			fclose(random_file);
+			if (read_bytes == len)
+				return 1;
+			read_bytes = 0;
+		}
+	}
+	return 0;
+}
+
+static void random_pool_free(void *p)
+{
+	if (p) {
+		insecure_memzero(p, sizeof(struct random_pool));
+		_yk_tsd_free(p);
+	}
+}
+
+static int pool_tsd_init = -1;
+static unsigned int fork_generation;
+YK_DEFINE_TSD_METADATA(pool_key);
+YK_DEFINE_TSD_ONCE(pool_key);
+
+#ifndef _WIN32
+static void random_atfork_child(void)
+{
+	fork_generation++;
+}
+#endif
+
+static void pool_key_create(void)
+{
+#ifndef _WIN32
+	/* without fork detection the buffer is not used at all */
+	if (pthread_atfork(NULL, NULL, random_atfork_child) != 0)
+		return;
+#endif
+	pool_tsd_init = YK_TSD_INIT(pool_key, random_pool_free) == 0 ? 1 : -1;
+}
+
+static struct random_pool *random_pool_get(void)
+{
+	struct random_pool *pool;
+
+	YK_TSD_ONCE(pool_key, pool_key_create);
+	if (pool_tsd_init != 1)
+		return NULL;
+
+	pool = YK_TSD_GET(struct random_pool *, pool_key);
+	if (pool == NULL) {
+		pool = _yk_tsd_calloc(sizeof(struct random_pool));
+		if (pool == NULL)
+			return NULL;
+		if (YK_TSD_SET(pool_key, pool) != 0) {
+			_yk_tsd_free(pool);
+			return NULL;
+		}
+		pool->generation = fork_generation;
+	}
+	if (pool->generation != fork_generation) {
+		insecure_memzero(pool->buf, sizeof(pool->buf));
+		pool->avail = 0;
+		pool->generation = fork_generation;
+	}
+	return pool;
+}
+
+int ykp_random_bytes(void *buf, size_t len)
+{
+	unsigned char *out = buf;
+	struct random_pool *pool;
+
+	if (!buf && len) {
+		ykp_errno = YKP_EINVAL;
+		return 0;
+	}
+
+	/* Large requests gain nothing from the buffer */
+	pool = random_pool_get();
+	if (pool == NULL || len >= RANDOM_POOL_SIZE) {
+		if (!random_fill(out, len)) {
+			ykp_errno = YKP_ENORANDOM;
+			return 0;
+		}
+		return 1;
+	}
+
+	while (len > 0) {
+		unsigned char *p;
+		size_t n;
+
+		if (pool->avail == 0) {
+			if (!random_fill(pool->buf, sizeof(pool->buf))) {
+				ykp_errno = YKP_ENORANDOM;
+				return 0;
+			}
+			pool->avail = sizeof(pool->buf);
+		}
+		n = len < pool->avail ? len : pool->avail;
+		p = pool->buf + sizeof(pool->buf) - pool->avail;
+		memcpy(out, p, n);
+		insecure_memzero(p, n);
+		pool->avail -= n;
+		out += n;
+		len -= n;
+	}
+	return 1;
+}
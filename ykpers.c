@@ -109,9 +109,73 @@ static const char *ndef_identifiers[] = {
 	"urn:nfc:"
 };
 
+/* Radix tree over ndef_identifiers, built from that table: every node
+   holds an edge label, the 1-based identifier ending at it (0 if none)
+   and the range of its children, whose labels start with different
+   characters.  The children of the root are the first
+   NDEF_TRIE_ROOT_CHILDREN nodes.  test_ndef_construction checks it
+   against a scan of ndef_identifiers, so update both together. */
+struct ndef_trie_node {
+	const char *edge;
+	unsigned char edge_len;
+	unsigned char identifier;
+	unsigned char child;
+	unsigned char children;
+};
+
+#define NDEF_TRIE_ROOT_CHILDREN 12
+
+static const struct ndef_trie_node ndef_trie[] = {
+	{ "bt", 2, 0, 12, 3 },	/* 0 */
+	{ "dav://", 6, 14, 0, 0 },	/* 1 */
+	{ "f", 1, 0, 15, 2 },	/* 2 */
+	{ "http", 4, 0, 17, 2 },	/* 3 */
+	{ "i", 1, 0, 19, 2 },	/* 4 */
+	{ "mailto:", 7, 6, 0, 0 },	/* 5 */
+	{ "n", 1, 0, 21, 2 },	/* 6 */
+	{ "pop:", 4, 20, 0, 0 },	/* 7 */
+	{ "rtsp://", 7, 18, 0, 0 },	/* 8 */
+	{ "s", 1, 0, 23, 3 },	/* 9 */
+	{ "t", 1, 0, 26, 3 },	/* 10 */
+	{ "urn:", 4, 19, 29, 2 },	/* 11 */
+	{ "goep://", 7, 26, 0, 0 },	/* 12 */
+	{ "l2cap://", 8, 25, 0, 0 },	/* 13 */
+	{ "spp://", 6, 24, 0, 0 },	/* 14 */
+	{ "ile://", 6, 29, 0, 0 },	/* 15 */
+	{ "tp", 2, 0, 31, 2 },	/* 16 */
+	{ "://", 3, 3, 33, 1 },	/* 17 */
+	{ "s://", 4, 4, 34, 1 },	/* 18 */
+	{ "map:", 4, 17, 0, 0 },	/* 19 */
+	{ "rdaobex://", 10, 28, 0, 0 },	/* 20 */
+	{ "ews:", 4, 15, 0, 0 },	/* 21 */
+	{ "fs://", 5, 12, 0, 0 },	/* 22 */
+	{ "ftp://", 6, 10, 0, 0 },	/* 23 */
+	{ "ip", 2, 0, 35, 2 },	/* 24 */
+	{ "mb://", 5, 11, 0, 0 },	/* 25 */
+	{ "cpobex://", 9, 27, 0, 0 },	/* 26 */
+	{ "el", 2, 0, 37, 2 },	/* 27 */
+	{ "ftp:", 4, 23, 0, 0 },	/* 28 */
+	{ "epc:", 4, 34, 39, 4 },	/* 29 */
+	{ "nfc:", 4, 35, 0, 0 },	/* 30 */
+	{ "://", 3, 13, 43, 2 },	/* 31 */
+	{ "s://", 4, 9, 0, 0 },	/* 32 */
+	{ "www.", 4, 1, 0, 0 },	/* 33 */
+	{ "www.", 4, 2, 0, 0 },	/* 34 */
+	{ ":", 1, 21, 0, 0 },	/* 35 */
+	{ "s:", 2, 22, 0, 0 },	/* 36 */
+	{ ":", 1, 5, 0, 0 },	/* 37 */
+	{ "net://", 6, 16, 0, 0 },	/* 38 */
+	{ "id:", 3, 30, 0, 0 },	/* 39 */
+	{ "pat:", 4, 32, 0, 0 },	/* 40 */
+	{ "raw:", 4, 33, 0, 0 },	/* 41 */
+	{ "tag:", 4, 31, 0, 0 },	/* 42 */
+	{ "anonymous:anonymous@", 20, 7, 0, 0 },	/* 43 */
+	{ "ftp.", 4, 8, 0, 0 },	/* 44 */
+};
+
 YKP_CONFIG *ykp_create_config(void)
 {
-	YKP_CONFIG *cfg = malloc(sizeof(YKP_CONFIG));
+	YKP_CONFIG *cfg = _yk_malloc(sizeof(YKP_CONFIG));
 	if (cfg) {
 		memcpy(&cfg->ykcore_config, &default_config1,
 		       sizeof(default_config1));
@@ -119,6 +183,7 @@ YKP_CONFIG *ykp_create_config(void)
 		cfg->yk_minor_version = 3;
 		cfg->yk_build_version = 0;
 		cfg->command = SLOT_CONFIG;
+		_ykp_set_capabilities(cfg);
 		return cfg;
 	}
 	return 0;
@@ -126,18 +191,36 @@ YKP_CONFIG *ykp_create_config(void)
 
 YKP_CONFIG *ykp_alloc(void)
 {
-	YKP_CONFIG *cfg = malloc(sizeof(YKP_CONFIG));
+	YKP_CONFIG *cfg = _yk_malloc(sizeof(YKP_CONFIG));
 	if(cfg) {
-		memset(cfg, 0, sizeof(YKP_CONFIG));
-		return cfg;
+		return ykp_config_init_in_place(cfg, sizeof(YKP_CONFIG));
 	}
 	return 0;
 }
 
+size_t ykp_config_size(void)
+{
+	return sizeof(YKP_CONFIG);
+}
+
+YKP_CONFIG *ykp_config_init_in_place(void *mem, size_t len)
+{
+	YKP_CONFIG *cfg = mem;
+
+	if (!mem || len < sizeof(YKP_CONFIG) ||
+	    (uintptr_t) mem % sizeof(unsigned int) != 0) {
+		ykp_errno = YKP_EINVAL;
+		return 0;
+	}
+	memset(cfg, 0, sizeof(YKP_CONFIG));
+	_ykp_set_capabilities(cfg);
+	return cfg;
+}
+
 int ykp_free_config(YKP_CONFIG *cfg)
 {
 	if (cfg) {
-		free(cfg);
+		_yk_free(cfg);
 		return 1;
 	}
 	return 0;
@@ -154,74 +237,75 @@ int ykp_clear_config(YKP_CONFIG *cfg)
 	return 0;
 }
 
+void _ykp_set_capabilities(YKP_CONFIG *cfg)
+{
+	const struct firmware_caps_st *p, *match = _firmware_caps;
+
+	for (p = _firmware_caps; p->capabilities; p++) {
+		if (cfg->yk_major_version < p->major ||
+		    (cfg->yk_major_version == p->major &&
+		     (cfg->yk_minor_version < p->minor ||
+		      (cfg->yk_minor_version == p->minor &&
+		       cfg->yk_build_version < p->build))))
+			break;
+		match = p;
+	}
+	cfg->capabilities = match->capabilities;
+}
+
 void ykp_configure_version(YKP_CONFIG *cfg, YK_STATUS *st)
 {
 	cfg->yk_major_version = st->versionMajor;
 	cfg->yk_minor_version = st->versionMinor;
 	cfg->yk_build_version = st->versionBuild;
+	_ykp_set_capabilities(cfg);
 }
 
 int ykp_configure_command(YKP_CONFIG *cfg, uint8_t command)
 {
+	unsigned int capability;
+
 	switch(command) {
 	case SLOT_CONFIG:
+		capability = 0;
 		break;
 	case SLOT_CONFIG2:
-		if (!(cfg->yk_major_version >= 2)) {
-			ykp_errno = YKP_EOLDYUBIKEY;
-			return 0;
-		}
-		/* The NEO Beta key is versioned from 2.1.4 but doesn't support slot2 */
-		else if( cfg->yk_major_version == 2 && cfg->yk_minor_version == 1 &&
-			  cfg->yk_build_version >= 4) {
-			ykp_errno = YKP_EYUBIKEYVER;
-			return 0;
-		}
+		capability = YKP_CAP_SLOT_TWO;
 		break;
 	case SLOT_UPDATE1:
 	case SLOT_UPDATE2:
 	case SLOT_SWAP:
-		if (!((cfg->yk_major_version == 2 && cfg->yk_minor_version >= 3)
-			  || cfg->yk_major_version > 2)) {
-			ykp_errno = YKP_EOLDYUBIKEY;
-			return 0;
-		}
+		capability = YKP_CAP_UPDATE;
 		break;
 	case SLOT_DEVICE_CONFIG:
-		if(!(cfg->yk_major_version <= 5)) {
-			ykp_errno = YKP_EYUBIKEYVER;
-			return 0;
-		} /* we have an intentional fall-through to the next case here */
+		capability = YKP_CAP_DEVICE_CONFIG;
+		break;
 	case SLOT_SCAN_MAP:
-		if(!(cfg->yk_major_version >= 3)) {
-			ykp_errno = YKP_EYUBIKEYVER;
-			return 0;
-		}
+		capability = YKP_CAP_SCAN_MAP;
 		break;
 	case SLOT_YK4_SET_DEVICE_INFO:
-		if(!(cfg->yk_major_version >= 5)) {
-			ykp_errno = YKP_EYUBIKEYVER;
-			return 0;
-		}
+		capability = YKP_CAP_DEVICE_INFO;
 		break;
 	case SLOT_NDEF2:
-		if(cfg->yk_major_version != 3 && cfg->yk_major_version != 5) {
-			ykp_errno = YKP_EYUBIKEYVER;
-			return 0;
-		}
+		capability = YKP_CAP_NDEF2;
 		break;
 	case SLOT_NDEF:
-		/* NDEF is available for neo, thus within 2.1 from build 4 */
-		if (!((cfg->yk_major_version == 2 && cfg->yk_minor_version == 1 &&
-			  cfg->yk_build_version >= 4) || cfg->yk_major_version == 3 || cfg->yk_major_version >= 5)) {
-			ykp_errno = YKP_EYUBIKEYVER;
-			return 0;
-		}
+		capability = YKP_CAP_NDEF;
 		break;
 	default:
 		ykp_errno = YKP_EINVCONFNUM;
 		return 0;
 	}
+	if (!capability_has(cfg, capability)) {
+		/* Keys from before the second slot and before update are
+		   too old, the others just don't have the feature. */
+		if ((command == SLOT_CONFIG2 && cfg->yk_major_version < 2) ||
+		    capability == YKP_CAP_UPDATE)
+			ykp_errno = YKP_EOLDYUBIKEY;
+		else
+			ykp_errno = YKP_EYUBIKEYVER;
+		return 0;
+	}
 	cfg->command = command;
 	return 1;
 }
@@ -244,6 +328,100 @@ int ykp_configure_for(YKP_CONFIG *cfg, int confnum, YK_STATUS *st)
 	}
 }
 
+static bool _ykp_is_zero(const unsigned char *buf, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		if (buf[i])
+			return false;
+	}
+	return true;
+}
+
+/* An update keeps key, uid and fixed part of the slot and changes the
+   flags in the update masks, so it can stand in for a full write when
+   the slot is programmed and the configuration has nothing else. */
+static bool _ykp_can_update(const YKP_CONFIG *cfg, const YK_STATUS *st,
+			    int confnum)
+{
+	const YK_CONFIG *ycfg = &cfg->ykcore_config;
+	unsigned short valid = confnum == 1 ? CONFIG1_VALID : CONFIG2_VALID;
+
+	if (!capability_has(cfg, YKP_CAP_UPDATE) ||
+	    (st->touchLevel & valid) != valid)
+		return false;
+	if ((ycfg->tktFlags & TKTFLAG_UPDATE_MASK) != ycfg->tktFlags ||
+	    (ycfg->cfgFlags & CFGFLAG_UPDATE_MASK) != ycfg->cfgFlags ||
+	    (ycfg->extFlags & EXTFLAG_UPDATE_MASK) != ycfg->extFlags ||
+	    (ycfg->extFlags & EXTFLAG_ALLOW_UPDATE) != EXTFLAG_ALLOW_UPDATE)
+		return false;
+	return ycfg->fixedSize == 0 &&
+		_ykp_is_zero(ycfg->key, sizeof(ycfg->key)) &&
+		_ykp_is_zero(ycfg->uid, sizeof(ycfg->uid));
+}
+
+int ykp_plan_config_write(YKP_CONFIG *cfg, YK_STATUS *st,
+			  unsigned char *acc_code, int *frames)
+{
+	uint8_t full, update, command;
+	int confnum, count;
+
+	if (!cfg || !st) {
+		ykp_errno = YKP_EINVAL;
+		return 0;
+	}
+	switch (cfg->command) {
+	case SLOT_CONFIG:
+	case SLOT_UPDATE1:
+		confnum = 1;
+		full = SLOT_CONFIG;
+		update = SLOT_UPDATE1;
+		break;
+	case SLOT_CONFIG2:
+	case SLOT_UPDATE2:
+		confnum = 2;
+		full = SLOT_CONFIG2;
+		update = SLOT_UPDATE2;
+		break;
+	default:
+		ykp_errno = YKP_EINVCONFNUM;
+		return 0;
+	}
+
+	ykp_configure_version(cfg, st);
+
+	/* Only ever go from a full write to an update: turning an update
+	   into a full write would replace the key in the slot. */
+	if (cfg->command == update) {
+		if (!_ykp_can_update(cfg, st, confnum)) {
+			ykp_errno = YKP_EINVAL;
+			return 0;
+		}
+		command = update;
+		count = yk_command_frame_count(&cfg->ykcore_config, update,
+					       acc_code);
+	} else {
+		command = full;
+		count = yk_command_frame_count(&cfg->ykcore_config, full,
+					       acc_code);
+		if (_ykp_can_update(cfg, st, confnum)) {
+			int update_count = yk_command_frame_count(
+				&cfg->ykcore_config, update, acc_code);
+			if (update_count <= count) {
+				command = update;
+				count = update_count;
+			}
+		}
+	}
+
+	if (!ykp_configure_command(cfg, command))
+		return 0;
+	if (frames)
+		*frames = count;
+	return 1;
+}
+
 /* Return number of bytes of key data for this configuration.
  * 20 bytes is 160 bits, 16 bytes is 128.
  */
@@ -339,20 +517,13 @@ int ykp_HMAC_key_from_hex(YKP_CONFIG *cfg, const char *hexkey) {
 /* Generate an AES (128 bits) or HMAC (despite the function name) (160 bits)
  * key from user entered input.
  *
- * Use user provided salt, or use salt from an available random device.
- * If no random device is available we return with an error.
+ * Use user provided salt, or use salt from ykp_random_bytes().
+ * If no randomness is available we return with an error.
  */
 int ykp_AES_key_from_passphrase(YKP_CONFIG *cfg, const char *passphrase,
 				const char *salt)
 {
 	if (cfg) {
-		const char *random_places[] = {
-			"/dev/srandom",
-			"/dev/urandom",
-			"/dev/random",
-			0
-		};
-		const char **random_place;
 		uint8_t _salt[8] = {0};
 		size_t _salt_len = 0;
 		unsigned char buf[sizeof(cfg->ykcore_config.key) + 4] = {0};
@@ -368,33 +539,10 @@ int ykp_AES_key_from_passphrase(YKP_CONFIG *cfg, const char *passphrase,
 				_salt_len = 8;
 			memcpy(_salt, salt, _salt_len);
 		} else {
-			for (random_place = random_places;
-			     *random_place;
-			     random_place++) {
-				FILE *random_file = fopen(*random_place, "r");
-				if (random_file) {
-					size_t read_bytes = 0;
-
-					while (read_bytes < sizeof(_salt)) {
-						size_t n = fread(&_salt[read_bytes],
-								 1, sizeof (_salt) - read_bytes,
-								 random_file);
-						read_bytes += n;
-					}
-
-					fclose(random_file);
-
-					_salt_len = sizeof(_salt);
-
-					break; /* from for loop */
-				}
-			}
-		}
-		if (_salt_len == 0) {
-			/* There was no randomness files, so don't do
-			 * anything */
-			ykp_errno = YKP_ENORANDOM;
-			return 0;
+			/* ykp_errno is set to YKP_ENORANDOM on failure */
+			if (!ykp_random_bytes(_salt, sizeof(_salt)))
+				return 0;
+			_salt_len = sizeof(_salt);
 		}
 
 		rc = yk_pbkdf2(passphrase,
@@ -419,7 +567,7 @@ int ykp_AES_key_from_passphrase(YKP_CONFIG *cfg, const char *passphrase,
 
 YK_NDEF *ykp_alloc_ndef(void)
 {
-	YK_NDEF *ndef = malloc(sizeof(YK_NDEF));
+	YK_NDEF *ndef = _yk_malloc(sizeof(YK_NDEF));
 	if(ndef) {
 		memset(ndef, 0, sizeof(YK_NDEF));
 		return ndef;
@@ -427,39 +575,81 @@ YK_NDEF *ykp_alloc_ndef(void)
 	return 0;
 }
 
+size_t ykp_ndef_size(void)
+{
+	return sizeof(YK_NDEF);
+}
+
+YK_NDEF *ykp_ndef_init_in_place(void *mem, size_t len)
+{
+	if (!mem || len < sizeof(YK_NDEF)) {
+		ykp_errno = YKP_EINVAL;
+		return 0;
+	}
+	memset(mem, 0, sizeof(YK_NDEF));
+	return mem;
+}
+
 int ykp_free_ndef(YK_NDEF *ndef)
 {
 	if(ndef)
 	{
-		free(ndef);
+		_yk_free(ndef);
 		return 1;
 	}
 	return 0;
 }
 
-/* Fill in the data and len parts of the YK_NDEF struct based on supplied uri. */
-int ykp_construct_ndef_uri(YK_NDEF *ndef, const char *uri)
+/* The 1-based index of the first entry in ndef_identifiers that uri
+   starts with, or 0.  Identifiers that are prefixes of each other lie on
+   one path through the tree, so the lowest one seen on the way down is
+   the one a scan of the table in order would find. */
+static int ndef_identifier_match(const char *uri, size_t *prefix_len)
 {
-	int num_identifiers = sizeof(ndef_identifiers) / sizeof(char*);
-	size_t data_length;
-	int indx = 0;
-	for(; indx < num_identifiers; indx++) {
-		size_t len = strlen(ndef_identifiers[indx]);
-		if(strncmp(uri, ndef_identifiers[indx], len) == 0) {
-			uri += len;
+	unsigned int first = 0;
+	unsigned int count = NDEF_TRIE_ROOT_CHILDREN;
+	size_t depth = 0;
+	int identifier = 0;
+
+	*prefix_len = 0;
+	while (count > 0) {
+		const struct ndef_trie_node *node = NULL;
+		unsigned int i;
+
+		for (i = first; i < first + count; i++) {
+			if (ndef_trie[i].edge[0] == uri[depth]) {
+				node = &ndef_trie[i];
+				break;
+			}
+		}
+		if (!node || strncmp(uri + depth, node->edge, node->edge_len) != 0)
 			break;
+		depth += node->edge_len;
+		if (node->identifier &&
+		    (identifier == 0 || node->identifier < identifier)) {
+			identifier = node->identifier;
+			*prefix_len = depth;
 		}
+		first = node->child;
+		count = node->children;
 	}
+	return identifier;
+}
+
+/* Fill in the data and len parts of the YK_NDEF struct based on supplied uri. */
+int ykp_construct_ndef_uri(YK_NDEF *ndef, const char *uri)
+{
+	size_t prefix_len = 0;
+	size_t data_length;
+	int identifier = ndef_identifier_match(uri, &prefix_len);
+
+	uri += prefix_len;
 	data_length = strlen(uri);
 	if(data_length + 1 > NDEF_DATA_SIZE) {
 		ykp_errno = YKP_EINVAL;
 		return 0;
 	}
-	if(indx == num_identifiers) {
-		ndef->data[0] = 0;
-	} else {
-		ndef->data[0] = indx + 1;
-	}
+	ndef->data[0] = identifier;
 	memcpy(ndef->data + 1, uri, data_length);
 	ndef->len = data_length + 1;
 	ndef->type = 'U';
@@ -487,6 +677,70 @@ int ykp_construct_ndef_text(YK_NDEF *ndef, const char *text, const char *lang, b
 	return 1;
 }
 
+/* Expand {serial}, {serial_hex}, {serial_modhex} and {prefix}, the
+   fixed part of cfg in modhex, in tmpl into out. */
+int ykp_expand_ndef_template(char *out, size_t len, const char *tmpl,
+			     unsigned int serial, const YKP_CONFIG *cfg)
+{
+	size_t used = 0;
+
+	while (*tmpl) {
+		char value[FIXED_SIZE * 2 + 1];
+		size_t value_len;
+
+		if (*tmpl != '{') {
+			if (used + 1 >= len)
+				goto toolong;
+			out[used++] = *tmpl++;
+			continue;
+		}
+		if (strncmp(tmpl, "{serial}", 8) == 0) {
+			snprintf(value, sizeof(value), "%u", serial);
+			tmpl += 8;
+		} else if (strncmp(tmpl, "{serial_hex}", 12) == 0 ||
+			   strncmp(tmpl, "{serial_modhex}", 15) == 0) {
+			unsigned char bin[4];
+			bool modhex = tmpl[8] == 'm';
+
+			bin[0] = serial >> 24;
+			bin[1] = serial >> 16;
+			bin[2] = serial >> 8;
+			bin[3] = serial;
+			if (modhex)
+				yubikey_modhex_encode(value, (const char *) bin, 4);
+			else
+				yubikey_hex_encode(value, (const char *) bin, 4);
+			tmpl += modhex ? 15 : 12;
+		} else if (strncmp(tmpl, "{prefix}", 8) == 0) {
+			if (!cfg || cfg->ykcore_config.fixedSize == 0 ||
+			    cfg->ykcore_config.fixedSize > FIXED_SIZE) {
+				ykp_errno = YKP_EINVAL;
+				return 0;
+			}
+			yubikey_modhex_encode(value,
+					      (const char *) cfg->ykcore_config.fixed,
+					      cfg->ykcore_config.fixedSize);
+			tmpl += 8;
+		} else {
+			ykp_errno = YKP_EINVAL;
+			return 0;
+		}
+		value_len = strlen(value);
+		if (used + value_len >= len)
+			goto toolong;
+		memcpy(out + used, value, value_len);
+		used += value_len;
+	}
+	if (len == 0)
+		goto toolong;
+	out[used] = '\0';
+	return 1;
+
+toolong:
+	ykp_errno = YKP_EINVAL;
+	return 0;
+}
+
 int ykp_ndef_as_text(YK_NDEF *ndef, char *text, size_t len)
 {
 	if(ndef->type == 'U') {
@@ -536,7 +790,7 @@ int ykp_set_ndef_access_code(YK_NDEF *ndef, unsigned char *access_code)
 
 YK_DEVICE_CONFIG *ykp_alloc_device_config(void)
 {
-	YK_DEVICE_CONFIG *cfg = malloc(sizeof(YK_DEVICE_CONFIG));
+	YK_DEVICE_CONFIG *cfg = _yk_malloc(sizeof(YK_DEVICE_CONFIG));
 	if(cfg) {
 		memset(cfg, 0, sizeof(YK_DEVICE_CONFIG));
 		return cfg;
@@ -544,10 +798,25 @@ YK_DEVICE_CONFIG *ykp_alloc_device_config(void)
 	return 0;
 }
 
+size_t ykp_device_config_size(void)
+{
+	return sizeof(YK_DEVICE_CONFIG);
+}
+
+YK_DEVICE_CONFIG *ykp_device_config_init_in_place(void *mem, size_t len)
+{
+	if (!mem || len < sizeof(YK_DEVICE_CONFIG)) {
+		ykp_errno = YKP_EINVAL;
+		return 0;
+	}
+	memset(mem, 0, sizeof(YK_DEVICE_CONFIG));
+	return mem;
+}
+
 int ykp_free_device_config(YK_DEVICE_CONFIG *device_config)
 {
 	if(device_config) {
-		free(device_config);
+		_yk_free(device_config);
 		return 1;
 	}
 	return 0;
@@ -583,155 +852,9 @@ int ykp_set_device_autoeject_time(YK_DEVICE_CONFIG *device_config, unsigned shor
 	return 0;
 }
 
-static bool vcheck_all(const YKP_CONFIG *cfg)
-{
-	return true;
-}
-static bool vcheck_v1(const YKP_CONFIG *cfg)
-{
-	return cfg->yk_major_version == 1;
-}
-static bool vcheck_no_v1(const YKP_CONFIG *cfg)
-{
-	return cfg->yk_major_version > 1;
-}
-
-static bool vcheck_v21_or_greater(const YKP_CONFIG *cfg)
-{
-	/* the NEO Beta is versioned from 2.1.4 but shouldn't be identified as a 2.1 above key */
-	return (cfg->yk_major_version == 2 && cfg->yk_minor_version > 1) ||
-		(cfg->yk_major_version == 2 && cfg->yk_minor_version == 1 && cfg->yk_build_version <= 3)
-		|| cfg->yk_major_version > 2;
-}
-
-static bool vcheck_v22_or_greater(const YKP_CONFIG *cfg)
-{
-	return (cfg->yk_major_version == 2 &&
-		cfg->yk_minor_version >= 2) ||
-		cfg->yk_major_version > 2;
-}
-
-static bool vcheck_v23_or_greater(const YKP_CONFIG *cfg)
-{
-	return (cfg->yk_major_version == 2 &&
-		cfg->yk_minor_version >= 3) ||
-		cfg->yk_major_version > 2;
-}
-
-static bool vcheck_v24_or_greater(const YKP_CONFIG *cfg)
-{
-	return (cfg->yk_major_version == 2 &&
-		cfg->yk_minor_version >= 4) ||
-		cfg->yk_major_version > 2;
-}
-
-static bool vcheck_v30(const YKP_CONFIG *cfg)
-{
-	return (cfg->yk_major_version == 3 &&
-		cfg->yk_minor_version == 0);
-}
-
-static bool vcheck_neo(const YKP_CONFIG *cfg)
-{
-	return (cfg->yk_major_version == 2 &&
-			cfg->yk_minor_version == 1 &&
-			cfg->yk_build_version >= 4);
-
-}
-
-static bool vcheck_neo_before_5(const YKP_CONFIG *cfg)
-{
-	return vcheck_neo(cfg) && cfg->yk_build_version < 5;
-}
-
-static bool vcheck_neo_after_6(const YKP_CONFIG *cfg)
-{
-	return vcheck_neo(cfg) && cfg->yk_build_version > 6;
-}
-
-bool capability_has_hidtrig(const YKP_CONFIG *cfg)
-{
-	return vcheck_v1(cfg);
-}
-
-bool capability_has_ticket_first(const YKP_CONFIG *cfg)
-{
-	return vcheck_v1(cfg);
-}
-
-bool capability_has_static(const YKP_CONFIG *cfg)
-{
-	return vcheck_all(cfg) && !vcheck_neo_before_5(cfg);
-}
-
-bool capability_has_static_extras(const YKP_CONFIG *cfg)
-{
-	return vcheck_no_v1(cfg) && !vcheck_neo_before_5(cfg);
-}
-
-bool capability_has_slot_two(const YKP_CONFIG *cfg)
-{
-	return vcheck_no_v1(cfg) && !vcheck_neo(cfg);
-}
-
-bool capability_has_chal_resp(const YKP_CONFIG *cfg)
-{
-	return vcheck_v22_or_greater(cfg);
-}
-
-bool capability_has_oath_imf(const YKP_CONFIG *cfg)
-{
-	return vcheck_v22_or_greater(cfg) || vcheck_neo_after_6(cfg);
-}
-
-bool capability_has_serial_api(const YKP_CONFIG *cfg)
-{
-	return vcheck_v22_or_greater(cfg) || vcheck_neo(cfg);
-}
-
-bool capability_has_serial(const YKP_CONFIG *cfg)
-{
-	return vcheck_v22_or_greater(cfg);
-}
-
-bool capability_has_oath(const YKP_CONFIG *cfg)
-{
-	return vcheck_v21_or_greater(cfg) || vcheck_neo(cfg);
-}
-
-bool capability_has_ticket_mods(const YKP_CONFIG *cfg)
-{
-	return vcheck_all(cfg);
-}
-
-bool capability_has_update(const YKP_CONFIG *cfg)
-{
-	return vcheck_v23_or_greater(cfg);
-}
-
-bool capability_has_fast(const YKP_CONFIG *cfg)
-{
-	return vcheck_v23_or_greater(cfg);
-}
-
-bool capability_has_numeric(const YKP_CONFIG *cfg)
-{
-	return vcheck_v23_or_greater(cfg);
-}
-
-bool capability_has_dormant(const YKP_CONFIG *cfg)
-{
-	return vcheck_v23_or_greater(cfg);
-}
-
-bool capability_has_led_inv(const YKP_CONFIG *cfg)
-{
-	return (vcheck_v24_or_greater(cfg) && !vcheck_v30(cfg));
-}
-
 int ykp_set_oath_imf(YKP_CONFIG *cfg, unsigned long imf)
 {
-	if (!capability_has_oath_imf(cfg)) {
+	if (!capability_has(cfg, YKP_CAP_OATH_IMF)) {
 		ykp_errno = YKP_EYUBIKEYVER;
 		return 0;
 	}
@@ -752,7 +875,7 @@ int ykp_set_oath_imf(YKP_CONFIG *cfg, unsigned long imf)
 
 unsigned long ykp_get_oath_imf(const YKP_CONFIG *cfg)
 {
-	if (!capability_has_oath_imf(cfg)) {
+	if (!capability_has(cfg, YKP_CAP_OATH_IMF)) {
 		return 0;
 	}
 
@@ -767,7 +890,7 @@ int ykp_set_ ## fnname(YKP_CONFIG *cfg, unsigned char *input, size_t len)	\
 	if (cfg) {						\
 		size_t max_chars = len;				\
 								\
-		if (!capability(cfg)) {				\
+		if (!capability_has(cfg, capability)) {		\
 			ykp_errno = YKP_EYUBIKEYVER;		\
 			return 0;				\
 		}						\
@@ -785,15 +908,15 @@ int ykp_set_ ## fnname(YKP_CONFIG *cfg, unsigned char *input, size_t len)	\
 	return 0;						\
 }
 
-def_set_charfield(access_code,accCode,ACC_CODE_SIZE,,vcheck_all)
-def_set_charfield(fixed,fixed,FIXED_SIZE,cfg->ykcore_config.fixedSize = max_chars,vcheck_all)
-def_set_charfield(uid,uid,UID_SIZE,,vcheck_all)
+def_set_charfield(access_code,accCode,ACC_CODE_SIZE,,0)
+def_set_charfield(fixed,fixed,FIXED_SIZE,cfg->ykcore_config.fixedSize = max_chars,0)
+def_set_charfield(uid,uid,UID_SIZE,,0)
 
 #define def_set_tktflag(type,capability)			\
 int ykp_set_tktflag_ ## type(YKP_CONFIG *cfg, bool state)	\
 {								\
 	if (cfg) {						\
-		if (!capability(cfg)) {				\
+		if (!capability_has(cfg, capability)) {		\
 			ykp_errno = YKP_EYUBIKEYVER;		\
 			return 0;				\
 		}						\
@@ -823,7 +946,7 @@ bool ykp_get_tktflag_ ## type(const YKP_CONFIG *cfg)		\
 int ykp_set_cfgflag_ ## type(YKP_CONFIG *cfg, bool state)	\
 {								\
 	if (cfg) {						\
-		if (!capability(cfg)) {				\
+		if (!capability_has(cfg, capability)) {		\
 			ykp_errno = YKP_EYUBIKEYVER;		\
 			return 0;				\
 		}						\
@@ -852,7 +975,7 @@ bool ykp_get_cfgflag_ ## type(const YKP_CONFIG *cfg)		\
 int ykp_set_extflag_ ## type(YKP_CONFIG *cfg, bool state)	\
 {								\
 	if (cfg) {						\
-		if (!capability(cfg)) {				\
+		if (!capability_has(cfg, capability)) {		\
 			ykp_errno = YKP_EYUBIKEYVER;		\
 			return 0;				\
 		}						\
@@ -876,43 +999,43 @@ bool ykp_get_extflag_ ## type(const YKP_CONFIG *cfg)		\
 	return false;						\
 }
 
-def_set_tktflag(TAB_FIRST,capability_has_ticket_mods)
-def_set_tktflag(APPEND_TAB1,capability_has_ticket_mods)
-def_set_tktflag(APPEND_TAB2,capability_has_ticket_mods)
-def_set_tktflag(APPEND_DELAY1,capability_has_ticket_mods)
-def_set_tktflag(APPEND_DELAY2,capability_has_ticket_mods)
-def_set_tktflag(APPEND_CR,capability_has_ticket_mods)
-def_set_tktflag(PROTECT_CFG2,capability_has_slot_two)
-def_set_tktflag(OATH_HOTP,capability_has_oath)
-def_set_tktflag(CHAL_RESP,capability_has_chal_resp)
-
-def_set_cfgflag(SEND_REF,capability_has_ticket_mods)
-def_set_cfgflag(TICKET_FIRST,capability_has_ticket_first)
-def_set_cfgflag(PACING_10MS,capability_has_ticket_mods)
-def_set_cfgflag(PACING_20MS,capability_has_ticket_mods)
-def_set_cfgflag(ALLOW_HIDTRIG,capability_has_hidtrig)
-def_set_cfgflag(STATIC_TICKET,capability_has_static)
-def_set_cfgflag(SHORT_TICKET,capability_has_static_extras)
-def_set_cfgflag(STRONG_PW1,capability_has_static_extras)
-def_set_cfgflag(STRONG_PW2,capability_has_static_extras)
-def_set_cfgflag(MAN_UPDATE,capability_has_static_extras)
-def_set_cfgflag(OATH_HOTP8,capability_has_oath)
-def_set_cfgflag(OATH_FIXED_MODHEX1,capability_has_oath)
-def_set_cfgflag(OATH_FIXED_MODHEX2,capability_has_oath)
-def_set_cfgflag(OATH_FIXED_MODHEX,capability_has_oath)
-def_set_cfgflag(CHAL_YUBICO,capability_has_chal_resp)
-def_set_cfgflag(CHAL_HMAC,capability_has_chal_resp)
-def_set_cfgflag(HMAC_LT64,capability_has_chal_resp)
-def_set_cfgflag(CHAL_BTN_TRIG,capability_has_chal_resp)
-
-def_set_extflag(SERIAL_BTN_VISIBLE,capability_has_serial)
-def_set_extflag(SERIAL_USB_VISIBLE,capability_has_serial)
-def_set_extflag(SERIAL_API_VISIBLE,capability_has_serial_api)
-def_set_extflag(USE_NUMERIC_KEYPAD,capability_has_numeric)
-def_set_extflag(FAST_TRIG,capability_has_fast)
-def_set_extflag(ALLOW_UPDATE,capability_has_update)
-def_set_extflag(DORMANT,capability_has_dormant)
-def_set_extflag(LED_INV,capability_has_led_inv)
+def_set_tktflag(TAB_FIRST,YKP_CAP_TICKET_MODS)
+def_set_tktflag(APPEND_TAB1,YKP_CAP_TICKET_MODS)
+def_set_tktflag(APPEND_TAB2,YKP_CAP_TICKET_MODS)
+def_set_tktflag(APPEND_DELAY1,YKP_CAP_TICKET_MODS)
+def_set_tktflag(APPEND_DELAY2,YKP_CAP_TICKET_MODS)
+def_set_tktflag(APPEND_CR,YKP_CAP_TICKET_MODS)
+def_set_tktflag(PROTECT_CFG2,YKP_CAP_SLOT_TWO)
+def_set_tktflag(OATH_HOTP,YKP_CAP_OATH)
+def_set_tktflag(CHAL_RESP,YKP_CAP_CHAL_RESP)
+
+def_set_cfgflag(SEND_REF,YKP_CAP_TICKET_MODS)
+def_set_cfgflag(TICKET_FIRST,YKP_CAP_TICKET_FIRST)
+def_set_cfgflag(PACING_10MS,YKP_CAP_TICKET_MODS)
+def_set_cfgflag(PACING_20MS,YKP_CAP_TICKET_MODS)
+def_set_cfgflag(ALLOW_HIDTRIG,YKP_CAP_HIDTRIG)
+def_set_cfgflag(STATIC_TICKET,YKP_CAP_STATIC)
+def_set_cfgflag(SHORT_TICKET,YKP_CAP_STATIC_EXTRAS)
+def_set_cfgflag(STRONG_PW1,YKP_CAP_STATIC_EXTRAS)
+def_set_cfgflag(STRONG_PW2,YKP_CAP_STATIC_EXTRAS)
+def_set_cfgflag(MAN_UPDATE,YKP_CAP_STATIC_EXTRAS)
+def_set_cfgflag(OATH_HOTP8,YKP_CAP_OATH)
+def_set_cfgflag(OATH_FIXED_MODHEX1,YKP_CAP_OATH)
+def_set_cfgflag(OATH_FIXED_MODHEX2,YKP_CAP_OATH)
+def_set_cfgflag(OATH_FIXED_MODHEX,YKP_CAP_OATH)
+def_set_cfgflag(CHAL_YUBICO,YKP_CAP_CHAL_RESP)
+def_set_cfgflag(CHAL_HMAC,YKP_CAP_CHAL_RESP)
+def_set_cfgflag(HMAC_LT64,YKP_CAP_CHAL_RESP)
+def_set_cfgflag(CHAL_BTN_TRIG,YKP_CAP_CHAL_RESP)
+
+def_set_extflag(SERIAL_BTN_VISIBLE,YKP_CAP_SERIAL)
+def_set_extflag(SERIAL_USB_VISIBLE,YKP_CAP_SERIAL)
+def_set_extflag(SERIAL_API_VISIBLE,YKP_CAP_SERIAL_API)
+def_set_extflag(USE_NUMERIC_KEYPAD,YKP_CAP_NUMERIC)
+def_set_extflag(FAST_TRIG,YKP_CAP_FAST)
+def_set_extflag(ALLOW_UPDATE,YKP_CAP_UPDATE)
+def_set_extflag(DORMANT,YKP_CAP_DORMANT)
+def_set_extflag(LED_INV,YKP_CAP_LED_INV)
 
 static const char str_key_value_separator[] = ": ";
 static const char str_hex_prefix[] = "h:";
@@ -1033,7 +1156,7 @@ static int _ykp_legacy_export_config(const YKP_CONFIG *cfg, char *buf, size_t le
 
 		/* OATH IMF: */
 		if ((ycfg.tktFlags & TKTFLAG_OATH_HOTP) == TKTFLAG_OATH_HOTP &&
-		    capability_has_oath_imf(cfg)) {
+		    capability_has(cfg, YKP_CAP_OATH_IMF)) {
 			written = snprintf(buf + pos, len - (size_t)pos, "%s%s%s%lx\n", str_oath_imf, str_key_value_separator, str_hex_prefix, ykp_get_oath_imf(cfg));
 			if (written < 0 || pos + written > len) {
 				return -1;
@@ -1045,7 +1168,7 @@ static int _ykp_legacy_export_config(const YKP_CONFIG *cfg, char *buf, size_t le
 		buffer[0] = '\0';
 		for (p = _ticket_flags_map; p->flag; p++) {
 			if ((ycfg.tktFlags & p->flag) == p->flag
-			    && p->capability(cfg)
+			    && capability_has(cfg, p->capability)
 			    && (mode & p->mode) == mode) {
 				if (*buffer) {
 					strncat(buffer, str_flags_separator, 256 - strlen(buffer));
@@ -1064,7 +1187,7 @@ static int _ykp_legacy_export_config(const YKP_CONFIG *cfg, char *buf, size_t le
 		t_flags = ycfg.cfgFlags;
 		for (p = _config_flags_map; p->flag; p++) {
 			if ((t_flags & p->flag) == p->flag
-			    && p->capability(cfg)
+			    && capability_has(cfg, p->capability)
 			    && (mode & p->mode) == mode) {
 				if (*buffer) {
 					strncat(buffer, str_flags_separator, 256 - strlen(buffer));
@@ -1086,7 +1209,7 @@ static int _ykp_legacy_export_config(const YKP_CONFIG *cfg, char *buf, size_t le
 		buffer[0] = '\0';
 		for (p = _extended_flags_map; p->flag; p++) {
 			if ((ycfg.extFlags & p->flag) == p->flag
-			    && p->capability(cfg)
+			    && capability_has(cfg, p->capability)
 			    && (mode & p->mode) == mode) {
 				if (*buffer) {
 					strncat(buffer, str_flags_separator, 256 - strlen(buffer));
@@ -1193,33 +1316,32 @@ unsigned int ykp_get_acccode_type(const YKP_CONFIG *cfg)
 	return cfg->ykp_acccode_type;
 }
 
+static int errno_tsd_init = -1;
+YK_DEFINE_TSD_METADATA(errno_key);
+YK_DEFINE_TSD_ONCE(errno_key);
+
+static void errno_key_create(void)
+{
+	errno_tsd_init = YK_TSD_INIT(errno_key, _yk_tsd_free) == 0 ? 1 : -1;
+}
+
 int * _ykp_errno_location(void)
 {
-	static int tsd_init = 0;
 	static int nothread_errno = 0;
-	YK_DEFINE_TSD_METADATA(errno_key);
-	int rc = 0;
+	int *p;
 
-	if (tsd_init == 0) {
-		if ((rc = YK_TSD_INIT(errno_key, free)) == 0) {
-			tsd_init = 1;
-		} else {
-			tsd_init = -1;
-		}
-	}
+	YK_TSD_ONCE(errno_key, errno_key_create);
+	if (errno_tsd_init != 1)
+		return &nothread_errno;
 
-	if(YK_TSD_GET(int *, errno_key) == NULL) {
-		void *p = calloc(1, sizeof(int));
-		if (!p) {
-			tsd_init = -1;
-		} else {
-			YK_TSD_SET(errno_key, p);
+	if ((p = YK_TSD_GET(int *, errno_key)) == NULL) {
+		p = _yk_tsd_calloc(sizeof(int));
+		if (!p || YK_TSD_SET(errno_key, p) != 0) {
+			_yk_tsd_free(p);
+			return &nothread_errno;
 		}
 	}
-	if (tsd_init == 1) {
-		return YK_TSD_GET(int *, errno_key);
-	}
-	return &nothread_errno;
+	return p;
 }
 
 static const char *errtext[] = {
@@ -1231,6 +1353,11 @@ static const char *errtext[] = {
 	"invalid configuration number (this is a programming error)",
 	"invalid option/argument value",
 	"no randomness source available",
+	"i/o error",
+	"invalid or corrupt manifest",
+	"code does not match",
+	"counter has been used before",
+	"out of memory",
 };
 const char *ykp_strerror(int errnum)
 {
@@ -51,6 +51,13 @@ int ykp_free_config(YKP_CONFIG *cfg);
    version information. */
 YKP_CONFIG *ykp_alloc(void);
 
+/* Size of a YKP_CONFIG, and initialisation of one in caller owned memory,
+   as ykp_alloc() does.  Such a config must not be given to
+   ykp_free_config().  The same goes for the ndef and device config
+   variants below. */
+size_t ykp_config_size(void);
+YKP_CONFIG *ykp_config_init_in_place(void *mem, size_t len);
+
 /* Set the version information in st in cfg. */
 void ykp_configure_version(YKP_CONFIG *cfg, YK_STATUS *st);
 
@@ -60,6 +67,17 @@ void ykp_configure_version(YKP_CONFIG *cfg, YK_STATUS *st);
 int ykp_configure_command(YKP_CONFIG *cfg, uint8_t command);
 /* wrapper function for ykp_configure_command */
 int ykp_configure_for(YKP_CONFIG *cfg, int confnum, YK_STATUS *st);
+/* Choose the cheapest command that writes cfg to a key with status st:
+   SLOT_UPDATE1/2 when the slot is programmed and cfg holds only update
+   flags with ALLOW_UPDATE and no key, uid or fixed part, otherwise a
+   full SLOT_CONFIG/2.  An update request is never turned into a full
+   write; if it can't be sent as an update it fails with YKP_EINVAL.
+   The status block doesn't show whether the slot was programmed with
+   ALLOW_UPDATE, so the key may still reject an update chosen here.
+   frames, if not NULL, receives the number of feature reports the
+   write takes. */
+int ykp_plan_config_write(YKP_CONFIG *cfg, YK_STATUS *st,
+			  unsigned char *acc_code, int *frames);
 
 int ykp_AES_key_from_hex(YKP_CONFIG *cfg, const char *hexkey);
 int ykp_AES_key_from_raw(YKP_CONFIG *cfg, const char *key);
@@ -71,13 +89,22 @@ int ykp_HMAC_key_from_raw(YKP_CONFIG *cfg, const char *key);
 /* Functions for constructing the YK_NDEF struct before writing it to a neo */
 YK_NDEF *ykp_alloc_ndef(void);
 int ykp_free_ndef(YK_NDEF *ndef);
+size_t ykp_ndef_size(void);
+YK_NDEF *ykp_ndef_init_in_place(void *mem, size_t len);
 int ykp_construct_ndef_uri(YK_NDEF *ndef, const char *uri);
 int ykp_construct_ndef_text(YK_NDEF *ndef, const char *text, const char *lang, bool isutf16);
 int ykp_set_ndef_access_code(YK_NDEF *ndef, unsigned char *access_code);
 int ykp_ndef_as_text(YK_NDEF *ndef, char *text, size_t len);
+/* Substitute {serial}, {serial_hex}, {serial_modhex} and {prefix} (the
+   public id in cfg, as modhex, cfg may be NULL without it) in an NDEF
+   URI or text template. */
+int ykp_expand_ndef_template(char *out, size_t len, const char *tmpl,
+			     unsigned int serial, const YKP_CONFIG *cfg);
 
 YK_DEVICE_CONFIG *ykp_alloc_device_config(void);
 int ykp_free_device_config(YK_DEVICE_CONFIG *device_config);
+size_t ykp_device_config_size(void);
+YK_DEVICE_CONFIG *ykp_device_config_init_in_place(void *mem, size_t len);
 int ykp_set_device_mode(YK_DEVICE_CONFIG *device_config, unsigned char mode);
 int ykp_set_device_chalresp_timeout(YK_DEVICE_CONFIG *device_config, unsigned char timeout);
 int ykp_set_device_autoeject_time(YK_DEVICE_CONFIG *device_config, unsigned short eject_time);
@@ -194,6 +221,122 @@ unsigned int ykp_get_acccode_type(const YKP_CONFIG *cfg);
 
 int ykp_get_supported_key_length(const YKP_CONFIG *cfg);
 
+/* Fill buf with len bytes from the system CSPRNG, buffered per thread. */
+int ykp_random_bytes(void *buf, size_t len);
+
+/* Derive key, uid and/or fixed from a master secret with HKDF-SHA256,
+   keyed by serial number, slot and mode of cfg.  If fixedSize is zero,
+   six bytes of fixed are derived.  ykp_derive_configs() derives count
+   configurations using the given number of threads, 0 meaning one per
+   CPU. */
+int ykp_derive_config(YKP_CONFIG *cfg, const unsigned char *master,
+		      size_t master_len, unsigned int serial,
+		      unsigned int fields);
+int ykp_derive_configs(YKP_CONFIG **cfgs, const unsigned int *serials,
+		       size_t count, const unsigned char *master,
+		       size_t master_len, unsigned int fields, int threads);
+
+#define YKP_DERIVE_KEY		0x01
+#define YKP_DERIVE_UID		0x02
+#define YKP_DERIVE_FIXED	0x04
+
+/* OATH codes from a configuration holding a 20 byte HMAC key, as for
+   OATH-HOTP and HMAC challenge-response.  The number of digits is taken
+   from code.  ykp_oath_hotp_validate() tries counter up to counter +
+   window and ykp_oath_totp_validate() the window time steps on either
+   side of now / period, nearest first.  On a match they return 1 and
+   set offset, otherwise ykp_errno is YKP_ENOMATCH.  A window above 1000
+   is refused with YKP_EINVAL.
+   ykp_oath_truncate() is the dynamic truncation of a HMAC-SHA1. */
+unsigned int ykp_oath_truncate(const unsigned char *hmac, unsigned int digits);
+int ykp_oath_hotp_validate(const YKP_CONFIG *cfg, uint64_t counter,
+			   unsigned int window, const char *code,
+			   unsigned int *offset);
+int ykp_oath_totp_validate(const YKP_CONFIG *cfg, uint64_t now,
+			   unsigned int period, unsigned int window,
+			   const char *code, int *offset);
+
+/* Yubico OTP validation, the OTP being the public id followed by the
+   ticket in modhex.  ykp_otp_decrypt() checks an OTP against a single
+   configuration.  A validator looks the configuration up by public id,
+   which must be unique, and ykp_otp_validate_batch() decrypts many OTPs
+   at once, returning how many are valid and setting errors[i] to 0 or
+   the ykp_errno of OTP i: YKP_EINVAL when it is malformed, YKP_ENOCFG
+   for an unknown public id and YKP_ENOMATCH when the CRC or uid does
+   not check.  The ticket fields are in host byte order; the counters
+   are only extracted, keeping track of them is up to the caller. */
+int ykp_otp_decrypt(const YKP_CONFIG *cfg, const char *otp,
+		    struct ticket_st *ticket);
+
+typedef struct ykp_otp_validator_t YKP_OTP_VALIDATOR;
+
+YKP_OTP_VALIDATOR *ykp_otp_validator_alloc(YKP_CONFIG *const *cfgs,
+					   size_t count);
+void ykp_otp_validator_free(YKP_OTP_VALIDATOR *v);
+int ykp_otp_validate(const YKP_OTP_VALIDATOR *v, const char *otp,
+		     struct ticket_st *ticket);
+size_t ykp_otp_validate_batch(const YKP_OTP_VALIDATOR *v,
+			      const char *const *otps, size_t count,
+			      struct ticket_st *tickets, int *errors);
+
+/* Yubico mode challenge-response (SLOT_CHAL_OTP1/2) in software, for
+   count challenges of UID_SIZE bytes and responses of 16.  A response
+   is a ticket with the challenge in place of the uid, so it depends on
+   the counters, timestamp and random number of the key:
+   ykp_chalresp_yubico() computes the responses a key in the state of
+   ticket would give, and ykp_chalresp_yubico_verify() checks responses
+   as ykp_otp_validate_batch() checks OTPs, unpacking the key state into
+   tickets if set.  Both return the number of responses computed or
+   valid, and use AES-NI where available. */
+size_t ykp_chalresp_yubico(const YKP_CONFIG *cfg,
+			   const unsigned char *challenges, size_t count,
+			   const struct ticket_st *ticket,
+			   unsigned char *responses);
+size_t ykp_chalresp_yubico_verify(const YKP_CONFIG *cfg,
+				  const unsigned char *challenges,
+				  const unsigned char *responses,
+				  size_t count, struct ticket_st *tickets,
+				  int *errors);
+
+/* Binary manifest of pre-generated configurations, indexed by serial
+   number and slot.  The configurations handed out by
+   ykp_config_from_manifest() point into the manifest and stay valid
+   until ykp_close_manifest(), they must not be freed. */
+typedef struct ykp_manifest_t YKP_MANIFEST;
+
+YKP_MANIFEST *ykp_open_manifest(const char *path);
+int ykp_close_manifest(YKP_MANIFEST *manifest);
+size_t ykp_manifest_count(const YKP_MANIFEST *manifest);
+YKP_CONFIG *ykp_config_from_manifest(YKP_MANIFEST *manifest,
+				     unsigned int serial, int slot);
+int ykp_write_manifest(const char *path, const unsigned int *serials,
+		       YKP_CONFIG *const *cfgs, size_t count);
+
+/* Replay counters by public id, in a file shared by any number of
+   validating threads and processes without a lock.  The store keeps
+   the highest counter accepted for each id and ykp_counter_update()
+   accepts only a higher one, otherwise ykp_errno is YKP_EREPLAY and
+   previous holds the stored counter.  For Yubico OTP pass
+   ykp_otp_counter() of the ticket.  For OATH-HOTP the store holds the
+   next moving factor, seeded with the initial moving factor by
+   ykp_counter_seed_config(): validate from it and update with counter
+   + offset + 1.  Seeding leaves an existing counter alone.  The
+   capacity only applies when the file is created; a full store fails
+   with YKP_EIO. */
+typedef struct ykp_counter_store_t YKP_COUNTER_STORE;
+
+YKP_COUNTER_STORE *ykp_open_counter_store(const char *path, size_t capacity);
+int ykp_close_counter_store(YKP_COUNTER_STORE *store);
+int ykp_counter_store_sync(YKP_COUNTER_STORE *store);
+int ykp_counter_get(YKP_COUNTER_STORE *store, const unsigned char *id,
+		    size_t id_len, uint64_t *counter);
+int ykp_counter_seed(YKP_COUNTER_STORE *store, const unsigned char *id,
+		     size_t id_len, uint64_t counter);
+int ykp_counter_seed_config(YKP_COUNTER_STORE *store, const YKP_CONFIG *cfg);
+int ykp_counter_update(YKP_COUNTER_STORE *store, const unsigned char *id,
+		       size_t id_len, uint64_t counter, uint64_t *previous);
+uint64_t ykp_otp_counter(const struct ticket_st *ticket);
+
 extern int * _ykp_errno_location(void);
 #define ykp_errno (*_ykp_errno_location())
 const char *ykp_strerror(int errnum);
@@ -205,6 +348,11 @@ const char *ykp_strerror(int errnum);
 #define YKP_EINVCONFNUM	0x05
 #define YKP_EINVAL	0x06
 #define YKP_ENORANDOM	0x07
+#define YKP_EIO		0x08
+#define YKP_EMANIFEST	0x09
+#define YKP_ENOMATCH	0x0a
+#define YKP_EREPLAY	0x0b
+#define YKP_ENOMEM	0x0c
 
 # ifdef __cplusplus
 }
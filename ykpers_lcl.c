@@ -30,50 +30,87 @@
 
 #include "ykpers_lcl.h"
 
+#define CAPS_V1		(YKP_CAP_TICKET_MODS | YKP_CAP_STATIC |		\
+			 YKP_CAP_HIDTRIG | YKP_CAP_TICKET_FIRST)
+#define CAPS_V20	(YKP_CAP_TICKET_MODS | YKP_CAP_STATIC |		\
+			 YKP_CAP_STATIC_EXTRAS | YKP_CAP_SLOT_TWO)
+#define CAPS_NEO_BETA	(YKP_CAP_TICKET_MODS | YKP_CAP_OATH |		\
+			 YKP_CAP_SERIAL_API | YKP_CAP_NDEF)
+#define CAPS_V22	(CAPS_V20 | YKP_CAP_OATH | YKP_CAP_CHAL_RESP |	\
+			 YKP_CAP_OATH_IMF | YKP_CAP_SERIAL_API |	\
+			 YKP_CAP_SERIAL)
+#define CAPS_V23	(CAPS_V22 | YKP_CAP_UPDATE | YKP_CAP_FAST |	\
+			 YKP_CAP_NUMERIC | YKP_CAP_DORMANT)
+#define CAPS_V3		(CAPS_V23 | YKP_CAP_NDEF | YKP_CAP_NDEF2 |	\
+			 YKP_CAP_DEVICE_CONFIG | YKP_CAP_SCAN_MAP)
+
+const struct firmware_caps_st _firmware_caps[] = {
+	{ 0, 0, 0, YKP_CAP_TICKET_MODS | YKP_CAP_STATIC },
+	{ 1, 0, 0, CAPS_V1 },
+	{ 2, 0, 0, CAPS_V20 },
+	{ 2, 1, 0, CAPS_V20 | YKP_CAP_OATH },
+	/* NEO, versioned from 2.1.4, has no second slot */
+	{ 2, 1, 4, CAPS_NEO_BETA },
+	{ 2, 1, 5, CAPS_NEO_BETA | YKP_CAP_STATIC | YKP_CAP_STATIC_EXTRAS },
+	{ 2, 1, 7, CAPS_NEO_BETA | YKP_CAP_STATIC | YKP_CAP_STATIC_EXTRAS |
+	  YKP_CAP_OATH_IMF },
+	{ 2, 2, 0, CAPS_V22 },
+	{ 2, 3, 0, CAPS_V23 },
+	{ 2, 4, 0, CAPS_V23 | YKP_CAP_LED_INV },
+	{ 3, 0, 0, CAPS_V3 },
+	{ 3, 1, 0, CAPS_V3 | YKP_CAP_LED_INV },
+	{ 4, 0, 0, CAPS_V23 | YKP_CAP_LED_INV | YKP_CAP_DEVICE_CONFIG |
+	  YKP_CAP_SCAN_MAP },
+	{ 5, 0, 0, CAPS_V3 | YKP_CAP_LED_INV | YKP_CAP_DEVICE_INFO },
+	{ 6, 0, 0, CAPS_V23 | YKP_CAP_LED_INV | YKP_CAP_NDEF |
+	  YKP_CAP_SCAN_MAP | YKP_CAP_DEVICE_INFO },
+	{ 0, 0, 0, 0 }	/* end marker, no row has zero capabilities */
+};
+
 struct map_st _ticket_flags_map[] = {
-	{ TKTFLAG_TAB_FIRST,	"TAB_FIRST",	"tabFirst",	capability_has_ticket_mods,	MODE_OUTPUT,	ykp_set_tktflag_TAB_FIRST },
-	{ TKTFLAG_APPEND_TAB1,	"APPEND_TAB1",	"tabBetween",	capability_has_ticket_mods,	MODE_OUTPUT,	ykp_set_tktflag_APPEND_TAB1 },
-	{ TKTFLAG_APPEND_TAB2,	"APPEND_TAB2",	"tabLast",	capability_has_ticket_mods,	MODE_OUTPUT,	ykp_set_tktflag_APPEND_TAB2 },
-	{ TKTFLAG_APPEND_DELAY1,"APPEND_DELAY1","appendDelay1",	capability_has_ticket_mods,	MODE_OUTPUT,	ykp_set_tktflag_APPEND_DELAY1 },
-	{ TKTFLAG_APPEND_DELAY2,"APPEND_DELAY2","appendDelay2",	capability_has_ticket_mods,	MODE_OUTPUT,	ykp_set_tktflag_APPEND_DELAY2 },
-	{ TKTFLAG_APPEND_CR,	"APPEND_CR",	"appendCR",	capability_has_ticket_mods,	MODE_OUTPUT,	ykp_set_tktflag_APPEND_CR },
-	{ TKTFLAG_PROTECT_CFG2,	"PROTECT_CFG2",	"protectSecond",capability_has_slot_two,	MODE_ALL,	ykp_set_tktflag_PROTECT_CFG2 },
-	{ TKTFLAG_OATH_HOTP,	"OATH_HOTP",	0,		capability_has_oath,		MODE_OATH_HOTP,	ykp_set_tktflag_OATH_HOTP },
-	{ TKTFLAG_CHAL_RESP,	"CHAL_RESP",	0,		capability_has_chal_resp,	MODE_CHAL_RESP, ykp_set_tktflag_CHAL_RESP },
+	{ TKTFLAG_TAB_FIRST,	"TAB_FIRST",	"tabFirst",	YKP_CAP_TICKET_MODS,	MODE_OUTPUT,	ykp_set_tktflag_TAB_FIRST },
+	{ TKTFLAG_APPEND_TAB1,	"APPEND_TAB1",	"tabBetween",	YKP_CAP_TICKET_MODS,	MODE_OUTPUT,	ykp_set_tktflag_APPEND_TAB1 },
+	{ TKTFLAG_APPEND_TAB2,	"APPEND_TAB2",	"tabLast",	YKP_CAP_TICKET_MODS,	MODE_OUTPUT,	ykp_set_tktflag_APPEND_TAB2 },
+	{ TKTFLAG_APPEND_DELAY1,"APPEND_DELAY1","appendDelay1",	YKP_CAP_TICKET_MODS,	MODE_OUTPUT,	ykp_set_tktflag_APPEND_DELAY1 },
+	{ TKTFLAG_APPEND_DELAY2,"APPEND_DELAY2","appendDelay2",	YKP_CAP_TICKET_MODS,	MODE_OUTPUT,	ykp_set_tktflag_APPEND_DELAY2 },
+	{ TKTFLAG_APPEND_CR,	"APPEND_CR",	"appendCR",	YKP_CAP_TICKET_MODS,	MODE_OUTPUT,	ykp_set_tktflag_APPEND_CR },
+	{ TKTFLAG_PROTECT_CFG2,	"PROTECT_CFG2",	"protectSecond",YKP_CAP_SLOT_TWO,	MODE_ALL,	ykp_set_tktflag_PROTECT_CFG2 },
+	{ TKTFLAG_OATH_HOTP,	"OATH_HOTP",	0,		YKP_CAP_OATH,		MODE_OATH_HOTP,	ykp_set_tktflag_OATH_HOTP },
+	{ TKTFLAG_CHAL_RESP,	"CHAL_RESP",	0,		YKP_CAP_CHAL_RESP,	MODE_CHAL_RESP, ykp_set_tktflag_CHAL_RESP },
 	{ 0, 0, 0, 0, 0, 0 }
 };
 
 struct map_st _config_flags_map[] = {
-	{ CFGFLAG_CHAL_YUBICO,		"CHAL_YUBICO",		0,		capability_has_chal_resp,	MODE_CHAL_YUBICO,	ykp_set_cfgflag_CHAL_YUBICO },
-	{ CFGFLAG_CHAL_HMAC,		"CHAL_HMAC",		0,		capability_has_chal_resp,	MODE_CHAL_HMAC,		ykp_set_cfgflag_CHAL_HMAC },
-	{ CFGFLAG_HMAC_LT64,		"HMAC_LT64",		"hmacLt64",	capability_has_chal_resp,	MODE_CHAL_HMAC,		ykp_set_cfgflag_HMAC_LT64 },
-	{ CFGFLAG_CHAL_BTN_TRIG,	"CHAL_BTN_TRIG",	"buttonReqd",	capability_has_chal_resp,	MODE_CHAL_RESP,		ykp_set_cfgflag_CHAL_BTN_TRIG },
-	{ CFGFLAG_OATH_HOTP8,		"OATH_HOTP8",		0,		capability_has_oath,		MODE_OATH_HOTP,		ykp_set_cfgflag_OATH_HOTP8 },
-	{ CFGFLAG_OATH_FIXED_MODHEX1,	"OATH_FIXED_MODHEX1",	0,		capability_has_oath,		MODE_OATH_HOTP,		ykp_set_cfgflag_OATH_FIXED_MODHEX1 },
-	{ CFGFLAG_OATH_FIXED_MODHEX2,	"OATH_FIXED_MODHEX2",	0,		capability_has_oath,		MODE_OATH_HOTP,		ykp_set_cfgflag_OATH_FIXED_MODHEX2 },
-	{ CFGFLAG_OATH_FIXED_MODHEX,	"OATH_FIXED_MODHEX",	0,		capability_has_oath,		MODE_OATH_HOTP,		ykp_set_cfgflag_OATH_FIXED_MODHEX },
-	{ CFGFLAG_SEND_REF,		"SEND_REF",		"sendRef",	capability_has_ticket_mods,	MODE_OUTPUT,		ykp_set_cfgflag_SEND_REF },
-	{ CFGFLAG_TICKET_FIRST,		"TICKET_FIRST",		0,		capability_has_ticket_first,	MODE_OUTPUT,		ykp_set_cfgflag_TICKET_FIRST },
-	{ CFGFLAG_PACING_10MS,		"PACING_10MS",		"pacing10ms",	capability_has_ticket_mods,	MODE_OUTPUT,		ykp_set_cfgflag_PACING_10MS },
-	{ CFGFLAG_PACING_20MS,		"PACING_20MS",		"pacing20ms",	capability_has_ticket_mods,	MODE_OUTPUT,		ykp_set_cfgflag_PACING_20MS },
-	{ CFGFLAG_ALLOW_HIDTRIG,	"ALLOW_HIDTRIG",	0,		capability_has_hidtrig,		MODE_OUTPUT,		ykp_set_cfgflag_ALLOW_HIDTRIG },
-	{ CFGFLAG_STATIC_TICKET,        "STATIC_TICKET",        "staticTicket", capability_has_static,		MODE_STATIC_TICKET,     ykp_set_cfgflag_STATIC_TICKET },
-	{ CFGFLAG_SHORT_TICKET,		"SHORT_TICKET",		"shortTicket",	capability_has_static_extras,	MODE_OUTPUT,		ykp_set_cfgflag_SHORT_TICKET },
-	{ CFGFLAG_STRONG_PW1,		"STRONG_PW1",		"strongPw1",	capability_has_static_extras,	MODE_STATIC_TICKET,	ykp_set_cfgflag_STRONG_PW1 },
-	{ CFGFLAG_STRONG_PW2,		"STRONG_PW2",		"strongPw2",	capability_has_static_extras,	MODE_STATIC_TICKET,	ykp_set_cfgflag_STRONG_PW2 },
-	{ CFGFLAG_MAN_UPDATE,		"MAN_UPDATE",		"manUpdate",	capability_has_static_extras,	MODE_STATIC_TICKET,	ykp_set_cfgflag_MAN_UPDATE },
+	{ CFGFLAG_CHAL_YUBICO,		"CHAL_YUBICO",		0,		YKP_CAP_CHAL_RESP,	MODE_CHAL_YUBICO,	ykp_set_cfgflag_CHAL_YUBICO },
+	{ CFGFLAG_CHAL_HMAC,		"CHAL_HMAC",		0,		YKP_CAP_CHAL_RESP,	MODE_CHAL_HMAC,		ykp_set_cfgflag_CHAL_HMAC },
+	{ CFGFLAG_HMAC_LT64,		"HMAC_LT64",		"hmacLt64",	YKP_CAP_CHAL_RESP,	MODE_CHAL_HMAC,		ykp_set_cfgflag_HMAC_LT64 },
+	{ CFGFLAG_CHAL_BTN_TRIG,	"CHAL_BTN_TRIG",	"buttonReqd",	YKP_CAP_CHAL_RESP,	MODE_CHAL_RESP,		ykp_set_cfgflag_CHAL_BTN_TRIG },
+	{ CFGFLAG_OATH_HOTP8,		"OATH_HOTP8",		0,		YKP_CAP_OATH,		MODE_OATH_HOTP,		ykp_set_cfgflag_OATH_HOTP8 },
+	{ CFGFLAG_OATH_FIXED_MODHEX1,	"OATH_FIXED_MODHEX1",	0,		YKP_CAP_OATH,		MODE_OATH_HOTP,		ykp_set_cfgflag_OATH_FIXED_MODHEX1 },
+	{ CFGFLAG_OATH_FIXED_MODHEX2,	"OATH_FIXED_MODHEX2",	0,		YKP_CAP_OATH,		MODE_OATH_HOTP,		ykp_set_cfgflag_OATH_FIXED_MODHEX2 },
+	{ CFGFLAG_OATH_FIXED_MODHEX,	"OATH_FIXED_MODHEX",	0,		YKP_CAP_OATH,		MODE_OATH_HOTP,		ykp_set_cfgflag_OATH_FIXED_MODHEX },
+	{ CFGFLAG_SEND_REF,		"SEND_REF",		"sendRef",	YKP_CAP_TICKET_MODS,	MODE_OUTPUT,		ykp_set_cfgflag_SEND_REF },
+	{ CFGFLAG_TICKET_FIRST,		"TICKET_FIRST",		0,		YKP_CAP_TICKET_FIRST,	MODE_OUTPUT,		ykp_set_cfgflag_TICKET_FIRST },
+	{ CFGFLAG_PACING_10MS,		"PACING_10MS",		"pacing10ms",	YKP_CAP_TICKET_MODS,	MODE_OUTPUT,		ykp_set_cfgflag_PACING_10MS },
+	{ CFGFLAG_PACING_20MS,		"PACING_20MS",		"pacing20ms",	YKP_CAP_TICKET_MODS,	MODE_OUTPUT,		ykp_set_cfgflag_PACING_20MS },
+	{ CFGFLAG_ALLOW_HIDTRIG,	"ALLOW_HIDTRIG",	0,		YKP_CAP_HIDTRIG,		MODE_OUTPUT,		ykp_set_cfgflag_ALLOW_HIDTRIG },
+	{ CFGFLAG_STATIC_TICKET,        "STATIC_TICKET",        "staticTicket", YKP_CAP_STATIC,		MODE_STATIC_TICKET,     ykp_set_cfgflag_STATIC_TICKET },
+	{ CFGFLAG_SHORT_TICKET,		"SHORT_TICKET",		"shortTicket",	YKP_CAP_STATIC_EXTRAS,	MODE_OUTPUT,		ykp_set_cfgflag_SHORT_TICKET },
+	{ CFGFLAG_STRONG_PW1,		"STRONG_PW1",		"strongPw1",	YKP_CAP_STATIC_EXTRAS,	MODE_STATIC_TICKET,	ykp_set_cfgflag_STRONG_PW1 },
+	{ CFGFLAG_STRONG_PW2,		"STRONG_PW2",		"strongPw2",	YKP_CAP_STATIC_EXTRAS,	MODE_STATIC_TICKET,	ykp_set_cfgflag_STRONG_PW2 },
+	{ CFGFLAG_MAN_UPDATE,		"MAN_UPDATE",		"manUpdate",	YKP_CAP_STATIC_EXTRAS,	MODE_STATIC_TICKET,	ykp_set_cfgflag_MAN_UPDATE },
 	{ 0, 0, 0, 0, 0, 0 }
 };
 
 struct map_st _extended_flags_map[] = {
-	{ EXTFLAG_SERIAL_BTN_VISIBLE,	"SERIAL_BTN_VISIBLE",	"serialBtnVisible",	capability_has_serial,		MODE_ALL,	ykp_set_extflag_SERIAL_BTN_VISIBLE },
-	{ EXTFLAG_SERIAL_USB_VISIBLE,	"SERIAL_USB_VISIBLE",	"serialUsbVisible",	capability_has_serial,		MODE_ALL,	ykp_set_extflag_SERIAL_USB_VISIBLE },
-	{ EXTFLAG_SERIAL_API_VISIBLE,	"SERIAL_API_VISIBLE",	"serialApiVisible",	capability_has_serial_api,	MODE_ALL,	ykp_set_extflag_SERIAL_API_VISIBLE },
-	{ EXTFLAG_USE_NUMERIC_KEYPAD,	"USE_NUMERIC_KEYPAD",	"useNumericKeypad",	capability_has_numeric,		MODE_ALL,	ykp_set_extflag_USE_NUMERIC_KEYPAD },
-	{ EXTFLAG_FAST_TRIG,		"FAST_TRIG",		"fastTrig",		capability_has_fast,		MODE_ALL,	ykp_set_extflag_FAST_TRIG },
-	{ EXTFLAG_ALLOW_UPDATE,		"ALLOW_UPDATE",		"allowUpdate",		capability_has_update,		MODE_ALL,	ykp_set_extflag_ALLOW_UPDATE },
-	{ EXTFLAG_DORMANT,		"DORMANT",		"dormant",		capability_has_dormant,		MODE_ALL,	ykp_set_extflag_DORMANT },
-	{ EXTFLAG_LED_INV,		"LED_INV",		"ledInverted",		capability_has_led_inv,		MODE_ALL,	ykp_set_extflag_LED_INV },
+	{ EXTFLAG_SERIAL_BTN_VISIBLE,	"SERIAL_BTN_VISIBLE",	"serialBtnVisible",	YKP_CAP_SERIAL,		MODE_ALL,	ykp_set_extflag_SERIAL_BTN_VISIBLE },
+	{ EXTFLAG_SERIAL_USB_VISIBLE,	"SERIAL_USB_VISIBLE",	"serialUsbVisible",	YKP_CAP_SERIAL,		MODE_ALL,	ykp_set_extflag_SERIAL_USB_VISIBLE },
+	{ EXTFLAG_SERIAL_API_VISIBLE,	"SERIAL_API_VISIBLE",	"serialApiVisible",	YKP_CAP_SERIAL_API,	MODE_ALL,	ykp_set_extflag_SERIAL_API_VISIBLE },
+	{ EXTFLAG_USE_NUMERIC_KEYPAD,	"USE_NUMERIC_KEYPAD",	"useNumericKeypad",	YKP_CAP_NUMERIC,		MODE_ALL,	ykp_set_extflag_USE_NUMERIC_KEYPAD },
+	{ EXTFLAG_FAST_TRIG,		"FAST_TRIG",		"fastTrig",		YKP_CAP_FAST,		MODE_ALL,	ykp_set_extflag_FAST_TRIG },
+	{ EXTFLAG_ALLOW_UPDATE,		"ALLOW_UPDATE",		"allowUpdate",		YKP_CAP_UPDATE,		MODE_ALL,	ykp_set_extflag_ALLOW_UPDATE },
+	{ EXTFLAG_DORMANT,		"DORMANT",		"dormant",		YKP_CAP_DORMANT,		MODE_ALL,	ykp_set_extflag_DORMANT },
+	{ EXTFLAG_LED_INV,		"LED_INV",		"ledInverted",		YKP_CAP_LED_INV,		MODE_ALL,	ykp_set_extflag_LED_INV },
 	{ 0, 0, 0, 0, 0, 0 }
 };
 
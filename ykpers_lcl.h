@@ -47,30 +47,58 @@ struct ykp_config_t {
 	YK_CONFIG ykcore_config;
 
 	unsigned int ykp_acccode_type;
+
+	/* YKP_CAP_* bits, derived from the version fields by
+	   _ykp_set_capabilities() whenever they change. */
+	unsigned int capabilities;
+};
+
+/* Configuration options */
+#define YKP_CAP_HIDTRIG		0x00000001
+#define YKP_CAP_TICKET_FIRST	0x00000002
+#define YKP_CAP_STATIC		0x00000004
+#define YKP_CAP_STATIC_EXTRAS	0x00000008
+#define YKP_CAP_SLOT_TWO	0x00000010
+#define YKP_CAP_CHAL_RESP	0x00000020
+#define YKP_CAP_OATH_IMF	0x00000040
+#define YKP_CAP_SERIAL_API	0x00000080
+#define YKP_CAP_SERIAL		0x00000100
+#define YKP_CAP_OATH		0x00000200
+#define YKP_CAP_TICKET_MODS	0x00000400
+#define YKP_CAP_UPDATE		0x00000800
+#define YKP_CAP_FAST		0x00001000
+#define YKP_CAP_NUMERIC		0x00002000
+#define YKP_CAP_DORMANT		0x00004000
+#define YKP_CAP_LED_INV		0x00008000
+/* Commands, beyond SLOT_CONFIG, SLOT_CONFIG2 (YKP_CAP_SLOT_TWO) and
+   SLOT_UPDATE1/2 and SLOT_SWAP (YKP_CAP_UPDATE) */
+#define YKP_CAP_NDEF		0x00010000
+#define YKP_CAP_NDEF2		0x00020000
+#define YKP_CAP_DEVICE_CONFIG	0x00040000
+#define YKP_CAP_SCAN_MAP	0x00080000
+#define YKP_CAP_DEVICE_INFO	0x00100000
+
+#define capability_has(cfg, cap) \
+	(((cfg)->capabilities & (cap)) == (cap))
+
+/* One row per firmware line, sorted by version.  A row applies from
+   its version up to the version of the next row. */
+struct firmware_caps_st {
+	unsigned char major;
+	unsigned char minor;
+	unsigned char build;
+	unsigned int capabilities;
 };
 
-extern bool capability_has_hidtrig(const YKP_CONFIG *cfg);
-extern bool capability_has_ticket_first(const YKP_CONFIG *cfg);
-extern bool capability_has_static(const YKP_CONFIG *cfg);
-extern bool capability_has_static_extras(const YKP_CONFIG *cfg);
-extern bool capability_has_slot_two(const YKP_CONFIG *cfg);
-extern bool capability_has_chal_resp(const YKP_CONFIG *cfg);
-extern bool capability_has_oath_imf(const YKP_CONFIG *cfg);
-extern bool capability_has_serial_api(const YKP_CONFIG *cfg);
-extern bool capability_has_serial(const YKP_CONFIG *cfg);
-extern bool capability_has_oath(const YKP_CONFIG *cfg);
-extern bool capability_has_ticket_mods(const YKP_CONFIG *cfg);
-extern bool capability_has_update(const YKP_CONFIG *cfg);
-extern bool capability_has_fast(const YKP_CONFIG *cfg);
-extern bool capability_has_numeric(const YKP_CONFIG *cfg);
-extern bool capability_has_dormant(const YKP_CONFIG *cfg);
-extern bool capability_has_led_inv(const YKP_CONFIG *cfg);
+extern const struct firmware_caps_st _firmware_caps[];
+
+extern void _ykp_set_capabilities(YKP_CONFIG *cfg);
 
 struct map_st {
 	uint8_t flag;
 	const char *flag_text;
 	const char *json_text;
-	bool (*capability)(const YKP_CONFIG *cfg);
+	unsigned int capability;
 	unsigned char mode;
 	int (*setter)(YKP_CONFIG *cfg, bool state);
 };
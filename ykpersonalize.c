@@ -41,6 +41,154 @@
 #include <ykpers-version.h>
 
 #include "ykpers-args.h"
+#include "ykthread.h"
+
+/* -A: the NDEF template is expanded for, and written to, every key
+   found, one thread per key.  With -M the access code of each key and
+   the public id for {prefix} come from the configuration the manifest
+   holds for the serial number and slot of the key. */
+
+struct ndef_job {
+	int index;
+	YK_KEY *yk;
+	YK_THREAD_TYPE thread;
+	bool threaded;
+
+	int confnum;
+	char ndef_type;
+	const char *ndef_template;
+	const unsigned char *access_code;
+	YKP_MANIFEST *manifest;
+
+	unsigned int serial;
+	char ndef_string[128];
+	int ok;
+	int yk_err;
+	int ykp_err;
+};
+
+static int write_ndef_job(struct ndef_job *job)
+{
+	const unsigned char *access_code = job->access_code;
+	YKP_CONFIG *cfg = NULL;
+	YK_NDEF ndef_mem;
+	YK_NDEF *ndef;
+	int res = 0;
+
+	if (!yk_get_serial(job->yk, 0, 0, &job->serial))
+		return 0;
+	if (job->manifest) {
+		cfg = ykp_config_from_manifest(job->manifest, job->serial,
+					       job->confnum);
+		if (!cfg)
+			return 0;
+		access_code = ((struct config_st *) ykp_core_config(cfg))->accCode;
+	}
+
+	if (!ykp_expand_ndef_template(job->ndef_string,
+				      sizeof(job->ndef_string),
+				      job->ndef_template, job->serial, cfg))
+		return 0;
+	ndef = ykp_ndef_init_in_place(&ndef_mem, sizeof(ndef_mem));
+	if (job->ndef_type == 'U') {
+		res = ykp_construct_ndef_uri(ndef, job->ndef_string);
+	} else if (job->ndef_type == 'T') {
+		res = ykp_construct_ndef_text(ndef, job->ndef_string, "en", false);
+	}
+	if (!res)
+		return 0;
+	if (access_code &&
+	    !ykp_set_ndef_access_code(ndef, (unsigned char *) access_code))
+		return 0;
+	return yk_write_ndef2(job->yk, ndef, job->confnum);
+}
+
+static YK_THREAD_FUNC(write_ndef_worker, arg)
+{
+	struct ndef_job *job = arg;
+
+	yk_errno = 0;
+	ykp_errno = 0;
+	job->ok = write_ndef_job(job);
+	job->yk_err = yk_errno;
+	job->ykp_err = ykp_errno;
+	return 0;
+}
+
+/* first is the key already open at first_index, the others are opened
+   here, every index from 0 on */
+static bool write_ndef_all(YK_KEY *first, int first_index, int confnum,
+			   char ndef_type, const char *ndef_template,
+			   const unsigned char *access_code,
+			   YKP_MANIFEST *manifest)
+{
+	struct ndef_job *jobs = NULL;
+	int num_jobs = 0;
+	bool ok = true;
+	int i;
+
+	for (;;) {
+		struct ndef_job *tmp;
+		YK_KEY *yk = num_jobs == first_index ? first :
+			yk_open_key(num_jobs);
+
+		if (!yk) {
+			if (yk_errno != YK_ENOKEY) {
+				fprintf(stderr, "Key %d: ", num_jobs);
+				report_yk_error();
+				ok = false;
+			}
+			break;
+		}
+		if (!(tmp = realloc(jobs, (num_jobs + 1) * sizeof(*jobs)))) {
+			if (yk != first)
+				yk_close_key(yk);
+			ok = false;
+			break;
+		}
+		jobs = tmp;
+		memset(&jobs[num_jobs], 0, sizeof(*jobs));
+		jobs[num_jobs].index = num_jobs;
+		jobs[num_jobs].yk = yk;
+		jobs[num_jobs].confnum = confnum;
+		jobs[num_jobs].ndef_type = ndef_type;
+		jobs[num_jobs].ndef_template = ndef_template;
+		jobs[num_jobs].access_code = access_code;
+		jobs[num_jobs].manifest = manifest;
+		num_jobs++;
+	}
+
+	for (i = 0; i < num_jobs; i++) {
+		if (YK_THREAD_CREATE(jobs[i].thread, write_ndef_worker,
+				     &jobs[i]) == 0)
+			jobs[i].threaded = true;
+		else
+			write_ndef_worker(&jobs[i]);
+	}
+	for (i = 0; i < num_jobs; i++) {
+		if (jobs[i].threaded)
+			YK_THREAD_JOIN(jobs[i].thread);
+		if (jobs[i].ok) {
+			printf("Key %d (serial %u): %s\n", jobs[i].index,
+			       jobs[i].serial, jobs[i].ndef_string);
+		} else {
+			fprintf(stderr, "Key %d (serial %u): failure to write ndef\n",
+				jobs[i].index, jobs[i].serial);
+			yk_errno = jobs[i].yk_err;
+			ykp_errno = jobs[i].ykp_err;
+			report_yk_error();
+			ok = false;
+		}
+		if (jobs[i].yk != first)
+			yk_close_key(jobs[i].yk);
+	}
+	yk_errno = 0;
+	ykp_errno = 0;
+
+	free(jobs);
+	return ok;
+}
+
 
 int main(int argc, char **argv)
 {
@@ -71,6 +219,9 @@ int main(int argc, char **argv)
 	int num_modes_seen = 0;
 	bool zap = false;
 	int key_index = 0;
+	bool all_keys = false;
+	const char *manifest_name = NULL;
+	YKP_MANIFEST *manifest = NULL;
 
 	/* Assume the worst */
 	bool error = true;
@@ -89,6 +240,12 @@ int main(int argc, char **argv)
 			case 'N':
 				key_index = atoi(optarg);
 				break;
+			case 'A':
+				all_keys = true;
+				break;
+			case 'M':
+				manifest_name = optarg;
+				break;
 			case 'V':
 				fputs(YKPERS_VERSION_STRING "\n", stderr);
 				return 0;
@@ -161,6 +318,23 @@ int main(int argc, char **argv)
 		goto err;
 	}
 
+	if ((all_keys || manifest_name) &&
+	    ykp_command(cfg) != SLOT_NDEF && ykp_command(cfg) != SLOT_NDEF2) {
+		fprintf(stderr, "All keys (-A) can only be used with ndef (-n/-t).\n");
+		exit_code = 1;
+		goto err;
+	}
+	if (manifest_name && !all_keys) {
+		fprintf(stderr, "A manifest (-M) can only be used with all keys (-A).\n");
+		exit_code = 1;
+		goto err;
+	}
+	if (manifest_name && !(manifest = ykp_open_manifest(manifest_name))) {
+		fprintf(stderr, "Couldn't open manifest %s\n", manifest_name);
+		exit_code = 1;
+		goto err;
+	}
+
 	if (oathid[0] != 0) {
 		set_oath_id(oathid, cfg, yk, st);
 	}
@@ -266,6 +440,8 @@ int main(int argc, char **argv)
 
 		if (ykp_command(cfg) == SLOT_SWAP) {
 			fprintf(stderr, "Configuration in slot 1 and 2 will be swapped\n");
+		} else if(all_keys) {
+			fprintf(stderr, "New NDEF will be written to all keys from the template:\n%s\n", ndef_string);
 		} else if(ykp_command(cfg) == SLOT_NDEF || ykp_command(cfg) == SLOT_NDEF2) {
 			fprintf(stderr, "New NDEF will be written as:\n%s\n", ndef_string);
 		} else if(ykp_command(cfg) == SLOT_DEVICE_CONFIG) {
@@ -314,6 +490,14 @@ int main(int argc, char **argv)
 			if (dry_run) {
 				printf("Not writing anything to key due to dry_run requested.\n");
 			}
+			else if(all_keys) {
+				if (!write_ndef_all(yk, key_index,
+						    ykp_command(cfg) == SLOT_NDEF2 ? 2 : 1,
+						    ndef_type, ndef_string,
+						    acc_code ? access_code : NULL,
+						    manifest))
+					goto err;
+			}
 			else if(ykp_command(cfg) == SLOT_NDEF || ykp_command(cfg) == SLOT_NDEF2) {
 				YK_NDEF *ndef = ykp_alloc_ndef();
 				int confnum = 1;
@@ -429,7 +613,9 @@ err:
 	}
 
 	if (st)
-		free(st);
+		ykds_free(st);
+	if (manifest)
+		ykp_close_manifest(manifest);
 	if (inf)
 		fclose(inf);
 	if (outf)
@@ -0,0 +1,596 @@
+/* -*- mode:C; c-file-style: "bsd" -*- */
+/*
+ * Copyright (c) 2026 Yubico AB
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * An enrollment station: keys are programmed as they are plugged in.
+ *
+ * The main thread watches for keys arriving and leaving and queues each
+ * new key.  Workers take keys off the queue, read the status and
+ * serial, look up the configurations for the serial in a manifest,
+ * write them as one plan, read the status again to check the
+ * programming sequence and the valid slots, and write an audit record.
+ * A key that leaves while queued is dropped; one that leaves while
+ * being programmed fails at the stage it was in.  The time spent in
+ * each stage is summed up on exit, to show where the line waits.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <time.h>
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+#include <ykpers.h>
+#include <ykcore.h>
+#include <ykstatus.h>
+#include <ykdef.h>
+#include <ykpers-version.h>
+
+#include "ykthread.h"
+
+const char *usage =
+	"Usage: ykstation [options] manifest\n"
+	"\n"
+	"Program every YubiKey plugged in with its configurations from the\n"
+	"manifest, by serial number.\n"
+	"\n"
+	"Options :\n"
+	"\n"
+	"\t-wworkers Program this many keys at a time (default 4)\n"
+	"\t-ccount   Exit after count keys, instead of on interrupt\n"
+	"\t-ofile    Append the audit records to file, not stdout\n"
+	"\t-ims      Look for keys every ms milliseconds without hotplug\n"
+	"\t          support (default 250)\n"
+	"\n"
+	"\t-V        Get the tool version\n"
+	"\t-h        help (this text)\n"
+	"\n"
+	"\n"
+	;
+const char *optstring = "w:c:o:i:hV";
+
+#define MAX_KEYS	128
+
+enum stage {
+	STAGE_QUEUE,
+	STAGE_OPEN,
+	STAGE_IDENTIFY,
+	STAGE_LOOKUP,
+	STAGE_PROGRAM,
+	STAGE_VERIFY,
+	NUM_STAGES
+};
+
+static const char *stage_names[NUM_STAGES] = {
+	"queue", "open", "identify", "lookup", "program", "verify"
+};
+
+enum key_state {
+	KEY_QUEUED,
+	KEY_BUSY,
+	KEY_DONE
+};
+
+struct station_key {
+	unsigned int id;
+	enum key_state state;
+	bool present;
+	unsigned int serial;
+	double arrived_ms;
+};
+
+struct stage_times {
+	double *ms;
+	size_t count, size;
+};
+
+struct station {
+	YKP_MANIFEST *manifest;
+	FILE *audit;
+
+	YK_MUTEX_TYPE lock;
+	YK_COND_TYPE wake;
+	struct station_key keys[MAX_KEYS];
+	size_t num_keys;
+	bool stopping;
+	unsigned int programmed, failed;
+	struct stage_times times[NUM_STAGES];
+};
+
+static volatile sig_atomic_t interrupted = 0;
+
+static void on_signal(int sig)
+{
+	interrupted = 1;
+}
+
+static double now_ms(void)
+{
+#ifdef _WIN32
+	LARGE_INTEGER freq, now;
+	QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&now);
+	return (double) now.QuadPart * 1000.0 / (double) freq.QuadPart;
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+#endif
+}
+
+static void sleep_ms(unsigned int ms)
+{
+#ifdef _WIN32
+	Sleep(ms);
+#else
+	usleep(ms * 1000);
+#endif
+}
+
+/* Called with the lock held */
+static void record_time(struct station *s, enum stage stage, double ms)
+{
+	struct stage_times *t = &s->times[stage];
+
+	if (t->count == t->size) {
+		size_t size = t->size ? t->size * 2 : 64;
+		double *tmp = realloc(t->ms, size * sizeof(*tmp));
+
+		if (!tmp)
+			return;
+		t->ms = tmp;
+		t->size = size;
+	}
+	t->ms[t->count++] = ms;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+	double x = *(const double *) a, y = *(const double *) b;
+
+	return x < y ? -1 : x > y;
+}
+
+static void print_times(struct station *s)
+{
+	int i;
+
+	fprintf(stderr, "%u programmed, %u failed\n", s->programmed,
+		s->failed);
+	fprintf(stderr, "%-10s %8s %10s %10s %10s\n", "stage ms", "count",
+		"median", "p95", "max");
+	for (i = 0; i < NUM_STAGES; i++) {
+		struct stage_times *t = &s->times[i];
+
+		if (t->count == 0)
+			continue;
+		qsort(t->ms, t->count, sizeof(double), cmp_double);
+		fprintf(stderr, "%-10s %8lu %10.2f %10.2f %10.2f\n",
+			stage_names[i], (unsigned long) t->count,
+			t->ms[t->count / 2], t->ms[t->count * 95 / 100],
+			t->ms[t->count - 1]);
+	}
+}
+
+struct job {
+	struct station *s;
+	struct station_key *key;
+	unsigned int id;
+	unsigned int serial;
+	int slots;
+	int pgm_seq;
+	enum stage stage;
+	double ms[NUM_STAGES];
+	double mark;
+};
+
+static void job_stage(struct job *job, enum stage next)
+{
+	double now = now_ms();
+
+	job->ms[job->stage] = now - job->mark;
+	job->mark = now;
+	job->stage = next;
+}
+
+static int program_key(struct job *job)
+{
+	YK_KEY *yk;
+	YK_STATUS *st = ykds_alloc();
+	YK_PLAN *plan = yk_plan_alloc();
+	int ok = 0;
+	int slot;
+
+	if (!st || !plan) {
+		yk_errno = YK_ENOMEM;
+		goto out;
+	}
+
+	if (!(yk = yk_open_key_id(job->id)))
+		goto out;
+
+	job_stage(job, STAGE_IDENTIFY);
+	if (!yk_get_status(yk, st) || !yk_get_serial(yk, 1, 0, &job->serial))
+		goto close;
+
+	job_stage(job, STAGE_LOOKUP);
+	for (slot = 1; slot <= 2; slot++) {
+		YKP_CONFIG *cfg = ykp_config_from_manifest(job->s->manifest,
+							   job->serial, slot);
+		struct config_st ycfg;
+
+		if (!cfg)
+			continue;
+		/* the manifest is shared, the checksum is filled in on a copy */
+		memcpy(&ycfg, ykp_core_config(cfg), sizeof(ycfg));
+		if (!yk_plan_add_command(plan, (YK_CONFIG *) &ycfg,
+					 ykp_command(cfg), NULL))
+			goto close;
+		job->slots |= slot;
+	}
+	if (!job->slots) {
+		yk_errno = 0;
+		ykp_errno = YKP_ENOCFG;
+		goto close;
+	}
+
+	job_stage(job, STAGE_PROGRAM);
+	if (!yk_plan_commit(yk, plan, st, NULL))
+		goto close;
+	job->pgm_seq = ykds_pgm_seq(st);
+
+	/* read back, the key must still be on the sequence the last write
+	   returned, with the written slots valid */
+	job_stage(job, STAGE_VERIFY);
+	if (!yk_get_status(yk, st))
+		goto close;
+	if (ykds_pgm_seq(st) != job->pgm_seq ||
+	    ((job->slots & 1) && !(ykds_touch_level(st) & CONFIG1_VALID)) ||
+	    ((job->slots & 2) && !(ykds_touch_level(st) & CONFIG2_VALID))) {
+		yk_errno = YK_EWRITEERR;
+		goto close;
+	}
+	ok = 1;
+
+ close:
+	if (!yk_close_key(yk))
+		ok = 0;
+ out:
+	job_stage(job, job->stage);
+	yk_plan_free(plan);
+	ykds_free(st);
+	return ok;
+}
+
+/* Called with the lock held */
+static void audit(struct station *s, const struct job *job, int ok)
+{
+	int i;
+
+	fprintf(s->audit, "{\"time\":%ld,\"id\":%u", (long) time(NULL),
+		job->id);
+	if (job->stage > STAGE_IDENTIFY)
+		fprintf(s->audit, ",\"serial\":%u", job->serial);
+	if (ok) {
+		fprintf(s->audit, ",\"result\":\"ok\",\"slots\":[%s]"
+			",\"pgm_seq\":%d", job->slots == 3 ? "1,2" :
+			job->slots == 2 ? "2" : "1", job->pgm_seq);
+	} else {
+		const char *err = yk_errno == YK_EUSBERR ? yk_usb_strerror() :
+			yk_errno ? yk_strerror(yk_errno) :
+			ykp_strerror(ykp_errno);
+		fprintf(s->audit, ",\"result\":\"failed\",\"stage\":\"%s\""
+			",\"error\":\"%s\"", stage_names[job->stage],
+			err ? err : "unknown error");
+	}
+	fprintf(s->audit, ",\"ms\":{");
+	for (i = 0; i <= (int) job->stage; i++)
+		fprintf(s->audit, "%s\"%s\":%.3f", i ? "," : "",
+			stage_names[i], job->ms[i]);
+	fprintf(s->audit, "}}\n");
+	fflush(s->audit);
+}
+
+static struct station_key *next_queued(struct station *s)
+{
+	size_t i;
+	struct station_key *first = NULL;
+
+	for (i = 0; i < s->num_keys; i++) {
+		struct station_key *k = &s->keys[i];
+
+		if (k->state == KEY_QUEUED && k->present &&
+		    (!first || k->arrived_ms < first->arrived_ms))
+			first = k;
+	}
+	return first;
+}
+
+/* Entries move when others are removed, so a job finds its key again by
+   id.  Called with the lock held. */
+static struct station_key *busy_key(struct station *s, unsigned int id)
+{
+	size_t i;
+
+	for (i = 0; i < s->num_keys; i++) {
+		if (s->keys[i].id == id && s->keys[i].state == KEY_BUSY)
+			return &s->keys[i];
+	}
+	return NULL;
+}
+
+static YK_THREAD_FUNC(worker, arg)
+{
+	struct station *s = arg;
+
+	YK_MUTEX_LOCK(s->lock);
+	for (;;) {
+		struct station_key *key = NULL;
+		struct job job;
+		int ok, i;
+
+		while (!s->stopping && !(key = next_queued(s)))
+			YK_COND_WAIT(s->wake, s->lock);
+		if (s->stopping)
+			break;
+
+		key->state = KEY_BUSY;
+		memset(&job, 0, sizeof(job));
+		job.s = s;
+		job.id = key->id;
+		job.mark = key->arrived_ms;
+		job.stage = STAGE_QUEUE;
+		YK_MUTEX_UNLOCK(s->lock);
+
+		yk_errno = 0;
+		ykp_errno = 0;
+		job_stage(&job, STAGE_OPEN);
+		ok = program_key(&job);
+
+		YK_MUTEX_LOCK(s->lock);
+		if ((key = busy_key(s, job.id)) != NULL) {
+			key->state = KEY_DONE;
+			key->serial = job.serial;
+		}
+		audit(s, &job, ok);
+		for (i = 0; i <= (int) job.stage; i++)
+			record_time(s, i, job.ms[i]);
+		if (ok)
+			s->programmed++;
+		else
+			s->failed++;
+		YK_COND_BROADCAST(s->wake);
+	}
+	YK_MUTEX_UNLOCK(s->lock);
+	return 0;
+}
+
+/* Queue keys that arrived, forget keys that left.  Called with the lock
+   held. */
+static void update_keys(struct station *s, const unsigned int *ids,
+			size_t count)
+{
+	size_t i, j;
+
+	for (i = 0; i < s->num_keys; i++)
+		s->keys[i].present = false;
+	for (j = 0; j < count; j++) {
+		for (i = 0; i < s->num_keys; i++) {
+			if (s->keys[i].id == ids[j])
+				break;
+		}
+		if (i < s->num_keys) {
+			s->keys[i].present = true;
+		} else if (s->num_keys < MAX_KEYS) {
+			struct station_key *k = &s->keys[s->num_keys++];
+
+			memset(k, 0, sizeof(*k));
+			k->id = ids[j];
+			k->state = KEY_QUEUED;
+			k->present = true;
+			k->arrived_ms = now_ms();
+			YK_COND_BROADCAST(s->wake);
+		}
+	}
+
+	/* a key being programmed keeps its entry until its worker is done,
+	   workers find their entry by id as the last one is moved into the
+	   place of a removed one */
+	for (i = 0; i < s->num_keys; ) {
+		struct station_key *k = &s->keys[i];
+
+		if (k->present || k->state == KEY_BUSY) {
+			i++;
+			continue;
+		}
+		fprintf(s->audit, "{\"time\":%ld,\"id\":%u", (long) time(NULL),
+			k->id);
+		if (k->state == KEY_DONE && k->serial)
+			fprintf(s->audit, ",\"serial\":%u", k->serial);
+		fprintf(s->audit, ",\"result\":\"%s\"}\n",
+			k->state == KEY_QUEUED ? "removed before programming" :
+			"removed");
+		fflush(s->audit);
+		*k = s->keys[--s->num_keys];
+	}
+}
+
+static void report_yk_error(void)
+{
+	if (ykp_errno)
+		fprintf(stderr, "Yubikey personalization error: %s\n",
+			ykp_strerror(ykp_errno));
+	if (yk_errno) {
+		if (yk_errno == YK_EUSBERR) {
+			fprintf(stderr, "USB error: %s\n",
+				yk_usb_strerror());
+		} else {
+			fprintf(stderr, "Yubikey core error: %s\n",
+				yk_strerror(yk_errno));
+		}
+	}
+}
+
+int main(int argc, char **argv)
+{
+	struct station s;
+	YK_THREAD_TYPE *threads = NULL;
+	unsigned int ids[MAX_KEYS];
+	const char *audit_name = NULL;
+	int workers = 4, started = 0;
+	unsigned int count = 0, interval = 250;
+	bool hotplug = true;
+	int exit_code = 0;
+	int c, i;
+
+	while ((c = getopt(argc, argv, optstring)) != -1) {
+		switch (c) {
+		case 'w':
+			workers = atoi(optarg);
+			break;
+		case 'c':
+			count = strtoul(optarg, NULL, 10);
+			break;
+		case 'o':
+			audit_name = optarg;
+			break;
+		case 'i':
+			interval = strtoul(optarg, NULL, 10);
+			break;
+		case 'V':
+			fputs(YKPERS_VERSION_STRING "\n", stderr);
+			exit(0);
+		case 'h':
+		default:
+			fputs(usage, stderr);
+			exit(c == 'h' ? 0 : 1);
+		}
+	}
+	if (optind != argc - 1 || workers < 1 || interval == 0) {
+		fputs(usage, stderr);
+		exit(1);
+	}
+
+	memset(&s, 0, sizeof(s));
+	if (!(s.manifest = ykp_open_manifest(argv[optind]))) {
+		fprintf(stderr, "Couldn't open manifest %s\n", argv[optind]);
+		report_yk_error();
+		exit(1);
+	}
+	s.audit = stdout;
+	if (audit_name && !(s.audit = fopen(audit_name, "a"))) {
+		perror(audit_name);
+		ykp_close_manifest(s.manifest);
+		exit(1);
+	}
+	if (YK_MUTEX_INIT(s.lock) != 0 || YK_COND_INIT(s.wake) != 0 ||
+	    !(threads = calloc(workers, sizeof(*threads)))) {
+		fputs("Out of memory\n", stderr);
+		exit(1);
+	}
+
+	if (!yk_init()) {
+		report_yk_error();
+		exit_code = 1;
+		goto out;
+	}
+
+	for (started = 0; started < workers; started++) {
+		if (YK_THREAD_CREATE(threads[started], worker, &s) != 0)
+			break;
+	}
+	if (started == 0) {
+		fputs("Couldn't start workers\n", stderr);
+		exit_code = 1;
+		goto release;
+	}
+
+	signal(SIGINT, on_signal);
+	signal(SIGTERM, on_signal);
+	while (!interrupted) {
+		size_t n;
+
+		if (!yk_list_keys(ids, MAX_KEYS, &n)) {
+			report_yk_error();
+			exit_code = 1;
+			break;
+		}
+		YK_MUTEX_LOCK(s.lock);
+		update_keys(&s, ids, n);
+		/* the last keys to count are let finish */
+		if (count && s.programmed + s.failed >= count) {
+			YK_MUTEX_UNLOCK(s.lock);
+			break;
+		}
+		YK_MUTEX_UNLOCK(s.lock);
+
+		if (hotplug && !yk_wait_for_change(interval)) {
+			if (yk_errno != YK_ENOTYETIMPL) {
+				report_yk_error();
+				exit_code = 1;
+				break;
+			}
+			hotplug = false;
+		}
+		if (!hotplug)
+			sleep_ms(interval);
+	}
+
+	YK_MUTEX_LOCK(s.lock);
+	s.stopping = true;
+	YK_COND_BROADCAST(s.wake);
+	YK_MUTEX_UNLOCK(s.lock);
+	for (i = 0; i < started; i++)
+		YK_THREAD_JOIN(threads[i]);
+	print_times(&s);
+	if (s.failed)
+		exit_code = 1;
+
+ release:
+	if (!yk_release()) {
+		report_yk_error();
+		exit_code = 2;
+	}
+ out:
+	for (i = 0; i < NUM_STAGES; i++)
+		free(s.times[i].ms);
+	free(threads);
+	if (audit_name)
+		fclose(s.audit);
+	ykp_close_manifest(s.manifest);
+	YK_COND_DESTROY(s.wake);
+	YK_MUTEX_DESTROY(s.lock);
+	exit(exit_code);
+}
@@ -0,0 +1,206 @@
+/* -*- mode:C; c-file-style: "bsd" -*- */
+/*
+ * Copyright (c) 2026 Yubico AB
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdbool.h>
+
+#include <ykcore.h>
+#include <ykpers-version.h>
+
+#include "yktrace.h"
+
+const char *usage =
+	"Usage: yktrace [options] file\n"
+	"\n"
+	"Print a trace recorded with YK_TRACE_RECORD.\n"
+	"\n"
+	"Options :\n"
+	"\n"
+	"\t-s        Only print a summary per device\n"
+	"\n"
+	"\t-V        Get the tool version\n"
+	"\t-h        help (this text)\n"
+	"\n"
+	"\n"
+	;
+const char *optstring = "shV";
+
+#define MAX_DEVS	256
+
+struct dev_summary {
+	bool seen;
+	unsigned int reads, writes, failures;
+	uint64_t first_us, last_us;
+};
+
+static const char *op_name(unsigned char op)
+{
+	switch (op) {
+	case YK_TRACE_OPEN:
+		return "open";
+	case YK_TRACE_CLOSE:
+		return "close";
+	case YK_TRACE_READ:
+		return "read";
+	case YK_TRACE_WRITE:
+		return "write";
+	}
+	return "?";
+}
+
+static void print_record(const struct yk_trace_rec *r, uint64_t time_us)
+{
+	int i;
+
+	printf("%12.3f  %3u  %-5s", time_us / 1000.0, r->dev, op_name(r->op));
+	if (!r->ok) {
+		const char *err = yk_strerror(r->data[0]);
+		printf("  failed: %s\n", err ? err : "unknown error");
+		return;
+	}
+	switch (r->op) {
+	case YK_TRACE_OPEN:
+		printf("  index %u  vid %04x pid %04x\n", r->arg,
+		       r->data[0] | (r->data[1] << 8),
+		       r->data[2] | (r->data[3] << 8));
+		break;
+	case YK_TRACE_READ:
+	case YK_TRACE_WRITE:
+		printf(" ");
+		for (i = 0; i < YK_TRACE_DATA_SIZE; i++)
+			printf(" %02x", r->data[i]);
+		printf("\n");
+		break;
+	default:
+		printf("\n");
+	}
+}
+
+static void print_summary(const struct dev_summary *devs, size_t count,
+			  uint64_t total_us)
+{
+	int i;
+
+	printf("%lu records over %.3f ms\n", (unsigned long) count,
+	       total_us / 1000.0);
+	for (i = 0; i < MAX_DEVS; i++) {
+		const struct dev_summary *d = &devs[i];
+
+		if (!d->seen)
+			continue;
+		printf("device %d: %u reads, %u writes, %u failures, %.3f ms\n",
+		       i, d->reads, d->writes, d->failures,
+		       (d->last_us - d->first_us) / 1000.0);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	unsigned char buf[YK_TRACE_RECORD_SIZE];
+	struct dev_summary *devs;
+	struct yk_trace_rec r;
+	bool summary = false;
+	uint64_t time_us = 0;
+	size_t count = 0;
+	FILE *f;
+	int c;
+
+	while ((c = getopt(argc, argv, optstring)) != -1) {
+		switch (c) {
+		case 's':
+			summary = true;
+			break;
+		case 'V':
+			fputs(YKPERS_VERSION_STRING "\n", stderr);
+			return 0;
+		case 'h':
+		default:
+			fputs(usage, stderr);
+			return c == 'h' ? 0 : 1;
+		}
+	}
+	if (optind != argc - 1) {
+		fputs(usage, stderr);
+		return 1;
+	}
+
+	if (!(f = fopen(argv[optind], "rb"))) {
+		perror(argv[optind]);
+		return 1;
+	}
+	if (fread(buf, YK_TRACE_MAGIC_LEN, 1, f) != 1 ||
+	    memcmp(buf, YK_TRACE_MAGIC, YK_TRACE_MAGIC_LEN) != 0) {
+		fprintf(stderr, "%s: not a trace file\n", argv[optind]);
+		fclose(f);
+		return 1;
+	}
+
+	devs = calloc(MAX_DEVS, sizeof(*devs));
+	if (!devs) {
+		fclose(f);
+		return 1;
+	}
+	while (fread(buf, sizeof(buf), 1, f) == 1) {
+		struct dev_summary *d;
+
+		yk_trace_unpack(&r, buf);
+		time_us += r.delta_us;
+		count++;
+
+		if (!summary) {
+			print_record(&r, time_us);
+			continue;
+		}
+		if (r.op == YK_TRACE_OPEN && !r.ok)
+			continue;
+		d = &devs[r.dev];
+		if (!d->seen || r.op == YK_TRACE_OPEN) {
+			memset(d, 0, sizeof(*d));
+			d->seen = true;
+			d->first_us = time_us;
+		}
+		d->last_us = time_us;
+		if (!r.ok)
+			d->failures++;
+		if (r.op == YK_TRACE_READ)
+			d->reads++;
+		else if (r.op == YK_TRACE_WRITE)
+			d->writes++;
+	}
+	if (summary)
+		print_summary(devs, count, time_us);
+
+	free(devs);
+	fclose(f);
+	return 0;
+}